@@ -1,278 +1,153 @@
-#include <algorithm>
-#include <fstream>
-#include <iomanip>
-#include <iostream>
-#include <sstream>
 #include <iterator>
-#include <map>
-#include <regex>
 #include <sstream>
 #include <stdint.h>
 #include <string>
 
-std::vector<std::string> tokenize(const std::string &input) {
-  std::regex re("([A-z0-9#]+)");
-  std::sregex_iterator first{input.begin(), input.end(), re}, last;
+#include "../libchip8/debuginfo.h"
+#include "assembler.h"
+#include "optimizer.h"
+
+// Programs assembled at compile time come out like those of the assembler
+constexpr std::string_view constexpr_example = R"(
+back:   JP fwd
+        CALL back
+fwd:    DB #f0, #90
+)";
+constexpr auto constexpr_binary =
+    assemble<program_size(constexpr_example)>(constexpr_example);
+static_assert(constexpr_binary.size() == 6 && constexpr_binary[0] == 0x12 &&
+                  constexpr_binary[1] == 0x04 && constexpr_binary[2] == 0x22 &&
+                  constexpr_binary[3] == 0x00 && constexpr_binary[4] == 0xF0,
+              "Compile time assembly is broken");
+
+void Encoder::define(std::string_view label) {
+  bool defined = m_symbols.insert({label, address()}).second;
+  if (defined && m_debug_info)
+    m_debug_info->add_label(label, address());
+}
 
-  std::vector<std::string> tokens;
-  for (auto i = first; i != last; ++i) {
-    std::smatch match = *i;
-    if (match.size() == 2) {
-      std::ssub_match submatch = match[1];
-      tokens.push_back(submatch.str());
-    }
+uint16_t Encoder::emit(const Instruction &instruction) {
+  m_line = instruction.line;
+  if (instruction.mnemonic == Mnemonic::DB) {
+    uint16_t start = address();
+    emit_data(instruction);
+    if (m_debug_info)
+      m_debug_info->add_line(start, address() - start, instruction.line,
+                             instruction.column, true);
+    return 0x0000;
   }
+  if (m_debug_info)
+    m_debug_info->add_line(address(), 2, instruction.line,
+                           instruction.column, false);
 
-  return tokens;
-}
-
-std::vector<std::string> split(const std::string &input,
-                               const std::string &regex) {
-  std::regex re(regex);
-  std::sregex_token_iterator first{input.begin(), input.end(), re, -1}, last;
+  if (const char *error = instruction_error(instruction)) {
+    m_errors += std::string(error) + " " + std::string(instruction.text) +
+                " on line " + std::to_string(instruction.line) + "\n";
+  }
 
-  return {first, last};
+  uint16_t opcode = encode(instruction, [this](const Operand &operand,
+                                               uint16_t mask) {
+    return value(operand, mask);
+  });
+  m_binary.push_back(opcode >> 8);
+  m_binary.push_back(opcode);
+  return opcode;
 }
 
-uint16_t hex_literal_to_integer(const std::string &hex_literal) {
-  std::stringstream string_stream;
-  string_stream << std::hex << hex_literal.substr(1, hex_literal.size());
-
-  uint16_t value;
-  string_stream >> value;
-
-  return value;
+void Encoder::emit_data(const Instruction &instruction) {
+  for_each_data_byte(instruction,
+                     [this](uint8_t byte) { m_binary.push_back(byte); });
 }
 
-std::vector<uint8_t> parse_register_numbers(const std::string &input) {
-  std::regex re("V(\\d+),?");
-  std::sregex_iterator first{input.begin(), input.end(), re}, last;
+std::vector<uint8_t> Encoder::finish(std::ostream &errors) {
+  errors << m_errors;
+  m_errors.clear();
 
-  std::vector<uint8_t> registers;
-  for (auto i = first; i != last; ++i) {
-    std::smatch match = *i;
-    if (match.size() == 2) {
-      std::ssub_match submatch = match[1];
-      registers.push_back(std::stoi(submatch.str()));
+  for (auto const &fixup : m_fixups) {
+    auto symbol = m_symbols.find(fixup.label);
+    if (symbol == m_symbols.end()) {
+      errors << "Undefined label " << fixup.label << " on line " << fixup.line
+             << std::endl;
+      continue;
     }
+
+    uint16_t value = symbol->second & fixup.mask;
+    m_binary[fixup.offset] |= value >> 8;
+    m_binary[fixup.offset + 1] |= value & 0xff;
   }
+  m_fixups.clear();
 
-  return registers;
+  return m_binary;
 }
 
-uint16_t assemble_chip8(const std::string &command) {
-  std::vector<std::string> tokens = tokenize(command);
-  std::string cmd = tokens[0];
+uint16_t Encoder::value(const Operand &operand, uint16_t mask) {
+  if (operand.type != OperandType::Label)
+    return operand.value & mask;
 
-  if (cmd == "CLS") {
-    return 0x00E0;
-  } else if (cmd == "RET") {
-    return 0x00EE;
-  } else if (cmd == "JP") {
-    std::vector<uint8_t> registers = parse_register_numbers(command);
-    if (registers.size() == 0) {
-      uint16_t addr = hex_literal_to_integer(tokens[1]);
-      return (0x1000 | addr);
-    } else {
-      uint16_t addr = hex_literal_to_integer(tokens[2]);
-      return (0xB000 | addr);
-    }
-  } else if (cmd == "CALL") {
-    uint16_t addr = hex_literal_to_integer(tokens[1]);
-    return (0x2000 | addr);
-  } else if (cmd == "SE") {
-    std::vector<uint8_t> registers = parse_register_numbers(command);
+  auto symbol = m_symbols.find(operand.label);
+  if (symbol != m_symbols.end())
+    return symbol->second & mask;
 
-    if (registers.size() == 1) { // SE Vx, byte
-      uint8_t byte = hex_literal_to_integer(tokens[2]);
-      return (0x3000 | registers[0] << 8 | byte);
-    } else if (registers.size() == 2) { // SE Vx, Vx
-      return (0x5000 | registers[0] << 8 | registers[1] << 4);
-    }
-
-  } else if (cmd == "SNE") {
-    std::vector<uint8_t> registers = parse_register_numbers(command);
-
-    if (registers.size() == 1) { // SNE Vx, byte
-      uint8_t byte = hex_literal_to_integer(tokens[2]);
-      return (0x4000 | registers[0] << 8 | byte);
-    } else if (registers.size() == 2) { // SNE Vx, Vx
-      return (0x9000 | registers[0] << 8 | registers[1] << 4);
-    }
-  } else if (cmd == "LD") {
-    std::vector<uint8_t> registers = parse_register_numbers(command);
-
-    if (registers.size() == 1) {
-      if (tokens[1] == "DT") {
-        return (0xF015 | registers[0] << 8);
-      } else if (tokens[1] == "ST") {
-        return (0xF018 | registers[0] << 8);
-      } else if (tokens[1] == "F") {
-        return (0xF029 | registers[0] << 8);
-      } else if (tokens[1] == "B") {
-        return (0xF033 | registers[0] << 8);
-      } else if (tokens[1] == "[I]") {
-        return (0xF055 | registers[0] << 8);
-      } else if (tokens[1] == "HF") {
-        return (0xF030 | registers[0] << 8);
-      } else if (tokens[1] == "R") {
-        return (0xF075 | registers[0] << 8);
-      } else if (tokens[2] == "DT") {
-        return (0xF007 | registers[0] << 8);
-      } else if (tokens[2] == "K") {
-        return (0xF00A | registers[0] << 8);
-      } else if (tokens[2] == "[I]") {
-        return (0xF065 | registers[0] << 8);
-      } else if (tokens[2] == "R") {
-        return (0xF085 | registers[0] << 8);
-      } else {
-        uint8_t byte = hex_literal_to_integer(tokens[2]);
-        return (0x6000 | registers[0] << 8 | byte);
-      }
-    } else if (registers.size() == 2) {
-      return (0x8000 | registers[0] << 8 | registers[1] << 4);
-    } else if (registers.size() == 0) {
-      uint16_t addr = hex_literal_to_integer(tokens[2]);
-      return (0xA000 | addr);
-    }
-  } else if (cmd == "ADD") {
-    std::vector<uint8_t> registers = parse_register_numbers(command);
-
-    if (registers.size() == 1) {
-      if (tokens[1] == "I") {
-        return (0xF01E | registers[0] << 8);
-      } else {
-        uint8_t byte = hex_literal_to_integer(tokens[2]);
-        return (0x7000 | registers[0] << 8 | byte);
-      }
-    } else if (registers.size() == 2) {
-      return (0x8004 | registers[0] << 8 | registers[1] << 4);
-    }
-  } else if (cmd == "OR") {
-    std::vector<uint8_t> registers = parse_register_numbers(command);
-    return (0x8001 | registers[0] << 8 | registers[1] << 4);
-  } else if (cmd == "AND") {
-    std::vector<uint8_t> registers = parse_register_numbers(command);
-    return (0x8002 | registers[0] << 8 | registers[1] << 4);
-  } else if (cmd == "XOR") {
-    std::vector<uint8_t> registers = parse_register_numbers(command);
-    return (0x8003 | registers[0] << 8 | registers[1] << 4);
-  } else if (cmd == "SUB") {
-    std::vector<uint8_t> registers = parse_register_numbers(command);
-    return (0x8005 | registers[0] << 8 | registers[1] << 4);
-  } else if (cmd == "SHR") {
-    std::vector<uint8_t> registers = parse_register_numbers(command);
-    if (registers.size() == 1) {
-      return (0x8006 | registers[0] << 8);
-    } else {
-      return (0x8006 | registers[0] << 8 | registers[1] << 4);
-    }
-  } else if (cmd == "SUBN") {
-    std::vector<uint8_t> registers = parse_register_numbers(command);
-    return (0x8007 | registers[0] << 8 | registers[1] << 4);
-  } else if (cmd == "SHL") {
-    std::vector<uint8_t> registers = parse_register_numbers(command);
-    if (registers.size() == 1) {
-      return (0x800E | registers[0] << 8);
-    } else {
-      return (0x800E | registers[0] << 8 | registers[1] << 4);
-    }
-  } else if (cmd == "RND") {
-    std::vector<uint8_t> registers = parse_register_numbers(command);
-
-    uint8_t byte = hex_literal_to_integer(tokens[2]);
-    return (0xC000 | registers[0] << 8 | byte);
-  } else if (cmd == "DRW") {
-    std::vector<uint8_t> registers = parse_register_numbers(command);
-
-    uint8_t byte = hex_literal_to_integer(tokens[3]);
-    return (0xD000 | registers[0] << 8 | registers[1] << 4 | (byte & 0x0F));
-  } else if (cmd == "SKP") {
-    std::vector<uint8_t> registers = parse_register_numbers(command);
-    return (0xE09E | registers[0] << 8);
-  } else if (cmd == "SKNP") {
-    std::vector<uint8_t> registers = parse_register_numbers(command);
-    return (0xE0A1 | registers[0] << 8);
-  } else if (cmd == "SCD") {
-    std::vector<uint8_t> registers = parse_register_numbers(command);
-    return (0x00C0 | (registers[0] & 0x0F));
-  } else if (cmd == "SCR") {
-    return 0x00FB;
-  } else if (cmd == "SCL") {
-    return 0x00FC;
-  } else if (cmd == "EXIT") {
-    return 0x00FD;
-  } else if (cmd == "LOW") {
-    return 0x00FE;
-  } else if (cmd == "HIGH") {
-    return 0x00FF;
-  }
-
-  return 0x0000;
+  // Forward reference, patched once the label is defined
+  m_fixups.push_back({m_binary.size(), operand.label, mask, m_line});
+  return 0;
 }
 
-int main(int argc, char **argv) {
-  std::ifstream program(argv[1], std::ios::in);
-  std::ofstream output(argv[2], std::ios::out | std::ios::binary);
-
-  if (!program.is_open()) {
-    std::cout << "Couldn't open source code file!" << std::endl;
-    return 1;
-  }
+uint16_t assemble_chip8(const std::string &command) {
+  return assemble_instruction(command);
+}
 
-  if (!output.is_open()) {
-    std::cout << "Couldn't open output file!" << std::endl;
-    return 1;
+std::vector<uint8_t> assemble_program(std::istream &program,
+                                      std::ostream *listing,
+                                      std::ostream &errors,
+                                      DebugInfoBuilder *debug_info,
+                                      Optimizer *optimizer) {
+  // The whole source is kept in one buffer so that tokens and labels can
+  // point into it.
+  std::string source{std::istreambuf_iterator<char>(program),
+                     std::istreambuf_iterator<char>()};
+
+  Encoder encoder;
+  encoder.set_debug_info(debug_info);
+  auto assemble_statement = [&](const Statement &statement) {
+    if (!statement.label.empty())
+      encoder.define(statement.label);
+
+    if (!statement.has_instruction)
+      return;
+
+    if (listing)
+      *listing << statement.instruction.text << '\n';
+    encoder.emit(statement.instruction);
+  };
+
+  // Lines are assembled as they are parsed unless the optimizer needs to
+  // see all of them first
+  std::vector<Statement> statements;
+  std::string_view remaining = source;
+  int line_number = 0;
+  while (!remaining.empty()) {
+    size_t end = remaining.find('\n');
+    std::string_view line = remaining.substr(0, end);
+    remaining.remove_prefix(end == std::string_view::npos ? remaining.size()
+                                                          : end + 1);
+    line_number++;
+
+    Statement statement = parse_line(line, line_number);
+    if (optimizer)
+      statements.push_back(statement);
+    else
+      assemble_statement(statement);
   }
 
-  std::map<std::string, std::string> label_addresses;
-  std::vector<std::string> lines;
-  std::string line;
-  int row = 0;
-  while (std::getline(program, line)) {
-    bool isEmpty = std::all_of(line.begin(), line.end(), [](char c) {
-      return std::isspace(static_cast<unsigned char>(c));
-    });
-
-    if (isEmpty) continue;
-
-    std::regex re("(\\w+:)");
-    std::smatch match;
-    if (std::regex_search(line, match, re)) {
-      std::string label_match = match[1].str();
-      std::string label = label_match.substr(0, label_match.size()-1);
-
-      std::string address;
-      std::stringstream ss2;
-      ss2 << "#" << std::hex << (row*2+0x200);
-      label_addresses.insert({label, ss2.str()});
-
-      std::stringstream ss;
-      ss << "^" << label_match << "\\s+";
-      std::string remove = ss.str();
-
-      line = std::regex_replace(line, std::regex(remove), "");
-    } else {
-      line = std::regex_replace(line, std::regex("^\\s+"), "");
-    }
-
-    lines.push_back(line);
-    row++;
+  if (optimizer) {
+    optimizer->run(statements);
+    for (auto const &statement : statements)
+      assemble_statement(statement);
   }
 
-  for (auto line : lines) {
-    std::smatch match;
-    for (auto const& label : label_addresses) {
-      if (std::regex_search(line, match, std::regex(label.first))) {
-        line = std::regex_replace(line, std::regex(label.first), label.second);
-      }
-    }
+  if (listing)
+    listing->flush();
 
-    std::cout << line << std::endl;
-    uint16_t instruction = assemble_chip8(line);
-    output.put(instruction >> 8);
-    output.put(instruction);
-  }
-
-  return 0;
+  return encoder.finish(errors);
 }
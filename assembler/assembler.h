@@ -0,0 +1,79 @@
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include <iostream>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "encode.h"
+
+class DebugInfoBuilder;
+class Optimizer;
+
+/* Encoder turns instructions into machine code in a single pass. Labels
+ * that are referenced before they are defined get a fixup which is patched
+ * in finish().
+ */
+class Encoder {
+public:
+  /* Defines a label at the address of the next instruction */
+  void define(std::string_view label);
+  /* Emits an instruction, or the bytes of a DB directive. Instructions
+   * that can't be encoded are emitted as 0000 and reported by finish().
+   */
+  uint16_t emit(const Instruction &instruction);
+  uint16_t address() const { return 0x200 + m_binary.size(); }
+
+  /* Records the source of every emitted byte and the labels in
+   * debug_info, which must outlive the encoder
+   */
+  void set_debug_info(DebugInfoBuilder *debug_info) {
+    m_debug_info = debug_info;
+  }
+
+  /* Applies the fixups. Undefined labels and instructions that couldn't be
+   * encoded are reported to errors.
+   */
+  std::vector<uint8_t> finish(std::ostream &errors = std::cerr);
+
+private:
+  void emit_data(const Instruction &instruction);
+  uint16_t value(const Operand &operand, uint16_t mask);
+
+  struct Fixup {
+    size_t offset; // Offset of the instruction in the binary
+    std::string_view label;
+    uint16_t mask;
+    int line;
+  };
+
+  std::unordered_map<std::string_view, uint16_t> m_symbols;
+  std::vector<Fixup> m_fixups;
+  std::vector<uint8_t> m_binary;
+  DebugInfoBuilder *m_debug_info = nullptr;
+  int m_line = 0;
+  std::string m_errors; // Of emit(), written out by finish()
+};
+
+/* Assembles a single source line (labels already resolved) into an opcode,
+ * like assemble_instruction()
+ */
+uint16_t assemble_chip8(const std::string &command);
+
+/* Assembles a whole program. Labels are resolved to addresses starting
+ * from 0x200. If listing is given, every assembled line is echoed to it.
+ * Undefined labels and instructions that can't be encoded, such as unknown
+ * mnemonics or registers past V15, are reported to errors. If debug_info is given, the
+ * source lines and labels are added to it. If optimizer is given, it
+ * rewrites the whole program before it is encoded.
+ */
+std::vector<uint8_t> assemble_program(std::istream &program,
+                                      std::ostream *listing = nullptr,
+                                      std::ostream &errors = std::cerr,
+                                      DebugInfoBuilder *debug_info = nullptr,
+                                      Optimizer *optimizer = nullptr);
+
+#endif
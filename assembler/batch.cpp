@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "../libchip8/debuginfo.h"
+#include "assembler.h"
+#include "batch.h"
+#include "optimizer.h"
+
+namespace {
+
+struct Result {
+  bool ok = false;
+  size_t size = 0;
+  size_t saved = 0;     // Bytes removed by the optimizer
+  std::string messages; // Listing and errors, written out at the end
+};
+
+std::string output_filename(const std::string &source) {
+  size_t dot = source.find_last_of('.');
+  size_t slash = source.find_last_of('/');
+  if (dot == std::string::npos ||
+      (slash != std::string::npos && dot < slash))
+    return source + ".ch8";
+  return source.substr(0, dot) + ".ch8";
+}
+
+Result assemble_file(const std::string &source, const BatchOptions &options) {
+  Result result;
+  std::ostringstream messages;
+
+  std::ifstream program(source, std::ios::in);
+  if (!program.is_open()) {
+    result.messages = "Couldn't open source code file " + source + "\n";
+    return result;
+  }
+
+  std::ostringstream errors;
+  DebugInfoBuilder debug_info;
+  Optimizer optimizer;
+  std::vector<uint8_t> binary =
+      assemble_program(program, options.listing ? &messages : nullptr, errors,
+                       options.debug_info ? &debug_info : nullptr,
+                       options.optimize ? &optimizer : nullptr);
+  if (options.optimize && options.listing)
+    optimizer.report(messages);
+  result.saved = optimizer.removed() * 2;
+
+  std::string output = output_filename(source);
+  std::ofstream out(output, std::ios::out | std::ios::binary);
+  if (!out.is_open()) {
+    messages << "Couldn't open output file " << output << "\n";
+  } else {
+    out.write(reinterpret_cast<const char *>(binary.data()), binary.size());
+    result.ok = errors.tellp() == 0;
+    result.size = binary.size();
+  }
+
+  if (options.debug_info &&
+      !debug_info.write(debug_info_filename(output), source, binary.data(),
+                        binary.size())) {
+    messages << "Couldn't write debug info for " << output << "\n";
+    result.ok = false;
+  }
+
+  if (errors.tellp() > 0)
+    messages << source << ":\n" << errors.str();
+
+  result.messages = messages.str();
+  return result;
+}
+
+} // namespace
+
+std::vector<std::string> read_manifest(const std::string &filename) {
+  std::ifstream manifest(filename, std::ios::in);
+  if (!manifest.is_open()) {
+    std::cout << "Couldn't open manifest " << filename << std::endl;
+    return {};
+  }
+
+  std::vector<std::string> sources;
+  std::string line;
+  while (std::getline(manifest, line)) {
+    size_t start = line.find_first_not_of(" \t");
+    if (start == std::string::npos || line[start] == '#')
+      continue;
+    size_t end = line.find_last_not_of(" \t\r");
+    sources.push_back(line.substr(start, end - start + 1));
+  }
+
+  return sources;
+}
+
+int assemble_batch(const std::vector<std::string> &sources,
+                   const BatchOptions &options) {
+  auto start = std::chrono::steady_clock::now();
+
+  int thread_count = options.threads;
+  if (thread_count <= 0)
+    thread_count = std::max(1u, std::thread::hardware_concurrency());
+  thread_count = std::min<int>(thread_count, sources.size());
+
+  std::vector<Result> results(sources.size());
+  std::atomic<size_t> next{0};
+
+  // Every worker takes the next unassembled file until all are done
+  auto worker = [&]() {
+    for (size_t i = next++; i < sources.size(); i = next++)
+      results[i] = assemble_file(sources[i], options);
+  };
+
+  std::vector<std::thread> pool;
+  for (auto i = 0; i < thread_count; i++)
+    pool.emplace_back(worker);
+  for (auto &thread : pool)
+    thread.join();
+
+  // Messages are written in input order through one buffered stream
+  std::ostringstream output;
+  int failed = 0;
+  size_t bytes = 0;
+  size_t saved = 0;
+  for (auto const &result : results) {
+    output << result.messages;
+    if (!result.ok)
+      failed++;
+    bytes += result.size;
+    saved += result.saved;
+  }
+
+  auto end = std::chrono::steady_clock::now();
+  auto elapsed =
+      std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+
+  output << "Assembled " << sources.size() - failed << "/" << sources.size()
+         << " files (" << bytes << " bytes) in " << elapsed.count()
+         << " ms using " << thread_count << " threads\n";
+  if (options.optimize)
+    output << "The optimizer saved " << saved << " bytes\n";
+  std::cout << output.str() << std::flush;
+
+  return failed;
+}
@@ -0,0 +1,26 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <string>
+#include <vector>
+
+struct BatchOptions {
+  int threads = 0;         // 0 uses one thread per hardware thread
+  bool listing = false;    // Echo the assembled lines of every file
+  bool debug_info = false; // Write a .ch8.dbg file next to every binary
+  bool optimize = false;   // Run the peephole optimizer, see optimizer.h
+};
+
+/* Reads a manifest with one source file per line. Empty lines and lines
+ * starting with '#' are skipped.
+ */
+std::vector<std::string> read_manifest(const std::string &filename);
+
+/* Assembles every source file to a .ch8 file next to it using a pool of
+ * threads. Prints a summary at the end and returns the number of failed
+ * files.
+ */
+int assemble_batch(const std::vector<std::string> &sources,
+                   const BatchOptions &options);
+
+#endif
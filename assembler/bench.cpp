@@ -0,0 +1,76 @@
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <stdint.h>
+#include <string>
+
+#include "assembler.h"
+
+/* Generates a program with the given number of lines. Every tenth line
+ * has a label, and jumps and calls reference labels both before and after
+ * them.
+ */
+std::string generate_source(int lines) {
+  std::stringstream source;
+  int labels = lines / 10;
+  for (auto i = 0; i < lines; i++) {
+    if (i % 10 == 0)
+      source << "label" << i / 10 << ": ";
+    else
+      source << "        ";
+
+    switch (i % 10) {
+    case 1:
+      source << "JP label" << (i / 10 + 7) % labels << "\n";
+      break;
+    case 2:
+      source << "CALL label" << (i / 10 + labels - 3) % labels << "\n";
+      break;
+    case 3:
+      source << "LD V" << i % 16 << ", #" << std::hex << i % 256 << std::dec
+             << "\n";
+      break;
+    case 4:
+      source << "ADD V" << i % 16 << ", V" << (i + 1) % 16 << "\n";
+      break;
+    case 5:
+      source << "LD I, label" << (i / 10 + 1) % labels << "\n";
+      break;
+    case 6:
+      source << "DRW V0, V1, #5\n";
+      break;
+    case 7:
+      source << "SE V" << i % 16 << ", #1F ; skip when done\n";
+      break;
+    default:
+      source << "LD [I], V" << i % 16 << "\n";
+    }
+  }
+  return source.str();
+}
+
+int main(int argc, char **argv) {
+  int lines = argc > 1 ? std::stoi(argv[1]) : 100000;
+  int runs = argc > 2 ? std::stoi(argv[2]) : 5;
+
+  std::string source = generate_source(lines);
+
+  double best = 0;
+  size_t size = 0;
+  for (auto run = 0; run < runs; run++) {
+    std::istringstream program(source);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<uint8_t> binary = assemble_program(program);
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    if (run == 0 || seconds < best)
+      best = seconds;
+    size = binary.size();
+  }
+
+  std::cout << lines << " lines, " << size << " bytes: " << best * 1000
+            << " ms, " << lines / best / 1e6 << " M lines/s" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,500 @@
+#ifndef ENCODE_H
+#define ENCODE_H
+
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+
+#include "../libchip8/opcodes.h"
+#include "lexer.h"
+
+/* Parsing and encoding of source lines. Everything here is constexpr, so
+ * programs can be assembled at compile time as well as by the assembler.
+ * The instructions and their syntax come from OPCODES.
+ */
+
+enum class Mnemonic : uint8_t {
+  CLS, RET, JP, CALL, SE, SNE, LD, ADD, OR, AND, XOR, SUB, SHR, SUBN, SHL,
+  RND, DRW, SKP, SKNP, SCD, SCR, SCL, EXIT, LOW, HIGH, DB, Unknown
+};
+
+enum class OperandType : uint8_t {
+  Number, Register, Label, I, IndirectI, DT, ST, K, F, B, HF, R
+};
+
+struct Operand {
+  OperandType type = OperandType::Number;
+  uint16_t value = 0;      // Number or register index
+  std::string_view label;  // Referenced label
+};
+
+struct Instruction {
+  Mnemonic mnemonic = Mnemonic::Unknown;
+  Operand operands[3];
+  int operand_count = 0;
+  int line = 0;   // 1-based source line
+  int column = 0; // Column of the mnemonic
+  std::string_view text; // Source text from the mnemonic onwards
+};
+
+/* A parsed source line: an optional label definition and an optional
+ * instruction.
+ */
+struct Statement {
+  std::string_view label;
+  bool has_instruction = false;
+  Instruction instruction;
+};
+
+inline constexpr std::string_view mnemonic_names[] = {
+    "CLS", "RET",  "JP",  "CALL", "SE",   "SNE", "LD",  "ADD", "OR",
+    "AND", "XOR",  "SUB", "SHR",  "SUBN", "SHL", "RND", "DRW", "SKP",
+    "SKNP", "SCD", "SCR", "SCL",  "EXIT", "LOW", "HIGH", "DB"};
+
+const int mnemonic_count = static_cast<int>(Mnemonic::Unknown);
+
+// Perfect hash over the mnemonic names: every name maps to its own slot.
+constexpr size_t mnemonic_hash(std::string_view name) {
+  return (3 * name[0] + 13 * name[1] + 5 * name.back() + name.size()) & 63;
+}
+
+constexpr std::array<int8_t, 64> make_mnemonic_table() {
+  std::array<int8_t, 64> table{};
+  for (auto &slot : table)
+    slot = -1;
+  for (auto i = 0; i < mnemonic_count; i++)
+    table[mnemonic_hash(mnemonic_names[i])] = i;
+  return table;
+}
+
+inline constexpr std::array<int8_t, 64> mnemonic_table = make_mnemonic_table();
+
+constexpr bool mnemonic_hash_is_perfect() {
+  for (auto i = 0; i < mnemonic_count; i++) {
+    if (mnemonic_table[mnemonic_hash(mnemonic_names[i])] != i)
+      return false;
+  }
+  return true;
+}
+
+static_assert(mnemonic_hash_is_perfect(), "Mnemonic hash has collisions");
+
+constexpr Mnemonic lookup_mnemonic(std::string_view name) {
+  if (name.size() < 2)
+    return Mnemonic::Unknown;
+
+  int index = mnemonic_table[mnemonic_hash(name)];
+  if (index < 0 || mnemonic_names[index] != name)
+    return Mnemonic::Unknown;
+
+  return static_cast<Mnemonic>(index);
+}
+
+constexpr int register_digit(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  return -1;
+}
+
+constexpr Operand parse_operand(const Token &token) {
+  Operand operand;
+  std::string_view text = token.text;
+
+  if (token.type == TokenType::Number) {
+    operand.value = token.value;
+    return operand;
+  }
+
+  // V0-V15 in decimal or V0-VF in hex. Larger numbers are kept for
+  // instruction_error() to report.
+  if (text.size() >= 2 && text[0] == 'V') {
+    std::string_view digits = text.substr(1);
+    bool decimal =
+        digits.find_first_not_of("0123456789") == std::string_view::npos;
+    if (decimal && digits.size() <= 2) {
+      operand.type = OperandType::Register;
+      for (char c : digits)
+        operand.value = operand.value * 10 + (c - '0');
+      return operand;
+    }
+    if (digits.size() == 1 && register_digit(digits[0]) >= 0) {
+      operand.type = OperandType::Register;
+      operand.value = register_digit(digits[0]);
+      return operand;
+    }
+  }
+
+  if (text == "I") {
+    operand.type = OperandType::I;
+  } else if (text == "[I]") {
+    operand.type = OperandType::IndirectI;
+  } else if (text == "DT") {
+    operand.type = OperandType::DT;
+  } else if (text == "ST") {
+    operand.type = OperandType::ST;
+  } else if (text == "K") {
+    operand.type = OperandType::K;
+  } else if (text == "F") {
+    operand.type = OperandType::F;
+  } else if (text == "B") {
+    operand.type = OperandType::B;
+  } else if (text == "HF") {
+    operand.type = OperandType::HF;
+  } else if (text == "R") {
+    operand.type = OperandType::R;
+  } else {
+    operand.type = OperandType::Label;
+    operand.label = text;
+  }
+
+  return operand;
+}
+
+constexpr Statement parse_line(std::string_view line, int line_number = 0) {
+  Statement statement;
+  Lexer lexer(line);
+
+  Token token = lexer.next();
+  if (token.type == TokenType::Label) {
+    statement.label = token.text;
+    token = lexer.next();
+  }
+
+  if (token.type != TokenType::Identifier)
+    return statement;
+
+  Instruction &instruction = statement.instruction;
+  statement.has_instruction = true;
+  instruction.mnemonic = lookup_mnemonic(token.text);
+  instruction.line = line_number;
+  instruction.column = token.column;
+
+  size_t end = line.find(';', token.column - 1);
+  instruction.text = line.substr(token.column - 1, end - (token.column - 1));
+  while (!instruction.text.empty() &&
+         (instruction.text.back() == ' ' || instruction.text.back() == '\t' ||
+          instruction.text.back() == '\r'))
+    instruction.text.remove_suffix(1);
+
+  for (token = lexer.next(); token.type != TokenType::End;
+       token = lexer.next()) {
+    if (token.type == TokenType::Comma || token.type == TokenType::Invalid)
+      continue;
+    if (instruction.operand_count == 3)
+      break;
+    instruction.operands[instruction.operand_count++] = parse_operand(token);
+  }
+
+  return statement;
+}
+
+/* Where the value of an operand goes in the opcode */
+enum class Field : uint8_t { None, X, Y, Nibble, Byte, Address };
+
+/* The form of an instruction, read from the text of its OPCODES entry.
+ * Operands with a field are a register (X, Y) or a number or label (the
+ * others); the rest, like I, DT or V0, have to be written as they are.
+ */
+struct Form {
+  Mnemonic mnemonic = Mnemonic::Unknown;
+  int operand_count = 0;
+  Operand operands[3];
+  Field fields[3] = {};
+};
+
+constexpr Form parse_form(std::string_view text) {
+  Form form;
+  size_t space = text.find(' ');
+  form.mnemonic = lookup_mnemonic(text.substr(0, space));
+  while (space != std::string_view::npos) {
+    text.remove_prefix(space + 1);
+    space = text.find(", ");
+    std::string_view operand = text.substr(0, space);
+    if (space != std::string_view::npos)
+      space++;
+
+    int i = form.operand_count++;
+    if (operand == "V%x" || operand == "V%y") {
+      form.operands[i].type = OperandType::Register;
+      form.fields[i] = operand[2] == 'x' ? Field::X : Field::Y;
+    } else if (operand[0] == '#') {
+      form.fields[i] = operand[2] == 'n'   ? Field::Nibble
+                       : operand[2] == 'k' ? Field::Byte
+                                           : Field::Address;
+    } else {
+      form.operands[i] =
+          parse_operand({TokenType::Identifier, operand, 0, 0});
+    }
+  }
+  return form;
+}
+
+/* The forms of OPCODES, and their indices grouped by mnemonic in the order
+ * of OPCODES
+ */
+struct FormTable {
+  Form forms[OPCODE_COUNT] = {};
+  uint8_t order[OPCODE_COUNT] = {};
+  uint8_t first[mnemonic_count + 2] = {}; // Of every mnemonic in order
+};
+
+constexpr FormTable make_form_table() {
+  FormTable table;
+  for (auto i = 0; i < OPCODE_COUNT; i++)
+    table.forms[i] = parse_form(OPCODES[i].text);
+
+  int next = 0;
+  for (auto mnemonic = 0; mnemonic <= mnemonic_count; mnemonic++) {
+    table.first[mnemonic] = next;
+    for (auto i = 0; i < OPCODE_COUNT; i++) {
+      if (static_cast<int>(table.forms[i].mnemonic) == mnemonic)
+        table.order[next++] = i;
+    }
+  }
+  table.first[mnemonic_count + 1] = next;
+  return table;
+}
+
+inline constexpr FormTable form_table = make_form_table();
+
+constexpr bool form_matches(const Form &form, const Instruction &instruction) {
+  if (form.operand_count != instruction.operand_count)
+    return false;
+
+  for (auto i = 0; i < form.operand_count; i++) {
+    const Operand &operand = instruction.operands[i];
+    switch (form.fields[i]) {
+    case Field::X:
+    case Field::Y:
+      if (operand.type != OperandType::Register || operand.value > 0xF)
+        return false;
+      break;
+    case Field::Nibble:
+    case Field::Byte:
+    case Field::Address:
+      if (operand.type != OperandType::Number &&
+          operand.type != OperandType::Label)
+        return false;
+      break;
+    case Field::None:
+      if (operand.type != form.operands[i].type ||
+          (operand.type == OperandType::Register &&
+           operand.value != form.operands[i].value))
+        return false;
+      break;
+    }
+  }
+  return true;
+}
+
+/* The first OPCODES entry with the form of instruction, -1 if none has */
+constexpr int find_form(const Instruction &instruction) {
+  int mnemonic = static_cast<int>(instruction.mnemonic);
+  for (auto i = form_table.first[mnemonic]; i < form_table.first[mnemonic + 1];
+       i++) {
+    int index = form_table.order[i];
+    if (form_matches(form_table.forms[index], instruction))
+      return index;
+  }
+  return -1;
+}
+
+/* Why instruction can't be encoded, nullptr if it can. DB is always fine. */
+constexpr const char *instruction_error(const Instruction &instruction) {
+  if (instruction.mnemonic == Mnemonic::DB)
+    return nullptr;
+  if (instruction.mnemonic == Mnemonic::Unknown)
+    return "Unknown instruction";
+  for (auto i = 0; i < instruction.operand_count; i++) {
+    if (instruction.operands[i].type == OperandType::Register &&
+        instruction.operands[i].value > 0xF)
+      return "Register out of range in";
+  }
+  if (find_form(instruction) < 0)
+    return "Invalid operands in";
+  return nullptr;
+}
+
+/* Encodes an instruction with the first OPCODES entry of its form. Numbers
+ * and labels are turned into field values by resolve(operand, mask).
+ * Returns 0x0000 for instructions that don't have the form of any entry,
+ * which instruction_error() reports.
+ */
+template <typename Resolve>
+constexpr uint16_t encode(const Instruction &instruction, Resolve &&resolve) {
+  int index = find_form(instruction);
+  if (index < 0)
+    return 0x0000;
+
+  const Form &form = form_table.forms[index];
+  uint16_t opcode = OPCODES[index].pattern;
+  for (auto j = 0; j < form.operand_count; j++) {
+    const Operand &operand = instruction.operands[j];
+    switch (form.fields[j]) {
+    case Field::X:
+      opcode |= operand.value << 8;
+      break;
+    case Field::Y:
+      opcode |= operand.value << 4;
+      break;
+    case Field::Nibble:
+      opcode |= resolve(operand, 0xF);
+      break;
+    case Field::Byte:
+      opcode |= resolve(operand, 0xFF);
+      break;
+    case Field::Address:
+      opcode |= resolve(operand, 0xFFF);
+      break;
+    case Field::None:
+      break;
+    }
+  }
+  return opcode;
+}
+
+/* Every entry of OPCODES assembles back to its own pattern */
+constexpr bool forms_round_trip() {
+  for (auto i = 0; i < OPCODE_COUNT; i++) {
+    const Form &form = form_table.forms[i];
+    Instruction instruction;
+    instruction.mnemonic = form.mnemonic;
+    instruction.operand_count = form.operand_count;
+    for (auto j = 0; j < form.operand_count; j++)
+      instruction.operands[j] = form.operands[j];
+    auto zero = [](const Operand &, uint16_t) -> uint16_t { return 0; };
+    if (encode(instruction, zero) != OPCODES[i].pattern)
+      return false;
+  }
+  return true;
+}
+
+static_assert(forms_round_trip(),
+              "An OPCODES entry can't be assembled from its own text");
+
+/* Assembles a single source line into an opcode. Labels are left 0. */
+constexpr uint16_t assemble_instruction(std::string_view line) {
+  Statement statement = parse_line(line);
+  if (!statement.has_instruction)
+    return 0x0000;
+  auto number = [](const Operand &operand, uint16_t mask) -> uint16_t {
+    return operand.type == OperandType::Label ? 0 : operand.value & mask;
+  };
+  return encode(statement.instruction, number);
+}
+
+/* Calls visit with every parsed line of source */
+template <typename Visit>
+constexpr void for_each_statement(std::string_view source, Visit &&visit) {
+  int line_number = 0;
+  while (!source.empty()) {
+    size_t end = source.find('\n');
+    std::string_view line = source.substr(0, end);
+    source.remove_prefix(end == std::string_view::npos ? source.size()
+                                                       : end + 1);
+    visit(parse_line(line, ++line_number));
+  }
+}
+
+/* Calls emit with every byte of a DB directive */
+template <typename Emit>
+constexpr void for_each_data_byte(const Instruction &instruction,
+                                  Emit &&emit) {
+  // The operands are read from the text as a DB can have any number of them
+  Lexer lexer(instruction.text);
+  lexer.next(); // DB
+  for (Token token = lexer.next(); token.type != TokenType::End;
+       token = lexer.next()) {
+    if (token.type == TokenType::Number)
+      emit(static_cast<uint8_t>(token.value));
+  }
+}
+
+constexpr size_t statement_size(const Statement &statement) {
+  if (!statement.has_instruction)
+    return 0;
+  if (statement.instruction.mnemonic != Mnemonic::DB)
+    return 2;
+  size_t size = 0;
+  for_each_data_byte(statement.instruction, [&](uint8_t) { size++; });
+  return size;
+}
+
+/* Size of the binary assembled from source, the size to give assemble() */
+constexpr size_t program_size(std::string_view source) {
+  size_t size = 0;
+  for_each_statement(source,
+                     [&](const Statement &statement) {
+                       size += statement_size(statement);
+                     });
+  return size;
+}
+
+// Labels a program assembled at compile time can define
+const int CONSTEXPR_LABELS = 256;
+
+/* Assembles a program at compile time, with labels resolved to addresses
+ * starting from 0x200:
+ *
+ *     constexpr std::string_view source = "loop: JP loop";
+ *     constexpr auto rom = assemble<program_size(source)>(source);
+ *
+ * Undefined labels and instructions that can't be encoded don't compile.
+ */
+template <size_t Size>
+constexpr std::array<uint8_t, Size> assemble(std::string_view source) {
+  struct Symbol {
+    std::string_view name;
+    uint16_t address = 0;
+  };
+  std::array<Symbol, CONSTEXPR_LABELS> symbols{};
+  int symbol_count = 0;
+
+  size_t size = 0;
+  for_each_statement(source, [&](const Statement &statement) {
+    if (!statement.label.empty()) {
+      if (symbol_count == CONSTEXPR_LABELS)
+        throw "Too many labels";
+      symbols[symbol_count++] = {statement.label,
+                                 static_cast<uint16_t>(0x200 + size)};
+    }
+    size += statement_size(statement);
+  });
+  if (size != Size)
+    throw "Size isn't program_size(source)";
+
+  auto resolve = [&](const Operand &operand, uint16_t mask) -> uint16_t {
+    if (operand.type != OperandType::Label)
+      return operand.value & mask;
+    for (auto i = 0; i < symbol_count; i++) {
+      if (symbols[i].name == operand.label)
+        return symbols[i].address & mask;
+    }
+    throw "Undefined label";
+  };
+
+  std::array<uint8_t, Size> binary{};
+  size_t offset = 0;
+  for_each_statement(source, [&](const Statement &statement) {
+    if (!statement.has_instruction)
+      return;
+    if (statement.instruction.mnemonic == Mnemonic::DB) {
+      for_each_data_byte(statement.instruction,
+                         [&](uint8_t byte) { binary[offset++] = byte; });
+      return;
+    }
+    if (instruction_error(statement.instruction))
+      throw "Invalid instruction";
+    uint16_t opcode = encode(statement.instruction, resolve);
+    binary[offset++] = opcode >> 8;
+    binary[offset++] = opcode & 0xFF;
+  });
+  return binary;
+}
+
+#endif
@@ -0,0 +1,142 @@
+#include <unordered_set>
+
+#include "incremental.h"
+
+bool IncrementalAssembler::update(std::string_view source,
+                                  std::ostream &errors) {
+  m_parsed = 0;
+  m_encoded = 0;
+
+  // The old lines by text, to take over with their statements and bytes
+  std::unordered_map<std::string_view, std::vector<std::unique_ptr<Line>>>
+      old_lines;
+  for (auto &line : m_lines) {
+    std::string_view text = line->text;
+    old_lines[text].push_back(std::move(line));
+  }
+
+  std::vector<std::unique_ptr<Line>> lines;
+  int line_number = 0;
+  while (!source.empty()) {
+    size_t end = source.find('\n');
+    std::string_view text = source.substr(0, end);
+    source.remove_prefix(end == std::string_view::npos ? source.size()
+                                                       : end + 1);
+    line_number++;
+
+    auto old = old_lines.find(text);
+    if (old != old_lines.end() && !old->second.empty()) {
+      lines.push_back(std::move(old->second.back()));
+      old->second.pop_back();
+      lines.back()->statement.instruction.line = line_number;
+      continue;
+    }
+
+    auto line = std::make_unique<Line>();
+    line->text = text;
+    line->statement = parse_line(line->text, line_number);
+    lines.push_back(std::move(line));
+    m_parsed++;
+  }
+  m_lines = std::move(lines);
+
+  std::unordered_map<std::string, uint16_t> symbols;
+  uint16_t address = 0x200;
+  for (auto const &line : m_lines) {
+    if (!line->statement.label.empty())
+      symbols.insert({std::string(line->statement.label), address});
+    address += statement_size(line->statement);
+  }
+
+  // Labels that moved, appeared or went away
+  std::unordered_set<std::string> moved;
+  for (auto const &[name, value] : symbols) {
+    auto old = m_symbols.find(name);
+    if (old == m_symbols.end() || old->second != value)
+      moved.insert(name);
+  }
+  for (auto const &[name, value] : m_symbols) {
+    if (!symbols.count(name))
+      moved.insert(name);
+  }
+  m_symbols = std::move(symbols);
+
+  bool ok = true;
+  m_binary.clear();
+  for (auto &line : m_lines) {
+    const Instruction &instruction = line->statement.instruction;
+    if (!line->statement.has_instruction)
+      continue;
+
+    bool stale = !line->encoded;
+    for (auto i = 0; i < instruction.operand_count && !stale; i++) {
+      const Operand &operand = instruction.operands[i];
+      stale = operand.type == OperandType::Label &&
+              moved.count(std::string(operand.label));
+    }
+    if (stale) {
+      ok &= encode_line(*line, errors);
+      m_encoded++;
+    }
+    m_binary.insert(m_binary.end(), line->bytes.begin(), line->bytes.end());
+  }
+  return ok;
+}
+
+bool IncrementalAssembler::encode_line(Line &line, std::ostream &errors) {
+  const Instruction &instruction = line.statement.instruction;
+  line.bytes.clear();
+  line.encoded = true;
+  if (instruction.mnemonic == Mnemonic::DB) {
+    for_each_data_byte(instruction,
+                       [&](uint8_t byte) { line.bytes.push_back(byte); });
+    return true;
+  }
+
+  if (const char *error = instruction_error(instruction)) {
+    errors << error << " " << instruction.text << " on line "
+           << instruction.line << std::endl;
+    line.encoded = false;
+  }
+
+  uint16_t opcode =
+      ::encode(instruction, [&](const Operand &operand, uint16_t mask) {
+        if (operand.type != OperandType::Label)
+          return static_cast<uint16_t>(operand.value & mask);
+        auto symbol = m_symbols.find(std::string(operand.label));
+        if (symbol != m_symbols.end())
+          return static_cast<uint16_t>(symbol->second & mask);
+        errors << "Undefined label " << operand.label << " on line "
+               << instruction.line << std::endl;
+        line.encoded = false;
+        return uint16_t(0);
+      });
+  line.bytes.push_back(opcode >> 8);
+  line.bytes.push_back(opcode);
+  return line.encoded;
+}
+
+std::vector<IncrementalAssembler::Range>
+IncrementalAssembler::changes(const std::vector<uint8_t> &previous) const {
+  std::vector<Range> ranges;
+  for (size_t i = 0; i < m_binary.size(); i++) {
+    if (i < previous.size() && previous[i] == m_binary[i])
+      continue;
+    uint16_t address = 0x200 + i;
+    if (!ranges.empty() && ranges.back().end == address)
+      ranges.back().end++;
+    else
+      ranges.push_back({address, static_cast<uint16_t>(address + 1)});
+  }
+
+  // The end of a longer previous binary, which is left to clear
+  if (previous.size() > m_binary.size()) {
+    uint16_t begin = 0x200 + m_binary.size();
+    uint16_t end = 0x200 + previous.size();
+    if (!ranges.empty() && ranges.back().end == begin)
+      ranges.back().end = end;
+    else
+      ranges.push_back({begin, end});
+  }
+  return ranges;
+}
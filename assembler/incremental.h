@@ -0,0 +1,62 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <iostream>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "encode.h"
+
+/* IncrementalAssembler keeps a program assembled while its source is
+ * edited, for patching a running machine. Only lines whose text is new are
+ * parsed, and only those and the instructions using a label that moved
+ * are encoded again; everything else keeps its bytes from the last time.
+ */
+class IncrementalAssembler {
+public:
+  /* Addresses begin to end - 1 */
+  struct Range {
+    uint16_t begin;
+    uint16_t end;
+  };
+
+  /* Assembles source. Returns false if labels were undefined or
+   * instructions couldn't be encoded, which are reported to errors and
+   * assembled as 0.
+   */
+  bool update(std::string_view source, std::ostream &errors = std::cerr);
+
+  const std::vector<uint8_t> &binary() const { return m_binary; }
+  /* The ranges of binary() that differ from previous, an earlier binary
+   * such as the one a machine runs. When previous is longer, its bytes
+   * past the end of binary() are a range too, to be cleared with zeros.
+   */
+  std::vector<Range> changes(const std::vector<uint8_t> &previous) const;
+
+  /* Lines parsed and instructions encoded by the last update() */
+  int parsed() const { return m_parsed; }
+  int encoded() const { return m_encoded; }
+
+private:
+  struct Line {
+    std::string text;
+    Statement statement; // Points into text
+    std::vector<uint8_t> bytes;
+    bool encoded = false; // bytes are valid, nothing was undefined
+  };
+
+  bool encode_line(Line &line, std::ostream &errors);
+
+  // On the heap so that statements keep pointing into their text
+  std::vector<std::unique_ptr<Line>> m_lines;
+  std::unordered_map<std::string, uint16_t> m_symbols;
+  std::vector<uint8_t> m_binary;
+  int m_parsed = 0;
+  int m_encoded = 0;
+};
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <stdint.h>
+#include <string_view>
+
+enum class TokenType {
+  Identifier, // Mnemonics, registers, labels and keywords like DT or [I]
+  Number,     // #1F (hex) or 31 (decimal)
+  Comma,
+  Label,      // Label definition, "name:"
+  Invalid,
+  End
+};
+
+struct Token {
+  TokenType type;
+  std::string_view text; // Points into the source line, never copied
+  uint16_t value;        // Value of a Number
+  int column;            // 1-based column of the first character
+};
+
+/* Lexer splits a single source line into tokens in one pass. Everything
+ * after a ';' is a comment.
+ */
+class Lexer {
+public:
+  constexpr explicit Lexer(std::string_view line) : m_line(line), m_pos(0) {}
+
+  constexpr Token next() {
+    while (m_pos < m_line.size() && is_space(m_line[m_pos]))
+      m_pos++;
+
+    if (m_pos >= m_line.size() || m_line[m_pos] == ';')
+      return {TokenType::End, {}, 0, static_cast<int>(m_pos) + 1};
+
+    size_t start = m_pos;
+    char c = m_line[m_pos];
+
+    if (c == ',') {
+      m_pos++;
+      return make(TokenType::Comma, start, 0);
+    }
+
+    if (c == '[') {
+      // Only [I] is valid inside brackets
+      while (m_pos < m_line.size() && m_line[m_pos] != ']')
+        m_pos++;
+      if (m_pos == m_line.size())
+        return make(TokenType::Invalid, start, 0);
+      m_pos++;
+      return make(TokenType::Identifier, start, 0);
+    }
+
+    if (c == '#') {
+      m_pos++;
+      uint16_t value = 0;
+      while (m_pos < m_line.size() && hex_digit(m_line[m_pos]) >= 0) {
+        value = value * 16 + hex_digit(m_line[m_pos]);
+        m_pos++;
+      }
+      return make(m_pos - start > 1 ? TokenType::Number : TokenType::Invalid,
+                  start, value);
+    }
+
+    if (is_digit(c)) {
+      uint16_t value = 0;
+      while (m_pos < m_line.size() && is_digit(m_line[m_pos])) {
+        value = value * 10 + (m_line[m_pos] - '0');
+        m_pos++;
+      }
+      return make(TokenType::Number, start, value);
+    }
+
+    if (is_identifier(c)) {
+      while (m_pos < m_line.size() && is_identifier(m_line[m_pos]))
+        m_pos++;
+      if (m_pos < m_line.size() && m_line[m_pos] == ':') {
+        Token label = make(TokenType::Label, start, 0);
+        m_pos++;
+        return label;
+      }
+      return make(TokenType::Identifier, start, 0);
+    }
+
+    m_pos++;
+    return make(TokenType::Invalid, start, 0);
+  }
+
+private:
+  constexpr Token make(TokenType type, size_t start, uint16_t value) const {
+    return {type, m_line.substr(start, m_pos - start), value,
+            static_cast<int>(start) + 1};
+  }
+
+  static constexpr bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+  }
+
+  static constexpr bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+  static constexpr bool is_identifier(char c) {
+    return is_digit(c) || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+           c == '_';
+  }
+
+  static constexpr int hex_digit(char c) {
+    if (is_digit(c))
+      return c - '0';
+    if (c >= 'A' && c <= 'F')
+      return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+    return -1;
+  }
+
+  std::string_view m_line;
+  size_t m_pos;
+};
+
+#endif
@@ -0,0 +1,96 @@
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdint.h>
+#include <string>
+
+#include "../libchip8/debuginfo.h"
+#include "assembler.h"
+#include "batch.h"
+#include "optimizer.h"
+
+void usage() {
+  std::cout << "Usage: assembler [-q] [-g] [-O] input.asm output.bin\n"
+            << "       assembler --batch [-v] [-g] [-O] [-j threads] "
+               "[-m manifest] [input.asm...]\n"
+            << std::endl;
+}
+
+int main(int argc, char **argv) {
+  bool batch = false;
+  bool quiet = false;
+  BatchOptions options;
+  std::vector<std::string> inputs;
+
+  for (auto i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--batch") {
+      batch = true;
+    } else if (arg == "-q") {
+      quiet = true;
+    } else if (arg == "-O") {
+      options.optimize = true;
+    } else if (arg == "-g") {
+      options.debug_info = true;
+    } else if (arg == "-v") {
+      options.listing = true;
+    } else if (arg == "-j" && i + 1 < argc) {
+      options.threads = std::stoi(argv[++i]);
+    } else if (arg == "-m" && i + 1 < argc) {
+      std::vector<std::string> sources = read_manifest(argv[++i]);
+      inputs.insert(inputs.end(), sources.begin(), sources.end());
+    } else {
+      inputs.push_back(arg);
+    }
+  }
+
+  if (batch) {
+    return assemble_batch(inputs, options) == 0 ? 0 : 1;
+  }
+
+  if (inputs.size() != 2) {
+    usage();
+    return 1;
+  }
+
+  std::ifstream program(inputs[0], std::ios::in);
+
+  if (!program.is_open()) {
+    std::cout << "Couldn't open source code file!" << std::endl;
+    return 1;
+  }
+
+  DebugInfoBuilder debug_info;
+  Optimizer optimizer;
+  std::ostringstream errors;
+  std::vector<uint8_t> binary =
+      assemble_program(program, quiet ? nullptr : &std::cout, errors,
+                       options.debug_info ? &debug_info : nullptr,
+                       options.optimize ? &optimizer : nullptr);
+
+  // A program with errors is not written
+  if (!errors.str().empty()) {
+    std::cerr << errors.str();
+    return 1;
+  }
+
+  std::ofstream output(inputs[1], std::ios::out | std::ios::binary);
+  if (!output.is_open()) {
+    std::cout << "Couldn't open output file!" << std::endl;
+    return 1;
+  }
+  output.write(reinterpret_cast<const char *>(binary.data()), binary.size());
+
+  if (options.optimize)
+    optimizer.report(std::cout);
+
+  if (options.debug_info) {
+    std::string filename = debug_info_filename(inputs[1]);
+    if (!debug_info.write(filename, inputs[0], binary.data(), binary.size())) {
+      std::cout << "Couldn't write debug info to " << filename << std::endl;
+      return 1;
+    }
+  }
+
+  return 0;
+}
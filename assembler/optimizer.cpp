@@ -0,0 +1,348 @@
+#include <algorithm>
+#include <iterator>
+#include <stdio.h>
+#include <unordered_map>
+
+#include "optimizer.h"
+
+namespace {
+
+// Rounds over all rewrites, each can enable others
+const int MAX_ROUNDS = 16;
+// Jumps followed from one jump
+const int MAX_CHAIN = 64;
+
+const char *rewrite_names[] = {"jump chain shortened", "dead code removed",
+                               "ADD folded into LD", "tail call made a JP",
+                               "redundant LD I removed"};
+
+bool is_skip(const Instruction &instruction) {
+  switch (instruction.mnemonic) {
+  case Mnemonic::SE:
+  case Mnemonic::SNE:
+  case Mnemonic::SKP:
+  case Mnemonic::SKNP:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/* JP or CALL to an address or label, not JP V0 */
+bool is_transfer(const Instruction &instruction, Mnemonic mnemonic) {
+  return instruction.mnemonic == mnemonic && instruction.operand_count == 1 &&
+         (instruction.operands[0].type == OperandType::Label ||
+          instruction.operands[0].type == OperandType::Number);
+}
+
+bool ends_flow(const Instruction &instruction) {
+  return is_transfer(instruction, Mnemonic::JP) ||
+         instruction.mnemonic == Mnemonic::RET ||
+         instruction.mnemonic == Mnemonic::EXIT;
+}
+
+bool is_load_i(const Instruction &instruction) {
+  return instruction.mnemonic == Mnemonic::LD &&
+         instruction.operand_count == 2 &&
+         instruction.operands[0].type == OperandType::I &&
+         (instruction.operands[1].type == OperandType::Label ||
+          instruction.operands[1].type == OperandType::Number);
+}
+
+/* Whether I may differ after instruction, LD [I] and LD Vx, [I] included
+ * as they advance I with some quirks
+ */
+bool writes_i(const Instruction &instruction) {
+  if (instruction.mnemonic == Mnemonic::CALL)
+    return true;
+  if (instruction.mnemonic != Mnemonic::LD &&
+      instruction.mnemonic != Mnemonic::ADD)
+    return false;
+  for (auto i = 0; i < instruction.operand_count; i++) {
+    switch (instruction.operands[i].type) {
+    case OperandType::I:
+    case OperandType::IndirectI:
+    case OperandType::F:
+    case OperandType::HF:
+      return true;
+    default:
+      break;
+    }
+  }
+  return false;
+}
+
+bool is_byte_immediate(const Instruction &instruction, Mnemonic mnemonic) {
+  return instruction.mnemonic == mnemonic && instruction.operand_count == 2 &&
+         instruction.operands[0].type == OperandType::Register &&
+         instruction.operands[1].type == OperandType::Number;
+}
+
+bool same_operand(const Operand &a, const Operand &b) {
+  if (a.type != b.type)
+    return false;
+  return a.type == OperandType::Label ? a.label == b.label
+                                      : a.value == b.value;
+}
+
+std::string operand_text(const Operand &operand) {
+  if (operand.type == OperandType::Label)
+    return std::string(operand.label);
+  char text[8];
+  snprintf(text, sizeof(text), "#%03X", operand.value);
+  return text;
+}
+
+/* The instruction before or after statement i, -1 or statements.size() if
+ * there is none
+ */
+int previous(const std::vector<Statement> &statements, int i) {
+  for (i--; i >= 0 && !statements[i].has_instruction; i--)
+    ;
+  return i;
+}
+
+int next(const std::vector<Statement> &statements, int i) {
+  int size = statements.size();
+  for (i++; i < size && !statements[i].has_instruction; i++)
+    ;
+  return i;
+}
+
+/* Whether a label points at the instruction of statement i */
+bool labeled(const std::vector<Statement> &statements, int i) {
+  for (int j = i; j >= 0; j--) {
+    if (j < i && statements[j].has_instruction)
+      break;
+    if (!statements[j].label.empty())
+      return true;
+  }
+  return false;
+}
+
+/* Whether statement i runs only when a skip before it doesn't skip */
+bool after_skip(const std::vector<Statement> &statements, int i) {
+  int before = previous(statements, i);
+  return before >= 0 && is_skip(statements[before].instruction);
+}
+
+} // namespace
+
+void Optimizer::run(std::vector<Statement> &statements) {
+  for (auto const &statement : statements) {
+    if (!statement.has_instruction)
+      continue;
+    const Instruction &instruction = statement.instruction;
+    bool numeric_address =
+        (is_transfer(instruction, Mnemonic::JP) ||
+         is_transfer(instruction, Mnemonic::CALL)) &&
+        instruction.operands[0].type == OperandType::Number;
+    bool jump_table =
+        instruction.mnemonic == Mnemonic::JP && instruction.operand_count == 2;
+    bool numeric_data = is_load_i(instruction) &&
+                        instruction.operands[1].type == OperandType::Number &&
+                        instruction.operands[1].value >= 0x200;
+    if (numeric_address || jump_table || numeric_data)
+      m_removing = false;
+  }
+
+  for (auto round = 0; round < MAX_ROUNDS; round++) {
+    bool changed = collapse_jump_chains(statements);
+    changed |= turn_tail_calls(statements);
+    if (m_removing) {
+      changed |= fold_adds(statements);
+      changed |= remove_dead_code(statements);
+      changed |= drop_redundant_loads(statements);
+    }
+    if (!changed)
+      break;
+  }
+
+  std::stable_sort(m_changes.begin(), m_changes.end(),
+                   [](const Change &a, const Change &b) {
+                     return a.line < b.line;
+                   });
+}
+
+bool Optimizer::collapse_jump_chains(std::vector<Statement> &statements) {
+  int size = statements.size();
+  std::unordered_map<std::string_view, int> targets;
+  for (auto i = 0; i < size; i++) {
+    if (!statements[i].label.empty()) {
+      int target = statements[i].has_instruction ? i : next(statements, i);
+      targets.insert({statements[i].label, target});
+    }
+  }
+
+  bool changed = false;
+  for (auto &statement : statements) {
+    Instruction &instruction = statement.instruction;
+    if (!statement.has_instruction ||
+        !(is_transfer(instruction, Mnemonic::JP) ||
+          is_transfer(instruction, Mnemonic::CALL)))
+      continue;
+
+    Operand target = instruction.operands[0];
+    for (auto hop = 0;
+         hop < MAX_CHAIN && target.type == OperandType::Label; hop++) {
+      auto found = targets.find(target.label);
+      if (found == targets.end() || found->second >= size)
+        break;
+      const Instruction &next_jump = statements[found->second].instruction;
+      if (!is_transfer(next_jump, Mnemonic::JP) ||
+          same_operand(next_jump.operands[0], target))
+        break;
+      target = next_jump.operands[0];
+    }
+
+    if (same_operand(target, instruction.operands[0]))
+      continue;
+    instruction.operands[0] = target;
+    std::string mnemonic(
+        mnemonic_names[static_cast<int>(instruction.mnemonic)]);
+    rewrite(instruction, Rewrite::JumpChain,
+            mnemonic + " " + operand_text(target));
+    changed = true;
+  }
+  return changed;
+}
+
+bool Optimizer::remove_dead_code(std::vector<Statement> &statements) {
+  int size = statements.size();
+  bool changed = false;
+  for (auto i = 0; i < size; i++) {
+    if (!statements[i].has_instruction ||
+        !ends_flow(statements[i].instruction) || after_skip(statements, i))
+      continue;
+    // Nothing gets past the end of the flow but jumps to a label
+    for (int j = next(statements, i);
+         j < size && !labeled(statements, j) &&
+         statements[j].instruction.mnemonic != Mnemonic::DB;
+         j = next(statements, j)) {
+      remove(statements[j], Rewrite::DeadCode);
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+bool Optimizer::fold_adds(std::vector<Statement> &statements) {
+  int size = statements.size();
+  bool changed = false;
+  for (auto i = 0; i < size; i++) {
+    Instruction &load = statements[i].instruction;
+    if (!statements[i].has_instruction ||
+        !is_byte_immediate(load, Mnemonic::LD) || after_skip(statements, i))
+      continue;
+    int j = next(statements, i);
+    if (j == size || labeled(statements, j))
+      continue;
+    const Instruction &add = statements[j].instruction;
+    if (!is_byte_immediate(add, Mnemonic::ADD) ||
+        add.operands[0].value != load.operands[0].value)
+      continue;
+
+    // 7xkk leaves VF alone, so the sum wraps around like the ADD
+    load.operands[1].value = (load.operands[1].value + add.operands[1].value) &
+                             0xFF;
+    char text[16];
+    snprintf(text, sizeof(text), "LD V%X, #%02X", load.operands[0].value,
+             load.operands[1].value);
+    load.text = keep(text);
+    remove(statements[j], Rewrite::FoldedAdd);
+    changed = true;
+  }
+  return changed;
+}
+
+bool Optimizer::turn_tail_calls(std::vector<Statement> &statements) {
+  int size = statements.size();
+  bool changed = false;
+  for (auto i = 0; i < size; i++) {
+    Instruction &call = statements[i].instruction;
+    if (!statements[i].has_instruction ||
+        !is_transfer(call, Mnemonic::CALL))
+      continue;
+    // The RET stays for skips and jumps to it, the subroutine returns to
+    // the caller instead. Unreachable, it goes as dead code.
+    int j = next(statements, i);
+    if (j == size || statements[j].instruction.mnemonic != Mnemonic::RET)
+      continue;
+    call.mnemonic = Mnemonic::JP;
+    rewrite(call, Rewrite::TailCall, "JP " + operand_text(call.operands[0]));
+    changed = true;
+  }
+  return changed;
+}
+
+bool Optimizer::drop_redundant_loads(std::vector<Statement> &statements) {
+  int size = statements.size();
+  bool changed = false;
+  bool known = false;
+  Operand address;
+  for (auto i = 0; i < size; i++) {
+    if (!statements[i].has_instruction)
+      continue;
+    const Instruction &instruction = statements[i].instruction;
+    if (labeled(statements, i))
+      known = false;
+
+    bool skipped = after_skip(statements, i);
+    if (is_load_i(instruction)) {
+      if (known && same_operand(address, instruction.operands[1]) &&
+          !skipped) {
+        remove(statements[i], Rewrite::RedundantLoad);
+        changed = true;
+        continue;
+      }
+      // After a skip, I has either address
+      known = !skipped;
+      address = instruction.operands[1];
+    } else if (writes_i(instruction) || ends_flow(instruction) ||
+               instruction.mnemonic == Mnemonic::DB) {
+      known = false;
+    }
+  }
+  return changed;
+}
+
+void Optimizer::remove(Statement &statement, Rewrite kind) {
+  statement.has_instruction = false;
+  m_changes.push_back({statement.instruction.line, kind});
+  m_removed++;
+}
+
+void Optimizer::rewrite(Instruction &instruction, Rewrite kind,
+                        std::string text) {
+  instruction.text = keep(std::move(text));
+  m_changes.push_back({instruction.line, kind});
+}
+
+std::string_view Optimizer::keep(std::string text) {
+  m_texts.push_back(std::move(text));
+  return m_texts.back();
+}
+
+void Optimizer::report(std::ostream &out) const {
+  int counts[std::size(rewrite_names)] = {};
+  for (auto const &change : m_changes) {
+    int rewrite = static_cast<int>(change.rewrite);
+    counts[rewrite]++;
+    out << "Line " << change.line << ": " << rewrite_names[rewrite] << '\n';
+  }
+
+  out << "Optimized: " << m_removed << " instructions (" << m_removed * 2
+      << " bytes) removed";
+  const char *separator = "; ";
+  for (size_t i = 0; i < std::size(rewrite_names); i++) {
+    if (counts[i]) {
+      out << separator << rewrite_names[i] << " x" << counts[i];
+      separator = ", ";
+    }
+  }
+  out << '\n';
+  if (!m_removing)
+    out << "No instructions removed as the program uses numeric addresses "
+           "or JP V0\n";
+  out.flush();
+}
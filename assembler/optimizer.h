@@ -0,0 +1,73 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "encode.h"
+
+/* The rewrites of the optimizer */
+enum class Rewrite : uint8_t {
+  JumpChain,     // JP or CALL to a JP goes to the final target
+  DeadCode,      // Unlabeled instructions after JP, RET or EXIT
+  FoldedAdd,     // LD Vx, a followed by ADD Vx, b becomes LD Vx, a+b
+  TailCall,      // CALL followed by RET becomes JP
+  RedundantLoad  // LD I of the address I already has
+};
+
+/* Optimizer rewrites the parsed statements of a program before they are
+ * encoded, to save instructions in the loops of programs that run on a
+ * budget of instructions per frame. Only rewrites that keep the behavior
+ * are made: a label starts a new block as anything may jump there, and
+ * the instruction after a skip is never removed or merged as that changes
+ * what is skipped.
+ *
+ * Instructions are only removed when the program refers to its own code by
+ * labels alone. Numeric jump, call and LD I addresses in the program and
+ * jump tables (JP V0) would point to other instructions once the ones in
+ * front of them are gone. Programs modifying their own code shouldn't be
+ * optimized at all.
+ */
+class Optimizer {
+public:
+  struct Change {
+    int line;
+    Rewrite rewrite;
+  };
+
+  /* Rewrites statements in place. Removed instructions are left as
+   * statements without an instruction, keeping their labels. The text of
+   * rewritten instructions is kept by the optimizer.
+   */
+  void run(std::vector<Statement> &statements);
+
+  const std::vector<Change> &changes() const { return m_changes; }
+  /* Instructions removed */
+  int removed() const { return m_removed; }
+  /* False if instructions couldn't be removed, see above */
+  bool removing() const { return m_removing; }
+
+  /* Writes a line per change and a summary of the savings */
+  void report(std::ostream &out) const;
+
+private:
+  bool collapse_jump_chains(std::vector<Statement> &statements);
+  bool remove_dead_code(std::vector<Statement> &statements);
+  bool fold_adds(std::vector<Statement> &statements);
+  bool turn_tail_calls(std::vector<Statement> &statements);
+  bool drop_redundant_loads(std::vector<Statement> &statements);
+
+  void remove(Statement &statement, Rewrite kind);
+  void rewrite(Instruction &instruction, Rewrite kind, std::string text);
+  /* Keeps the text of a rewritten instruction */
+  std::string_view keep(std::string text);
+
+  std::deque<std::string> m_texts; // Of rewritten instructions
+  std::vector<Change> m_changes;
+  int m_removed = 0;
+  bool m_removing = true;
+};
+
+#endif
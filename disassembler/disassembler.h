@@ -1,8 +1,28 @@
-#include <fstream>
-#include <iomanip>
-#include <iostream>
+#ifndef DISASSEMBLER_H
+#define DISASSEMBLER_H
+
+#include <stddef.h>
 #include <stdint.h>
-#include <sstream>
+#include <string>
+
+// Longest disassembled instruction including the terminating null
+const int DISASSEMBLY_MAX = 24;
+// Longest line written by disassemble_range, "0200 a2 1e LD I, #21e\n"
+const int DISASSEMBLY_LINE_MAX = DISASSEMBLY_MAX + 12;
+
+/* Writes the instruction as a null terminated string to out, which must have
+ * room for DISASSEMBLY_MAX characters. Returns the length of the string.
+ * Unknown opcodes produce an empty string.
+ */
+size_t disassemble(uint16_t opcode, char *out);
 
 std::string disassemble(uint8_t firstbyte, uint8_t lastbyte);
 void disassemble_buffer(uint8_t *codebuffer, int pc);
+
+/* Disassembles the instructions from begin up to end into out, one line per
+ * instruction with the address and bytes in front.
+ */
+void disassemble_range(const uint8_t *buffer, int begin, int end,
+                       std::string &out);
+
+#endif
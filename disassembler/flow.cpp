@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <set>
+
+#include "../libchip8/decode.h"
+#include "disassembler.h"
+#include "flow.h"
+
+namespace {
+
+enum Successors {
+  Next = 1,   // Continues with the next instruction
+  Skip = 2,   // May skip the next instruction
+  Target = 4, // Jumps or calls to the address in the opcode
+  End = 8     // Ends the basic block
+};
+
+/* Where execution may go after opcode. Whether it ends a block comes from
+ * the decoder, so the disassembler splits code exactly where the core does.
+ */
+int successors(Op op) {
+  if (!ends_block(op))
+    return Next;
+  switch (op) {
+  case Op::JP:
+  case Op::JP_V0:
+    return Target | End;
+  case Op::CALL: // Returns to the next instruction
+    return Target | Next | End;
+  case Op::SE_BYTE:
+  case Op::SNE_BYTE:
+  case Op::SE_REG:
+  case Op::SNE_REG:
+  case Op::SKP:
+  case Op::SKNP:
+    return Next | Skip | End;
+  case Op::LD_VX_K: // Continues once a key goes down
+    return Next | End;
+  default: // RET, EXIT and unknown opcodes that wait in place
+    return End;
+  }
+}
+
+std::string hex(uint16_t value, int digits) {
+  const char hex_digits[] = "0123456789abcdef";
+  std::string text(digits, '0');
+  for (auto i = digits - 1; i >= 0; i--, value >>= 4)
+    text[i] = hex_digits[value & 0xF];
+  return text;
+}
+
+} // namespace
+
+ControlFlow analyze(const uint8_t *memory, int begin, int end, int entry) {
+  ControlFlow flow;
+  flow.map.assign(end, ByteType::Data);
+
+  std::set<uint16_t> leaders{static_cast<uint16_t>(entry)};
+  std::vector<uint16_t> worklist{static_cast<uint16_t>(entry)};
+  auto visit = [&](int address, bool leader) {
+    if (address < begin || address + 1 >= end)
+      return;
+    if (leader)
+      leaders.insert(address);
+    if (flow.map[address] != ByteType::Instruction)
+      worklist.push_back(address);
+  };
+
+  while (!worklist.empty()) {
+    uint16_t address = worklist.back();
+    worklist.pop_back();
+
+    // Walk straight-line code until something changes the control flow
+    while (address >= begin && address + 1 < end &&
+           flow.map[address] != ByteType::Instruction) {
+      flow.map[address] = ByteType::Instruction;
+      flow.map[address + 1] = ByteType::Operand;
+
+      uint16_t opcode = memory[address] << 8 | memory[address + 1];
+      Decoded decoded = decode(opcode);
+      int next = successors(decoded.op);
+      uint16_t target = decoded.nnn;
+
+      if (decoded.op == Op::LD_I && target >= begin && target < end &&
+          flow.labels.count(target) == 0)
+        flow.labels[target] = "data_" + hex(target, 3);
+
+      if (next & Target) {
+        visit(target, true);
+        const char *prefix = decoded.op == Op::CALL    ? "sub_"
+                             : decoded.op == Op::JP_V0 ? "table_"
+                                                       : "label_";
+        if (target >= begin && target < end)
+          flow.labels[target] = prefix + hex(target, 3);
+      }
+      if (next & Skip)
+        visit(address + 4, true);
+      if (next & End) {
+        if (next & Next)
+          visit(address + 2, true);
+        break;
+      }
+
+      address += 2;
+    }
+  }
+
+  // A block starts at a leader and ends after a control flow instruction,
+  // before the next leader or where the code ends.
+  for (auto address = begin; address < end; address++) {
+    if (flow.map[address] != ByteType::Instruction)
+      continue;
+
+    BasicBlock block{static_cast<uint16_t>(address), 0};
+    while (flow.is_instruction(address)) {
+      uint16_t opcode = memory[address] << 8 | memory[address + 1];
+      address += 2;
+      if (ends_block(decode_op(opcode)) || leaders.count(address))
+        break;
+    }
+    block.end = address;
+    flow.blocks.push_back(block);
+    address--;
+  }
+
+  return flow;
+}
+
+void disassemble_flow(const uint8_t *memory, int begin, int end,
+                      const ControlFlow &flow, std::string &out) {
+  char text[DISASSEMBLY_MAX];
+  auto instruction_at = [&](int address, uint16_t &opcode) -> size_t {
+    opcode = address + 1 < end ? memory[address] << 8 | memory[address + 1]
+                               : 0;
+    return flow.is_instruction(address) ? disassemble(opcode, text) : 0;
+  };
+
+  // A label on the second byte of an instruction, such as an LD I into
+  // code, can't be defined. Its users keep the numeric address.
+  std::map<uint16_t, std::string> labels = flow.labels;
+  uint16_t opcode;
+  for (auto address = begin; address < end; address++) {
+    if (instruction_at(address, opcode) > 0)
+      labels.erase(++address);
+  }
+
+  int address = begin;
+  while (address < end) {
+    auto label = labels.find(address);
+    if (label != labels.end())
+      out += label->second + ":\n";
+
+    size_t length = instruction_at(address, opcode);
+
+    if (length > 0) {
+      std::string instruction(text, length);
+
+      // Replace the address operand with its label
+      Decoded decoded = decode(opcode);
+      auto target = labels.find(decoded.nnn);
+      if (target != labels.end() &&
+          (decoded.op == Op::LD_I || (successors(decoded.op) & Target)))
+        instruction.replace(instruction.rfind('#'), std::string::npos,
+                            target->second);
+
+      out += "        " + instruction + "\n";
+      address += 2;
+      continue;
+    }
+
+    // Data up to the next instruction or label, at most 8 bytes per line
+    out += "        DB ";
+    int count = 0;
+    do {
+      if (count > 0)
+        out += ", ";
+      out += "#" + hex(memory[address], 2);
+      address++;
+      count++;
+    } while (address < end && count < 8 && !flow.is_instruction(address) &&
+             labels.count(address) == 0);
+    out += "\n";
+  }
+}
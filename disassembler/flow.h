@@ -0,0 +1,47 @@
+#ifndef FLOW_H
+#define FLOW_H
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+enum class ByteType : uint8_t {
+  Data,        // Not reached from the entry point
+  Instruction, // First byte of an instruction
+  Operand      // Second byte of an instruction
+};
+
+struct BasicBlock {
+  uint16_t start;
+  uint16_t end; // One past the last byte
+};
+
+/* Code and data of a program found by following the control flow from the
+ * entry point.
+ */
+struct ControlFlow {
+  std::vector<ByteType> map;      // Indexed by address
+  std::vector<BasicBlock> blocks; // Sorted by start address
+  std::map<uint16_t, std::string> labels;
+
+  bool is_instruction(int address) const {
+    return address < static_cast<int>(map.size()) &&
+           map[address] == ByteType::Instruction;
+  }
+};
+
+/* Follows every path from entry through JP, CALL, RET and both successors
+ * of the skip instructions. JP V0 jumps are only followed to their base
+ * address. Addresses outside [begin, end) are not visited.
+ */
+ControlFlow analyze(const uint8_t *memory, int begin, int end, int entry);
+
+/* Writes code as instructions and data as DB directives, with labels for
+ * every jump, call and LD I target that starts a line. The output can be
+ * assembled again.
+ */
+void disassemble_flow(const uint8_t *memory, int begin, int end,
+                      const ControlFlow &flow, std::string &out);
+
+#endif
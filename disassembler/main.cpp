@@ -1,13 +1,18 @@
 #include <fstream>
-#include <iomanip>
 #include <iostream>
 #include <stdint.h>
-#include <sstream>
+#include <string>
+#include <vector>
 
 #include "disassembler.h"
+#include "flow.h"
 
 int main(int argc, char **argv) {
-  std::ifstream rom(argv[1], std::ios::in | std::ios::binary | std::ios::ate);
+  // -r follows the control flow and prints code that can be assembled again
+  bool recursive = argc > 2 && std::string(argv[1]) == "-r";
+  const char *filename = argv[argc - 1];
+
+  std::ifstream rom(filename, std::ios::in | std::ios::binary | std::ios::ate);
 
   if (!rom.is_open()) {
     std::cout << "Couldn't open file!" << std::endl;
@@ -15,18 +20,21 @@ int main(int argc, char **argv) {
   }
 
   long size = rom.tellg();
-  unsigned char *buffer = new unsigned char[size + 0x200];
+  std::vector<uint8_t> buffer(size + 0x200);
 
   rom.seekg(0, std::ios::beg);
-  rom.read((char *)buffer + 0x200, size);
+  rom.read((char *)buffer.data() + 0x200, size);
   rom.close();
 
-  int pc = 0x200;
-  while (pc < (size + 0x200)) {
-    disassemble_buffer(buffer, pc);
-    pc += 2;
-    std::cout << std::endl;
+  // The whole listing is formatted in memory and written at once
+  std::string listing;
+  if (recursive) {
+    ControlFlow flow = analyze(buffer.data(), 0x200, size + 0x200, 0x200);
+    disassemble_flow(buffer.data(), 0x200, size + 0x200, flow, listing);
+  } else {
+    disassemble_range(buffer.data(), 0x200, size + 0x200, listing);
   }
+  std::cout.write(listing.data(), listing.size());
 
   return 0;
 }
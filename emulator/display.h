@@ -3,26 +3,34 @@
 
 #include <SDL.h>
 #include <SDL_opengl.h>
+#include <memory>
 
-const uint8_t SCREEN_WIDTH = 64;
-const uint8_t SCREEN_HEIGHT = 32;
+#include "../libchip8/chip8.h"
+#include "../libchip8/postprocess.h"
 
 /* Display handles drawing the Chip8 screen contents.
  * The actual screen data is stored in emulator memory
- * and it's passed to the update method.
+ * and it's passed to the update method. It goes through a PostProcess,
+ * scaling it and fading pixels out, into a texture stretched over the
+ * window.
  */
 class Display {
 public:
   Display() {}
   ~Display() {
     SDL_Log("DESTROY\n");
+    if (m_texture)
+      SDL_DestroyTexture(m_texture);
     SDL_GL_DeleteContext(m_glcontext);
     SDL_DestroyWindow(m_window);
     SDL_Quit();
   }
 
-  /* Initializes SDL and creates a window and OpenGL context for rendering */
-  int init() {
+  /* Initializes SDL and creates a window and OpenGL context for rendering.
+   * scale is 1 for plain pixels, 2 or 3 for Scale2x or Scale3x, and
+   * persistence the brightness out of 256 a pixel keeps per frame.
+   */
+  int init(int scale = 1, int persistence = 0) {
     if (SDL_Init(SDL_INIT_VIDEO) != 0) {
       SDL_Log("Failed to initialize SDL: %s", SDL_GetError());
       return 1;
@@ -30,39 +38,30 @@ public:
 
     SDL_CreateWindowAndRenderer(640, 320, SDL_WINDOW_OPENGL, &m_window,
                                 &m_renderer);
-    SDL_RenderSetLogicalSize(m_renderer, 64, 32);
-
     if (m_window == nullptr)
       return 1;
 
+    m_post = std::make_unique<PostProcess>(SCREEN_WIDTH, SCREEN_HEIGHT, scale,
+                                           persistence);
+    SDL_RenderSetLogicalSize(m_renderer, m_post->width(), m_post->height());
+    m_texture = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_ARGB8888,
+                                  SDL_TEXTUREACCESS_STREAMING,
+                                  m_post->width(), m_post->height());
+
     m_glcontext = SDL_GL_CreateContext(m_window);
     return 0;
   }
 
-  void update(uint8_t *screen) {
-    SDL_SetRenderDrawColor(m_renderer, 0, 0, 0, 0);
+  void update(const uint8_t *screen) {
+    const uint32_t *pixels = m_post->process(screen);
+    SDL_UpdateTexture(m_texture, nullptr, pixels,
+                      m_post->width() * sizeof(uint32_t));
     SDL_RenderClear(m_renderer);
-    SDL_SetRenderDrawColor(m_renderer, 255, 255, 255, 255);
-    int byte_count = SCREEN_WIDTH * SCREEN_HEIGHT / 8;
-    for (auto i = 0; i < byte_count; i++) {
-      uint8_t screen_byte = screen[i];
-      for (auto a = 7; a >= 0; a--) {
-        int bit = i * 8 + a;
-        int y = bit / SCREEN_WIDTH;
-        int x = bit - y * SCREEN_WIDTH;
-        if (screen_byte & 0x01) {
-          SDL_RenderDrawPoint(m_renderer, x, y);
-          // std::cout << x << ", " << y << std::endl;
-        }
-
-        screen_byte = screen_byte >> 1;
-      }
-    }
-
+    SDL_RenderCopy(m_renderer, m_texture, nullptr, nullptr);
     SDL_RenderPresent(m_renderer);
   }
 
-  void print_debug(uint8_t *screen) {
+  void print_debug(const uint8_t *screen) {
     int byte_count = SCREEN_WIDTH * SCREEN_HEIGHT / 8;
     std::cout << "SCREEN START" << std::endl;
     for (auto i = 0; i < byte_count; i++) {
@@ -80,6 +79,8 @@ public:
 private:
   SDL_Window *m_window = nullptr;
   SDL_Renderer *m_renderer = nullptr;
+  SDL_Texture *m_texture = nullptr;
+  std::unique_ptr<PostProcess> m_post;
   SDL_GLContext m_glcontext;
 };
 
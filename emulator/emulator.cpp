@@ -1,9 +1,15 @@
-#include <bitset>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <signal.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <vector>
 
 #include <SDL.h>
 
@@ -12,13 +18,27 @@
 
 #include <nlohmann/json.hpp>
 
+#include "../assembler/incremental.h"
 #include "../disassembler/disassembler.h"
+#include "../libchip8/chip8.h"
+#include "../libchip8/debuginfo.h"
+#include "../libchip8/recorder.h"
+#include "../libchip8/stats.h"
+#include "../libchip8/timeline.h"
 
-#include "timer.h"
+using json = nlohmann::json;
 
-const uint16_t CLOCK_SPEED_HZ = 500;
+using Clock = std::chrono::steady_clock;
 
-using json = nlohmann::json;
+int64_t microseconds(Clock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(duration)
+      .count();
+}
+
+// Set by SIGUSR1 to write the timeline without quitting
+volatile sig_atomic_t timeline_requested = 0;
+
+void request_timeline(int) { timeline_requested = 1; }
 
 template<typename T>
 std::string int_to_hex(T i) {
@@ -28,492 +48,353 @@ std::string int_to_hex(T i) {
 }
 
 
-class Chip8 {
+/* Emulator runs a Chip8 machine in an SDL window */
+class Emulator {
 public:
-  Chip8()
-      : m_delay(60), m_sound(60), m_clock_speed(CLOCK_SPEED_HZ),
-        m_step_mode(false), m_step(false) {
-    m_memory = new unsigned char[1024 * 4 + 0x200]; // 4K memory reserved
-    m_screen = &m_memory[0xF00];
-    m_I = 0x00;
-    m_SP = 0x70;
-    m_PC = 0x200; // Programs are loaded at 0x200
-
-    const unsigned char fontset[] = {
-        0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-        0x20, 0x60, 0x20, 0x20, 0x70, // 1
-        0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-        0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-        0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-        0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-        0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-        0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-        0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-        0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-        0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-        0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-        0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-        0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-        0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-        0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-    };
-
-    for (auto i = 0; i < (1024 * 4 + 0x200); i++) {
-      m_memory[i] = 0;
+  /* Loads a ROM with the given profile, or the one of the ROM in the
+   * profile database next to it, and the debug info the assembler wrote
+   * next to it if it is there
+   */
+  void load_rom(const char *filename, const char *profile_option) {
+    std::ifstream in(filename, std::ios::in | std::ios::binary);
+    std::vector<uint8_t> rom((std::istreambuf_iterator<char>(in)),
+                             std::istreambuf_iterator<char>());
+    m_debug_info.open(debug_info_filename(filename), rom.data(), rom.size());
+
+    Profile profile = Profile::Modern;
+    if (profile_option) {
+      if (!profile_from_name(profile_option, profile))
+        std::cout << "Unknown profile " << profile_option << std::endl;
+    } else {
+      find_profile(profile_database(filename), rom.data(), rom.size(),
+                   profile);
     }
+    m_vm.set_quirk_profile(profile);
 
-    for (auto i = 0; i < 80; i++) {
-      m_memory[i] = fontset[i];
+    // Translations are kept across runs when CHIP8_CACHE names a directory
+    const char *cache_directory = getenv("CHIP8_CACHE");
+    if (!cache_directory) {
+      m_vm.load_rom(filename);
+      return;
     }
-  }
 
-  void load_rom(char *filename) {
-    std::ifstream rom(filename,
-                      std::ios::in | std::ios::binary | std::ios::ate);
+    TranslationCache cache(cache_directory);
+    m_vm.load_rom(filename, &cache);
+  }
 
-    if (!rom.is_open()) {
-      std::cout << "Couldn't open file!" << std::endl;
-      m_ready = false;
-      return;
-    }
+  /* Assembles the program in filename and runs it. Changes to the file are
+   * patched into the running machine.
+   */
+  void load_source(const char *filename, const char *profile_option) {
+    Profile profile = Profile::Modern;
+    if (profile_option && !profile_from_name(profile_option, profile))
+      std::cout << "Unknown profile " << profile_option << std::endl;
+    m_vm.set_quirk_profile(profile);
+
+    m_source = filename;
+    std::error_code error;
+    m_source_time = std::filesystem::last_write_time(m_source, error);
+    m_assembler.update(read_source(), std::cout);
+    m_loaded = m_assembler.binary();
+    m_vm.load_rom(m_loaded.data(), m_loaded.size());
+  }
 
-    int size = rom.tellg();
+  std::string read_source() {
+    std::ifstream in(m_source, std::ios::in);
+    if (!in.is_open())
+      std::cout << "Couldn't open source code file " << m_source << std::endl;
+    return {std::istreambuf_iterator<char>(in),
+            std::istreambuf_iterator<char>()};
+  }
 
-    // Load rom to memory at 0x200
-    rom.seekg(0, std::ios::beg);
-    rom.read((char *)m_memory + 0x200, size);
-    rom.close();
+  /* Reassembles the source if it changed and writes the bytes that differ
+   * into memory, so the program goes on with its state
+   */
+  void reload_source() {
+    std::error_code error;
+    auto time = std::filesystem::last_write_time(m_source, error);
+    if (error || time == m_source_time)
+      return;
+    m_source_time = time;
 
-    m_ready = true;
+    if (!m_assembler.update(read_source(), std::cout)) {
+      std::cout << "Not patched, fix the errors in " << m_source << std::endl;
+      return;
+    }
+    // Zeros past the end clear what a shorter program no longer has
+    std::vector<uint8_t> binary = m_assembler.binary();
+    binary.resize(std::max(binary.size(), m_loaded.size()));
+    size_t bytes = 0;
+    for (auto const &range : m_assembler.changes(m_loaded)) {
+      m_vm.patch(range.begin, &binary[range.begin - PROGRAM_START],
+                 range.end - range.begin);
+      bytes += range.end - range.begin;
+    }
+    m_loaded = m_assembler.binary();
+    std::cout << "Reassembled " << m_source << ": " << m_assembler.parsed()
+              << " lines parsed, " << m_assembler.encoded()
+              << " instructions encoded, " << bytes << " bytes patched"
+              << std::endl;
   }
 
   void run() {
-    while (!m_quitting) {
-      emulate();
-      m_display.update(m_screen);
-      m_keyboard.pollEvents();
+    StatsPublisher publisher(stats_name(getpid()));
+
+    // Every presented frame is recorded when CHIP8_RECORD names a file
+    std::unique_ptr<Recorder> recorder;
+    if (const char *record = getenv("CHIP8_RECORD")) {
+      recorder = std::make_unique<Recorder>(record);
+      if (!recorder->is_open())
+        std::cout << "Couldn't open " << record << std::endl;
+    }
+    Stats stats{};
+
+    // The phases of every frame are recorded when CHIP8_TIMELINE names a
+    // file, which gets the latest of them on exit and on SIGUSR1
+    const char *timeline = getenv("CHIP8_TIMELINE");
+    if (timeline) {
+      timeline_start();
+      signal(SIGUSR1, request_timeline);
+    }
 
+    // Executions are counted per instruction when CHIP8_PROFILE names a
+    // file, which gets the hottest of them on exit
+    const char *profile = getenv("CHIP8_PROFILE");
+    if (profile)
+      m_vm.set_features(m_vm.features() | FEATURE_PROFILE);
+
+    auto frame_duration = std::chrono::microseconds(1000000 / FRAME_RATE);
+    auto start = Clock::now();
+    auto deadline = start;
+    auto second = start;
+    uint64_t second_instructions = 0;
+
+    while (!m_vm.quitting()) {
+      TimelineSpan frame_span("frame");
+      auto frame_start = Clock::now();
+      {
+        TimelineSpan span("poll events");
+        m_keyboard.pollEvents();
+      }
+      uint16_t key_down = m_keyboard.keyDownMask();
+      m_vm.set_keys(m_keyboard.pressedMask(), key_down);
+      if (key_down) {
+        stats.input_latency_us =
+            (SDL_GetTicks() - m_keyboard.keyDownTime()) * 1000;
+      }
+
+      bool stepping = false;
       if (m_keyboard.keyDownEvent(SDLK_SPACE)) {
-        m_step = true;
+        m_vm.step();
+        stepping = true;
       }
 
       if (m_keyboard.keyDownEvent(SDLK_p)) {
-        m_step_mode = !m_step_mode;
+        m_vm.toggle_step_mode();
+        stepping = true;
       }
 
-      SDL_Event event;
-      while (SDL_PollEvent(&event)) {
-        if (event.type == SDL_QUIT)
-          m_quitting = true;
-      }
-      SDL_Delay(1000 / m_clock_speed);
-    }
+      if (m_keyboard.quitRequested())
+        m_vm.quit();
 
-    print_debug();
+      // A watched source is checked a few times a second
+      if (!m_source.empty() && stats.frames % (FRAME_RATE / 4) == 0) {
+        TimelineSpan span("reassemble");
+        reload_source();
+      }
 
-  }
+      {
+        TimelineSpan span("emulate");
+        // Translated blocks, from the cache with CHIP8_CACHE, unless
+        // stepping an instruction at a time
+        if (m_vm.step_mode()) {
+          for (auto i = 0; i < CYCLES_PER_FRAME && !m_vm.quitting(); i++)
+            m_vm.emulate();
+        } else {
+          m_vm.run_cycles(CYCLES_PER_FRAME);
+        }
+      }
+      if (stepping)
+        print_location();
 
-  void init() { m_display.init(); }
+      auto present_start = Clock::now();
+      {
+        TimelineSpan span("present");
+        m_display.update(m_vm.screen());
+      }
+      if (recorder) {
+        TimelineSpan span("record");
+        recorder->push(m_vm.screen(), m_vm.sound() > 0);
+      }
+      auto now = Clock::now();
+
+      stats.present_time_us = microseconds(now - present_start);
+      stats.frame_time_us = microseconds(now - frame_start);
+      add_frame_time(stats, stats.frame_time_us);
+      stats.frames++;
+      stats.instructions = m_vm.instructions();
+      stats.PC = m_vm.PC();
+
+      // Sleep until the next frame is due. Frames that can't be made up
+      // for are dropped instead of running the following ones back to back.
+      deadline += frame_duration;
+      if (now > deadline) {
+        stats.late_frames++;
+        auto behind = (now - deadline) / frame_duration;
+        stats.dropped_frames += behind;
+        deadline += behind * frame_duration;
+      } else {
+        TimelineSpan span("sleep");
+        SDL_Delay(microseconds(deadline - now) / 1000);
+      }
+      stats.timer_drift_us = microseconds(Clock::now() - start) -
+                             stats.frames * frame_duration.count();
+
+      if (now - second >= std::chrono::seconds(1)) {
+        stats.ips = (stats.instructions - second_instructions) * 1000000 /
+                    microseconds(now - second);
+        second_instructions = stats.instructions;
+        second = now;
+      }
+      publisher.publish(stats);
 
-  void print_debug() {
+      if (timeline_requested) {
+        timeline_requested = 0;
+        write_timeline(timeline);
+      }
+    }
 
-    json debug = {{"I", static_cast<int>(m_I)},
-                  {"PC", static_cast<int>(m_PC)},
-                  {"SP", static_cast<int>(m_SP)}};
+    if (timeline)
+      write_timeline(timeline);
+    if (profile)
+      write_profile(profile);
 
-    for (auto i = 0; i < 16; i++) {
-      debug.emplace("V" + int_to_hex(i), static_cast<int>(m_V[i]));
+    if (recorder && recorder->dropped()) {
+      std::cout << "Recording dropped " << recorder->dropped() << " of "
+                << recorder->frames() + recorder->dropped() << " frames"
+                << std::endl;
     }
 
-    std::cout << debug << std::endl;
+    print_debug();
+
   }
 
-  void emulate() {
-    if (!m_ready)
-      return;
+  void init(int scale, int persistence) {
+    m_display.init(scale, persistence);
+  }
 
-    if (m_step_mode && !m_step)
-      return;
+  void write_timeline(const char *filename) {
+    if (!timeline_write(filename))
+      std::cout << "Couldn't write the timeline to " << filename << std::endl;
+  }
 
-    // Fetch first 8 bits of next instruction
-    uint8_t *op = &m_memory[m_PC];
-
-    uint8_t firstbyte = op[0];
-    uint8_t lastbyte = op[1];
-
-    int highnib = (*op & 0xf0) >> 4;
-    switch (highnib) {
-    case 0x00:
-      switch (lastbyte) {
-      case 0xFD:
-        // EXIT
-        // Exits the program
-        m_quitting = true;
-        // Don't advance PC on exit.
-        m_PC -= 2;
-        break;
-      case 0xE0: {
-        // CLS
-        // Clear the display
-        int byte_count = SCREEN_WIDTH * SCREEN_HEIGHT / 8;
-        for (auto i = 0; i < byte_count; i++) {
-          m_screen[i] = 0;
-        }
-        break;
-      }
-      case 0xEE:
-        // RET
-        // Return from subroutine
-        m_PC = m_memory[m_SP] << 8 | m_memory[m_SP + 1];
-        m_SP += 2;
-        return;
-      }
-      m_PC += 2;
-      break;
-    case 0x01: {
-      // JUMP 1NNN
-      // Jump to NNN
-      uint16_t target = ((firstbyte & 0x0f) << 8) | lastbyte;
-      m_PC = target;
-    } break;
-    case 0x02: {
-      // CALL 2NNN
-      // Call subroutine at NNN
-
-      // Advance stack pointer
-      m_SP -= 2;
-
-      // Store next instructions address to memory pointed by the stack
-      // pointer
-      m_memory[m_SP] = ((m_PC + 2) & 0xff00) >> 8;
-      m_memory[m_SP + 1] = ((m_PC + 2) & 0x00ff);
-
-      // Jump to subroutines address NNN
-      uint16_t target = ((firstbyte & 0xf) << 8) | lastbyte;
-      m_PC = target;
-    } break;
-    case 0x03: {
-      // 3xkk SE Vx, byte
-      // Skip next instructions if Vx = kk
-      uint8_t reg = firstbyte & 0x0f;
-      if (m_V[reg] == lastbyte)
-        m_PC += 2;
-      m_PC += 2;
-    } break;
-    case 0x04: {
-      // 4xkk SNE Vx, byte
-      // Skip next instruction if Vx != kk
-      uint8_t reg = firstbyte & 0x0f;
-      if (m_V[reg] != lastbyte)
-        m_PC += 2;
-      m_PC += 2;
-    } break;
-    case 0x05: {
-      // 5xy0 SE Vx, Vy
-      // Skip next instruction if Vx = Vy
-      uint8_t reg1 = firstbyte & 0x0f;
-      uint8_t reg2 = (lastbyte & 0xf0) >> 4;
-      if (m_V[reg1] == m_V[reg2])
-        m_PC += 2;
-      m_PC += 2;
-    } break;
-    case 0x06: {
-      // 6xkk LD Vx, byte
-      // Set Vx = kk
-      uint8_t reg = firstbyte & 0x0f;
-      m_V[reg] = lastbyte;
-      m_PC += 2;
-    } break;
-    case 0x07: {
-      // 7xkk ADD Vx, byte
-      // Set Vx = Vx + kk
-      uint8_t reg = firstbyte & 0x0f;
-      m_V[reg] += lastbyte;
-      m_PC += 2;
-    } break;
-    case 0x08: {
-      uint8_t command = lastbyte & 0x0f;
-      uint8_t reg1 = firstbyte & 0x0f;
-      uint8_t reg2 = (lastbyte & 0xf0) >> 4;
-
-      switch (command) {
-      case 0x0: {
-        // 8xy0 LD Vx, Vy
-        // Set Vx = Vy
-        m_V[reg1] = m_V[reg2];
-      }
-      case 0x1: {
-        // 8xy1 OR Vx, Vy
-        // Bitwise OR on Vx and Vy. The result is stored to Vx.
-        m_V[reg1] |= m_V[reg2];
-      } break;
-      case 0x2: {
-        // 8xy1 AND Vx, Vy
-        // Bitwise AND on Vx and Vy. The result is stored to Vx.
-        m_V[reg1] &= m_V[reg2];
-      } break;
-      case 0x3: {
-        // 8xy1 XOR Vx, Vy
-        // Bitwise XOR on Vx and Vy. The result is stored to Vx.
-        m_V[reg1] ^= m_V[reg2];
-      } break;
-      case 0x4: {
-        // 8xy4 ADD Vx, Vy
-        // Set Vx = Vx + Vy, set VF = carry
-        //  Values of Vx and Vy are added together.
-        // If the result is > 255, VF is set to 1.
-        uint16_t result = m_V[reg1] + m_V[reg2];
-        m_V[0xf] = (result > 0xff) ? 1 : 0;
-        m_V[reg1] = result & 0xff;
-      } break;
-      case 0x5: {
-        // 8xy5 SUB Vx, Vy
-        // Set Vx = Vx - Vy, set VF = NOT borrow
-        // If Vx > Vy, VF is set to 1.
-        uint8_t vx = m_V[reg1];
-        uint8_t vy = m_V[reg2];
-        uint8_t result = vx - vy;
-        m_V[0xf] = (vx > vy) ? 1 : 0;
-        m_V[reg1] = result;
-      } break;
-      case 0x6: {
-        // 8xy6 SHR Vx {, Vy}
-        // Set Vx = Vx SHR 1
-        // If the least significant bit of Vx is 1, set VF to 1.
-        // Divide Vx by 2.
-        m_V[0xf] = m_V[reg1] & 0x1;
-        m_V[reg1] = m_V[reg1] >> 1;
-      } break;
-      case 0x7: {
-        // 8xy7 SUBN Vx, Vy
-        // Set Vx = Vy - Vx, set VF = NOT borrow
-        // If Vy > Vx, set VF 1.
-        uint8_t vx = m_V[reg1];
-        uint8_t vy = m_V[reg2];
-        uint8_t result = vy - vx;
-        m_V[0xf] = (vx < vy) ? 1 : 0;
-        m_V[reg1] = result;
-      } break;
-      case 0xe: {
-        // 8xyE SHL Vx {, Vy}
-        // Set Vx = Vx SHL 1
-        // If the most significant bit of Vx is 1, set VF to 1.
-        // Multiply Vx by 2;
-        m_V[0xf] = (m_V[reg1] & 0x8) >> 7;
-        m_V[reg1] = m_V[reg1] << 1;
-      } break;
-      }
-      m_PC += 2;
-    } break;
-    case 0x09: {
-      // 9xy0 SNE Vx, Vy
-      // Skip next instruction if Vx != Vy
-      uint8_t reg1 = firstbyte & 0xf;
-      uint8_t reg2 = (lastbyte & 0xf0) >> 4;
-      if (m_V[reg1] != m_V[reg2])
-        m_PC += 2;
-      m_PC += 2;
+  /* Writes the executed instructions, the most executed first, with their
+   * source lines if there is debug info
+   */
+  void write_profile(const char *filename) {
+    const std::vector<uint32_t> &counts = m_vm.profile();
+    std::vector<uint16_t> addresses;
+    for (size_t address = 0; address < counts.size(); address++) {
+      if (counts[address])
+        addresses.push_back(address);
     }
-    case 0x0a: {
-      // Annn LD I, addr
-      // The value of the register I is set to nnn.
-      m_I = ((firstbyte & 0xf) << 8) | lastbyte;
-      m_PC += 2;
-    } break;
-    case 0x0b: {
-      // Bnnn JP V0, addr
-      // Jump to location nnn + V0
-      uint16_t num = ((firstbyte & 0xf) << 8) | lastbyte;
-      m_PC = m_V[0] + num;
-    } break;
-    case 0x0c: {
-      // Cxkk RND Vx, byte
-      // Set Vx = random byte AND kk
-      uint8_t reg = firstbyte & 0xf;
-      uint8_t num = lastbyte;
-      m_V[reg] = (rand() % 256) & num;
-      m_PC += 2;
-    } break;
-    case 0x0d: {
-      // Dxyn DRW Vx, Vy, nibble
-      //   Display n-byte sprite starting at memory location I at (Vx, Vy),
-      //   set VF = collision.
-
-      //   The interpreter reads n bytes from memory, starting at the address
-      //   stored in I. These bytes are then displayed as sprites on screen at
-      //   coordinates (Vx, Vy). Sprites are XORed onto the existing screen.
-      //   If this causes any pixels to be erased, VF is set to 1, otherwise
-      //   it is set to 0. If the sprite is positioned so part of it is
-      //   outside the coordinates of the display, it wraps around to the
-      //   opposite side of the screen. See instruction 8xy3 for more
-      //   information on XOR, and section 2.4, Display, for more information
-      //   on the Chip-8 screen and sprites.
-      uint8_t x_reg = firstbyte & 0x0f;
-      uint8_t y_reg = (lastbyte >> 4) & 0x0f;
-      uint8_t n = lastbyte & 0x0f;
-
-      uint8_t x = m_V[x_reg];
-      uint8_t y = m_V[y_reg];
-
-      int bit_position = y * SCREEN_WIDTH + x;
-      int bit_offset = bit_position % 8;
-      int byte_position = (bit_position - bit_offset) / 8;
-      int overflow_bit_position = y * SCREEN_WIDTH + x + 8;
-      int overflow_bit_offset = overflow_bit_position % 8;
-      int overflow_byte_position =
-          (overflow_bit_position - overflow_bit_offset) / 8;
-
-      bool erased = false;
-      for (auto i = 0; i < n; i++) {
-
-        int screen_byte_position = byte_position + i * SCREEN_WIDTH / 8;
-        uint8_t screen_byte = m_screen[screen_byte_position];
-        if ((screen_byte >> bit_offset) > 0) erased = true;
-
-        uint8_t byte = m_memory[m_I + i];
-        m_screen[screen_byte_position] ^= (byte >> bit_offset);
-
-        if (overflow_bit_offset > 0) {
-          m_screen[overflow_byte_position + i * SCREEN_WIDTH / 8] ^=
-              (byte << (8 - overflow_bit_offset));
-        }
+    std::stable_sort(addresses.begin(), addresses.end(),
+                     [&](uint16_t a, uint16_t b) {
+                       return counts[a] > counts[b];
+                     });
+
+    std::ofstream out(filename, std::ios::out);
+    if (!out.is_open()) {
+      std::cout << "Couldn't open " << filename << std::endl;
+      return;
+    }
+    const uint8_t *memory = m_vm.memory();
+    for (uint16_t address : addresses) {
+      char line[64];
+      snprintf(line, sizeof(line), "%10u %03x %-16s ", counts[address],
+               address,
+               disassemble(memory[address], memory[address + 1]).c_str());
+      out << line << m_debug_info.describe(address) << '\n';
+    }
+  }
 
-        if (i == n) {
-          m_screen[byte_position + i + 1] ^= (byte << (8 - bit_offset));
-        }
-      }
+  /* Shows where the debugger stopped */
+  void print_location() {
+    uint16_t PC = m_vm.PC();
+    char address[8];
+    snprintf(address, sizeof(address), "%03x ", PC);
+    std::cout << address
+              << disassemble(m_vm.memory()[PC], m_vm.memory()[PC + 1]);
+    std::string source = m_debug_info.describe(PC);
+    if (!source.empty())
+      std::cout << "  ; " << source;
+    std::cout << std::endl;
+  }
 
-      m_V[0xf] = erased ? 1 : 0;
-
-      m_PC += 2;
-    } break;
-    case 0x0e: {
-      int reg = firstbyte & 0xf;
-      switch (lastbyte) {
-      case 0x9e: {
-        // Ex9E SKP Vx
-        // Skip next instruction if key stored in Vx is pressed
-        uint8_t key = m_V[reg];
-        // Add 2 to program counter to skip next instruction
-        if (m_keyboard.isPressed(key))
-          m_PC += 2;
-        m_PC += 2;
-      } break;
-      case 0xa1: {
-        // ExA1 SKNP Vx
-        // Skip next instruction if key stored in Vx is not pressed
-        uint8_t key = m_V[reg];
-        // Add 2 to program counter to skip next instruction
-        if (!m_keyboard.isPressed(key))
-          m_PC += 2;
-        m_PC += 2;
-      } break;
-      }
-    } break;
-    case 0x0f: {
-      int reg = firstbyte & 0x0f;
-      switch (lastbyte) {
-      case 0x07: {
-        // Fx07 LD Vx, DT
-        // Set Vx = the delay timer
-        m_V[reg] = m_delay.value();
-        // m_PC += 2;
-      } break;
-      case 0x0A: {
-        // Fx0A LD Vx, K
-        // Wait for key press, store value of the key in Vx
-        // m_V[reg] = m_keyboard.waitKeyPress();
-        if (!m_keyboard.anyKeyDownEvents()) {
-          m_PC -= 2;
-        } else {
-          uint8_t key = m_keyboard.lastPressed();
-          m_V[reg] = key;
-        }
-      } break;
-      case 0x15: {
-        // Fx15 LD DT, Vx
-        // Set delay timer = Vx
-        m_delay.setValue(m_V[reg]);
-      } break;
-      case 0x18: {
-        // Fx18 LD ST, Vx
-        // Set sound timer = Vx
-        m_sound = m_V[reg];
-      } break;
-      case 0x1e: {
-        // Fx1E ADD I, Vx
-        // Set I = I + Vx
-        m_I = m_V[reg] + m_I;
-      } break;
-      case 0x29: {
-        // Fx29 - LD F, Vx
-        // Set I to location of the sprite for digit stored in Vx
-        m_I = 5 * m_V[reg];
-      } break;
-      case 0x33: {
-        // Fx33 - LD B, Vx
-        // Store Binary Coded Decimal representation of Vx in memory
-        // locations I, I+1 and I+2.
-        uint8_t ones, tens, hundreds;
-        uint8_t value = m_V[reg];
-        ones = value % 10;
-        value /= 10;
-        tens = value % 10;
-        hundreds = value / 10;
-        m_memory[m_I] = hundreds;
-        m_memory[m_I + 1] = tens;
-        m_memory[m_I + 2] = ones;
-      } break;
-      case 0x55: {
-        // Fx55 - LD [I], Vx
-        // Store registers V0 to Vx in memory starting at location I.
-        for (auto i = 0; i <= reg; i++)
-          m_memory[m_I + i] = m_V[i];
-      } break;
-      case 0x65: {
-        // Fx65 - LD Vx, [I]
-        // Read registers V0 to Vx from memory starting at location I.
-        for (auto i = 0; i <= reg; i++)
-          m_V[i] = m_memory[m_I + i];
-      } break;
-      }
-      m_PC += 2;
-    } break;
+  void print_debug() {
+
+    json debug = {{"I", static_cast<int>(m_vm.I())},
+                  {"PC", static_cast<int>(m_vm.PC())},
+                  {"SP", static_cast<int>(m_vm.SP())}};
+
+    for (auto i = 0; i < 16; i++) {
+      debug.emplace("V" + int_to_hex(i), static_cast<int>(m_vm.V(i)));
     }
 
-    if (m_step_mode)
-      m_step = false;
+    std::string source = m_debug_info.describe(m_vm.PC());
+    if (!source.empty())
+      debug.emplace("source", source);
 
-    m_delay.update(m_clock_speed);
-    m_sound.update(m_clock_speed);
+    std::cout << debug << std::endl;
   }
 
 private:
-  uint8_t m_V[16]; // Registers 0-F
-  uint16_t m_I;    // Index register
-  uint16_t m_SP;   // Stack pointer
-  uint16_t m_PC;   // Program counter
-  Timer m_delay;   // Delay timer
-  Timer m_sound;   // Sound timer
-  uint8_t *m_memory;
-  uint8_t *m_screen; // Same as memory[0xF00]
-
-  uint16_t m_clock_speed;
-  bool m_step_mode;
-  bool m_step;
-
-  bool m_ready = false;
-  bool m_quitting = false;
-
+  Chip8 m_vm;
+  DebugInfo m_debug_info;
+  // The watched source and the program last written to memory
+  std::string m_source;
+  std::filesystem::file_time_type m_source_time;
+  IncrementalAssembler m_assembler;
+  std::vector<uint8_t> m_loaded;
   Display m_display;
   Keyboard m_keyboard;
 };
 
 int main(int argc, char **argv) {
-  Chip8 vm;
-  vm.init();
-  vm.load_rom(argv[1]);
-  vm.run();
+  const char *profile = nullptr;
+  const char *rom = nullptr;
+  int scale = 1;
+  int persistence = 0;
+  bool watch = false;
+  for (auto i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-w")
+      watch = true;
+    else if (arg == "-p" && i + 1 < argc)
+      profile = argv[++i];
+    else if (arg == "-s" && i + 1 < argc)
+      scale = std::atoi(argv[++i]);
+    else if (arg == "-f" && i + 1 < argc)
+      persistence = std::atoi(argv[++i]) * 256 / 100;
+    else
+      rom = argv[i];
+  }
+  if (!rom) {
+    std::cout << "Usage: emulator [-p modern|vip|chip48|schip] [-s 1|2|3] "
+                 "[-f percent] rom\n"
+                 "       emulator [-p profile] [-s 1|2|3] [-f percent] -w "
+                 "source.asm"
+              << std::endl;
+    return 1;
+  }
+
+  Emulator emulator;
+  emulator.init(scale, persistence);
+  if (watch)
+    emulator.load_source(rom, profile);
+  else
+    emulator.load_rom(rom, profile);
+  emulator.run();
 
   return 0;
 }
@@ -12,35 +12,58 @@ public:
   bool isPressed(const uint8_t &key) const { return m_pressed.count(key) == 1; }
   uint8_t lastPressed() const {return *m_pressed.rbegin();}
 
+  /* Handles every pending event, once per frame. keyDown only holds the
+     keys that went down during this poll */
   void pollEvents() {
-    // m_pressed.clear();
-    for (auto key : m_pressed) 
-      m_keyDown.erase(key);
+    m_keyDown.clear();
 
     SDL_Event event;
-    SDL_PollEvent(&event);
-    if (event.type == SDL_KEYDOWN) {
-      uint8_t keysym = event.key.keysym.sym;
-      uint8_t key = Keyboard::keySymToChip8Key(keysym);
-      if (m_pressed.count(key) == 0) {
-        m_pressed.insert(key);
-        m_keyDown.insert(key);
-      }
+    while (SDL_PollEvent(&event)) {
+      if (event.type == SDL_KEYDOWN) {
+        uint8_t keysym = event.key.keysym.sym;
+        uint8_t key = Keyboard::keySymToChip8Key(keysym);
+        if (m_pressed.count(key) == 0) {
+          m_pressed.insert(key);
+          m_keyDown.insert(key);
+          m_keyDownTime = event.key.timestamp;
+        }
 
-    } else if (event.type == SDL_KEYUP) {
-      uint8_t keysym = event.key.keysym.sym;
-      m_pressed.erase(Keyboard::keySymToChip8Key(keysym));
+      } else if (event.type == SDL_KEYUP) {
+        uint8_t keysym = event.key.keysym.sym;
+        m_pressed.erase(Keyboard::keySymToChip8Key(keysym));
+      } else if (event.type == SDL_QUIT) {
+        m_quit = true;
+      }
     }
   }
 
+  bool quitRequested() const { return m_quit; }
+  /* SDL_GetTicks() time of the last key press */
+  uint32_t keyDownTime() const { return m_keyDownTime; }
+
 
   bool keyDownEvent(const uint8_t &key) const { return m_keyDown.count(key) == 1; }
   bool anyKeyDownEvents() const {return m_keyDown.size() > 0;}
 
+  /* Pressed and pressed down Chip-8 keys as bitmasks, one bit per key */
+  uint16_t pressedMask() const { return toMask(m_pressed); }
+  uint16_t keyDownMask() const { return toMask(m_keyDown); }
+
 
 private:
   std::set<uint8_t> m_pressed;
   std::set<uint8_t> m_keyDown;
+  uint32_t m_keyDownTime = 0;
+  bool m_quit = false;
+
+  static uint16_t toMask(const std::set<uint8_t> &keys) {
+    uint16_t mask = 0;
+    for (auto key : keys) {
+      if (key < 16)
+        mask |= 1 << key;
+    }
+    return mask;
+  }
 
   static uint8_t keySymToChip8Key(uint8_t sym) {
     switch(sym) {
@@ -0,0 +1,112 @@
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <SDL.h>
+
+#include "../libchip8/stream.h"
+
+/* chip8-view shows the screens of machines streaming their frames, such as
+ * chip8-run -S, side by side in one window. Streams that aren't there yet
+ * or go away are tried again every second.
+ */
+
+const int SCALE = 4;  // Window pixels per Chip-8 pixel
+const int BORDER = 1; // Chip-8 pixels between the screens
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::cout << "Usage: chip8-view socket..." << std::endl;
+    return 1;
+  }
+
+  std::vector<std::unique_ptr<FrameViewer>> viewers;
+  for (auto i = 1; i < argc; i++)
+    viewers.push_back(std::make_unique<FrameViewer>(argv[i]));
+
+  int columns = 1;
+  while (columns * columns < (int)viewers.size())
+    columns++;
+  int rows = (viewers.size() + columns - 1) / columns;
+  int cell_width = SCREEN_WIDTH + BORDER;
+  int cell_height = SCREEN_HEIGHT + BORDER;
+  int width = columns * cell_width - BORDER;
+  int height = rows * cell_height - BORDER;
+
+  if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+    SDL_Log("Failed to initialize SDL: %s", SDL_GetError());
+    return 1;
+  }
+  SDL_Window *window = nullptr;
+  SDL_Renderer *renderer = nullptr;
+  SDL_CreateWindowAndRenderer(width * SCALE, height * SCALE, 0, &window,
+                              &renderer);
+  if (window == nullptr) {
+    SDL_Log("Failed to create a window: %s", SDL_GetError());
+    SDL_Quit();
+    return 1;
+  }
+  SDL_SetWindowTitle(window, "chip8-view");
+  SDL_RenderSetLogicalSize(renderer, width, height);
+
+  uint32_t last_connect = 0;
+  bool quitting = false;
+  bool redraw = true;
+  while (!quitting) {
+    SDL_Event event;
+    while (SDL_PollEvent(&event)) {
+      if (event.type == SDL_QUIT)
+        quitting = true;
+    }
+
+    bool connect = SDL_GetTicks() - last_connect >= 1000;
+    if (connect)
+      last_connect = SDL_GetTicks();
+    for (auto &viewer : viewers) {
+      bool connected = viewer->connected();
+      if (!connected && connect)
+        viewer->connect();
+      redraw |= viewer->poll();
+      // Streams that ended go dark grey right away
+      redraw |= viewer->connected() != connected;
+    }
+
+    if (redraw) {
+      SDL_SetRenderDrawColor(renderer, 64, 64, 64, 255);
+      SDL_RenderClear(renderer);
+      for (size_t i = 0; i < viewers.size(); i++) {
+        int left = (i % columns) * cell_width;
+        int top = (i / columns) * cell_height;
+        const FrameViewer &viewer = *viewers[i];
+
+        // Disconnected screens stay dark grey, beeping ones get a red
+        // background
+        if (!viewer.connected())
+          continue;
+        SDL_Rect cell{left, top, SCREEN_WIDTH, SCREEN_HEIGHT};
+        SDL_SetRenderDrawColor(renderer, viewer.beeping() ? 96 : 0, 0, 0, 255);
+        SDL_RenderFillRect(renderer, &cell);
+
+        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+        for (auto byte = 0; byte < SCREEN_BYTES; byte++) {
+          for (auto bit = 0; bit < 8; bit++) {
+            if (viewer.screen()[byte] & (0x80 >> bit)) {
+              int pixel = byte * 8 + bit;
+              SDL_RenderDrawPoint(renderer, left + pixel % SCREEN_WIDTH,
+                                  top + pixel / SCREEN_WIDTH);
+            }
+          }
+        }
+      }
+      SDL_RenderPresent(renderer);
+      redraw = false;
+    }
+
+    SDL_Delay(1000 / FRAME_RATE);
+  }
+
+  SDL_DestroyRenderer(renderer);
+  SDL_DestroyWindow(window);
+  SDL_Quit();
+  return 0;
+}
@@ -0,0 +1,191 @@
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <type_traits>
+#include <unistd.h>
+
+#include "cache.h"
+
+namespace {
+
+const char MAGIC[4] = {'C', '8', 'T', 'C'};
+
+/* An entry is the header, the ROM padded to 4 bytes, the blocks and the
+ * instructions
+ */
+struct Header {
+  char magic[4];
+  uint32_t version;
+  uint32_t config;
+  uint32_t rom_size;
+  uint64_t rom_hash;
+  uint32_t block_count;
+  uint32_t instruction_count;
+  uint64_t checksum; // Of everything after the header
+};
+
+static_assert(std::is_trivially_copyable<Decoded>::value &&
+                  sizeof(Decoded) == 8,
+              "Decoded is written to the cache as it is");
+
+// FNV-1a
+uint64_t hash(const void *data, size_t size, uint64_t hash = 0xcbf29ce484222325) {
+  auto bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
+size_t padded(size_t size) { return (size + 3) & ~size_t(3); }
+
+} // namespace
+
+uint64_t rom_hash(const uint8_t *rom, size_t size) { return hash(rom, size); }
+
+TranslationCache::TranslationCache(const std::string &directory)
+    : m_directory(directory) {}
+
+TranslationCache::~TranslationCache() { close(); }
+
+std::string TranslationCache::path(uint64_t rom_hash, uint32_t config) const {
+  char name[64];
+  snprintf(name, sizeof(name), "%016llx-%u-%x.c8tc",
+           static_cast<unsigned long long>(rom_hash), TRANSLATION_VERSION,
+           config);
+  return m_directory + "/" + name;
+}
+
+void TranslationCache::close() {
+  if (m_map)
+    munmap(m_map, m_map_size);
+  m_map = nullptr;
+  m_map_size = 0;
+  m_blocks = nullptr;
+  m_block_count = 0;
+  m_instructions = nullptr;
+}
+
+bool TranslationCache::open(const uint8_t *rom, size_t size, uint32_t config) {
+  // Machines loading the same ROM over and over keep the entry mapped
+  uint64_t rom_hash = ::rom_hash(rom, size);
+  if (m_blocks) {
+    Header header;
+    memcpy(&header, m_map, sizeof(header));
+    if (header.config == config && header.rom_hash == rom_hash &&
+        header.rom_size == size &&
+        memcmp(static_cast<const uint8_t *>(m_map) + sizeof(Header), rom,
+               size) == 0)
+      return true;
+  }
+  close();
+
+  std::string filename = path(rom_hash, config);
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(Header))
+    map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED)
+    return false;
+
+  m_map = map;
+  m_map_size = st.st_size;
+
+  // Everything is checked before it is used, a file that doesn't add up
+  // was damaged and is translated again
+  auto base = static_cast<const uint8_t *>(map);
+  Header header;
+  memcpy(&header, base, sizeof(header));
+  size_t blocks_offset = sizeof(Header) + padded(header.rom_size);
+  size_t instructions_offset =
+      blocks_offset + header.block_count * sizeof(CachedBlock);
+  size_t total =
+      instructions_offset + header.instruction_count * sizeof(Decoded);
+
+  bool valid =
+      memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+      header.version == TRANSLATION_VERSION && header.config == config &&
+      header.rom_size == size && header.rom_hash == rom_hash &&
+      total == m_map_size &&
+      hash(base + sizeof(Header), total - sizeof(Header)) == header.checksum &&
+      memcmp(base + sizeof(Header), rom, size) == 0;
+
+  if (valid) {
+    m_blocks = reinterpret_cast<const CachedBlock *>(base + blocks_offset);
+    m_block_count = header.block_count;
+    m_instructions =
+        reinterpret_cast<const Decoded *>(base + instructions_offset);
+
+    size_t end = 0x200 + size;
+    for (size_t i = 0; i < m_block_count && valid; i++) {
+      const CachedBlock &block = m_blocks[i];
+      valid = block.start >= 0x200 && block.start < block.end &&
+              block.end <= end && block.count > 0 &&
+              block.first + block.count <= header.instruction_count &&
+              block.end - block.start == static_cast<int>(block.count * 2);
+    }
+    for (size_t i = 0; i < header.instruction_count && valid; i++)
+      valid = static_cast<int>(m_instructions[i].op) < OP_COUNT;
+  }
+
+  if (!valid) {
+    close();
+    unlink(filename.c_str());
+  }
+  return valid;
+}
+
+void TranslationCache::store(const uint8_t *rom, size_t size, uint32_t config,
+                             const std::vector<CachedBlock> &blocks,
+                             const std::vector<Decoded> &instructions) {
+  std::string payload(padded(size), '\0');
+  memcpy(&payload[0], rom, size);
+  payload.append(reinterpret_cast<const char *>(blocks.data()),
+                 blocks.size() * sizeof(CachedBlock));
+  payload.append(reinterpret_cast<const char *>(instructions.data()),
+                 instructions.size() * sizeof(Decoded));
+
+  Header header;
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = TRANSLATION_VERSION;
+  header.config = config;
+  header.rom_size = size;
+  header.rom_hash = rom_hash(rom, size);
+  header.block_count = blocks.size();
+  header.instruction_count = instructions.size();
+  header.checksum = hash(payload.data(), payload.size());
+
+  std::error_code error;
+  std::filesystem::create_directories(m_directory, error);
+
+  // Written under a temporary name and renamed, so that other processes
+  // and threads never see a partial entry
+  std::string filename = path(header.rom_hash, config);
+  std::string temporary =
+      filename + "." + std::to_string(getpid()) + "." +
+      std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+  {
+    std::ofstream out(temporary, std::ios::out | std::ios::binary);
+    if (!out.is_open())
+      return;
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(payload.data(), payload.size());
+    if (!out.good()) {
+      out.close();
+      unlink(temporary.c_str());
+      return;
+    }
+  }
+  if (rename(temporary.c_str(), filename.c_str()) != 0)
+    unlink(temporary.c_str());
+}
@@ -0,0 +1,73 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "decode.h"
+
+// Bump whenever decoding or block translation changes, so that entries
+// written by older versions are ignored
+const uint32_t TRANSLATION_VERSION = 2;
+
+/* Hash of a ROM image, naming its cache entries and identifying it in
+ * profile databases
+ */
+uint64_t rom_hash(const uint8_t *rom, size_t size);
+
+/* A translated block in a cache entry, its instructions are
+ * instructions()[first] to instructions()[first + count - 1]
+ */
+struct CachedBlock {
+  uint16_t start;
+  uint16_t end;
+  uint32_t first;
+  uint32_t count;
+};
+
+/* TranslationCache keeps the translated blocks of ROMs in files named
+ * after a hash of the ROM, the translation version and the configuration
+ * of the machine. An entry is mapped into memory when opened and checked
+ * against the ROM before it is used.
+ */
+class TranslationCache {
+public:
+  explicit TranslationCache(const std::string &directory);
+  ~TranslationCache();
+
+  TranslationCache(const TranslationCache &) = delete;
+  TranslationCache &operator=(const TranslationCache &) = delete;
+
+  /* Maps the entry for rom. Returns false when there is no entry or it is
+   * stale or damaged; damaged entries are removed. The entry stays mapped
+   * until the next open() of another ROM or the destruction of the cache.
+   * A cache is used by one thread at a time.
+   */
+  bool open(const uint8_t *rom, size_t size, uint32_t config);
+
+  const CachedBlock *blocks() const { return m_blocks; }
+  size_t block_count() const { return m_block_count; }
+  const Decoded *instructions() const { return m_instructions; }
+
+  /* Writes the entry for rom. Errors are ignored, the next run translates
+   * the ROM again.
+   */
+  void store(const uint8_t *rom, size_t size, uint32_t config,
+             const std::vector<CachedBlock> &blocks,
+             const std::vector<Decoded> &instructions);
+
+private:
+  void close();
+  std::string path(uint64_t hash, uint32_t config) const;
+
+  std::string m_directory;
+  void *m_map = nullptr;
+  size_t m_map_size = 0;
+  const CachedBlock *m_blocks = nullptr;
+  size_t m_block_count = 0;
+  const Decoded *m_instructions = nullptr;
+};
+
+#endif
@@ -0,0 +1,978 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string.h>
+#include <vector>
+
+#include "../disassembler/flow.h"
+#include "chip8.h"
+#include "state.h"
+#include "timeline.h"
+
+Chip8::Chip8()
+    : m_delay(60), m_sound(60), m_clock_speed(CLOCK_SPEED_HZ),
+      m_step_mode(false), m_step(false) {
+  m_memory = new unsigned char[MEMORY_SIZE];
+  m_screen = &m_memory[SCREEN_START];
+  m_blocks.resize(MEMORY_SIZE);
+  m_block_coverage.resize(MEMORY_SIZE);
+  reset();
+}
+
+void Chip8::reset() {
+  for (auto i = 0; i < 16; i++) {
+    m_V[i] = 0;
+  }
+  for (auto i = 0; i < FLAG_REGISTERS; i++) {
+    m_flags[i] = 0;
+  }
+  m_I = 0x00;
+  m_SP = STACK_TOP;
+  m_PC = PROGRAM_START;
+  m_delay = Timer(60);
+  m_sound = Timer(60);
+  m_keys = 0;
+  m_key_down = 0;
+  m_step_mode = false;
+  m_step = false;
+  m_ready = false;
+  m_quitting = false;
+  m_random.seed(1);
+  m_instructions = 0;
+  m_stop = Stop::None;
+  m_resuming = false;
+  m_trace_next = 0;
+  m_trace_count = 0;
+  std::fill(m_profile.begin(), m_profile.end(), 0);
+  m_faults = FAULT_NONE;
+  m_fault_PC = 0;
+
+  const unsigned char fontset[] = {
+      0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+      0x20, 0x60, 0x20, 0x20, 0x70, // 1
+      0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+      0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+      0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+      0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+      0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+      0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+      0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+      0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+      0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+      0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+      0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+      0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+      0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+      0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+  };
+
+  const unsigned char big_fontset[] = {
+      0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+      0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+      0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+      0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+      0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+      0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+      0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+      0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+      0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+      0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+      0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+      0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+      0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+      0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+      0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+      0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+  };
+
+  for (auto i = 0; i < MEMORY_SIZE; i++) {
+    m_memory[i] = 0;
+  }
+
+  for (auto i = 0; i < 80; i++) {
+    m_memory[i] = fontset[i];
+  }
+
+  for (auto i = 0; i < 160; i++) {
+    m_memory[BIG_FONT_START + i] = big_fontset[i];
+  }
+
+  if (m_code_low < m_code_high)
+    invalidate(m_code_low, m_code_high);
+  m_code_low = MEMORY_SIZE;
+  m_code_high = 0;
+  m_dirty_pages = ~0u;
+}
+
+Chip8::~Chip8() { delete[] m_memory; }
+
+void Chip8::load_rom(const char *filename, TranslationCache *cache) {
+  std::ifstream rom(filename,
+                    std::ios::in | std::ios::binary | std::ios::ate);
+
+  if (!rom.is_open()) {
+    std::cout << "Couldn't open file!" << std::endl;
+    m_ready = false;
+    return;
+  }
+
+  std::vector<uint8_t> buffer(rom.tellg());
+
+  rom.seekg(0, std::ios::beg);
+  rom.read((char *)buffer.data(), buffer.size());
+  rom.close();
+
+  load_rom(buffer.data(), buffer.size(), cache);
+}
+
+void Chip8::load_rom(const uint8_t *rom, size_t size,
+                     TranslationCache *cache) {
+  TimelineSpan span("load ROM");
+  // Load rom to memory at 0x200
+  size = std::min(size, static_cast<size_t>(MEMORY_SIZE - PROGRAM_START));
+  std::copy(rom, rom + size, m_memory + PROGRAM_START);
+  invalidate(PROGRAM_START, MEMORY_SIZE);
+  m_dirty_pages = ~0u;
+
+  if (!cache || !load_blocks(*cache, rom, size)) {
+    // Translate every block reachable from the entry point up front
+    int end = PROGRAM_START + size;
+    ControlFlow flow = analyze(m_memory, PROGRAM_START, end, PROGRAM_START);
+    for (auto const &block : flow.blocks) {
+      if (m_blocks[block.start].end == 0)
+        translate(block.start, block.end);
+    }
+
+    if (cache)
+      store_blocks(*cache, rom, size);
+  }
+
+  m_ready = true;
+}
+
+bool Chip8::load_blocks(TranslationCache &cache, const uint8_t *rom,
+                        size_t size) {
+  TimelineSpan span("read translation cache");
+  if (!cache.open(rom, size, 0))
+    return false;
+
+  for (size_t i = 0; i < cache.block_count(); i++) {
+    const CachedBlock &cached = cache.blocks()[i];
+    Block &block = m_blocks[cached.start];
+    const Decoded *first = cache.instructions() + cached.first;
+    block.instructions.assign(first, first + cached.count);
+    add_block(block, cached.start, cached.end);
+  }
+  return true;
+}
+
+void Chip8::store_blocks(TranslationCache &cache, const uint8_t *rom,
+                         size_t size) {
+  TimelineSpan span("write translation cache");
+  std::vector<CachedBlock> blocks;
+  std::vector<Decoded> instructions;
+  for (int start = PROGRAM_START; start < PROGRAM_START + (int)size; start++) {
+    const Block &block = m_blocks[start];
+    if (block.end == 0)
+      continue;
+    blocks.push_back({static_cast<uint16_t>(start), block.end,
+                      static_cast<uint32_t>(instructions.size()),
+                      static_cast<uint32_t>(block.instructions.size())});
+    instructions.insert(instructions.end(), block.instructions.begin(),
+                        block.instructions.end());
+  }
+  cache.store(rom, size, 0, blocks, instructions);
+}
+
+Registers Chip8::registers() const {
+  Registers registers;
+  for (auto i = 0; i < 16; i++) {
+    registers.V[i] = m_V[i];
+  }
+  registers.I = m_I;
+  registers.SP = m_SP;
+  registers.PC = m_PC;
+  registers.delay = m_delay.value();
+  registers.sound = m_sound.value();
+  return registers;
+}
+
+void Chip8::set_registers(const Registers &registers) {
+  for (auto i = 0; i < 16; i++) {
+    m_V[i] = registers.V[i];
+  }
+  m_I = registers.I;
+  m_SP = registers.SP;
+  m_PC = registers.PC & 0xFFF;
+  m_delay.setValue(registers.delay);
+  m_sound.setValue(registers.sound);
+}
+
+void Chip8::save(MachineState &state) {
+  // Pages are shared with the mirror when they are still the same, which
+  // needs both states to be in the same pool
+  bool share = m_mirror && m_mirror->m_pool == state.m_pool;
+  for (auto i = 0; i < PAGE_COUNT; i++) {
+    Page *page;
+    if (share && !(m_dirty_pages >> i & 1) && m_mirror->m_pages[i]) {
+      page = m_mirror->m_pages[i];
+      state.m_pool->retain(page);
+    } else {
+      page = state.m_pool->allocate();
+      memcpy(page->bytes, m_memory + i * PAGE_SIZE, PAGE_SIZE);
+      page->hash = page_hash(page->bytes, i);
+    }
+    state.set_page(i, page);
+  }
+
+  state.m_registers = registers();
+  state.m_delay = m_delay;
+  state.m_sound = m_sound;
+  std::copy(m_flags, m_flags + FLAG_REGISTERS, state.m_flags);
+  state.m_keys = m_keys;
+  state.m_key_down = m_key_down;
+  state.m_random = m_random;
+  state.m_instructions = m_instructions;
+  state.m_quitting = m_quitting;
+  state.m_faults = m_faults;
+  state.m_fault_PC = m_fault_PC;
+
+  mirror(state);
+}
+
+void Chip8::restore(const MachineState &state) {
+  if (state.empty())
+    return;
+
+  for (auto i = 0; i < PAGE_COUNT; i++) {
+    if (m_mirror && !(m_dirty_pages >> i & 1) &&
+        m_mirror->m_pages[i] == state.m_pages[i])
+      continue;
+
+    memcpy(m_memory + i * PAGE_SIZE, state.m_pages[i]->bytes, PAGE_SIZE);
+    // Only the first 4K are addressable, the rest is padding
+    if (i * PAGE_SIZE < 0x1000)
+      written(i * PAGE_SIZE, PAGE_SIZE);
+  }
+
+  set_registers(state.m_registers);
+  m_delay = state.m_delay;
+  m_sound = state.m_sound;
+  std::copy(state.m_flags, state.m_flags + FLAG_REGISTERS, m_flags);
+  m_keys = state.m_keys;
+  m_key_down = state.m_key_down;
+  m_random = state.m_random;
+  m_instructions = state.m_instructions;
+  m_quitting = state.m_quitting;
+  m_faults = state.m_faults;
+  m_fault_PC = state.m_fault_PC;
+  m_stop = Stop::None;
+  m_ready = true;
+
+  mirror(state);
+}
+
+void Chip8::mirror(const MachineState &state) {
+  if (m_mirror)
+    *m_mirror = state;
+  else
+    m_mirror = std::make_unique<MachineState>(state);
+  m_dirty_pages = 0;
+}
+
+uint64_t Chip8::screen_hash() const {
+  uint64_t hash = 0x9E3779B97F4A7C15;
+  for (auto i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT / 8; i += 8) {
+    uint64_t word = 0;
+    for (auto j = 0; j < 8; j++)
+      word |= static_cast<uint64_t>(m_screen[i + j]) << (j * 8);
+    hash = (hash ^ word) * 0xFF51AFD7ED558CCD;
+    hash ^= hash >> 32;
+  }
+  return hash;
+}
+
+void Chip8::set_keys(uint16_t pressed, uint16_t down) {
+  m_keys = pressed;
+  m_key_down = down;
+}
+
+using AllFeatures = std::make_integer_sequence<unsigned, FEATURE_ALL + 1>;
+
+const Chip8::Engines Chip8::engines[PROFILE_COUNT] = {
+    engines_for<Profile::Modern>(AllFeatures()),
+    engines_for<Profile::CosmacVip>(AllFeatures()),
+    engines_for<Profile::Chip48>(AllFeatures()),
+    engines_for<Profile::SuperChip>(AllFeatures())};
+
+void Chip8::set_quirk_profile(Profile profile) {
+  m_quirk_profile = profile;
+  m_engine = &engines[static_cast<int>(m_quirk_profile)][m_features];
+}
+
+void Chip8::set_features(unsigned features) {
+  m_features = features & FEATURE_ALL;
+  m_engine = &engines[static_cast<int>(m_quirk_profile)][m_features];
+
+  if ((m_features & FEATURE_TRACE) && m_trace.empty())
+    m_trace.resize(TRACE_LENGTH);
+  if ((m_features & FEATURE_PROFILE) && m_profile.empty())
+    m_profile.resize(0x1000);
+}
+
+void Chip8::set_coverage(uint8_t *bitmap) {
+  m_coverage = bitmap;
+  if (bitmap)
+    set_features(m_features | FEATURE_PROFILE);
+}
+
+void Chip8::toggle_step_mode() {
+  m_step_mode = !m_step_mode;
+  if (m_step_mode)
+    set_features(m_features | FEATURE_DEBUG);
+}
+
+void Chip8::set_breakpoint(uint16_t address, bool enabled) {
+  m_breakpoints[address & 0xFFF] = enabled;
+  set_features(m_features | FEATURE_DEBUG);
+}
+
+void Chip8::set_watchpoint(uint16_t address, bool enabled) {
+  m_watchpoints[address & 0xFFF] = enabled;
+  m_watching = m_watchpoints.any();
+  set_features(m_features | FEATURE_DEBUG);
+}
+
+void Chip8::watch_registers(uint32_t mask) {
+  m_watched_registers = mask;
+  if (mask)
+    set_features(m_features | FEATURE_DEBUG);
+}
+
+void Chip8::resume() {
+  m_resuming = m_stop == Stop::Breakpoint;
+  m_stop = Stop::None;
+}
+
+std::vector<TraceEntry> Chip8::trace() const {
+  std::vector<TraceEntry> trace;
+  size_t first = (m_trace_next + TRACE_LENGTH - m_trace_count) % TRACE_LENGTH;
+  for (size_t i = 0; i < m_trace_count; i++)
+    trace.push_back(m_trace[(first + i) % TRACE_LENGTH]);
+  return trace;
+}
+
+bool Chip8::break_before() {
+  if (m_stop != Stop::None)
+    return true;
+
+  if (m_breakpoints[m_PC] && !m_resuming) {
+    m_stop = Stop::Breakpoint;
+    m_stop_address = m_PC;
+    return true;
+  }
+  m_resuming = false;
+  return false;
+}
+
+bool Chip8::break_after(const uint8_t *V, uint16_t I) {
+  for (auto i = 0; i < 16; i++) {
+    if ((m_watched_registers >> i & 1) && V[i] != m_V[i]) {
+      m_stop = Stop::Register;
+      m_stop_address = i;
+      return true;
+    }
+  }
+  if ((m_watched_registers >> 16 & 1) && I != m_I) {
+    m_stop = Stop::Register;
+    m_stop_address = 16;
+    return true;
+  }
+  return false;
+}
+
+void Chip8::watch(uint16_t address, int count) {
+  if (!m_watching)
+    return;
+
+  for (auto i = 0; i < count; i++) {
+    uint16_t watched = (address + i) & 0xFFF;
+    if (m_watchpoints[watched]) {
+      m_stop = Stop::Watchpoint;
+      m_stop_address = watched;
+      return;
+    }
+  }
+}
+
+template <Profile P, unsigned Features> void Chip8::emulate_with() {
+  if (!m_ready)
+    return;
+
+  m_PC &= 0xFFF;
+  if constexpr ((Features & FEATURE_DEBUG) != 0) {
+    if (m_step_mode && !m_step)
+      return;
+    if (break_before())
+      return;
+  }
+
+  // Fetch the next instruction
+  uint16_t opcode = m_memory[m_PC] << 8 | m_memory[m_PC + 1];
+  execute<P, Features>(decode(opcode));
+}
+
+template <Profile P, unsigned Features>
+int Chip8::run_cycles_with(int cycles) {
+  if (!m_ready)
+    return 0;
+
+  int executed = 0;
+  while (executed < cycles && !m_quitting) {
+    m_PC &= 0xFFF;
+    const Block *block = &m_blocks[m_PC];
+    if (block->end == 0)
+      block = &translate(m_PC, 0x1000);
+
+    m_blocks_changed = false;
+    for (size_t i = 0; i < block->instructions.size(); i++) {
+      if constexpr ((Features & FEATURE_DEBUG) != 0) {
+        if (break_before())
+          return executed;
+      }
+
+      execute<P, Features>(block->instructions[i]);
+      executed++;
+
+      // The block may have overwritten itself
+      if (m_blocks_changed || m_quitting || executed == cycles)
+        break;
+    }
+
+    if constexpr ((Features & FEATURE_DEBUG) != 0) {
+      if (m_stop != Stop::None)
+        break;
+    }
+  }
+
+  return executed;
+}
+
+const Chip8::Block &Chip8::translate(uint16_t start, uint16_t end) {
+  TimelineSpan span("translate");
+  Block &block = m_blocks[start];
+  uint16_t address = start;
+  do {
+    Decoded decoded = decode(m_memory[address] << 8 | m_memory[address + 1]);
+    block.instructions.push_back(decoded);
+    address += 2;
+    if (ends_block(decoded.op))
+      break;
+  } while (address + 1 < end && block.instructions.size() < MAX_BLOCK_LENGTH);
+  add_block(block, start, address);
+
+  return block;
+}
+
+void Chip8::add_block(Block &block, uint16_t start, uint16_t end) {
+  block.end = end;
+  for (auto i = start; i < end; i++)
+    m_block_coverage[i]++;
+  m_code_low = std::min(m_code_low, start);
+  m_code_high = std::max(m_code_high, end);
+}
+
+void Chip8::invalidate(uint16_t begin, uint16_t end) {
+  int first = std::max(0, begin - MAX_BLOCK_LENGTH * 2 + 1);
+  for (auto start = first; start < end; start++) {
+    Block &block = m_blocks[start];
+    if (block.end == 0 || block.end <= begin)
+      continue;
+
+    for (auto i = start; i < block.end; i++)
+      m_block_coverage[i]--;
+    block.instructions.clear();
+    block.end = 0;
+    m_blocks_changed = true;
+  }
+}
+
+void Chip8::patch(uint16_t address, const uint8_t *bytes, size_t size) {
+  address &= 0xFFF;
+  size = std::min(size, static_cast<size_t>(0x1000 - address));
+  if (size == 0)
+    return;
+  std::copy(bytes, bytes + size, m_memory + address);
+  written(address, size);
+}
+
+void Chip8::written(uint16_t address, int count) {
+  address &= 0xFFF;
+  int end = address + count;
+  if (end > 0x1000) {
+    // The write wrapped around to the beginning of memory
+    written(0, end - 0x1000);
+    end = 0x1000;
+  }
+  m_dirty_pages |=
+      (2u << ((end - 1) / PAGE_SIZE)) - (1u << (address / PAGE_SIZE));
+
+  if (end <= m_code_low || address >= m_code_high)
+    return;
+
+  for (auto i = address; i < end; i++) {
+    if (m_block_coverage[i] > 0) {
+      invalidate(address, end);
+      return;
+    }
+  }
+}
+
+template <Profile P, unsigned Features> void Chip8::execute(Decoded d) {
+  constexpr Quirks quirk = quirks(P);
+  uint16_t from = m_PC;
+
+  uint8_t V[16];
+  uint16_t I = 0;
+  if constexpr ((Features & FEATURE_DEBUG) != 0) {
+    if (m_watched_registers) {
+      memcpy(V, m_V, sizeof(V));
+      I = m_I;
+    }
+  }
+  if constexpr ((Features & FEATURE_TRACE) != 0) {
+    m_trace[m_trace_next] = {from, d};
+    m_trace_next = (m_trace_next + 1) % TRACE_LENGTH;
+    m_trace_count = std::min<size_t>(m_trace_count + 1, TRACE_LENGTH);
+  }
+  if constexpr ((Features & FEATURE_PROFILE) != 0)
+    m_profile[from & 0xFFF]++;
+
+  switch (d.op) {
+  case Op::SCD:
+    // 00Cn SCD nibble
+    // Scroll the display down n rows
+    memmove(m_screen + d.n * SCREEN_WIDTH / 8, m_screen,
+            (SCREEN_HEIGHT - std::min<int>(d.n, SCREEN_HEIGHT)) *
+                SCREEN_WIDTH / 8);
+    memset(m_screen, 0, std::min<int>(d.n, SCREEN_HEIGHT) * SCREEN_WIDTH / 8);
+    written(SCREEN_START, SCREEN_BYTES);
+    if constexpr ((Features & FEATURE_DEBUG) != 0)
+      watch(SCREEN_START, SCREEN_BYTES);
+    m_PC += 2;
+    break;
+  case Op::SCR:
+  case Op::SCL:
+    // 00FB SCR, 00FC SCL
+    // Scroll the display 4 pixels right or left
+    for (auto row = 0; row < SCREEN_BYTES; row += SCREEN_WIDTH / 8) {
+      uint64_t pixels = 0;
+      for (auto i = 0; i < SCREEN_WIDTH / 8; i++)
+        pixels = pixels << 8 | m_screen[row + i];
+      pixels = d.op == Op::SCR ? pixels >> 4 : pixels << 4;
+      for (auto i = SCREEN_WIDTH / 8 - 1; i >= 0; i--, pixels >>= 8)
+        m_screen[row + i] = pixels & 0xFF;
+    }
+    written(SCREEN_START, SCREEN_BYTES);
+    if constexpr ((Features & FEATURE_DEBUG) != 0)
+      watch(SCREEN_START, SCREEN_BYTES);
+    m_PC += 2;
+    break;
+  case Op::LOW:
+    // 00FE LOW
+    // The 64x32 display, which is the only one
+    m_PC += 2;
+    break;
+  case Op::HIGH:
+    // 00FF HIGH
+    // The 128x64 display isn't supported, the program continues on the
+    // 64x32 one
+    fault(FAULT_OPCODE);
+    m_PC += 2;
+    break;
+  case Op::EXIT:
+    // EXIT
+    // Exits the program
+    // Don't advance PC on exit.
+    m_quitting = true;
+    break;
+  case Op::CLS: {
+    // CLS
+    // Clear the display
+    int byte_count = SCREEN_WIDTH * SCREEN_HEIGHT / 8;
+    for (auto i = 0; i < byte_count; i++) {
+      m_screen[i] = 0;
+    }
+    written(SCREEN_START, byte_count);
+    m_PC += 2;
+  } break;
+  case Op::RET:
+    // RET
+    // Return from subroutine
+    if (m_SP >= STACK_TOP)
+      fault(FAULT_STACK);
+    m_PC = (m_memory[m_SP & 0xFFF] << 8 | m_memory[(m_SP + 1) & 0xFFF]) & 0xFFF;
+    m_SP += 2;
+    break;
+  case Op::NOP:
+    fault(FAULT_OPCODE);
+    m_PC += 2;
+    break;
+  case Op::INVALID:
+    fault(FAULT_OPCODE);
+    break;
+  case Op::JP:
+    // JUMP 1NNN
+    // Jump to NNN
+    m_PC = d.nnn;
+    break;
+  case Op::CALL:
+    // CALL 2NNN
+    // Call subroutine at NNN
+
+    // Advance stack pointer
+    if (m_SP < STACK_BOTTOM + 2)
+      fault(FAULT_STACK);
+    m_SP -= 2;
+
+    // Store next instructions address to memory pointed by the stack
+    // pointer
+    m_memory[m_SP & 0xFFF] = ((m_PC + 2) & 0xff00) >> 8;
+    m_memory[(m_SP + 1) & 0xFFF] = ((m_PC + 2) & 0x00ff);
+    written(m_SP, 2);
+
+    // Jump to subroutines address NNN
+    m_PC = d.nnn;
+    break;
+  case Op::SE_BYTE:
+    // 3xkk SE Vx, byte
+    // Skip next instructions if Vx = kk
+    if (m_V[d.x] == d.kk)
+      m_PC += 2;
+    m_PC += 2;
+    break;
+  case Op::SNE_BYTE:
+    // 4xkk SNE Vx, byte
+    // Skip next instruction if Vx != kk
+    if (m_V[d.x] != d.kk)
+      m_PC += 2;
+    m_PC += 2;
+    break;
+  case Op::SE_REG:
+    // 5xy0 SE Vx, Vy
+    // Skip next instruction if Vx = Vy
+    if (m_V[d.x] == m_V[d.y])
+      m_PC += 2;
+    m_PC += 2;
+    break;
+  case Op::LD_BYTE:
+    // 6xkk LD Vx, byte
+    // Set Vx = kk
+    m_V[d.x] = d.kk;
+    m_PC += 2;
+    break;
+  case Op::ADD_BYTE:
+    // 7xkk ADD Vx, byte
+    // Set Vx = Vx + kk
+    m_V[d.x] += d.kk;
+    m_PC += 2;
+    break;
+  case Op::LD_REG:
+    // 8xy0 LD Vx, Vy
+    // Set Vx = Vy
+    m_V[d.x] = m_V[d.y];
+    m_PC += 2;
+    break;
+  case Op::OR:
+    // 8xy1 OR Vx, Vy
+    // Bitwise OR on Vx and Vy. The result is stored to Vx.
+    m_V[d.x] |= m_V[d.y];
+    m_PC += 2;
+    break;
+  case Op::AND:
+    // 8xy1 AND Vx, Vy
+    // Bitwise AND on Vx and Vy. The result is stored to Vx.
+    m_V[d.x] &= m_V[d.y];
+    m_PC += 2;
+    break;
+  case Op::XOR:
+    // 8xy1 XOR Vx, Vy
+    // Bitwise XOR on Vx and Vy. The result is stored to Vx.
+    m_V[d.x] ^= m_V[d.y];
+    m_PC += 2;
+    break;
+  case Op::ADD_REG: {
+    // 8xy4 ADD Vx, Vy
+    // Set Vx = Vx + Vy, set VF = carry
+    //  Values of Vx and Vy are added together.
+    // If the result is > 255, VF is set to 1.
+    uint16_t result = m_V[d.x] + m_V[d.y];
+    m_V[d.x] = result & 0xff;
+    m_V[0xf] = (result > 0xff) ? 1 : 0;
+    m_PC += 2;
+  } break;
+  case Op::SUB: {
+    // 8xy5 SUB Vx, Vy
+    // Set Vx = Vx - Vy, set VF = NOT borrow
+    // If Vx > Vy, VF is set to 1.
+    uint8_t vx = m_V[d.x];
+    uint8_t vy = m_V[d.y];
+    uint8_t result = vx - vy;
+    m_V[d.x] = result;
+    m_V[0xf] = (vx > vy) ? 1 : 0;
+    m_PC += 2;
+  } break;
+  case Op::SHR: {
+    // 8xy6 SHR Vx {, Vy}
+    // Set Vx = Vx SHR 1
+    // If the least significant bit of Vx is 1, set VF to 1.
+    // Divide Vx by 2.
+    uint8_t vx = quirk.shift_vy ? m_V[d.y] : m_V[d.x];
+    m_V[d.x] = vx >> 1;
+    m_V[0xf] = vx & 0x1;
+    m_PC += 2;
+  } break;
+  case Op::SUBN: {
+    // 8xy7 SUBN Vx, Vy
+    // Set Vx = Vy - Vx, set VF = NOT borrow
+    // If Vy > Vx, set VF 1.
+    uint8_t vx = m_V[d.x];
+    uint8_t vy = m_V[d.y];
+    uint8_t result = vy - vx;
+    m_V[d.x] = result;
+    m_V[0xf] = (vx < vy) ? 1 : 0;
+    m_PC += 2;
+  } break;
+  case Op::SHL: {
+    // 8xyE SHL Vx {, Vy}
+    // Set Vx = Vx SHL 1
+    // If the most significant bit of Vx is 1, set VF to 1.
+    // Multiply Vx by 2;
+    uint8_t vx = quirk.shift_vy ? m_V[d.y] : m_V[d.x];
+    m_V[d.x] = vx << 1;
+    m_V[0xf] = (vx & 0x80) >> 7;
+    m_PC += 2;
+  } break;
+  case Op::SNE_REG:
+    // 9xy0 SNE Vx, Vy
+    // Skip next instruction if Vx != Vy
+    if (m_V[d.x] != m_V[d.y])
+      m_PC += 2;
+    m_PC += 2;
+    break;
+  case Op::LD_I:
+    // Annn LD I, addr
+    // The value of the register I is set to nnn.
+    m_I = d.nnn;
+    m_PC += 2;
+    break;
+  case Op::JP_V0:
+    // Bnnn JP V0, addr
+    // Jump to location nnn + V0
+    m_PC = ((quirk.jump_vx ? m_V[d.x] : m_V[0]) + d.nnn) & 0xFFF;
+    break;
+  case Op::RND:
+    // Cxkk RND Vx, byte
+    // Set Vx = random byte AND kk
+    m_V[d.x] = m_random.next() & d.kk;
+    m_PC += 2;
+    break;
+  case Op::DRW: {
+    // Dxyn DRW Vx, Vy, nibble
+    //   Display n-byte sprite starting at memory location I at (Vx, Vy),
+    //   set VF = collision.
+
+    //   The interpreter reads n bytes from memory, starting at the address
+    //   stored in I. These bytes are then displayed as sprites on screen at
+    //   coordinates (Vx, Vy). Sprites are XORed onto the existing screen.
+    //   If this causes any pixels to be erased, VF is set to 1, otherwise
+    //   it is set to 0. If the sprite is positioned so part of it is
+    //   outside the coordinates of the display, it wraps around to the
+    //   opposite side of the screen. See instruction 8xy3 for more
+    //   information on XOR, and section 2.4, Display, for more information
+    //   on the Chip-8 screen and sprites.
+    //   Some interpreters clip the sprite at the edges instead; the
+    //   position itself always wraps.
+    check_I(d.n);
+    uint8_t x = m_V[d.x] % SCREEN_WIDTH;
+    uint8_t y = m_V[d.y] % SCREEN_HEIGHT;
+
+    // A sprite row covers at most two screen bytes. The second one wraps
+    // around to the beginning of the same row.
+    int bit_offset = x % 8;
+    int row_bytes = SCREEN_WIDTH / 8;
+
+    bool erased = false;
+    for (auto i = 0; i < d.n; i++) {
+      if constexpr (quirk.clip) {
+        if (y + i >= SCREEN_HEIGHT)
+          break;
+      }
+      int row = ((y + i) % SCREEN_HEIGHT) * row_bytes;
+      int left_position = row + x / 8;
+      int right_position = row + (x / 8 + 1) % row_bytes;
+
+      uint8_t byte = m_memory[(m_I + i) & 0xFFF];
+      uint8_t left = byte >> bit_offset;
+      uint8_t right = bit_offset > 0 ? byte << (8 - bit_offset) : 0;
+      if constexpr (quirk.clip) {
+        if (x / 8 + 1 == row_bytes)
+          right = 0;
+      }
+
+      if ((m_screen[left_position] & left) || (m_screen[right_position] & right))
+        erased = true;
+
+      m_screen[left_position] ^= left;
+      m_screen[right_position] ^= right;
+      if constexpr ((Features & FEATURE_DEBUG) != 0) {
+        watch(SCREEN_START + left_position, 1);
+        watch(SCREEN_START + right_position, 1);
+      }
+    }
+    written(SCREEN_START, row_bytes * SCREEN_HEIGHT);
+
+    m_V[0xf] = erased ? 1 : 0;
+
+    m_PC += 2;
+  } break;
+  case Op::SKP: {
+    // Ex9E SKP Vx
+    // Skip next instruction if key stored in Vx is pressed
+    uint8_t key = m_V[d.x];
+    // Add 2 to program counter to skip next instruction
+    if (isPressed(key))
+      m_PC += 2;
+    m_PC += 2;
+  } break;
+  case Op::SKNP: {
+    // ExA1 SKNP Vx
+    // Skip next instruction if key stored in Vx is not pressed
+    uint8_t key = m_V[d.x];
+    // Add 2 to program counter to skip next instruction
+    if (!isPressed(key))
+      m_PC += 2;
+    m_PC += 2;
+  } break;
+  case Op::LD_VX_DT:
+    // Fx07 LD Vx, DT
+    // Set Vx = the delay timer
+    m_V[d.x] = m_delay.value();
+    m_PC += 2;
+    break;
+  case Op::LD_VX_K:
+    // Fx0A LD Vx, K
+    // Wait for key press, store value of the key in Vx
+    if (m_key_down != 0) {
+      uint8_t key = 15;
+      while (!((m_key_down >> key) & 0x1))
+        key--;
+      m_V[d.x] = key;
+      m_PC += 2;
+    }
+    break;
+  case Op::LD_DT_VX:
+    // Fx15 LD DT, Vx
+    // Set delay timer = Vx
+    m_delay.setValue(m_V[d.x]);
+    m_PC += 2;
+    break;
+  case Op::LD_ST_VX:
+    // Fx18 LD ST, Vx
+    // Set sound timer = Vx
+    m_sound = m_V[d.x];
+    m_PC += 2;
+    break;
+  case Op::ADD_I_VX:
+    // Fx1E ADD I, Vx
+    // Set I = I + Vx
+    m_I = m_V[d.x] + m_I;
+    m_PC += 2;
+    break;
+  case Op::LD_F_VX:
+    // Fx29 - LD F, Vx
+    // Set I to location of the sprite for digit stored in Vx
+    m_I = 5 * m_V[d.x];
+    m_PC += 2;
+    break;
+  case Op::LD_HF_VX:
+    // Fx30 - LD HF, Vx
+    // Set I to location of the big sprite for digit stored in Vx
+    m_I = BIG_FONT_START + 10 * m_V[d.x];
+    m_PC += 2;
+    break;
+  case Op::LD_B_VX: {
+    // Fx33 - LD B, Vx
+    // Store Binary Coded Decimal representation of Vx in memory
+    // locations I, I+1 and I+2.
+    uint8_t ones, tens, hundreds;
+    uint8_t value = m_V[d.x];
+    ones = value % 10;
+    value /= 10;
+    tens = value % 10;
+    hundreds = value / 10;
+    check_I(3);
+    m_memory[m_I & 0xFFF] = hundreds;
+    m_memory[(m_I + 1) & 0xFFF] = tens;
+    m_memory[(m_I + 2) & 0xFFF] = ones;
+    written(m_I, 3);
+    if constexpr ((Features & FEATURE_DEBUG) != 0)
+      watch(m_I, 3);
+    m_PC += 2;
+  } break;
+  case Op::LD_MEM_VX:
+    // Fx55 - LD [I], Vx
+    // Store registers V0 to Vx in memory starting at location I.
+    check_I(d.x + 1);
+    for (auto i = 0; i <= d.x; i++)
+      m_memory[(m_I + i) & 0xFFF] = m_V[i];
+    written(m_I, d.x + 1);
+    if constexpr ((Features & FEATURE_DEBUG) != 0)
+      watch(m_I, d.x + 1);
+    if constexpr (quirk.load_store_i)
+      m_I += quirk.load_store_x ? d.x : d.x + 1;
+    m_PC += 2;
+    break;
+  case Op::LD_VX_MEM:
+    // Fx65 - LD Vx, [I]
+    // Read registers V0 to Vx from memory starting at location I.
+    check_I(d.x + 1);
+    for (auto i = 0; i <= d.x; i++)
+      m_V[i] = m_memory[(m_I + i) & 0xFFF];
+    if constexpr (quirk.load_store_i)
+      m_I += quirk.load_store_x ? d.x : d.x + 1;
+    m_PC += 2;
+    break;
+  case Op::LD_R_VX:
+    // Fx75 - LD R, Vx
+    // Store registers V0 to Vx in the flag registers, of which there are 8.
+    for (auto i = 0; i <= d.x && i < FLAG_REGISTERS; i++)
+      m_flags[i] = m_V[i];
+    m_PC += 2;
+    break;
+  case Op::LD_VX_R:
+    // Fx85 - LD Vx, R
+    // Read registers V0 to Vx from the flag registers.
+    for (auto i = 0; i <= d.x && i < FLAG_REGISTERS; i++)
+      m_V[i] = m_flags[i];
+    m_PC += 2;
+    break;
+  }
+
+  if constexpr ((Features & FEATURE_PROFILE) != 0) {
+    // Control transfers, ignoring instructions waiting in place
+    if (m_coverage && ends_block(d.op) && m_PC != from)
+      m_coverage[(from << 4 ^ m_PC) & (COVERAGE_SIZE - 1)]++;
+  }
+
+  m_instructions++;
+  if constexpr ((Features & FEATURE_DEBUG) != 0) {
+    if (m_step_mode)
+      m_step = false;
+    if (m_watched_registers)
+      break_after(V, I);
+  }
+
+  m_delay.update(m_clock_speed);
+  m_sound.update(m_clock_speed);
+}
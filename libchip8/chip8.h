@@ -0,0 +1,328 @@
+#ifndef CHIP8_H
+#define CHIP8_H
+
+#include <array>
+#include <bitset>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include "cache.h"
+#include "decode.h"
+#include "quirks.h"
+#include "random.h"
+#include "timer.h"
+
+const uint16_t CLOCK_SPEED_HZ = 500;
+const int FRAME_RATE = 60;
+const int CYCLES_PER_FRAME = CLOCK_SPEED_HZ / FRAME_RATE;
+
+const uint8_t SCREEN_WIDTH = 64;
+const uint8_t SCREEN_HEIGHT = 32;
+const int SCREEN_BYTES = SCREEN_WIDTH * SCREEN_HEIGHT / 8; // 1 bit per pixel
+
+const int MEMORY_SIZE = 1024 * 4 + 0x200; // 4K memory reserved
+const int PROGRAM_START = 0x200;          // Programs are loaded at 0x200
+const int SCREEN_START = 0xF00;
+
+const int STACK_TOP = 0x70;      // SP after reset, the stack grows down
+const int STACK_BOTTOM = 0x50;   // Right after the font
+const int BIG_FONT_START = 0x70; // 8x10 digits for LD HF, after the stack
+const int FLAG_REGISTERS = 8;    // Saved by LD R, Vx and read by LD Vx, R
+
+const int COVERAGE_SIZE = 64 * 1024; // Bytes in an edge coverage bitmap
+
+/* Faults are recorded as they happen, the machine keeps running */
+enum Fault : uint8_t {
+  FAULT_NONE = 0,
+  FAULT_MEMORY = 1, // Access through I past the end of memory
+  FAULT_STACK = 2,  // Return with an empty stack or call with a full one
+  FAULT_OPCODE = 4  // Unknown opcode
+};
+
+/* Optional features of the CPU. Every combination is a separate
+ * instantiation of the interpreter, so features that aren't selected cost
+ * nothing.
+ */
+enum Feature : unsigned {
+  FEATURE_DEBUG = 1,   // Step mode, breakpoints and watchpoints
+  FEATURE_TRACE = 2,   // Keeps the last executed instructions
+  FEATURE_PROFILE = 4, // Counts executions per address and control transfers
+  FEATURE_ALL = 7
+};
+
+/* Why a machine with FEATURE_DEBUG stopped */
+enum class Stop : uint8_t {
+  None,
+  Breakpoint, // Before the instruction at a breakpoint
+  Watchpoint, // After an instruction writing a watched address
+  Register    // After an instruction changing a watched register
+};
+
+const int TRACE_LENGTH = 256;
+
+struct TraceEntry {
+  uint16_t PC;
+  Decoded instruction;
+};
+
+/* The CPU registers, for saving and restoring the machine state */
+struct Registers {
+  uint8_t V[16];
+  uint16_t I;
+  uint16_t SP;
+  uint16_t PC;
+  uint8_t delay;
+  uint8_t sound;
+};
+
+class MachineState;
+
+/* Chip8 is the emulated machine: memory, registers, timers and the CPU.
+ * It has no dependency on SDL; the host feeds it key state and reads
+ * the screen back from memory.
+ */
+class Chip8 {
+public:
+  Chip8();
+  ~Chip8();
+
+  Chip8(const Chip8 &) = delete;
+  Chip8 &operator=(const Chip8 &) = delete;
+
+  /* Restores the power-on state, unloading the program */
+  void reset();
+
+  /* Loads a ROM and translates the code reachable from its entry point.
+   * With a cache, the translation is taken from there when it has a valid
+   * entry for the ROM and stored there otherwise.
+   */
+  void load_rom(const char *filename, TranslationCache *cache = nullptr);
+  void load_rom(const uint8_t *rom, size_t size,
+                TranslationCache *cache = nullptr);
+
+  /* Executes a single instruction */
+  void emulate() { (this->*m_engine->emulate)(); }
+
+  /* Executes up to cycles instructions from translated blocks, stopping
+   * early when the program exits or a debugger stop. Ignores step mode.
+   * Returns the number of instructions executed.
+   */
+  int run_cycles(int cycles) { return (this->*m_engine->run_cycles)(cycles); }
+
+  /* Switches to the interpreter with the given Feature bits. The machine
+   * state carries over.
+   */
+  void set_features(unsigned features);
+  unsigned features() const { return m_features; }
+
+  /* Switches to the interpreter for the quirks of profile. reset() keeps
+   * the profile.
+   */
+  void set_quirk_profile(Profile profile);
+  Profile quirk_profile() const { return m_quirk_profile; }
+
+  /* Sets the currently pressed keys and the keys pressed down since the
+   * last call, one bit per Chip-8 key.
+   */
+  void set_keys(uint16_t pressed, uint16_t down);
+
+  /* Seeds the random numbers of RND. reset() seeds with 1. */
+  void seed(uint64_t seed) { m_random.seed(seed); }
+
+  /* Counts every control transfer from PC to PC in bitmap, which must
+   * have COVERAGE_SIZE bytes, and turns on FEATURE_PROFILE. nullptr stops
+   * recording.
+   */
+  void set_coverage(uint8_t *bitmap);
+
+  /* Faults since reset, and the address of the instruction causing the
+   * first one
+   */
+  uint8_t faults() const { return m_faults; }
+  uint16_t fault_PC() const { return m_fault_PC; }
+
+  /* Debugging, these turn on FEATURE_DEBUG */
+  void toggle_step_mode();
+  bool step_mode() const { return m_step_mode; }
+  void step() { m_step = true; }
+  void set_breakpoint(uint16_t address, bool enabled = true);
+  /* Stops after Fx33, Fx55 and DRW write to address */
+  void set_watchpoint(uint16_t address, bool enabled = true);
+  /* Stops after instructions changing the registers in mask, bit n for Vn
+   * and bit 16 for I
+   */
+  void watch_registers(uint32_t mask);
+
+  Stop stopped() const { return m_stop; }
+  /* The breakpoint, the written address or the changed register */
+  uint16_t stop_address() const { return m_stop_address; }
+  /* Continues after a stop, running the instruction at a breakpoint */
+  void resume();
+
+  /* The last executed instructions with FEATURE_TRACE, oldest first */
+  std::vector<TraceEntry> trace() const;
+  /* Executions of the instruction at every address with FEATURE_PROFILE */
+  const std::vector<uint32_t> &profile() const { return m_profile; }
+
+  void quit() { m_quitting = true; }
+  bool quitting() const { return m_quitting; }
+  bool ready() const { return m_ready; }
+
+  uint8_t V(int reg) const { return m_V[reg]; }
+  uint16_t I() const { return m_I; }
+  uint16_t SP() const { return m_SP; }
+  uint16_t PC() const { return m_PC; }
+  uint8_t delay() const { return m_delay.value(); }
+  uint8_t sound() const { return m_sound.value(); }
+  /* Instructions executed since reset */
+  uint64_t instructions() const { return m_instructions; }
+
+  Registers registers() const;
+  void set_registers(const Registers &registers);
+
+  /* Saves the machine into state. Pages not written since the last save()
+   * or restore() are shared with that state instead of being copied.
+   */
+  void save(MachineState &state);
+  /* Continues from a saved state, copying only the pages that differ from
+   * memory. Translated code on them is dropped. The pool of the state has
+   * to outlive the machine or its next save() or restore().
+   */
+  void restore(const MachineState &state);
+
+  const uint8_t *memory() const { return m_memory; }
+  /* Writes size bytes to memory at address, such as a program reassembled
+   * while it runs. Only the translated code overlapping them is dropped;
+   * registers, timers and the rest of memory stay as they are.
+   */
+  void patch(uint16_t address, const uint8_t *bytes, size_t size);
+  const uint8_t *screen() const { return m_screen; }
+  /* 64-bit hash of the screen contents. It is stored in golden files, so
+   * it must never change.
+   */
+  uint64_t screen_hash() const;
+
+private:
+  // Straight-line run of decoded instructions ending at a jump, call,
+  // return, skip or wait
+  struct Block {
+    uint16_t end = 0; // One past the last byte, 0 when not translated
+    std::vector<Decoded> instructions;
+  };
+
+  static const int MAX_BLOCK_LENGTH = 32;
+
+  struct Engine {
+    void (Chip8::*emulate)();
+    int (Chip8::*run_cycles)(int);
+  };
+  using Engines = std::array<Engine, FEATURE_ALL + 1>;
+  // Indexed by profile, then by features
+  static const Engines engines[PROFILE_COUNT];
+
+  template <Profile P, unsigned... Features>
+  static constexpr Engines
+  engines_for(std::integer_sequence<unsigned, Features...>) {
+    return {{{&Chip8::emulate_with<P, Features>,
+              &Chip8::run_cycles_with<P, Features>}...}};
+  }
+
+  template <Profile P, unsigned Features> void emulate_with();
+  template <Profile P, unsigned Features> int run_cycles_with(int cycles);
+  template <Profile P, unsigned Features> void execute(Decoded d);
+
+  /* Debugger checks before and after an instruction, true to stop */
+  bool break_before();
+  bool break_after(const uint8_t *V, uint16_t I);
+  void watch(uint16_t address, int count);
+
+  /* Decodes the block starting at start. It has at least one instruction
+   * and ends at the first instruction ending a block or before end.
+   */
+  const Block &translate(uint16_t start, uint16_t end);
+  /* Installs the blocks of a cache entry, returns false if there is none */
+  bool load_blocks(TranslationCache &cache, const uint8_t *rom, size_t size);
+  void store_blocks(TranslationCache &cache, const uint8_t *rom, size_t size);
+  /* Accounts for a block covering [start, end) */
+  void add_block(Block &block, uint16_t start, uint16_t end);
+  /* Drops the blocks overlapping [begin, end) */
+  void invalidate(uint16_t begin, uint16_t end);
+  /* Called after count bytes of memory starting from address have been
+   * written. Addresses wrap around at 4K.
+   */
+  void written(uint16_t address, int count);
+  /* Remembers state as the one memory equals */
+  void mirror(const MachineState &state);
+
+  void fault(Fault fault) {
+    if (m_faults == FAULT_NONE)
+      m_fault_PC = m_PC;
+    m_faults |= fault;
+  }
+  /* Faults when count bytes from I don't fit in memory */
+  void check_I(int count) {
+    if (m_I + count > 0x1000)
+      fault(FAULT_MEMORY);
+  }
+
+  bool isPressed(uint8_t key) const {
+    return key < 16 && ((m_keys >> key) & 0x1);
+  }
+
+  uint8_t m_V[16]; // Registers 0-F
+  uint16_t m_I;    // Index register
+  uint16_t m_SP;   // Stack pointer
+  uint16_t m_PC;   // Program counter
+  uint8_t m_flags[FLAG_REGISTERS]; // SUPER-CHIP flag registers
+  Timer m_delay;   // Delay timer
+  Timer m_sound;   // Sound timer
+  uint8_t *m_memory;
+  uint8_t *m_screen; // Same as memory[0xF00]
+
+  uint16_t m_keys = 0;     // Currently pressed keys
+  uint16_t m_key_down = 0; // Keys pressed down since the last poll
+
+  std::vector<Block> m_blocks;            // Indexed by start address
+  std::vector<uint8_t> m_block_coverage;  // Blocks covering each byte
+  uint16_t m_code_low = MEMORY_SIZE;      // Lowest translated address
+  uint16_t m_code_high = 0;               // Highest translated address + 1
+  bool m_blocks_changed = false;
+
+  uint64_t m_instructions = 0;
+  Random m_random;
+
+  const Engine *m_engine = &engines[0][0];
+  unsigned m_features = 0;
+  Profile m_quirk_profile = Profile::Modern;
+  std::bitset<0x1000> m_breakpoints;
+  std::bitset<0x1000> m_watchpoints;
+  bool m_watching = false; // Any watchpoints set
+  uint32_t m_watched_registers = 0;
+  Stop m_stop = Stop::None;
+  uint16_t m_stop_address = 0;
+  bool m_resuming = false;
+  std::vector<TraceEntry> m_trace; // Ring buffer
+  size_t m_trace_next = 0;
+  size_t m_trace_count = 0;
+  std::vector<uint32_t> m_profile;
+  uint8_t *m_coverage = nullptr;
+  uint8_t m_faults = FAULT_NONE;
+  uint16_t m_fault_PC = 0;
+
+  uint16_t m_clock_speed;
+  bool m_step_mode;
+  bool m_step;
+
+  bool m_ready = false;
+  bool m_quitting = false;
+
+  // The state memory was last saved to or restored from, and the pages
+  // written since, one bit per page
+  std::unique_ptr<MachineState> m_mirror;
+  uint32_t m_dirty_pages = ~0u;
+};
+
+#endif
@@ -0,0 +1,279 @@
+#include <algorithm>
+#include <fcntl.h>
+#include <fstream>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "debuginfo.h"
+
+namespace {
+
+const char MAGIC[4] = {'C', '8', 'D', 'I'};
+const uint32_t VERSION = 1;
+
+/* A file is the header, the lines, the labels, the data ranges and the
+ * names, each NUL-terminated, the source file first
+ */
+struct Header {
+  char magic[4];
+  uint32_t version;
+  uint32_t rom_size;
+  uint32_t line_count;
+  uint64_t rom_hash;
+  uint32_t label_count;
+  uint32_t data_count;
+  uint32_t names_size;
+  uint32_t reserved;
+};
+
+static_assert(sizeof(Header) % 4 == 0 && sizeof(DebugLine) == 12 &&
+                  sizeof(DebugRange) == 8,
+              "Debug info is written as it is in memory");
+
+template <typename T> void append(std::vector<uint8_t> &out, const T *items,
+                                  size_t count) {
+  auto bytes = reinterpret_cast<const uint8_t *>(items);
+  out.insert(out.end(), bytes, bytes + count * sizeof(T));
+}
+
+uint16_t start(const DebugLine &line) { return line.address; }
+uint16_t start(const DebugRange &range) { return range.begin; }
+
+/* The last line or range starting at or before address */
+template <typename T>
+const T *find_before(const T *items, size_t count, uint16_t address) {
+  auto after = std::upper_bound(
+      items, items + count, address,
+      [](uint16_t value, const T &item) { return value < start(item); });
+  return after == items ? nullptr : after - 1;
+}
+
+} // namespace
+
+void DebugInfoBuilder::add_label(std::string_view name, uint16_t address) {
+  m_labels.push_back({std::string(name), address});
+}
+
+void DebugInfoBuilder::add_line(uint16_t address, uint16_t size, int line,
+                                int column, bool data) {
+  if (size == 0)
+    return;
+  m_lines.push_back({address, size, static_cast<uint32_t>(line),
+                     static_cast<uint32_t>(column)});
+  // Directives next to each other make one range
+  if (data) {
+    if (!m_data.empty() && m_data.back().end == address)
+      m_data.back().end += size;
+    else
+      m_data.push_back({address, static_cast<uint16_t>(address + size), 0});
+  }
+}
+
+std::vector<uint8_t> DebugInfoBuilder::finish(const std::string &source,
+                                              const uint8_t *rom,
+                                              size_t size) const {
+  std::string names = source + '\0';
+
+  // A label reaches up to the next label at a higher address
+  std::vector<Label> labels = m_labels;
+  std::stable_sort(labels.begin(), labels.end(),
+                   [](const Label &a, const Label &b) {
+                     return a.address < b.address;
+                   });
+  uint16_t end = 0x200 + size;
+  std::vector<DebugRange> ranges;
+  for (size_t i = 0; i < labels.size(); i++) {
+    uint16_t next = end;
+    for (size_t j = i + 1; j < labels.size(); j++) {
+      if (labels[j].address > labels[i].address) {
+        next = labels[j].address;
+        break;
+      }
+    }
+    ranges.push_back({labels[i].address,
+                      std::max(labels[i].address, next),
+                      static_cast<uint32_t>(names.size())});
+    names += labels[i].name + '\0';
+  }
+
+  std::vector<DebugRange> data = m_data;
+  for (auto &range : data) {
+    auto label = find_before(ranges.data(), ranges.size(), range.begin);
+    range.name = label && range.begin < label->end ? label->name : 0;
+  }
+
+  Header header{};
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.rom_size = size;
+  header.rom_hash = rom_hash(rom, size);
+  header.line_count = m_lines.size();
+  header.label_count = ranges.size();
+  header.data_count = data.size();
+  header.names_size = names.size();
+
+  std::vector<uint8_t> out;
+  append(out, &header, 1);
+  append(out, m_lines.data(), m_lines.size());
+  append(out, ranges.data(), ranges.size());
+  append(out, data.data(), data.size());
+  append(out, names.data(), names.size());
+  return out;
+}
+
+bool DebugInfoBuilder::write(const std::string &filename,
+                             const std::string &source, const uint8_t *rom,
+                             size_t size) const {
+  std::vector<uint8_t> contents = finish(source, rom, size);
+  std::ofstream out(filename, std::ios::out | std::ios::binary);
+  out.write(reinterpret_cast<const char *>(contents.data()), contents.size());
+  return out.good();
+}
+
+std::string debug_info_filename(const std::string &program) {
+  return program + ".dbg";
+}
+
+DebugInfo::~DebugInfo() { close(); }
+
+void DebugInfo::close() {
+  if (m_map)
+    munmap(m_map, m_map_size);
+  m_map = nullptr;
+  m_map_size = 0;
+  m_contents.clear();
+  m_base = nullptr;
+  m_line_count = m_label_count = m_data_count = m_names_size = 0;
+  m_source = {};
+}
+
+bool DebugInfo::open(const std::string &filename, const uint8_t *rom,
+                     size_t size) {
+  close();
+
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(Header))
+    map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED)
+    return false;
+
+  m_map = map;
+  m_map_size = st.st_size;
+  m_base = static_cast<const uint8_t *>(map);
+  if (!validate(rom, size)) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool DebugInfo::load(std::vector<uint8_t> contents) {
+  close();
+  if (contents.size() < sizeof(Header))
+    return false;
+  m_contents = std::move(contents);
+  m_map_size = m_contents.size();
+  m_base = m_contents.data();
+  if (!validate(nullptr, 0)) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool DebugInfo::validate(const uint8_t *rom, size_t size) {
+  Header header;
+  memcpy(&header, m_base, sizeof(header));
+  size_t lines_offset = sizeof(Header);
+  size_t labels_offset =
+      lines_offset + size_t(header.line_count) * sizeof(DebugLine);
+  size_t data_offset =
+      labels_offset + size_t(header.label_count) * sizeof(DebugRange);
+  size_t names_offset =
+      data_offset + size_t(header.data_count) * sizeof(DebugRange);
+
+  if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      header.version != VERSION ||
+      names_offset + header.names_size != m_map_size ||
+      header.names_size == 0 || m_base[m_map_size - 1] != '\0')
+    return false;
+  if (rom &&
+      (header.rom_size != size || header.rom_hash != rom_hash(rom, size)))
+    return false;
+
+  m_lines = reinterpret_cast<const DebugLine *>(m_base + lines_offset);
+  m_line_count = header.line_count;
+  m_labels = reinterpret_cast<const DebugRange *>(m_base + labels_offset);
+  m_label_count = header.label_count;
+  m_data = reinterpret_cast<const DebugRange *>(m_base + data_offset);
+  m_data_count = header.data_count;
+  m_names = reinterpret_cast<const char *>(m_base + names_offset);
+  m_names_size = header.names_size;
+  m_source = m_names;
+
+  // The lookups rely on the tables being sorted
+  for (size_t i = 1; i < m_line_count; i++) {
+    if (m_lines[i].address < m_lines[i - 1].address)
+      return false;
+  }
+  for (auto table : {std::make_pair(m_labels, m_label_count),
+                     std::make_pair(m_data, m_data_count)}) {
+    for (size_t i = 0; i < table.second; i++) {
+      const DebugRange &range = table.first[i];
+      if (range.begin > range.end || range.name >= m_names_size ||
+          (i > 0 && range.begin < table.first[i - 1].begin))
+        return false;
+    }
+  }
+  return true;
+}
+
+const DebugLine *DebugInfo::find_line(uint16_t address) const {
+  auto line = find_before(m_lines, m_line_count, address);
+  if (!line || address >= line->address + line->size)
+    return nullptr;
+  return line;
+}
+
+std::string_view DebugInfo::find_label(uint16_t address,
+                                       uint16_t &offset) const {
+  auto label = find_before(m_labels, m_label_count, address);
+  if (!label || address >= label->end)
+    return {};
+  offset = address - label->begin;
+  return m_names + label->name;
+}
+
+bool DebugInfo::is_data(uint16_t address) const {
+  auto range = find_before(m_data, m_data_count, address);
+  return range && address < range->end;
+}
+
+std::string DebugInfo::describe(uint16_t address) const {
+  std::string text;
+  if (!is_open())
+    return text;
+  if (const DebugLine *line = find_line(address)) {
+    text = std::string(m_source) + ":" + std::to_string(line->line) + ":" +
+           std::to_string(line->column);
+  }
+  uint16_t offset = 0;
+  std::string_view label = find_label(address, offset);
+  if (!label.empty()) {
+    if (!text.empty())
+      text += ' ';
+    text += label;
+    if (offset)
+      text += "+" + std::to_string(offset);
+  }
+  return text;
+}
@@ -0,0 +1,120 @@
+#ifndef DEBUGINFO_H
+#define DEBUGINFO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/* Debug info maps the addresses of an assembled program back to its
+ * source. The assembler writes it next to the binary, as program.ch8.dbg
+ * for program.ch8, and tools showing addresses map it into memory and look
+ * addresses up with a binary search instead of reading the source again.
+ *
+ * The file is a header followed by three tables sorted by address: the
+ * source lines emitting code or data, the address ranges of labels, and
+ * the ranges of data (DB) directives, then the names of the source file
+ * and of the labels.
+ */
+
+/* The source of the bytes from address to address + size - 1 */
+struct DebugLine {
+  uint16_t address;
+  uint16_t size;
+  uint32_t line;   // 1-based
+  uint32_t column; // 1-based, of the mnemonic
+};
+
+/* Addresses begin to end - 1. name is an offset into the names, for data
+ * the name of the label in front of it, if any.
+ */
+struct DebugRange {
+  uint16_t begin;
+  uint16_t end;
+  uint32_t name;
+};
+
+/* DebugInfoBuilder collects the debug info of a program while it is
+ * assembled, in address order
+ */
+class DebugInfoBuilder {
+public:
+  void add_label(std::string_view name, uint16_t address);
+  void add_line(uint16_t address, uint16_t size, int line, int column,
+                bool data);
+
+  /* The file contents for a program of size bytes assembled from source */
+  std::vector<uint8_t> finish(const std::string &source, const uint8_t *rom,
+                              size_t size) const;
+  /* Writes the file, returns false on errors */
+  bool write(const std::string &filename, const std::string &source,
+             const uint8_t *rom, size_t size) const;
+
+private:
+  struct Label {
+    std::string name;
+    uint16_t address;
+  };
+
+  std::vector<Label> m_labels;
+  std::vector<DebugLine> m_lines;
+  std::vector<DebugRange> m_data; // name is the index of the label before
+};
+
+/* The debug info file of a program */
+std::string debug_info_filename(const std::string &program);
+
+/* DebugInfo looks up addresses in debug info mapped from a file or held in
+ * memory. Lookups are O(log n) and don't allocate.
+ */
+class DebugInfo {
+public:
+  DebugInfo() = default;
+  ~DebugInfo();
+
+  DebugInfo(const DebugInfo &) = delete;
+  DebugInfo &operator=(const DebugInfo &) = delete;
+
+  /* Maps filename. Returns false if it can't be read, is damaged, or was
+   * written for another binary than rom when rom is given.
+   */
+  bool open(const std::string &filename, const uint8_t *rom = nullptr,
+            size_t size = 0);
+  /* Uses debug info built in memory */
+  bool load(std::vector<uint8_t> contents);
+
+  bool is_open() const { return m_base != nullptr; }
+
+  /* The line emitting the byte at address, nullptr if none */
+  const DebugLine *find_line(uint16_t address) const;
+  /* The label with address in its range and the offset from it. Empty if
+   * none.
+   */
+  std::string_view find_label(uint16_t address, uint16_t &offset) const;
+  bool is_data(uint16_t address) const;
+  std::string_view source() const { return m_source; }
+
+  /* "file:line:column label+offset", or empty if address is unknown */
+  std::string describe(uint16_t address) const;
+
+private:
+  void close();
+  bool validate(const uint8_t *rom, size_t size);
+
+  void *m_map = nullptr;
+  size_t m_map_size = 0;
+  std::vector<uint8_t> m_contents;
+  const uint8_t *m_base = nullptr;
+  const DebugLine *m_lines = nullptr;
+  size_t m_line_count = 0;
+  const DebugRange *m_labels = nullptr;
+  size_t m_label_count = 0;
+  const DebugRange *m_data = nullptr;
+  size_t m_data_count = 0;
+  const char *m_names = nullptr;
+  size_t m_names_size = 0;
+  std::string_view m_source;
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <stdint.h>
+
+#include "opcodes.h"
+
+/* A decoded instruction. Every operand field is filled in regardless of
+ * the operation.
+ */
+struct Decoded {
+  Op op;
+  uint8_t x;    // 0x0X00
+  uint8_t y;    // 0x00Y0
+  uint8_t n;    // 0x000N
+  uint8_t kk;   // 0x00KK
+  uint16_t nnn; // 0x0NNN
+};
+
+constexpr Op decode_op(uint16_t opcode) {
+  if (const OpcodeSpec *spec = find_opcode(opcode))
+    return spec->op;
+  // Unknown opcodes in the E group wait in place like a key check that
+  // never succeeds
+  return opcode >> 12 == 0xE ? Op::INVALID : Op::NOP;
+}
+
+constexpr Decoded decode(uint16_t opcode) {
+  return {decode_op(opcode),
+          static_cast<uint8_t>((opcode >> 8) & 0xF),
+          static_cast<uint8_t>((opcode >> 4) & 0xF),
+          static_cast<uint8_t>(opcode & 0xF),
+          static_cast<uint8_t>(opcode & 0xFF),
+          static_cast<uint16_t>(opcode & 0xFFF)};
+}
+
+/* True for operations after which execution doesn't simply continue with
+ * the next instruction.
+ */
+constexpr bool ends_block(Op op) {
+  switch (op) {
+  case Op::INVALID:
+  case Op::RET:
+  case Op::EXIT:
+  case Op::JP:
+  case Op::CALL:
+  case Op::SE_BYTE:
+  case Op::SNE_BYTE:
+  case Op::SE_REG:
+  case Op::SNE_REG:
+  case Op::JP_V0:
+  case Op::SKP:
+  case Op::SKNP:
+  case Op::LD_VX_K:
+    return true;
+  default:
+    return false;
+  }
+}
+
+#endif
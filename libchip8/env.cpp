@@ -0,0 +1,164 @@
+#include <string.h>
+
+#include "env.h"
+#include "timeline.h"
+
+VectorEnv::VectorEnv(const uint8_t *rom, size_t size, int count)
+    : m_rom(rom, rom + size) {
+  for (auto i = 0; i < count; i++)
+    m_machines.push_back(std::make_unique<Machine>());
+}
+
+VectorEnv::~VectorEnv() { stop_workers(); }
+
+void VectorEnv::add_reward(uint16_t address, float scale) {
+  m_rewards.push_back({static_cast<uint16_t>(address & 0xFFF), scale});
+  for (auto &machine : m_machines)
+    machine->rewarded.push_back(machine->vm.memory()[address & 0xFFF]);
+}
+
+void VectorEnv::set_done(uint16_t address, uint8_t value) {
+  m_has_done = true;
+  m_done_address = address & 0xFFF;
+  m_done_value = value;
+}
+
+void VectorEnv::set_quirk_profile(Profile profile) {
+  for (auto &machine : m_machines)
+    machine->vm.set_quirk_profile(profile);
+}
+
+void VectorEnv::set_buffers(uint8_t *observations, float *rewards,
+                            uint8_t *dones) {
+  m_observations = observations;
+  m_rewards_out = rewards;
+  m_dones = dones;
+}
+
+void VectorEnv::reset(const uint64_t *seeds, const uint8_t *mask) {
+  for (auto i = 0; i < count(); i++) {
+    if (mask && !mask[i])
+      continue;
+
+    Machine &machine = *m_machines[i];
+    machine.vm.reset();
+    machine.vm.load_rom(m_rom.data(), m_rom.size());
+    machine.vm.seed(seeds[i]);
+    machine.held = 0;
+    machine.frames = 0;
+    machine.done = false;
+    for (size_t j = 0; j < m_rewards.size(); j++)
+      machine.rewarded[j] = machine.vm.memory()[m_rewards[j].address];
+    observe(i, 0);
+  }
+}
+
+bool VectorEnv::ended(const Machine &machine) const {
+  return machine.vm.quitting() ||
+         (m_has_done && machine.vm.memory()[m_done_address] == m_done_value) ||
+         (m_max_frames > 0 && machine.frames >= m_max_frames);
+}
+
+void VectorEnv::observe(int index, float reward) {
+  const Machine &machine = *m_machines[index];
+  if (m_observations)
+    memcpy(m_observations + index * SCREEN_BYTES, machine.vm.screen(),
+           SCREEN_BYTES);
+  if (m_rewards_out)
+    m_rewards_out[index] = reward;
+  if (m_dones)
+    m_dones[index] = machine.done;
+}
+
+void VectorEnv::step_range(const uint16_t *actions, int begin, int end) {
+  TimelineSpan span("step machines");
+  for (auto i = begin; i < end; i++) {
+    Machine &machine = *m_machines[i];
+    if (machine.done) {
+      observe(i, 0);
+      continue;
+    }
+
+    uint16_t keys = actions[i];
+    uint16_t down = keys & ~machine.held;
+    machine.held = keys;
+    for (auto frame = 0; frame < m_frame_skip && !ended(machine); frame++) {
+      machine.vm.set_keys(keys, frame == 0 ? down : 0);
+      machine.vm.run_cycles(CYCLES_PER_FRAME);
+      machine.frames++;
+    }
+
+    float reward = 0;
+    for (size_t j = 0; j < m_rewards.size(); j++) {
+      uint8_t value = machine.vm.memory()[m_rewards[j].address];
+      reward += m_rewards[j].scale * (value - machine.rewarded[j]);
+      machine.rewarded[j] = value;
+    }
+    machine.done = ended(machine);
+    observe(i, reward);
+  }
+}
+
+void VectorEnv::step(const uint16_t *actions) {
+  if (m_workers.empty()) {
+    step_range(actions, 0, count());
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_actions = actions;
+    m_running = m_workers.size();
+    m_generation++;
+  }
+  m_wake.notify_all();
+
+  step_range(actions, 0, count() / m_threads);
+
+  TimelineSpan span("wait for workers");
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_finished.wait(lock, [this] { return m_running == 0; });
+}
+
+void VectorEnv::set_threads(int threads) {
+  stop_workers();
+  m_threads = std::max(1, std::min(threads, count()));
+  for (auto i = 1; i < m_threads; i++)
+    m_workers.emplace_back(&VectorEnv::work, this, i, m_generation);
+}
+
+void VectorEnv::stop_workers() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_wake.notify_all();
+  for (auto &worker : m_workers)
+    worker.join();
+  m_workers.clear();
+  m_stopping = false;
+  m_threads = 1;
+}
+
+void VectorEnv::work(int thread, uint64_t generation) {
+  for (;;) {
+    const uint16_t *actions;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_wake.wait(lock, [&] {
+        return m_stopping || m_generation != generation;
+      });
+      if (m_stopping)
+        return;
+      generation = m_generation;
+      actions = m_actions;
+    }
+
+    step_range(actions, count() * thread / m_threads,
+               count() * (thread + 1) / m_threads);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (--m_running == 0)
+      m_finished.notify_one();
+  }
+}
@@ -0,0 +1,103 @@
+#ifndef ENV_H
+#define ENV_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "chip8.h"
+
+/* Part of the reward: scale times the change of the byte at address */
+struct RewardSource {
+  uint16_t address;
+  float scale;
+};
+
+/* VectorEnv runs a number of machines on the same ROM in lockstep, for
+ * training agents. An action is the mask of keys held for a step, which
+ * lasts frame_skip frames. Observations, rewards and done flags are written
+ * straight into arrays owned by the caller, so they can live in shared
+ * memory or back numpy arrays:
+ *
+ *   observations  count * SCREEN_BYTES bytes, the screens
+ *   rewards       count floats, the reward of the last step
+ *   dones         count bytes, 1 once the episode has ended
+ *
+ * An episode ends when the program exits, when the done byte has the done
+ * value or after max_frames frames. Machines whose episode has ended don't
+ * run until they are reset.
+ */
+class VectorEnv {
+public:
+  VectorEnv(const uint8_t *rom, size_t size, int count);
+  ~VectorEnv();
+
+  VectorEnv(const VectorEnv &) = delete;
+  VectorEnv &operator=(const VectorEnv &) = delete;
+
+  int count() const { return m_machines.size(); }
+
+  void set_frame_skip(int frames) { m_frame_skip = std::max(1, frames); }
+  void set_max_frames(int frames) { m_max_frames = frames; }
+  void add_reward(uint16_t address, float scale);
+  void set_done(uint16_t address, uint8_t value);
+  void set_quirk_profile(Profile profile);
+  /* Steps the machines on this many threads, including the caller's */
+  void set_threads(int threads);
+
+  void set_buffers(uint8_t *observations, float *rewards, uint8_t *dones);
+
+  /* Starts new episodes, seeding RND with seeds[i]. With a mask only the
+   * machines with a non-zero mask byte are reset.
+   */
+  void reset(const uint64_t *seeds, const uint8_t *mask = nullptr);
+  /* actions has count key masks */
+  void step(const uint16_t *actions);
+
+private:
+  struct Machine {
+    Chip8 vm;
+    uint16_t held = 0;             // Keys of the last action
+    int frames = 0;                // In this episode
+    std::vector<uint8_t> rewarded; // Reward bytes after the last step
+    bool done = false;
+  };
+
+  void step_range(const uint16_t *actions, int begin, int end);
+  /* Writes the observation, reward and done flag of a machine */
+  void observe(int index, float reward);
+  bool ended(const Machine &machine) const;
+  void stop_workers();
+  void work(int thread, uint64_t generation);
+
+  std::vector<uint8_t> m_rom;
+  std::vector<std::unique_ptr<Machine>> m_machines;
+  int m_frame_skip = 1;
+  int m_max_frames = 0; // No limit
+  std::vector<RewardSource> m_rewards;
+  bool m_has_done = false;
+  uint16_t m_done_address = 0;
+  uint8_t m_done_value = 0;
+
+  uint8_t *m_observations = nullptr;
+  float *m_rewards_out = nullptr;
+  uint8_t *m_dones = nullptr;
+
+  // Workers stepping the machines after the caller's share, woken up
+  // every step
+  int m_threads = 1;
+  std::vector<std::thread> m_workers;
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_finished;
+  const uint16_t *m_actions = nullptr;
+  uint64_t m_generation = 0;
+  int m_running = 0;
+  bool m_stopping = false;
+};
+
+#endif
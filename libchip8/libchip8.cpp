@@ -0,0 +1,456 @@
+#include <algorithm>
+#include <sstream>
+
+#include "../assembler/assembler.h"
+#include "../assembler/incremental.h"
+#include "../assembler/optimizer.h"
+#include "../disassembler/flow.h"
+#include "chip8.h"
+#include "debuginfo.h"
+#include "env.h"
+#include "libchip8.h"
+#include "postprocess.h"
+#include "recorder.h"
+#include "state.h"
+#include "stream.h"
+#include "timeline.h"
+
+static_assert(CHIP8_FAULT_MEMORY == FAULT_MEMORY &&
+                  CHIP8_FAULT_STACK == FAULT_STACK &&
+                  CHIP8_FAULT_OPCODE == FAULT_OPCODE,
+              "Fault bits differ from the core");
+static_assert(COVERAGE_SIZE == 65536, "Coverage bitmap size differs");
+static_assert(CHIP8_FEATURE_DEBUG == FEATURE_DEBUG &&
+                  CHIP8_FEATURE_TRACE == FEATURE_TRACE &&
+                  CHIP8_FEATURE_PROFILE == FEATURE_PROFILE,
+              "Feature bits differ from the core");
+static_assert(CHIP8_STOP_BREAKPOINT == static_cast<int>(Stop::Breakpoint) &&
+                  CHIP8_STOP_WATCHPOINT == static_cast<int>(Stop::Watchpoint) &&
+                  CHIP8_STOP_REGISTER == static_cast<int>(Stop::Register),
+              "Stop reasons differ from the core");
+static_assert(CHIP8_PROFILE_MODERN == static_cast<int>(Profile::Modern) &&
+                  CHIP8_PROFILE_COSMAC_VIP ==
+                      static_cast<int>(Profile::CosmacVip) &&
+                  CHIP8_PROFILE_CHIP48 == static_cast<int>(Profile::Chip48) &&
+                  CHIP8_PROFILE_SUPER_CHIP ==
+                      static_cast<int>(Profile::SuperChip),
+              "Profiles differ from the core");
+
+struct chip8 {
+  Chip8 vm;
+};
+
+chip8_t *chip8_create(void) { return new chip8; }
+
+void chip8_destroy(chip8_t *vm) { delete vm; }
+
+void chip8_load(chip8_t *vm, const uint8_t *rom, size_t size) {
+  vm->vm.load_rom(rom, size);
+}
+
+void chip8_load_cached(chip8_t *vm, const uint8_t *rom, size_t size,
+                       const char *cache_directory) {
+  TranslationCache cache(cache_directory);
+  vm->vm.load_rom(rom, size, &cache);
+}
+
+int chip8_step(chip8_t *vm, int cycles) { return vm->vm.run_cycles(cycles); }
+
+int chip8_quitting(const chip8_t *vm) { return vm->vm.quitting(); }
+
+void chip8_set_keys(chip8_t *vm, uint16_t pressed, uint16_t down) {
+  vm->vm.set_keys(pressed, down);
+}
+
+void chip8_seed(chip8_t *vm, uint64_t seed) { vm->vm.seed(seed); }
+
+int chip8_faults(const chip8_t *vm) { return vm->vm.faults(); }
+
+void chip8_set_coverage(chip8_t *vm, uint8_t *bitmap) {
+  vm->vm.set_coverage(bitmap);
+}
+
+void chip8_set_features(chip8_t *vm, unsigned features) {
+  vm->vm.set_features(features);
+}
+
+int chip8_set_quirk_profile(chip8_t *vm, int profile) {
+  if (profile < 0 || profile >= PROFILE_COUNT)
+    return -1;
+  vm->vm.set_quirk_profile(static_cast<Profile>(profile));
+  return 0;
+}
+
+void chip8_set_breakpoint(chip8_t *vm, uint16_t address, int enabled) {
+  vm->vm.set_breakpoint(address, enabled);
+}
+
+void chip8_set_watchpoint(chip8_t *vm, uint16_t address, int enabled) {
+  vm->vm.set_watchpoint(address, enabled);
+}
+
+void chip8_watch_registers(chip8_t *vm, uint32_t mask) {
+  vm->vm.watch_registers(mask);
+}
+
+int chip8_stopped(const chip8_t *vm, uint16_t *address) {
+  if (address)
+    *address = vm->vm.stop_address();
+  return static_cast<int>(vm->vm.stopped());
+}
+
+void chip8_resume(chip8_t *vm) { vm->vm.resume(); }
+
+void chip8_get_registers(const chip8_t *vm, chip8_registers_t *registers) {
+  for (auto i = 0; i < 16; i++) {
+    registers->V[i] = vm->vm.V(i);
+  }
+  registers->I = vm->vm.I();
+  registers->SP = vm->vm.SP();
+  registers->PC = vm->vm.PC();
+  registers->delay = vm->vm.delay();
+  registers->sound = vm->vm.sound();
+}
+
+size_t chip8_read_memory(const chip8_t *vm, uint16_t address, uint8_t *out,
+                         size_t len) {
+  if (address >= MEMORY_SIZE)
+    return 0;
+
+  len = std::min(len, static_cast<size_t>(MEMORY_SIZE - address));
+  std::copy(vm->vm.memory() + address, vm->vm.memory() + address + len, out);
+  return len;
+}
+
+void chip8_patch(chip8_t *vm, uint16_t address, const uint8_t *bytes,
+                 size_t size) {
+  vm->vm.patch(address, bytes, size);
+}
+
+void chip8_read_framebuffer(const chip8_t *vm, uint8_t *out) {
+  int byte_count = SCREEN_WIDTH * SCREEN_HEIGHT / 8;
+  std::copy(vm->vm.screen(), vm->vm.screen() + byte_count, out);
+}
+
+uint64_t chip8_framebuffer_hash(const chip8_t *vm) {
+  return vm->vm.screen_hash();
+}
+
+struct chip8_pool {
+  PagePool pool;
+};
+
+struct chip8_state {
+  MachineState state;
+};
+
+chip8_pool_t *chip8_pool_create(void) { return new chip8_pool; }
+
+void chip8_pool_destroy(chip8_pool_t *pool) { delete pool; }
+
+size_t chip8_pool_used(const chip8_pool_t *pool) { return pool->pool.used(); }
+
+chip8_state_t *chip8_state_create(chip8_pool_t *pool) {
+  return new chip8_state{MachineState(pool->pool)};
+}
+
+chip8_state_t *chip8_state_fork(const chip8_state_t *state) {
+  return new chip8_state{state->state};
+}
+
+void chip8_state_destroy(chip8_state_t *state) { delete state; }
+
+uint64_t chip8_state_hash(const chip8_state_t *state) {
+  return state->state.hash();
+}
+
+void chip8_save(chip8_t *vm, chip8_state_t *state) {
+  vm->vm.save(state->state);
+}
+
+int chip8_restore(chip8_t *vm, const chip8_state_t *state) {
+  if (state->state.empty())
+    return -1;
+  vm->vm.restore(state->state);
+  return 0;
+}
+
+void chip8_timeline_start(size_t capacity) { timeline_start(capacity); }
+
+int chip8_timeline_write(const char *filename) {
+  return timeline_write(filename) ? 0 : -1;
+}
+
+struct chip8_postprocess {
+  PostProcess post;
+};
+
+chip8_postprocess_t *chip8_postprocess_create(int width, int height,
+                                              int scale, int persistence) {
+  if (width <= 0 || width % 64 != 0 || height <= 0)
+    return nullptr;
+  return new chip8_postprocess{PostProcess(width, height, scale, persistence)};
+}
+
+void chip8_postprocess_destroy(chip8_postprocess_t *post) { delete post; }
+
+int chip8_postprocess_set_isa(chip8_postprocess_t *post, int isa) {
+  if (isa < CHIP8_ISA_SCALAR || isa > CHIP8_ISA_AVX2)
+    return -1;
+  return post->post.set_isa(static_cast<Isa>(isa)) ? 0 : -1;
+}
+
+void chip8_postprocess_run(chip8_postprocess_t *post, const uint8_t *screen,
+                           uint32_t *out) {
+  const uint32_t *pixels = post->post.process(screen);
+  std::copy(pixels, pixels + post->post.width() * post->post.height(), out);
+}
+
+size_t chip8_encode_frame(const uint8_t *screen, const uint8_t *previous,
+                          uint8_t *out, size_t capacity) {
+  std::vector<uint8_t> data;
+  encode_frame(screen, previous, data);
+  std::copy(data.begin(), data.begin() + std::min(capacity, data.size()), out);
+  return data.size();
+}
+
+size_t chip8_decode_frame(const uint8_t *data, size_t size, uint8_t *screen) {
+  return decode_frame(data, size, screen);
+}
+
+struct chip8_streamer {
+  explicit chip8_streamer(const char *path) : streamer(path) {}
+  FrameStreamer streamer;
+};
+
+chip8_streamer_t *chip8_streamer_create(const char *path) {
+  auto streamer = new chip8_streamer(path);
+  if (!streamer->streamer.is_open()) {
+    delete streamer;
+    return nullptr;
+  }
+  return streamer;
+}
+
+void chip8_streamer_destroy(chip8_streamer_t *streamer) { delete streamer; }
+
+void chip8_streamer_push(chip8_streamer_t *streamer, const uint8_t *screen,
+                         int beeping) {
+  streamer->streamer.push(screen, beeping != 0);
+}
+
+size_t chip8_streamer_viewers(const chip8_streamer_t *streamer) {
+  return streamer->streamer.viewers();
+}
+
+struct chip8_viewer {
+  explicit chip8_viewer(const char *path) : viewer(path) {}
+  FrameViewer viewer;
+};
+
+chip8_viewer_t *chip8_viewer_create(const char *path) {
+  return new chip8_viewer(path);
+}
+
+void chip8_viewer_destroy(chip8_viewer_t *viewer) { delete viewer; }
+
+int chip8_viewer_connect(chip8_viewer_t *viewer) {
+  return viewer->viewer.connect() ? 0 : -1;
+}
+
+int chip8_viewer_connected(const chip8_viewer_t *viewer) {
+  return viewer->viewer.connected();
+}
+
+int chip8_viewer_poll(chip8_viewer_t *viewer) {
+  return viewer->viewer.poll();
+}
+
+int chip8_viewer_screen(const chip8_viewer_t *viewer, uint8_t *out) {
+  std::copy(viewer->viewer.screen(), viewer->viewer.screen() + SCREEN_BYTES,
+            out);
+  return viewer->viewer.beeping();
+}
+
+uint16_t chip8_assemble_instruction(const char *line) {
+  return assemble_chip8(line);
+}
+
+size_t chip8_assemble(const char *source, uint8_t *out, size_t capacity) {
+  std::istringstream program(source);
+  std::vector<uint8_t> binary = assemble_program(program);
+
+  std::copy(binary.begin(), binary.begin() + std::min(capacity, binary.size()),
+            out);
+  return binary.size();
+}
+
+size_t chip8_assemble_optimized(const char *source, uint8_t *out,
+                                size_t capacity) {
+  std::istringstream program(source);
+  Optimizer optimizer;
+  std::vector<uint8_t> binary =
+      assemble_program(program, nullptr, std::cerr, nullptr, &optimizer);
+
+  std::copy(binary.begin(), binary.begin() + std::min(capacity, binary.size()),
+            out);
+  return binary.size();
+}
+
+struct chip8_incremental {
+  IncrementalAssembler assembler;
+};
+
+chip8_incremental_t *chip8_incremental_create(void) {
+  return new chip8_incremental;
+}
+
+void chip8_incremental_destroy(chip8_incremental_t *assembler) {
+  delete assembler;
+}
+
+int chip8_incremental_update(chip8_incremental_t *assembler,
+                             const char *source) {
+  return assembler->assembler.update(source) ? 0 : -1;
+}
+
+size_t chip8_incremental_binary(const chip8_incremental_t *assembler,
+                                uint8_t *out, size_t capacity) {
+  const std::vector<uint8_t> &binary = assembler->assembler.binary();
+  std::copy(binary.begin(), binary.begin() + std::min(capacity, binary.size()),
+            out);
+  return binary.size();
+}
+
+void chip8_incremental_counts(const chip8_incremental_t *assembler,
+                              int *parsed, int *encoded) {
+  *parsed = assembler->assembler.parsed();
+  *encoded = assembler->assembler.encoded();
+}
+
+size_t chip8_incremental_changes(const chip8_incremental_t *assembler,
+                                 const uint8_t *previous, size_t size,
+                                 uint16_t *ranges, size_t capacity) {
+  auto changes =
+      assembler->assembler.changes(std::vector<uint8_t>(previous,
+                                                        previous + size));
+  for (size_t i = 0; i < changes.size() && i < capacity; i++) {
+    ranges[2 * i] = changes[i].begin;
+    ranges[2 * i + 1] = changes[i].end;
+  }
+  return changes.size();
+}
+
+struct chip8_debug_info {
+  DebugInfo info;
+};
+
+int chip8_write_debug_info(const char *source, const char *source_name,
+                           const char *filename) {
+  std::istringstream program(source);
+  DebugInfoBuilder builder;
+  std::vector<uint8_t> binary =
+      assemble_program(program, nullptr, std::cerr, &builder);
+  return builder.write(filename, source_name, binary.data(), binary.size())
+             ? 0
+             : -1;
+}
+
+chip8_debug_info_t *chip8_debug_info_open(const char *filename,
+                                          const uint8_t *rom, size_t size) {
+  auto info = new chip8_debug_info;
+  if (!info->info.open(filename, rom, size)) {
+    delete info;
+    return nullptr;
+  }
+  return info;
+}
+
+void chip8_debug_info_close(chip8_debug_info_t *info) { delete info; }
+
+uint32_t chip8_debug_info_line(const chip8_debug_info_t *info,
+                               uint16_t address, uint32_t *column) {
+  const DebugLine *line = info->info.find_line(address);
+  if (column)
+    *column = line ? line->column : 0;
+  return line ? line->line : 0;
+}
+
+int chip8_debug_info_is_data(const chip8_debug_info_t *info,
+                             uint16_t address) {
+  return info->info.is_data(address);
+}
+
+size_t chip8_debug_info_describe(const chip8_debug_info_t *info,
+                                 uint16_t address, char *out,
+                                 size_t capacity) {
+  std::string text = info->info.describe(address);
+  std::copy(text.begin(), text.begin() + std::min(capacity, text.size()), out);
+  return text.size();
+}
+
+size_t chip8_disassemble(const uint8_t *rom, size_t size, char *out,
+                         size_t capacity) {
+  std::vector<uint8_t> memory(PROGRAM_START + size);
+  std::copy(rom, rom + size, memory.begin() + PROGRAM_START);
+
+  int end = PROGRAM_START + size;
+  ControlFlow flow = analyze(memory.data(), PROGRAM_START, end, PROGRAM_START);
+  std::string source;
+  disassemble_flow(memory.data(), PROGRAM_START, end, flow, source);
+
+  std::copy(source.begin(), source.begin() + std::min(capacity, source.size()),
+            out);
+  return source.size();
+}
+
+struct chip8_env {
+  VectorEnv env;
+};
+
+chip8_env_t *chip8_env_create(const uint8_t *rom, size_t size, int count) {
+  return new chip8_env{VectorEnv(rom, size, count)};
+}
+
+void chip8_env_destroy(chip8_env_t *env) { delete env; }
+
+void chip8_env_set_frame_skip(chip8_env_t *env, int frames) {
+  env->env.set_frame_skip(frames);
+}
+
+void chip8_env_set_max_frames(chip8_env_t *env, int frames) {
+  env->env.set_max_frames(frames);
+}
+
+void chip8_env_add_reward(chip8_env_t *env, uint16_t address, float scale) {
+  env->env.add_reward(address, scale);
+}
+
+void chip8_env_set_done(chip8_env_t *env, uint16_t address, uint8_t value) {
+  env->env.set_done(address, value);
+}
+
+int chip8_env_set_quirk_profile(chip8_env_t *env, int profile) {
+  if (profile < 0 || profile >= PROFILE_COUNT)
+    return -1;
+  env->env.set_quirk_profile(static_cast<Profile>(profile));
+  return 0;
+}
+
+void chip8_env_set_threads(chip8_env_t *env, int threads) {
+  env->env.set_threads(threads);
+}
+
+void chip8_env_set_buffers(chip8_env_t *env, uint8_t *observations,
+                           float *rewards, uint8_t *dones) {
+  env->env.set_buffers(observations, rewards, dones);
+}
+
+void chip8_env_reset(chip8_env_t *env, const uint64_t *seeds,
+                     const uint8_t *mask) {
+  env->env.reset(seeds, mask);
+}
+
+void chip8_env_step(chip8_env_t *env, const uint16_t *actions) {
+  env->env.step(actions);
+}
@@ -0,0 +1,313 @@
+#ifndef LIBCHIP8_H
+#define LIBCHIP8_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* C interface to the Chip-8 core and assembler, for embedding the
+ * emulator in other programs (e.g. the Python tests via ctypes).
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct chip8 chip8_t;
+
+typedef struct chip8_registers {
+  uint8_t V[16];
+  uint16_t I;
+  uint16_t SP;
+  uint16_t PC;
+  uint8_t delay;
+  uint8_t sound;
+} chip8_registers_t;
+
+chip8_t *chip8_create(void);
+void chip8_destroy(chip8_t *vm);
+
+/* Copies a ROM image to memory at 0x200 */
+void chip8_load(chip8_t *vm, const uint8_t *rom, size_t size);
+/* Same as chip8_load, taking the translated code from the cache in
+ * cache_directory if it has the ROM and adding the ROM to it otherwise
+ */
+void chip8_load_cached(chip8_t *vm, const uint8_t *rom, size_t size,
+                       const char *cache_directory);
+
+/* Executes up to cycles instructions. Stops early when the program
+ * exits. Returns the number of instructions executed.
+ */
+int chip8_step(chip8_t *vm, int cycles);
+int chip8_quitting(const chip8_t *vm);
+
+void chip8_set_keys(chip8_t *vm, uint16_t pressed, uint16_t down);
+
+/* Seeds the random numbers of RND */
+void chip8_seed(chip8_t *vm, uint64_t seed);
+
+/* Bits of CHIP8_FAULT_* for the faults since the machine was created */
+#define CHIP8_FAULT_MEMORY 1
+#define CHIP8_FAULT_STACK 2
+#define CHIP8_FAULT_OPCODE 4
+int chip8_faults(const chip8_t *vm);
+
+/* Counts control transfers in bitmap, which must have 65536 bytes and
+ * outlive the machine. NULL stops counting.
+ */
+void chip8_set_coverage(chip8_t *vm, uint8_t *bitmap);
+
+/* Bits of CHIP8_FEATURE_* selecting the interpreter, the machine state
+ * carries over
+ */
+#define CHIP8_FEATURE_DEBUG 1
+#define CHIP8_FEATURE_TRACE 2
+#define CHIP8_FEATURE_PROFILE 4
+void chip8_set_features(chip8_t *vm, unsigned features);
+
+/* Interprets the opcodes that differ between interpreters like one of
+ * CHIP8_PROFILE_*. Returns -1 for an unknown profile.
+ */
+#define CHIP8_PROFILE_MODERN 0
+#define CHIP8_PROFILE_COSMAC_VIP 1
+#define CHIP8_PROFILE_CHIP48 2
+#define CHIP8_PROFILE_SUPER_CHIP 3
+int chip8_set_quirk_profile(chip8_t *vm, int profile);
+
+/* Debugging, these turn on CHIP8_FEATURE_DEBUG. A stopped machine doesn't
+ * execute anything until chip8_resume.
+ */
+#define CHIP8_STOP_NONE 0
+#define CHIP8_STOP_BREAKPOINT 1
+#define CHIP8_STOP_WATCHPOINT 2
+#define CHIP8_STOP_REGISTER 3
+void chip8_set_breakpoint(chip8_t *vm, uint16_t address, int enabled);
+void chip8_set_watchpoint(chip8_t *vm, uint16_t address, int enabled);
+/* Bit n for Vn, bit 16 for I */
+void chip8_watch_registers(chip8_t *vm, uint32_t mask);
+/* One of CHIP8_STOP_*, with the breakpoint, written address or register
+ * in address
+ */
+int chip8_stopped(const chip8_t *vm, uint16_t *address);
+void chip8_resume(chip8_t *vm);
+
+void chip8_get_registers(const chip8_t *vm, chip8_registers_t *registers);
+/* Copies len bytes of memory starting from address. Returns the number of
+ * bytes copied.
+ */
+size_t chip8_read_memory(const chip8_t *vm, uint16_t address, uint8_t *out,
+                         size_t len);
+/* Writes size bytes to memory at address, dropping only the translated
+ * code overlapping them. The machine keeps running from where it is.
+ */
+void chip8_patch(chip8_t *vm, uint16_t address, const uint8_t *bytes,
+                 size_t size);
+/* Copies the 64x32 1-bit framebuffer (256 bytes) */
+void chip8_read_framebuffer(const chip8_t *vm, uint8_t *out);
+/* Stable 64-bit hash of the framebuffer, as stored in golden files */
+uint64_t chip8_framebuffer_hash(const chip8_t *vm);
+
+/* Saved machine states for branching a running program. Forking a state
+ * is cheap: it shares its 256-byte memory pages with the original until
+ * either is saved over. States share pages from a pool, which must outlive
+ * them and the machines they were saved from or restored to. A pool and its
+ * states must be used from one thread at a time.
+ */
+typedef struct chip8_pool chip8_pool_t;
+typedef struct chip8_state chip8_state_t;
+
+chip8_pool_t *chip8_pool_create(void);
+void chip8_pool_destroy(chip8_pool_t *pool);
+/* Pages held by states and machines */
+size_t chip8_pool_used(const chip8_pool_t *pool);
+
+/* An empty state to save into */
+chip8_state_t *chip8_state_create(chip8_pool_t *pool);
+chip8_state_t *chip8_state_fork(const chip8_state_t *state);
+void chip8_state_destroy(chip8_state_t *state);
+/* Equal for states continuing the same way given the same keys, 0 for an
+ * empty state. See MachineState::hash().
+ */
+uint64_t chip8_state_hash(const chip8_state_t *state);
+
+void chip8_save(chip8_t *vm, chip8_state_t *state);
+/* Returns -1 for an empty state */
+int chip8_restore(chip8_t *vm, const chip8_state_t *state);
+
+/* Records spans of loading ROMs, translating code and stepping
+ * environments, keeping the last capacity spans of every thread
+ */
+void chip8_timeline_start(size_t capacity);
+/* Writes the spans recorded so far as Chrome trace-event JSON. Returns -1
+ * if the file couldn't be written.
+ */
+int chip8_timeline_write(const char *filename);
+
+/* Post-processing of screens for display: Scale2x or Scale3x and fading
+ * like phosphor. See PostProcess in postprocess.h.
+ */
+typedef struct chip8_postprocess chip8_postprocess_t;
+
+/* For width x height screens, width a multiple of 64. scale is 1 to 3,
+ * persistence the brightness out of 256 kept per frame, 0 to 255.
+ */
+chip8_postprocess_t *chip8_postprocess_create(int width, int height,
+                                              int scale, int persistence);
+void chip8_postprocess_destroy(chip8_postprocess_t *post);
+/* Uses one of CHIP8_ISA_*, the best the CPU has by default. Returns -1 if
+ * the CPU lacks it.
+ */
+#define CHIP8_ISA_SCALAR 0
+#define CHIP8_ISA_SSE2 1
+#define CHIP8_ISA_AVX2 2
+int chip8_postprocess_set_isa(chip8_postprocess_t *post, int isa);
+/* Processes a screen of 1 bit per pixel, leftmost pixel in the highest bit,
+ * writing width * scale by height * scale ARGB8888 pixels to out
+ */
+void chip8_postprocess_run(chip8_postprocess_t *post, const uint8_t *screen,
+                           uint32_t *out);
+
+/* Encodes a 256-byte screen XORed with the previous one and run-length
+ * encoded, as recordings and streams do. See encode_frame() in recorder.h.
+ * Writes at most capacity bytes to out and returns the full size.
+ */
+size_t chip8_encode_frame(const uint8_t *screen, const uint8_t *previous,
+                          uint8_t *out, size_t capacity);
+/* Applies encoded data to screen, which holds the previous frame. Returns
+ * the number of bytes of data used, 0 if it is damaged.
+ */
+size_t chip8_decode_frame(const uint8_t *data, size_t size, uint8_t *screen);
+
+/* Streams of frames to viewers over a Unix domain socket, see
+ * FrameStreamer and FrameViewer in stream.h
+ */
+typedef struct chip8_streamer chip8_streamer_t;
+typedef struct chip8_viewer chip8_viewer_t;
+
+/* Returns NULL if it can't listen on path */
+chip8_streamer_t *chip8_streamer_create(const char *path);
+void chip8_streamer_destroy(chip8_streamer_t *streamer);
+/* Sends a 256-byte screen to the viewers, once per frame */
+void chip8_streamer_push(chip8_streamer_t *streamer, const uint8_t *screen,
+                         int beeping);
+size_t chip8_streamer_viewers(const chip8_streamer_t *streamer);
+
+chip8_viewer_t *chip8_viewer_create(const char *path);
+void chip8_viewer_destroy(chip8_viewer_t *viewer);
+/* Returns -1 if it couldn't connect */
+int chip8_viewer_connect(chip8_viewer_t *viewer);
+int chip8_viewer_connected(const chip8_viewer_t *viewer);
+/* Applies the frames received so far. Returns 1 if the screen changed. */
+int chip8_viewer_poll(chip8_viewer_t *viewer);
+/* Copies the 256-byte screen, returns whether the beeper sounds */
+int chip8_viewer_screen(const chip8_viewer_t *viewer, uint8_t *out);
+
+/* Assembles a single line into an opcode */
+uint16_t chip8_assemble_instruction(const char *line);
+/* Assembles a program. Writes at most capacity bytes to out and returns
+ * the full size of the program.
+ */
+size_t chip8_assemble(const char *source, uint8_t *out, size_t capacity);
+/* Same as chip8_assemble with the peephole optimizer of the assembler */
+size_t chip8_assemble_optimized(const char *source, uint8_t *out,
+                                size_t capacity);
+
+/* Assembles a program again as its source is edited, parsing only the
+ * lines that changed. See IncrementalAssembler in incremental.h.
+ */
+typedef struct chip8_incremental chip8_incremental_t;
+
+chip8_incremental_t *chip8_incremental_create(void);
+void chip8_incremental_destroy(chip8_incremental_t *assembler);
+/* Returns -1 if labels were undefined */
+int chip8_incremental_update(chip8_incremental_t *assembler,
+                             const char *source);
+/* Writes at most capacity bytes of the binary to out and returns its full
+ * size
+ */
+size_t chip8_incremental_binary(const chip8_incremental_t *assembler,
+                                uint8_t *out, size_t capacity);
+/* Lines parsed and instructions encoded by the last update */
+void chip8_incremental_counts(const chip8_incremental_t *assembler,
+                              int *parsed, int *encoded);
+/* Writes at most capacity ranges of addresses in which the binary differs
+ * from previous to ranges, as pairs of begin and end (excluded), and
+ * returns their full number. Ranges past the end of the binary are to be
+ * cleared.
+ */
+size_t chip8_incremental_changes(const chip8_incremental_t *assembler,
+                                 const uint8_t *previous, size_t size,
+                                 uint16_t *ranges, size_t capacity);
+
+/* Debug info mapping the addresses of an assembled program to its source,
+ * see debuginfo.h
+ */
+typedef struct chip8_debug_info chip8_debug_info_t;
+
+/* Assembles source like chip8_assemble and writes the debug info of the
+ * program to filename, naming the source source_name. Returns -1 if it
+ * couldn't be written.
+ */
+int chip8_write_debug_info(const char *source, const char *source_name,
+                           const char *filename);
+/* Maps the debug info in filename, checked against rom unless it is NULL.
+ * Returns NULL if it can't be read or was written for another program.
+ */
+chip8_debug_info_t *chip8_debug_info_open(const char *filename,
+                                          const uint8_t *rom, size_t size);
+void chip8_debug_info_close(chip8_debug_info_t *info);
+/* The source line of the byte at address and its column, 0 if unknown */
+uint32_t chip8_debug_info_line(const chip8_debug_info_t *info,
+                               uint16_t address, uint32_t *column);
+int chip8_debug_info_is_data(const chip8_debug_info_t *info,
+                             uint16_t address);
+/* Describes address like "file:line:column label+offset". Writes at most
+ * capacity characters to out and returns the full length of the text.
+ */
+size_t chip8_debug_info_describe(const chip8_debug_info_t *info,
+                                 uint16_t address, char *out,
+                                 size_t capacity);
+
+/* Disassembles a program loaded at 0x200 by following its control flow.
+ * The output can be assembled again. Writes at most capacity characters to
+ * out and returns the full length of the text.
+ */
+size_t chip8_disassemble(const uint8_t *rom, size_t size, char *out,
+                         size_t capacity);
+
+/* A batch of machines running the same ROM in lockstep, for training
+ * agents. Each step holds the keys of an action for frame_skip frames.
+ * Observations (count * 256 bytes of screen), rewards (count floats) and
+ * done flags (count bytes) are written into the caller's arrays, which may
+ * be shared memory or numpy arrays.
+ */
+typedef struct chip8_env chip8_env_t;
+
+chip8_env_t *chip8_env_create(const uint8_t *rom, size_t size, int count);
+void chip8_env_destroy(chip8_env_t *env);
+
+void chip8_env_set_frame_skip(chip8_env_t *env, int frames);
+/* Ends episodes after this many frames, 0 for no limit */
+void chip8_env_set_max_frames(chip8_env_t *env, int frames);
+/* Adds scale times the change of the byte at address to the reward */
+void chip8_env_add_reward(chip8_env_t *env, uint16_t address, float scale);
+/* Ends episodes when the byte at address has value, besides on EXIT */
+void chip8_env_set_done(chip8_env_t *env, uint16_t address, uint8_t value);
+/* One of CHIP8_PROFILE_*, returns -1 for an unknown profile */
+int chip8_env_set_quirk_profile(chip8_env_t *env, int profile);
+void chip8_env_set_threads(chip8_env_t *env, int threads);
+void chip8_env_set_buffers(chip8_env_t *env, uint8_t *observations,
+                           float *rewards, uint8_t *dones);
+
+/* Starts new episodes with the given RND seeds. With a mask, only the
+ * machines with a non-zero mask byte, such as the done flags.
+ */
+void chip8_env_reset(chip8_env_t *env, const uint64_t *seeds,
+                     const uint8_t *mask);
+/* actions has a key mask for every machine */
+void chip8_env_step(chip8_env_t *env, const uint16_t *actions);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef OPCODES_H
+#define OPCODES_H
+
+#include <array>
+#include <stdint.h>
+
+/* Operations of the Chip-8 CPU. An opcode is decoded once into an
+ * operation and its operands, so executing it doesn't need to take the
+ * opcode apart again.
+ */
+enum class Op : uint8_t {
+  NOP,       // Unknown opcode, only advances PC
+  INVALID,   // Unknown opcode which doesn't advance PC
+  CLS,       // 00E0
+  RET,       // 00EE
+  EXIT,      // 00FD
+  JP,        // 1nnn
+  CALL,      // 2nnn
+  SE_BYTE,   // 3xkk
+  SNE_BYTE,  // 4xkk
+  SE_REG,    // 5xy0
+  LD_BYTE,   // 6xkk
+  ADD_BYTE,  // 7xkk
+  LD_REG,    // 8xy0
+  OR,        // 8xy1
+  AND,       // 8xy2
+  XOR,       // 8xy3
+  ADD_REG,   // 8xy4
+  SUB,       // 8xy5
+  SHR,       // 8xy6
+  SUBN,      // 8xy7
+  SHL,       // 8xyE
+  SNE_REG,   // 9xy0
+  LD_I,      // Annn
+  JP_V0,     // Bnnn
+  RND,       // Cxkk
+  DRW,       // Dxyn
+  SKP,       // Ex9E
+  SKNP,      // ExA1
+  LD_VX_DT,  // Fx07
+  LD_VX_K,   // Fx0A
+  LD_DT_VX,  // Fx15
+  LD_ST_VX,  // Fx18
+  ADD_I_VX,  // Fx1E
+  LD_F_VX,   // Fx29
+  LD_B_VX,   // Fx33
+  LD_MEM_VX, // Fx55
+  LD_VX_MEM, // Fx65
+  SCD,       // 00Cn, SUPER-CHIP from here on
+  SCR,       // 00FB
+  SCL,       // 00FC
+  LOW,       // 00FE
+  HIGH,      // 00FF
+  LD_HF_VX,  // Fx30
+  LD_R_VX,   // Fx75
+  LD_VX_R    // Fx85
+};
+
+const int OP_COUNT = static_cast<int>(Op::LD_VX_R) + 1;
+
+/* The instruction set, the one description the emulator, the assembler and
+ * the disassembler are all derived from. Every instruction has the bits
+ * that identify it, its operation and a template for its text. In the
+ * template
+ *   %x and %y  are the register numbers in 0x0X00 and 0x00Y0
+ *   %n         is the lowest nibble
+ *   %k         is the lowest byte
+ *   %a         is the 12 bit address
+ * When several entries match an opcode, or have the form of a source line,
+ * the first one wins.
+ */
+struct OpcodeSpec {
+  uint16_t mask;
+  uint16_t pattern;
+  Op op;
+  const char *text;
+};
+
+// Sorted by the highest nibble
+inline constexpr OpcodeSpec OPCODES[] = {
+    {0xFFF0, 0x00C0, Op::SCD, "SCD #%n"},
+    {0xFFFF, 0x00E0, Op::CLS, "CLS"},
+    {0xFFFF, 0x00EE, Op::RET, "RET"},
+    {0xFFFF, 0x00FB, Op::SCR, "SCR"},
+    {0xFFFF, 0x00FC, Op::SCL, "SCL"},
+    {0xFFFF, 0x00FD, Op::EXIT, "EXIT"},
+    {0xFFFF, 0x00FE, Op::LOW, "LOW"},
+    {0xFFFF, 0x00FF, Op::HIGH, "HIGH"},
+    {0xF000, 0x1000, Op::JP, "JP #%a"},
+    {0xF000, 0x2000, Op::CALL, "CALL #%a"},
+    {0xF000, 0x3000, Op::SE_BYTE, "SE V%x, #%k"},
+    {0xF000, 0x4000, Op::SNE_BYTE, "SNE V%x, #%k"},
+    {0xF00F, 0x5000, Op::SE_REG, "SE V%x, V%y"},
+    {0xF000, 0x6000, Op::LD_BYTE, "LD V%x, #%k"},
+    {0xF000, 0x7000, Op::ADD_BYTE, "ADD V%x, #%k"},
+    {0xF00F, 0x8000, Op::LD_REG, "LD V%x, V%y"},
+    {0xF00F, 0x8001, Op::OR, "OR V%x, V%y"},
+    {0xF00F, 0x8002, Op::AND, "AND V%x, V%y"},
+    {0xF00F, 0x8003, Op::XOR, "XOR V%x, V%y"},
+    {0xF00F, 0x8004, Op::ADD_REG, "ADD V%x, V%y"},
+    {0xF00F, 0x8005, Op::SUB, "SUB V%x, V%y"},
+    {0xF0FF, 0x8006, Op::SHR, "SHR V%x"},
+    {0xF00F, 0x8006, Op::SHR, "SHR V%x, V%y"},
+    {0xF00F, 0x8007, Op::SUBN, "SUBN V%x, V%y"},
+    {0xF0FF, 0x800E, Op::SHL, "SHL V%x"},
+    {0xF00F, 0x800E, Op::SHL, "SHL V%x, V%y"},
+    {0xF00F, 0x9000, Op::SNE_REG, "SNE V%x, V%y"},
+    {0xF000, 0xA000, Op::LD_I, "LD I, #%a"},
+    {0xF000, 0xB000, Op::JP_V0, "JP V0, #%a"},
+    {0xF000, 0xC000, Op::RND, "RND V%x, #%k"},
+    {0xF000, 0xD000, Op::DRW, "DRW V%x, V%y, #%n"},
+    {0xF0FF, 0xE09E, Op::SKP, "SKP V%x"},
+    {0xF0FF, 0xE0A1, Op::SKNP, "SKNP V%x"},
+    {0xF0FF, 0xF007, Op::LD_VX_DT, "LD V%x, DT"},
+    {0xF0FF, 0xF00A, Op::LD_VX_K, "LD V%x, K"},
+    {0xF0FF, 0xF015, Op::LD_DT_VX, "LD DT, V%x"},
+    {0xF0FF, 0xF018, Op::LD_ST_VX, "LD ST, V%x"},
+    {0xF0FF, 0xF01E, Op::ADD_I_VX, "ADD I, V%x"},
+    {0xF0FF, 0xF029, Op::LD_F_VX, "LD F, V%x"},
+    {0xF0FF, 0xF030, Op::LD_HF_VX, "LD HF, V%x"},
+    {0xF0FF, 0xF033, Op::LD_B_VX, "LD B, V%x"},
+    {0xF0FF, 0xF055, Op::LD_MEM_VX, "LD [I], V%x"},
+    {0xF0FF, 0xF065, Op::LD_VX_MEM, "LD V%x, [I]"},
+    {0xF0FF, 0xF075, Op::LD_R_VX, "LD R, V%x"},
+    {0xF0FF, 0xF085, Op::LD_VX_R, "LD V%x, R"},
+};
+
+const int OPCODE_COUNT = sizeof(OPCODES) / sizeof(OPCODES[0]);
+
+/* Opcodes are looked up in a table indexed by the highest nibble and the
+ * lowest byte, which tell all instructions apart. The x nibble, which only
+ * the 0 group depends on, is checked against the entry afterwards.
+ */
+constexpr int opcode_slot(uint16_t opcode) {
+  return (opcode >> 4 & 0xF00) | (opcode & 0xFF);
+}
+
+const uint8_t NO_OPCODE = 0xFF;
+
+constexpr std::array<uint8_t, 0x1000> make_opcode_table() {
+  std::array<uint8_t, 0x1000> table{};
+  for (auto slot = 0; slot < 0x1000; slot++) {
+    table[slot] = NO_OPCODE;
+    uint16_t bits = (slot & 0xF00) << 4 | (slot & 0xFF);
+    for (auto i = 0; i < OPCODE_COUNT; i++) {
+      const OpcodeSpec &spec = OPCODES[i];
+      if ((bits & spec.mask & 0xF0FF) == (spec.pattern & 0xF0FF)) {
+        table[slot] = i;
+        break;
+      }
+    }
+  }
+  return table;
+}
+
+inline constexpr std::array<uint8_t, 0x1000> OPCODE_TABLE =
+    make_opcode_table();
+
+/* True if no entry depending on the x nibble shares its slots with another
+ * entry, so checking the single entry found in the table is enough
+ */
+constexpr bool opcode_table_is_exact() {
+  for (auto i = 0; i < OPCODE_COUNT; i++) {
+    if ((OPCODES[i].mask & 0x0F00) == 0)
+      continue;
+    for (auto j = 0; j < OPCODE_COUNT; j++) {
+      uint16_t common = OPCODES[i].mask & OPCODES[j].mask & 0xF0FF;
+      if (i != j &&
+          (OPCODES[i].pattern & common) == (OPCODES[j].pattern & common))
+        return false;
+    }
+  }
+  return true;
+}
+
+static_assert(opcode_table_is_exact(),
+              "Entries depending on the x nibble overlap other entries");
+
+/* The entry describing opcode, nullptr if it isn't an instruction */
+constexpr const OpcodeSpec *find_opcode(uint16_t opcode) {
+  uint8_t index = OPCODE_TABLE[opcode_slot(opcode)];
+  if (index == NO_OPCODE ||
+      (opcode & OPCODES[index].mask) != OPCODES[index].pattern)
+    return nullptr;
+  return &OPCODES[index];
+}
+
+#endif
@@ -0,0 +1,305 @@
+#include <algorithm>
+#include <array>
+#include <string.h>
+
+#include "postprocess.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define POSTPROCESS_X86
+#include <immintrin.h>
+#endif
+
+Isa best_isa() {
+  if (isa_supported(Isa::AVX2))
+    return Isa::AVX2;
+  if (isa_supported(Isa::SSE2))
+    return Isa::SSE2;
+  return Isa::Scalar;
+}
+
+bool isa_supported(Isa isa) {
+  switch (isa) {
+  case Isa::Scalar:
+    return true;
+#ifdef POSTPROCESS_X86
+  case Isa::SSE2:
+    return __builtin_cpu_supports("sse2");
+  case Isa::AVX2:
+    return __builtin_cpu_supports("avx2");
+#endif
+  default:
+    return false;
+  }
+}
+
+// The bits of a byte spread out to every second or third bit, leftmost
+// first, for interleaving the pixels of scaled rows
+constexpr std::array<uint16_t, 256> make_spread2() {
+  std::array<uint16_t, 256> spread{};
+  for (auto byte = 0; byte < 256; byte++)
+    for (auto i = 0; i < 8; i++)
+      if (byte & (0x80 >> i))
+        spread[byte] |= 0x8000 >> (2 * i);
+  return spread;
+}
+
+constexpr std::array<uint32_t, 256> make_spread3() {
+  std::array<uint32_t, 256> spread{};
+  for (auto byte = 0; byte < 256; byte++)
+    for (auto i = 0; i < 8; i++)
+      if (byte & (0x80 >> i))
+        spread[byte] |= 0x800000 >> (3 * i);
+  return spread;
+}
+
+constexpr std::array<uint16_t, 256> spread2 = make_spread2();
+constexpr std::array<uint32_t, 256> spread3 = make_spread3();
+
+// Bits of a where mask is set, of b elsewhere
+static uint64_t pick(uint64_t mask, uint64_t a, uint64_t b) {
+  return (mask & a) | (~mask & b);
+}
+
+// The pixels left and right of every pixel of word i of a row. Pixels past
+// the edges repeat the ones at the edges.
+static uint64_t left(const uint64_t *row, int i) {
+  return row[i] >> 1 | (i > 0 ? row[i - 1] << 63 : row[0] & 1ULL << 63);
+}
+
+static uint64_t right(const uint64_t *row, int i, int words) {
+  return row[i] << 1 | (i + 1 < words ? row[i + 1] >> 63 : row[i] & 1);
+}
+
+PostProcess::PostProcess(int width, int height, int scale, int persistence)
+    : m_width(width), m_height(height), m_scale(std::clamp(scale, 1, 3)),
+      m_persistence(std::clamp(persistence, 0, 255)), m_isa(best_isa()) {
+  m_words.resize(m_width / 64 * m_height);
+  m_scaled.resize(this->width() * this->height() / 8);
+  m_brightness.resize(this->width() * this->height());
+  m_pixels.resize(this->width() * this->height());
+}
+
+bool PostProcess::set_isa(Isa isa) {
+  if (!isa_supported(isa))
+    return false;
+  m_isa = isa;
+  return true;
+}
+
+const uint32_t *PostProcess::process(const uint8_t *screen) {
+  int words = m_width / 64;
+  for (auto i = 0; i < words * m_height; i++) {
+    uint64_t word = 0;
+    for (auto j = 0; j < 8; j++)
+      word = word << 8 | screen[i * 8 + j];
+    m_words[i] = word;
+  }
+
+  if (m_scale == 2)
+    scale2x();
+  else if (m_scale == 3)
+    scale3x();
+  else
+    memcpy(m_scaled.data(), screen, m_scaled.size());
+
+  int end = 0;
+  int count = m_pixels.size();
+#ifdef POSTPROCESS_X86
+  if (m_isa == Isa::AVX2) {
+    end = count & ~31;
+    blend_avx2(end);
+  } else if (m_isa == Isa::SSE2) {
+    end = count & ~15;
+    blend_sse2(end);
+  }
+#endif
+  blend_scalar(end, count);
+  return m_pixels.data();
+}
+
+/* Every pixel E becomes 4 with its neighbours B above, D to the left, F
+ * to the right and H below:
+ *
+ *       B         E0 E1
+ *     D E F  ->   E2 E3
+ *       H
+ *
+ * The corners take the colour of the two neighbours next to them where
+ * those agree, but only where the pixel is on an edge (B != H, D != F).
+ */
+void PostProcess::scale2x() {
+  int words = m_width / 64;
+  int row_bytes = m_width * 2 / 8;
+  for (auto y = 0; y < m_height; y++) {
+    const uint64_t *up = &m_words[std::max(y - 1, 0) * words];
+    const uint64_t *row = &m_words[y * words];
+    const uint64_t *down = &m_words[std::min(y + 1, m_height - 1) * words];
+    uint8_t *out0 = &m_scaled[2 * y * row_bytes];
+    uint8_t *out1 = out0 + row_bytes;
+
+    for (auto i = 0; i < words; i++) {
+      uint64_t B = up[i], H = down[i], E = row[i];
+      uint64_t D = left(row, i), F = right(row, i, words);
+      uint64_t edge = (B ^ H) & (D ^ F);
+      uint64_t e0 = pick(edge & ~(D ^ B), D, E);
+      uint64_t e1 = pick(edge & ~(B ^ F), F, E);
+      uint64_t e2 = pick(edge & ~(D ^ H), D, E);
+      uint64_t e3 = pick(edge & ~(H ^ F), F, E);
+
+      for (auto k = 0; k < 8; k++) {
+        int shift = 56 - 8 * k;
+        uint16_t top = spread2[e0 >> shift & 0xFF] |
+                       spread2[e1 >> shift & 0xFF] >> 1;
+        uint16_t bottom = spread2[e2 >> shift & 0xFF] |
+                          spread2[e3 >> shift & 0xFF] >> 1;
+        out0[i * 16 + 2 * k] = top >> 8;
+        out0[i * 16 + 2 * k + 1] = top;
+        out1[i * 16 + 2 * k] = bottom >> 8;
+        out1[i * 16 + 2 * k + 1] = bottom;
+      }
+    }
+  }
+}
+
+/* Like scale2x() with 9 pixels, the corner neighbours A, C, G and I
+ * deciding the middles of the sides:
+ *
+ *     A B C        E0 E1 E2
+ *     D E F   ->   E3 E4 E5
+ *     G H I        E6 E7 E8
+ */
+void PostProcess::scale3x() {
+  int words = m_width / 64;
+  int row_bytes = m_width * 3 / 8;
+  for (auto y = 0; y < m_height; y++) {
+    const uint64_t *up = &m_words[std::max(y - 1, 0) * words];
+    const uint64_t *row = &m_words[y * words];
+    const uint64_t *down = &m_words[std::min(y + 1, m_height - 1) * words];
+    uint8_t *out[3];
+    for (auto j = 0; j < 3; j++)
+      out[j] = &m_scaled[(3 * y + j) * row_bytes];
+
+    for (auto i = 0; i < words; i++) {
+      uint64_t A = left(up, i), B = up[i], C = right(up, i, words);
+      uint64_t D = left(row, i), E = row[i], F = right(row, i, words);
+      uint64_t G = left(down, i), H = down[i], I = right(down, i, words);
+      uint64_t edge = (B ^ H) & (D ^ F);
+      uint64_t db = ~(D ^ B), bf = ~(B ^ F), dh = ~(D ^ H), hf = ~(H ^ F);
+
+      uint64_t e[9];
+      e[0] = pick(edge & db, D, E);
+      e[1] = pick(edge & ((db & (E ^ C)) | (bf & (E ^ A))), B, E);
+      e[2] = pick(edge & bf, F, E);
+      e[3] = pick(edge & ((db & (E ^ G)) | (dh & (E ^ A))), D, E);
+      e[4] = E;
+      e[5] = pick(edge & ((bf & (E ^ I)) | (hf & (E ^ C))), F, E);
+      e[6] = pick(edge & dh, D, E);
+      e[7] = pick(edge & ((dh & (E ^ I)) | (hf & (E ^ G))), H, E);
+      e[8] = pick(edge & hf, F, E);
+
+      for (auto k = 0; k < 8; k++) {
+        int shift = 56 - 8 * k;
+        for (auto j = 0; j < 3; j++) {
+          uint32_t bits = spread3[e[3 * j] >> shift & 0xFF] |
+                          spread3[e[3 * j + 1] >> shift & 0xFF] >> 1 |
+                          spread3[e[3 * j + 2] >> shift & 0xFF] >> 2;
+          uint8_t *bytes = out[j] + i * 24 + 3 * k;
+          bytes[0] = bits >> 16;
+          bytes[1] = bits >> 8;
+          bytes[2] = bits;
+        }
+      }
+    }
+  }
+}
+
+void PostProcess::blend_scalar(int begin, int end) {
+  for (auto i = begin; i < end; i++) {
+    bool lit = m_scaled[i / 8] & (0x80 >> (i % 8));
+    uint8_t brightness = lit ? 255 : m_brightness[i] * m_persistence >> 8;
+    m_brightness[i] = brightness;
+    m_pixels[i] = 0xFF000000 | brightness * 0x010101;
+  }
+}
+
+#ifdef POSTPROCESS_X86
+
+// 16 pixels at a time: the bits of two bytes become bytes of 0 or 255
+__attribute__((target("sse2"))) void PostProcess::blend_sse2(int end) {
+  const __m128i bits = _mm_setr_epi8(
+      (char)0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01, (char)0x80, 0x40,
+      0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i factor = _mm_set1_epi16(m_persistence);
+  const __m128i alpha = _mm_set1_epi32(0xFF000000);
+
+  for (auto i = 0; i < end; i += 16) {
+    __m128i packed = _mm_cvtsi32_si128(m_scaled[i / 8] | m_scaled[i / 8 + 1] << 8);
+    packed = _mm_unpacklo_epi8(packed, packed);
+    packed = _mm_unpacklo_epi16(packed, packed);
+    packed = _mm_unpacklo_epi32(packed, packed);
+    __m128i lit = _mm_cmpeq_epi8(_mm_and_si128(packed, bits), bits);
+
+    __m128i previous = _mm_loadu_si128((const __m128i *)&m_brightness[i]);
+    __m128i low = _mm_srli_epi16(
+        _mm_mullo_epi16(_mm_unpacklo_epi8(previous, zero), factor), 8);
+    __m128i high = _mm_srli_epi16(
+        _mm_mullo_epi16(_mm_unpackhi_epi8(previous, zero), factor), 8);
+    __m128i brightness = _mm_or_si128(lit, _mm_packus_epi16(low, high));
+    _mm_storeu_si128((__m128i *)&m_brightness[i], brightness);
+
+    // Grey in every byte of a pixel, then opaque
+    __m128i doubled[2] = {_mm_unpacklo_epi8(brightness, brightness),
+                          _mm_unpackhi_epi8(brightness, brightness)};
+    for (auto j = 0; j < 2; j++) {
+      _mm_storeu_si128((__m128i *)&m_pixels[i + 8 * j],
+                       _mm_or_si128(_mm_unpacklo_epi16(doubled[j], doubled[j]),
+                                    alpha));
+      _mm_storeu_si128((__m128i *)&m_pixels[i + 8 * j + 4],
+                       _mm_or_si128(_mm_unpackhi_epi16(doubled[j], doubled[j]),
+                                    alpha));
+    }
+  }
+}
+
+// 32 pixels at a time, from four bytes
+__attribute__((target("avx2"))) void PostProcess::blend_avx2(int end) {
+  const __m256i spread = _mm256_setr_epi8(
+      0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2,
+      3, 3, 3, 3, 3, 3, 3, 3);
+  const __m256i bits = _mm256_set1_epi64x(0x0102040810204080);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i factor = _mm256_set1_epi16(m_persistence);
+  const __m256i alpha = _mm256_set1_epi32(0xFF000000);
+
+  for (auto i = 0; i < end; i += 32) {
+    int32_t word;
+    memcpy(&word, &m_scaled[i / 8], sizeof(word));
+    __m256i packed = _mm256_shuffle_epi8(_mm256_set1_epi32(word), spread);
+    __m256i lit = _mm256_cmpeq_epi8(_mm256_and_si256(packed, bits), bits);
+
+    __m256i previous = _mm256_loadu_si256((const __m256i *)&m_brightness[i]);
+    __m256i low = _mm256_srli_epi16(
+        _mm256_mullo_epi16(_mm256_unpacklo_epi8(previous, zero), factor), 8);
+    __m256i high = _mm256_srli_epi16(
+        _mm256_mullo_epi16(_mm256_unpackhi_epi8(previous, zero), factor), 8);
+    __m256i brightness = _mm256_or_si256(lit, _mm256_packus_epi16(low, high));
+    _mm256_storeu_si256((__m256i *)&m_brightness[i], brightness);
+
+    for (auto j = 0; j < 32; j += 8) {
+      __m256i grey = _mm256_cvtepu8_epi32(
+          _mm_loadl_epi64((const __m128i *)&m_brightness[i + j]));
+      grey = _mm256_or_si256(grey, _mm256_slli_epi32(grey, 8));
+      grey = _mm256_or_si256(grey, _mm256_slli_epi32(grey, 16));
+      _mm256_storeu_si256((__m256i *)&m_pixels[i + j],
+                          _mm256_or_si256(grey, alpha));
+    }
+  }
+}
+
+#else
+
+void PostProcess::blend_sse2(int end) { blend_scalar(0, end); }
+void PostProcess::blend_avx2(int end) { blend_scalar(0, end); }
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef POSTPROCESS_H
+#define POSTPROCESS_H
+
+#include <stdint.h>
+#include <vector>
+
+/* Instruction sets the post-processing can use */
+enum class Isa : uint8_t { Scalar, SSE2, AVX2 };
+
+/* The best instruction set this CPU has */
+Isa best_isa();
+bool isa_supported(Isa isa);
+
+/* PostProcess turns screens, 1 bit per pixel with the leftmost pixel in the
+ * highest bit, into pixels for a window. The screen is scaled with Scale2x or
+ * Scale3x, which round off the stairs of diagonal edges instead of growing
+ * blocks, and blended with the previous frames like phosphor that fades
+ * instead of going dark at once, which hides the flicker of sprites erased
+ * and drawn again every frame.
+ *
+ * The edges are found on 64 pixels at a time, packed in words. The blend
+ * and the conversion to ARGB use SSE2 or AVX2 when the CPU has them.
+ */
+class PostProcess {
+public:
+  /* For width x height screens, width a multiple of 64, enlarged scale
+   * times (1 to 3). persistence is the brightness out of 256 a pixel keeps
+   * per frame after going dark, up to 255; 0 turns it off.
+   */
+  PostProcess(int width, int height, int scale = 1, int persistence = 0);
+
+  int width() const { return m_width * m_scale; }
+  int height() const { return m_height * m_scale; }
+
+  /* Uses the given instruction set, returns false if the CPU lacks it */
+  bool set_isa(Isa isa);
+
+  /* Returns width() * height() ARGB8888 pixels, row by row, valid until
+   * the next call
+   */
+  const uint32_t *process(const uint8_t *screen);
+
+private:
+  void scale2x();
+  void scale3x();
+  /* Fades m_brightness, lights the pixels set in m_scaled and converts the
+   * result into m_pixels
+   */
+  void blend_scalar(int begin, int end);
+  void blend_sse2(int end);
+  void blend_avx2(int end);
+
+  int m_width;
+  int m_height;
+  int m_scale;
+  int m_persistence;
+  Isa m_isa;
+  std::vector<uint64_t> m_words;     // The screen, 64 pixels a word
+  std::vector<uint8_t> m_scaled;     // Scaled screen, 1 bit per pixel
+  std::vector<uint8_t> m_brightness; // Of every scaled pixel
+  std::vector<uint32_t> m_pixels;
+};
+
+#endif
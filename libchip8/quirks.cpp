@@ -0,0 +1,47 @@
+#include <fstream>
+#include <sstream>
+
+#include "cache.h"
+#include "quirks.h"
+
+const char *profile_names[PROFILE_COUNT] = {"modern", "vip", "chip48",
+                                            "schip"};
+
+const char *profile_name(Profile profile) {
+  return profile_names[static_cast<int>(profile)];
+}
+
+bool profile_from_name(const std::string &name, Profile &profile) {
+  for (auto i = 0; i < PROFILE_COUNT; i++) {
+    if (name == profile_names[i]) {
+      profile = static_cast<Profile>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string profile_database(const std::string &rom_filename) {
+  size_t slash = rom_filename.rfind('/');
+  if (slash == std::string::npos)
+    return "profiles.txt";
+  return rom_filename.substr(0, slash + 1) + "profiles.txt";
+}
+
+bool find_profile(const std::string &database, const uint8_t *rom,
+                  size_t size, Profile &profile) {
+  std::ifstream in(database);
+  if (!in.is_open())
+    return false;
+
+  uint64_t hash = rom_hash(rom, size);
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line.substr(0, line.find('#')));
+    uint64_t entry;
+    std::string name;
+    if (fields >> std::hex >> entry >> name && entry == hash)
+      return profile_from_name(name, profile);
+  }
+  return false;
+}
@@ -0,0 +1,60 @@
+#ifndef QUIRKS_H
+#define QUIRKS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/* Interpreters from different eras disagree on a few opcodes, and programs
+ * depend on the interpreter they were written for. A profile names one
+ * such interpreter. Each profile is a separate instantiation of the CPU, so
+ * the quirks are decided at compile time rather than on every instruction.
+ */
+enum class Profile : uint8_t {
+  Modern,    // The default: none of the quirks below
+  CosmacVip, // The original interpreter on the COSMAC VIP
+  Chip48,    // CHIP-48 on the HP-48
+  SuperChip  // SUPER-CHIP 1.1 on the HP-48
+};
+
+const int PROFILE_COUNT = 4;
+
+struct Quirks {
+  bool shift_vy;     // 8xy6 and 8xyE shift Vy into Vx instead of Vx itself
+  bool load_store_i; // Fx55 and Fx65 advance I past the registers
+  bool load_store_x; // ... and stop one short, at I + x
+  bool jump_vx;      // Bxnn jumps to xnn + Vx instead of nnn + V0
+  bool clip;         // DRW clips sprites at the screen edges instead of
+                     // wrapping them around
+};
+
+constexpr Quirks quirks(Profile profile) {
+  switch (profile) {
+  case Profile::CosmacVip:
+    return {true, true, false, false, true};
+  case Profile::Chip48:
+    return {false, true, true, true, true};
+  case Profile::SuperChip:
+    return {false, false, false, true, true};
+  default:
+    return {false, false, false, false, false};
+  }
+}
+
+/* "modern", "vip", "chip48" or "schip" */
+const char *profile_name(Profile profile);
+/* Returns false if name isn't one of the names above */
+bool profile_from_name(const std::string &name, Profile &profile);
+
+/* The profile database for a ROM file: profiles.txt in its directory */
+std::string profile_database(const std::string &rom_filename);
+
+/* Looks rom up in a profile database. Every line of the database is
+ * rom_hash() of a ROM as 16 hexadecimal digits, a profile name and
+ * optionally a comment starting with #. Returns false if the database can't
+ * be read or doesn't have the ROM.
+ */
+bool find_profile(const std::string &database, const uint8_t *rom,
+                  size_t size, Profile &profile);
+
+#endif
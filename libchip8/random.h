@@ -0,0 +1,30 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+/* xorshift64* generator. Every machine has its own, so a run only depends
+ * on its seed and the input, not on other machines in the same process.
+ */
+class Random {
+public:
+  explicit Random(uint64_t seed = 1) { this->seed(seed); }
+
+  void seed(uint64_t seed) { m_state = seed ? seed : 1; }
+  /* What the next numbers depend on, for hashing machine states */
+  uint64_t state() const { return m_state; }
+
+  uint32_t next() {
+    m_state ^= m_state >> 12;
+    m_state ^= m_state << 25;
+    m_state ^= m_state >> 27;
+    return (m_state * 0x2545F4914F6CDD1DULL) >> 32;
+  }
+
+  uint32_t below(uint32_t bound) { return next() % bound; }
+
+private:
+  uint64_t m_state;
+};
+
+#endif
@@ -0,0 +1,136 @@
+#include <chrono>
+#include <string.h>
+
+#include "recorder.h"
+
+const char RLE_MAGIC[] = "CHIP8RLE";
+
+// Luma of lit and dark pixels and the neutral chroma, in video range
+const uint8_t Y4M_LIT = 235;
+const uint8_t Y4M_DARK = 16;
+const uint8_t Y4M_CHROMA = 128;
+
+void encode_frame(const uint8_t *screen, const uint8_t *previous,
+                  std::vector<uint8_t> &out) {
+  int i = 0;
+  while (i < SCREEN_BYTES) {
+    uint8_t byte = screen[i] ^ previous[i];
+    int length = 1;
+    while (i + length < SCREEN_BYTES && length < 255 &&
+           (screen[i + length] ^ previous[i + length]) == byte)
+      length++;
+    out.push_back(length);
+    out.push_back(byte);
+    i += length;
+  }
+}
+
+size_t decode_frame(const uint8_t *data, size_t size, uint8_t *screen) {
+  size_t used = 0;
+  int i = 0;
+  while (i < SCREEN_BYTES) {
+    if (used + 2 > size)
+      return 0;
+    int length = data[used];
+    uint8_t byte = data[used + 1];
+    used += 2;
+    if (length == 0 || i + length > SCREEN_BYTES)
+      return 0;
+    for (auto end = i + length; i < end; i++)
+      screen[i] ^= byte;
+  }
+  return used;
+}
+
+static bool ends_with(const std::string &text, const std::string &suffix) {
+  return text.size() >= suffix.size() &&
+         text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+Recorder::Recorder(const std::string &filename, Overflow overflow)
+    : m_y4m(ends_with(filename, ".y4m")), m_overflow(overflow) {
+  m_file = fopen(filename.c_str(), "wb");
+  if (!m_file)
+    return;
+
+  if (m_y4m) {
+    fprintf(m_file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n",
+            SCREEN_WIDTH, SCREEN_HEIGHT, FRAME_RATE);
+  } else {
+    fwrite(RLE_MAGIC, 1, strlen(RLE_MAGIC), m_file);
+    fputc(SCREEN_WIDTH, m_file);
+    fputc(SCREEN_HEIGHT, m_file);
+  }
+
+  m_writer = std::thread(&Recorder::write_frames, this);
+}
+
+Recorder::~Recorder() {
+  if (!m_file)
+    return;
+  m_done = true;
+  m_writer.join();
+  fclose(m_file);
+}
+
+void Recorder::push(const uint8_t *screen, bool beeping) {
+  if (!m_file)
+    return;
+
+  uint64_t head = m_head.load(std::memory_order_relaxed);
+  while (head - m_tail.load(std::memory_order_acquire) == m_queue.size()) {
+    if (m_overflow == Overflow::Drop) {
+      m_dropped++;
+      return;
+    }
+    std::this_thread::yield();
+  }
+
+  RecordedFrame &frame = m_queue[head % m_queue.size()];
+  memcpy(frame.screen, screen, SCREEN_BYTES);
+  frame.beeping = beeping;
+  m_head.store(head + 1, std::memory_order_release);
+  m_frames++;
+}
+
+void Recorder::write_frames() {
+  for (;;) {
+    // Read done first, so that frames pushed before it was set are written
+    bool done = m_done;
+    uint64_t tail = m_tail.load(std::memory_order_relaxed);
+    uint64_t head = m_head.load(std::memory_order_acquire);
+    if (tail == head) {
+      if (done)
+        break;
+      std::this_thread::sleep_for(std::chrono::milliseconds(4));
+      continue;
+    }
+
+    for (; tail != head; tail++) {
+      write(m_queue[tail % m_queue.size()]);
+      m_tail.store(tail + 1, std::memory_order_release);
+    }
+  }
+  fflush(m_file);
+}
+
+void Recorder::write(const RecordedFrame &frame) {
+  m_buffer.clear();
+
+  if (m_y4m) {
+    fputs(frame.beeping ? "FRAME Xbeep=1\n" : "FRAME Xbeep=0\n", m_file);
+    for (auto i = 0; i < SCREEN_BYTES; i++) {
+      for (auto bit = 7; bit >= 0; bit--)
+        m_buffer.push_back((frame.screen[i] >> bit) & 1 ? Y4M_LIT : Y4M_DARK);
+    }
+    // Both chroma planes at half the resolution in each direction
+    m_buffer.insert(m_buffer.end(), SCREEN_WIDTH * SCREEN_HEIGHT / 2,
+                    Y4M_CHROMA);
+  } else {
+    m_buffer.push_back(frame.beeping ? 1 : 0);
+    encode_frame(frame.screen, m_previous, m_buffer);
+    memcpy(m_previous, frame.screen, SCREEN_BYTES);
+  }
+
+  fwrite(m_buffer.data(), 1, m_buffer.size(), m_file);
+}
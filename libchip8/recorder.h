@@ -0,0 +1,89 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <array>
+#include <atomic>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "chip8.h"
+
+// Frames the writer may fall behind by before frames are dropped, about
+// four seconds at 60 Hz
+const int RECORDER_QUEUE_LENGTH = 256;
+
+/* A presented frame: the screen and whether the beeper sounds */
+struct RecordedFrame {
+  uint8_t screen[SCREEN_BYTES];
+  bool beeping;
+};
+
+/* Appends screen to out, run-length encoded after XOR with previous so
+ * that unchanged bytes become long runs of zeros. Runs are pairs of a
+ * length from 1 to 255 and a byte; they cover exactly SCREEN_BYTES.
+ */
+void encode_frame(const uint8_t *screen, const uint8_t *previous,
+                  std::vector<uint8_t> &out);
+
+/* Reverses encode_frame() into screen, which holds the previous frame.
+ * Returns the number of bytes of data used, 0 if it is damaged.
+ */
+size_t decode_frame(const uint8_t *data, size_t size, uint8_t *screen);
+
+/* Recorder writes frames to a file from a background thread, so that the
+ * emulator never waits for the disk. Frames go through a single producer,
+ * single consumer ring; when the writer falls behind by
+ * RECORDER_QUEUE_LENGTH frames, new frames are dropped and counted. Without
+ * a wall clock to keep up with, as in headless runs, push() can wait for the
+ * writer instead so that no frame is lost.
+ *
+ * Files ending in .y4m are YUV4MPEG2 video at 60 frames per second with
+ * the beeper in an "Xbeep" parameter of every frame. Anything else is the
+ * lossless "CHIP8RLE" format: the magic, the width and the height, then
+ * per frame a byte with the beeper in bit 0 and the encode_frame() data.
+ */
+class Recorder {
+public:
+  enum class Overflow { Drop, Wait };
+
+  explicit Recorder(const std::string &filename,
+                    Overflow overflow = Overflow::Drop);
+  /* Writes the frames still queued and closes the file */
+  ~Recorder();
+
+  Recorder(const Recorder &) = delete;
+  Recorder &operator=(const Recorder &) = delete;
+
+  bool is_open() const { return m_file != nullptr; }
+
+  /* Queues a frame, called once per presented frame */
+  void push(const uint8_t *screen, bool beeping);
+
+  uint64_t frames() const { return m_frames; }
+  uint64_t dropped() const { return m_dropped; }
+
+private:
+  void write_frames();
+  void write(const RecordedFrame &frame);
+
+  FILE *m_file = nullptr;
+  bool m_y4m;
+  Overflow m_overflow;
+  std::array<RecordedFrame, RECORDER_QUEUE_LENGTH> m_queue;
+  std::atomic<uint64_t> m_head{0}; // Next frame to push, set by push()
+  std::atomic<uint64_t> m_tail{0}; // Next frame to write, set by the writer
+  std::atomic<bool> m_done{false};
+  uint64_t m_frames = 0;
+  uint64_t m_dropped = 0;
+
+  // Only used by the writer
+  uint8_t m_previous[SCREEN_BYTES] = {};
+  std::vector<uint8_t> m_buffer;
+
+  std::thread m_writer;
+};
+
+#endif
@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <string.h>
+#include <utility>
+
+#include "state.h"
+
+// Hashes size bytes, a multiple of 8, into hash
+static uint64_t mix(uint64_t hash, const uint8_t *bytes, size_t size) {
+  for (size_t i = 0; i < size; i += 8) {
+    uint64_t word;
+    memcpy(&word, bytes + i, sizeof(word));
+    hash = (hash ^ word) * 0xFF51AFD7ED558CCD;
+    hash ^= hash >> 29;
+  }
+  hash *= 0xC4CEB9FE1A85EC53;
+  return hash ^ (hash >> 32);
+}
+
+uint64_t page_hash(const uint8_t *bytes, int index) {
+  return mix(0x9E3779B97F4A7C15 * (index + 1), bytes, PAGE_SIZE);
+}
+
+Page *PagePool::allocate() {
+  if (m_free == nullptr) {
+    m_chunks.push_back(std::make_unique<Page[]>(m_chunk_pages));
+    Page *chunk = m_chunks.back().get();
+    for (size_t i = 0; i < m_chunk_pages; i++) {
+      chunk[i].next_free = m_free;
+      m_free = &chunk[i];
+    }
+  }
+
+  Page *page = m_free;
+  m_free = page->next_free;
+  page->references = 1;
+  m_used++;
+  return page;
+}
+
+MachineState::MachineState(const MachineState &other) : m_pool(other.m_pool) {
+  *this = other;
+}
+
+MachineState::MachineState(MachineState &&other) : m_pool(other.m_pool) {
+  *this = std::move(other);
+}
+
+MachineState &MachineState::operator=(const MachineState &other) {
+  if (this == &other)
+    return *this;
+
+  // Pages can only be shared within a pool
+  if (m_pool != other.m_pool) {
+    clear();
+    m_pool = other.m_pool;
+  }
+  for (auto i = 0; i < PAGE_COUNT; i++) {
+    if (other.m_pages[i])
+      m_pool->retain(other.m_pages[i]);
+    set_page(i, other.m_pages[i]);
+  }
+
+  m_registers = other.m_registers;
+  m_delay = other.m_delay;
+  m_sound = other.m_sound;
+  std::copy(other.m_flags, other.m_flags + FLAG_REGISTERS, m_flags);
+  m_keys = other.m_keys;
+  m_key_down = other.m_key_down;
+  m_random = other.m_random;
+  m_instructions = other.m_instructions;
+  m_quitting = other.m_quitting;
+  m_faults = other.m_faults;
+  m_fault_PC = other.m_fault_PC;
+  return *this;
+}
+
+MachineState &MachineState::operator=(MachineState &&other) {
+  if (this == &other)
+    return *this;
+
+  // Takes over the references of other
+  clear();
+  m_pool = other.m_pool;
+  std::copy(other.m_pages, other.m_pages + PAGE_COUNT, m_pages);
+  std::fill(other.m_pages, other.m_pages + PAGE_COUNT, nullptr);
+
+  m_registers = other.m_registers;
+  m_delay = other.m_delay;
+  m_sound = other.m_sound;
+  std::copy(other.m_flags, other.m_flags + FLAG_REGISTERS, m_flags);
+  m_keys = other.m_keys;
+  m_key_down = other.m_key_down;
+  m_random = other.m_random;
+  m_instructions = other.m_instructions;
+  m_quitting = other.m_quitting;
+  m_faults = other.m_faults;
+  m_fault_PC = other.m_fault_PC;
+  return *this;
+}
+
+uint64_t MachineState::hash() const {
+  if (empty())
+    return 0;
+
+  // Every part is hashed on its own and combined by XOR, so a page shared
+  // with another state contributes the hash computed when it was saved
+  uint64_t hash = 0;
+  for (auto i = 0; i < PAGE_COUNT; i++)
+    hash ^= m_pages[i]->hash;
+
+  uint8_t cpu[48] = {};
+  static_assert(sizeof(m_registers) == 24, "Registers have padding");
+  memcpy(cpu, &m_registers, sizeof(m_registers));
+  memcpy(cpu + 24, m_flags, FLAG_REGISTERS);
+  memcpy(cpu + 32, &m_keys, sizeof(m_keys));
+  memcpy(cpu + 34, &m_key_down, sizeof(m_key_down));
+  uint64_t random = m_random.state();
+  memcpy(cpu + 40, &random, sizeof(random));
+  return hash ^ mix(0, cpu, sizeof(cpu));
+}
+
+void MachineState::clear() {
+  for (auto i = 0; i < PAGE_COUNT; i++)
+    set_page(i, nullptr);
+}
+
+void MachineState::set_page(int index, Page *page) {
+  if (m_pages[index])
+    m_pool->release(m_pages[index]);
+  m_pages[index] = page;
+}
@@ -0,0 +1,127 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "chip8.h"
+
+const int PAGE_SIZE = 256;
+const int PAGE_COUNT = MEMORY_SIZE / PAGE_SIZE;
+
+static_assert(MEMORY_SIZE % PAGE_SIZE == 0, "Memory isn't made of pages");
+
+/* A page of memory shared by machine states, returned to its pool when the
+ * last state lets go of it
+ */
+struct Page {
+  uint8_t bytes[PAGE_SIZE];
+  uint64_t hash; // Of the bytes and where the page is, set by Chip8::save()
+  uint32_t references;
+  Page *next_free;
+};
+
+/* Hash of the bytes of the page at index, different for equal bytes at
+ * different indexes
+ */
+uint64_t page_hash(const uint8_t *bytes, int index);
+
+/* PagePool hands out pages from chunks allocated in bulk and keeps
+ * released pages for reuse, so forking never calls the allocator once the
+ * pool has grown. It isn't thread safe: the states and machines using a
+ * pool have to stay on one thread at a time, and the pool has to outlive
+ * them.
+ */
+class PagePool {
+public:
+  explicit PagePool(size_t chunk_pages = 1024) : m_chunk_pages(chunk_pages) {}
+
+  PagePool(const PagePool &) = delete;
+  PagePool &operator=(const PagePool &) = delete;
+
+  /* A page with one reference and undefined contents */
+  Page *allocate();
+  void retain(Page *page) { page->references++; }
+  void release(Page *page) {
+    if (--page->references == 0) {
+      page->next_free = m_free;
+      m_free = page;
+      m_used--;
+    }
+  }
+
+  size_t used() const { return m_used; }
+  size_t capacity() const { return m_chunks.size() * m_chunk_pages; }
+
+private:
+  size_t m_chunk_pages;
+  std::vector<std::unique_ptr<Page[]>> m_chunks;
+  Page *m_free = nullptr;
+  size_t m_used = 0;
+};
+
+/* MachineState is everything a machine needs to continue from a point:
+ * memory, registers, timers, keys and the random generator. The debugger,
+ * features and quirk profile belong to the machine and aren't part of it.
+ *
+ * Copying a state forks it in constant time, the copy shares every page of
+ * memory with the original. Chip8::save() only gives a state new pages for
+ * memory written since the machine's last save() or restore(), and
+ * restore() only copies the pages that differ, so branching a running game
+ * costs a few pages rather than all of its memory.
+ */
+class MachineState {
+public:
+  /* An empty state, to save() into */
+  explicit MachineState(PagePool &pool) : m_pool(&pool) {}
+  MachineState(const MachineState &other);
+  MachineState(MachineState &&other);
+  MachineState &operator=(const MachineState &other);
+  MachineState &operator=(MachineState &&other);
+  ~MachineState() { clear(); }
+
+  bool empty() const { return m_pages[0] == nullptr; }
+  PagePool &pool() const { return *m_pool; }
+
+  const Registers &registers() const { return m_registers; }
+  uint8_t memory(uint16_t address) const {
+    return m_pages[address / PAGE_SIZE]->bytes[address % PAGE_SIZE];
+  }
+  /* Hash of everything deciding how the machine continues for given keys:
+   * memory, registers, timers, flag and key registers and the random
+   * generator, but not the instruction count or faults. The pages are
+   * hashed once by the save() creating them and combined by XOR, so this
+   * costs the same however much memory the state has.
+   */
+  uint64_t hash() const;
+  /* True if both states have the very same page, not just equal bytes */
+  bool shares_page(const MachineState &other, int index) const {
+    return m_pages[index] == other.m_pages[index];
+  }
+
+private:
+  friend class Chip8;
+
+  void clear();
+  /* Takes over a reference to page */
+  void set_page(int index, Page *page);
+
+  PagePool *m_pool;
+  Page *m_pages[PAGE_COUNT] = {};
+
+  Registers m_registers = {};
+  Timer m_delay = Timer(60);
+  Timer m_sound = Timer(60);
+  uint8_t m_flags[FLAG_REGISTERS] = {};
+  uint16_t m_keys = 0;
+  uint16_t m_key_down = 0;
+  Random m_random;
+  uint64_t m_instructions = 0;
+  bool m_quitting = false;
+  uint8_t m_faults = FAULT_NONE;
+  uint16_t m_fault_PC = 0;
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include <fcntl.h>
+#include <new>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+const uint32_t STATS_MAGIC = 0x54533843; // "C8ST"
+const uint32_t STATS_VERSION = 1;
+
+struct StatsSegment {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t pid;
+  std::atomic<uint32_t> sequence; // Odd while the counters are written
+  Stats stats;
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free,
+              "The sequence number is shared between processes");
+
+void add_frame_time(Stats &stats, uint32_t frame_time_us) {
+  int bucket = 0;
+  while (bucket < FRAME_TIME_BUCKETS - 1 && frame_time_us >= 1u << (bucket + 9))
+    bucket++;
+  stats.frame_times[bucket]++;
+}
+
+std::string stats_name(int pid) { return "/chip8." + std::to_string(pid); }
+
+StatsPublisher::StatsPublisher(const std::string &name) : m_name(name) {
+  int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+  if (fd < 0)
+    return;
+
+  void *map = MAP_FAILED;
+  if (ftruncate(fd, sizeof(StatsSegment)) == 0)
+    map = mmap(nullptr, sizeof(StatsSegment), PROT_READ | PROT_WRITE,
+               MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    return;
+  }
+
+  m_segment = new (map) StatsSegment();
+  m_segment->magic = STATS_MAGIC;
+  m_segment->version = STATS_VERSION;
+  m_segment->pid = getpid();
+}
+
+StatsPublisher::~StatsPublisher() {
+  if (!m_segment)
+    return;
+  munmap(m_segment, sizeof(StatsSegment));
+  shm_unlink(m_name.c_str());
+}
+
+void StatsPublisher::publish(const Stats &stats) {
+  if (!m_segment)
+    return;
+
+  uint32_t sequence = m_segment->sequence.load(std::memory_order_relaxed);
+  m_segment->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(&m_segment->stats, &stats, sizeof(stats));
+  m_segment->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+StatsReader::StatsReader(const std::string &name) {
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+    return;
+
+  void *map =
+      mmap(nullptr, sizeof(StatsSegment), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return;
+
+  auto segment = static_cast<const StatsSegment *>(map);
+  if (segment->magic != STATS_MAGIC || segment->version != STATS_VERSION) {
+    munmap(map, sizeof(StatsSegment));
+    return;
+  }
+  m_segment = segment;
+}
+
+StatsReader::~StatsReader() {
+  if (m_segment)
+    munmap(const_cast<StatsSegment *>(m_segment), sizeof(StatsSegment));
+}
+
+uint32_t StatsReader::pid() const { return m_segment ? m_segment->pid : 0; }
+
+bool StatsReader::read(Stats &stats) const {
+  // A writer that died halfway leaves the sequence number odd for good
+  for (auto tries = 0; tries < 100000; tries++) {
+    uint32_t before = m_segment->sequence.load(std::memory_order_acquire);
+    if (before & 1)
+      continue;
+    memcpy(&stats, &m_segment->stats, sizeof(stats));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (m_segment->sequence.load(std::memory_order_relaxed) == before)
+      return true;
+  }
+  return false;
+}
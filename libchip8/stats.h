@@ -0,0 +1,76 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+// Frame time buckets, bucket i counts frames shorter than 2^(i + 9) us and
+// the last one everything longer
+const int FRAME_TIME_BUCKETS = 12;
+
+/* Counters of a running emulator, published once per frame */
+struct Stats {
+  uint64_t instructions;     // Executed since start
+  uint64_t frames;
+  uint64_t late_frames;      // Finished after their deadline
+  uint64_t dropped_frames;   // Skipped to catch up with the wall clock
+  uint32_t ips;              // Instructions per second over the last second
+  uint32_t frame_time_us;    // Emulation and presentation of the last frame
+  uint32_t present_time_us;  // Presentation of the last frame
+  uint32_t input_latency_us; // From the last key press to the frame seeing it
+  int64_t timer_drift_us;    // Wall clock ahead of the 60 Hz frame clock
+  uint16_t PC;
+  uint64_t frame_times[FRAME_TIME_BUCKETS];
+};
+
+/* Counts a frame of the given length in its frame time bucket */
+void add_frame_time(Stats &stats, uint32_t frame_time_us);
+
+/* StatsPublisher makes the counters readable by other processes through a
+ * POSIX shared memory segment. Readers never block it: a sequence number
+ * that is odd while the counters are being written tells them to retry.
+ */
+class StatsPublisher {
+public:
+  /* Creates the segment, named like "/chip8.1234". If that fails the
+   * counters are simply not published.
+   */
+  explicit StatsPublisher(const std::string &name);
+  ~StatsPublisher();
+
+  StatsPublisher(const StatsPublisher &) = delete;
+  StatsPublisher &operator=(const StatsPublisher &) = delete;
+
+  void publish(const Stats &stats);
+
+private:
+  std::string m_name;
+  struct StatsSegment *m_segment = nullptr;
+};
+
+class StatsReader {
+public:
+  explicit StatsReader(const std::string &name);
+  ~StatsReader();
+
+  StatsReader(const StatsReader &) = delete;
+  StatsReader &operator=(const StatsReader &) = delete;
+
+  bool is_open() const { return m_segment != nullptr; }
+  /* Process publishing the counters */
+  uint32_t pid() const;
+
+  /* Copies a consistent snapshot of the counters. Returns false if none
+   * could be taken.
+   */
+  bool read(Stats &stats) const;
+
+private:
+  const struct StatsSegment *m_segment = nullptr;
+};
+
+/* Segment name for the given process */
+std::string stats_name(int pid);
+
+#endif
@@ -0,0 +1,135 @@
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "recorder.h"
+#include "stream.h"
+
+// The beeper bit and the longest possible encode_frame() output
+const size_t MAX_MESSAGE = 1 + 2 * SCREEN_BYTES;
+
+static bool socket_address(const std::string &path, sockaddr_un &address) {
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path))
+    return false;
+  memcpy(address.sun_path, path.c_str(), path.size());
+  return true;
+}
+
+FrameStreamer::FrameStreamer(const std::string &path) : m_path(path) {
+  // Sequenced packets keep the messages apart and are sent whole or not at
+  // all
+  sockaddr_un address;
+  if (!socket_address(path, address))
+    return;
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0);
+  if (fd < 0)
+    return;
+
+  unlink(path.c_str());
+  if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+      listen(fd, 16) != 0) {
+    close(fd);
+    return;
+  }
+  m_listener = fd;
+}
+
+FrameStreamer::~FrameStreamer() {
+  if (m_listener < 0)
+    return;
+  for (auto viewer : m_viewers)
+    close(viewer);
+  close(m_listener);
+  unlink(m_path.c_str());
+}
+
+void FrameStreamer::push(const uint8_t *screen, bool beeping) {
+  if (m_listener < 0)
+    return;
+
+  if (beeping != m_beeping || memcmp(screen, m_previous, SCREEN_BYTES) != 0)
+    send_frame(screen, m_previous, beeping, 0);
+
+  // New viewers start from a blank screen
+  size_t first_new = m_viewers.size();
+  int viewer;
+  while ((viewer = accept4(m_listener, nullptr, nullptr, SOCK_NONBLOCK)) >= 0)
+    m_viewers.push_back(viewer);
+  if (first_new < m_viewers.size()) {
+    const uint8_t blank[SCREEN_BYTES] = {};
+    send_frame(screen, blank, beeping, first_new);
+  }
+
+  memcpy(m_previous, screen, SCREEN_BYTES);
+  m_beeping = beeping;
+}
+
+void FrameStreamer::send_frame(const uint8_t *screen, const uint8_t *previous,
+                               bool beeping, size_t first_viewer) {
+  m_message.clear();
+  m_message.push_back(beeping ? 1 : 0);
+  encode_frame(screen, previous, m_message);
+
+  for (size_t i = first_viewer; i < m_viewers.size();) {
+    if (send(m_viewers[i], m_message.data(), m_message.size(),
+             MSG_DONTWAIT | MSG_NOSIGNAL) == (ssize_t)m_message.size()) {
+      i++;
+      continue;
+    }
+    // Gone or too slow, the next frame would be applied to the wrong one
+    close(m_viewers[i]);
+    m_viewers.erase(m_viewers.begin() + i);
+  }
+}
+
+bool FrameViewer::connect() {
+  if (m_socket >= 0)
+    return true;
+
+  sockaddr_un address;
+  if (!socket_address(m_path, address))
+    return false;
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (fd < 0)
+    return false;
+  if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) !=
+      0) {
+    close(fd);
+    return false;
+  }
+
+  m_socket = fd;
+  memset(m_screen, 0, SCREEN_BYTES);
+  m_beeping = false;
+  return true;
+}
+
+void FrameViewer::disconnect() {
+  if (m_socket >= 0)
+    close(m_socket);
+  m_socket = -1;
+}
+
+bool FrameViewer::poll() {
+  bool changed = false;
+  uint8_t message[MAX_MESSAGE];
+  while (m_socket >= 0) {
+    ssize_t size = recv(m_socket, message, sizeof(message), MSG_DONTWAIT);
+    if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+    if (size < 0 && errno == EINTR)
+      continue;
+    if (size <= 1 ||
+        decode_frame(message + 1, size - 1, m_screen) != (size_t)size - 1) {
+      disconnect();
+      break;
+    }
+    m_beeping = message[0] & 1;
+    changed = true;
+  }
+  return changed;
+}
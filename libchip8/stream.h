@@ -0,0 +1,78 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "chip8.h"
+
+/* FrameStreamer lets viewers watch a machine without a window. It listens
+ * on a Unix domain socket and sends every frame that differs from the
+ * previous one to each connected viewer as a single message: a byte with
+ * the beeper in bit 0 followed by encode_frame() data, usually a few bytes.
+ * A viewer that connects first gets the current frame encoded against a
+ * blank screen. Sends never block; a viewer too slow to keep up with the
+ * messages is disconnected and can connect again.
+ */
+class FrameStreamer {
+public:
+  /* Listens on path, replacing a socket left over there */
+  explicit FrameStreamer(const std::string &path);
+  ~FrameStreamer();
+
+  FrameStreamer(const FrameStreamer &) = delete;
+  FrameStreamer &operator=(const FrameStreamer &) = delete;
+
+  bool is_open() const { return m_listener >= 0; }
+  size_t viewers() const { return m_viewers.size(); }
+
+  /* Called once per presented frame */
+  void push(const uint8_t *screen, bool beeping);
+
+private:
+  void send_frame(const uint8_t *screen, const uint8_t *previous,
+                  bool beeping, size_t first_viewer);
+
+  std::string m_path;
+  int m_listener = -1;
+  std::vector<int> m_viewers;
+  uint8_t m_previous[SCREEN_BYTES] = {};
+  bool m_beeping = false;
+  std::vector<uint8_t> m_message;
+};
+
+/* FrameViewer is the other end of a FrameStreamer, keeping a copy of the
+ * screen of the streaming machine
+ */
+class FrameViewer {
+public:
+  explicit FrameViewer(const std::string &path) : m_path(path) {}
+  ~FrameViewer() { disconnect(); }
+
+  FrameViewer(const FrameViewer &) = delete;
+  FrameViewer &operator=(const FrameViewer &) = delete;
+
+  /* Connects unless connected already, returns true when connected */
+  bool connect();
+  bool connected() const { return m_socket >= 0; }
+
+  /* Applies the messages received so far. Returns true if the screen
+   * changed. Disconnects when the stream ends or a message is damaged.
+   */
+  bool poll();
+
+  const std::string &path() const { return m_path; }
+  const uint8_t *screen() const { return m_screen; }
+  bool beeping() const { return m_beeping; }
+
+private:
+  void disconnect();
+
+  std::string m_path;
+  int m_socket = -1;
+  uint8_t m_screen[SCREEN_BYTES] = {};
+  bool m_beeping = false;
+};
+
+#endif
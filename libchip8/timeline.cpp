@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <unistd.h>
+#include <vector>
+
+#include "timeline.h"
+
+struct TimelineEvent {
+  const char *name;
+  int64_t start;
+  int64_t end;
+};
+
+// The spans of one thread. Rings stay after their thread ends, so its
+// spans are still written, and the next thread started records into it.
+// Programs starting threads over and over keep as many rings as they ever
+// ran threads at once, and the ring is the thread in the trace.
+struct TimelineRing {
+  std::mutex mutex; // Only contended while the timeline is written
+  std::vector<TimelineEvent> events;
+  size_t next = 0;
+  size_t count = 0;
+  uint32_t thread;
+  bool in_use = false;
+};
+
+std::atomic<bool> timeline_recording{false};
+
+static std::mutex rings_mutex;
+static std::vector<std::unique_ptr<TimelineRing>> rings;
+static size_t ring_capacity = 0;
+
+/* Keeps the latest spans of ring that fit into capacity */
+static void resize(TimelineRing &ring, size_t capacity) {
+  size_t size = ring.events.size();
+  size_t count = std::min(ring.count, capacity);
+  std::vector<TimelineEvent> events(capacity);
+  for (size_t i = 0; i < count; i++)
+    events[i] = ring.events[(ring.next + size - count + i) % size];
+  ring.events = std::move(events);
+  ring.count = count;
+  ring.next = count % capacity;
+}
+
+void timeline_start(size_t capacity) {
+  std::lock_guard<std::mutex> lock(rings_mutex);
+  ring_capacity = std::max<size_t>(capacity, 1);
+  for (auto const &ring : rings) {
+    std::lock_guard<std::mutex> ring_lock(ring->mutex);
+    if (ring->events.size() != ring_capacity)
+      resize(*ring, ring_capacity);
+  }
+  timeline_recording = true;
+}
+
+int64_t timeline_now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/* Hands the ring of a thread back when the thread ends */
+struct RingOwner {
+  TimelineRing *ring = nullptr;
+
+  ~RingOwner() {
+    if (!ring)
+      return;
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    ring->in_use = false;
+  }
+};
+
+static TimelineRing &thread_ring() {
+  thread_local RingOwner owner;
+  if (!owner.ring) {
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    auto free = std::find_if(rings.begin(), rings.end(),
+                             [](auto const &ring) { return !ring->in_use; });
+    if (free == rings.end()) {
+      rings.push_back(std::make_unique<TimelineRing>());
+      free = rings.end() - 1;
+      (*free)->events.resize(ring_capacity);
+      (*free)->thread = rings.size();
+    }
+    owner.ring = free->get();
+    owner.ring->in_use = true;
+  }
+  return *owner.ring;
+}
+
+void timeline_record(const char *name, int64_t start, int64_t end) {
+  TimelineRing &ring = thread_ring();
+  std::lock_guard<std::mutex> lock(ring.mutex);
+  ring.events[ring.next] = {name, start, end};
+  ring.next = (ring.next + 1) % ring.events.size();
+  ring.count = std::min(ring.count + 1, ring.events.size());
+}
+
+bool timeline_write(const std::string &filename) {
+  std::ofstream out(filename);
+  if (!out.is_open())
+    return false;
+
+  // Complete events, with times in microseconds
+  std::string text = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  char event[256];
+  bool first = true;
+  std::lock_guard<std::mutex> lock(rings_mutex);
+  for (auto const &ring : rings) {
+    std::lock_guard<std::mutex> ring_lock(ring->mutex);
+    size_t size = ring->events.size();
+    for (size_t i = 0; i < ring->count; i++) {
+      const TimelineEvent &span =
+          ring->events[(ring->next + size - ring->count + i) % size];
+      snprintf(event, sizeof(event),
+               "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,"
+               "\"ts\":%.3f,\"dur\":%.3f}",
+               first ? "" : ",", span.name, getpid(), ring->thread,
+               span.start / 1000.0, (span.end - span.start) / 1000.0);
+      text += event;
+      first = false;
+    }
+  }
+  text += "\n]}\n";
+  out << text;
+  return out.good();
+}
@@ -0,0 +1,60 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/* A timeline of spans, the phases of a frame or translations, for finding
+ * what made a frame late. Every thread records into its own ring buffer,
+ * keeping its latest spans, and the rings are written out as Chrome
+ * trace-event JSON for chrome://tracing or Perfetto.
+ *
+ * Nothing is recorded before timeline_start(), and a span then costs a
+ * check of a flag.
+ */
+
+/* Starts recording, keeping the last capacity spans of every thread.
+ * Starting again applies the new capacity to the threads seen so far.
+ */
+void timeline_start(size_t capacity = 64 * 1024);
+/* Writes the spans recorded so far by all threads, oldest first. Returns
+ * false if filename couldn't be written.
+ */
+bool timeline_write(const std::string &filename);
+
+extern std::atomic<bool> timeline_recording;
+
+/* Nanoseconds on the clock of the timeline */
+int64_t timeline_now();
+/* Records a span of the calling thread. name must outlive the timeline,
+ * like a string literal.
+ */
+void timeline_record(const char *name, int64_t start, int64_t end);
+
+/* TimelineSpan records the span from its construction to the end of the
+ * scope
+ */
+class TimelineSpan {
+public:
+  explicit TimelineSpan(const char *name) {
+    if (timeline_recording.load(std::memory_order_relaxed)) {
+      m_name = name;
+      m_start = timeline_now();
+    }
+  }
+  ~TimelineSpan() {
+    if (m_name)
+      timeline_record(m_name, m_start, timeline_now());
+  }
+
+  TimelineSpan(const TimelineSpan &) = delete;
+  TimelineSpan &operator=(const TimelineSpan &) = delete;
+
+private:
+  const char *m_name = nullptr;
+  int64_t m_start = 0;
+};
+
+#endif
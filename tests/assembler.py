@@ -0,0 +1,57 @@
+#!/usr/bin/env python
+
+# Label resolution and source syntax of the assembler
+
+import subprocess
+
+import pytest
+
+from util import IncrementalAssembler, assemble, assembler, run_asm
+
+def test_forward_and_backward_labels():
+    binary = assemble("""
+back:   JP fwd
+        JP back
+fwd:    CALL back
+    """)
+    assert binary == bytes([0x12, 0x04, 0x12, 0x00, 0x22, 0x00])
+
+def test_comments_and_label_only_lines():
+    binary = assemble("""
+    ;; Jump to main
+        JP main
+main:
+        LD V0, #1 ; comment after an instruction
+    """)
+    assert binary == bytes([0x12, 0x02, 0x60, 0x01])
+
+def test_hex_register_names():
+    asm = """
+        LD V0, #FF
+        LD V1, #1
+        ADD V0, V1
+        LD V2, Vf
+        EXIT
+    """
+    emulator_debug = run_asm(asm)
+    assert emulator_debug.get("V2") == 1
+
+@pytest.mark.parametrize("line, error", [
+    ("FOO V1", "Unknown instruction FOO V1 on line 2"),
+    ("LD V16, #1", "Register out of range in LD V16, #1 on line 2"),
+    ("LD I, V1", "Invalid operands in LD I, V1 on line 2"),
+    ("JP nowhere", "Undefined label nowhere on line 2"),
+])
+def test_errors_fail_the_program(tmp_path, line, error):
+    source = tmp_path / "bad.asm"
+    source.write_text("        CLS\n        " + line + "\n        EXIT\n")
+    output = tmp_path / "bad.bin"
+    result = subprocess.run([assembler, "-q", str(source), str(output)],
+                            capture_output=True, text=True)
+    assert result.returncode == 1
+    assert result.stderr == error + "\n"
+    assert not output.exists()
+
+    with IncrementalAssembler() as incremental:
+        assert not incremental.update(source.read_text())
+
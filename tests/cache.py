@@ -0,0 +1,35 @@
+#!/usr/bin/env python
+
+# Translations cached on disk give the same results as fresh ones
+
+import os
+
+from util import Machine
+
+def run_rom(rom, cache=None):
+    with Machine(rom, cache) as machine:
+        machine.run(5000)
+        return machine.debug(), machine.framebuffer()
+
+def read_rom(name):
+    with open(name, "rb") as rom_file:
+        return rom_file.read()
+
+def test_cached_runs_match(tmp_path):
+    rom = read_rom("../roms/pong.ch8")
+    expected = run_rom(rom)
+    assert run_rom(rom, str(tmp_path)) == expected
+    assert len(os.listdir(tmp_path)) == 1
+    assert run_rom(rom, str(tmp_path)) == expected
+
+def test_damaged_entry_is_replaced(tmp_path):
+    rom = read_rom("../roms/Fishie.ch8")
+    expected = run_rom(rom)
+    run_rom(rom, str(tmp_path))
+    entry = tmp_path / os.listdir(tmp_path)[0]
+    data = bytearray(entry.read_bytes())
+    data[-3] ^= 0xff
+    entry.write_bytes(bytes(data))
+
+    assert run_rom(rom, str(tmp_path)) == expected
+    assert entry.read_bytes() != bytes(data)
@@ -14,4 +14,6 @@ def test_call():
 test:   EXIT
     """
     emulator_debug = run_asm(asm)
-    assert emulator_debug.get("PC") == 0x200 + 6
+    # EXIT doesn't advance PC, it stays on the EXIT in the subroutine
+    assert emulator_debug.get("PC") == 0x200 + 4
+    assert emulator_debug.get("SP") == 0x6e
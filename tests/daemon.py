@@ -0,0 +1,86 @@
+#!/usr/bin/env python
+
+# chip8d: jobs sent over its socket, answers, errors and timeouts
+
+import os
+import signal
+import socket
+import subprocess
+import time
+
+import pytest
+
+from util import chip8d
+
+@pytest.fixture
+def daemon(tmp_path):
+    """A daemon with one machine, returning the path of its socket"""
+    path = tmp_path / "chip8d.sock"
+    process = subprocess.Popen([chip8d, "-j", "1", "-t", "200", str(path)],
+                               stdout=subprocess.PIPE, text=True)
+    for _ in range(100):
+        if path.exists():
+            break
+        time.sleep(0.02)
+    yield path
+    process.send_signal(signal.SIGTERM)
+    output, _ = process.communicate(timeout=10)
+    assert process.returncode == 0
+    assert "jobs run" in output
+
+def connect(path):
+    client = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    client.connect(str(path))
+    return client, client.makefile("rb")
+
+def send(client, reader, line, *payloads):
+    client.sendall(line.encode() + b"\n" + b"".join(payloads))
+    return reader.readline().decode().split()
+
+def fields(answer):
+    return dict(word.split("=", 1) for word in answer[1:])
+
+def test_runs_assembly(daemon):
+    source = b"LD V0, 5\nADD V0, 2\nEXIT\n"
+    client, reader = connect(daemon)
+    answer = send(client, reader, f"run asm={len(source)} trace=2", source)
+    assert answer[0] == "ok"
+    result = fields(answer)
+    assert result["V0"] == "07"
+    assert result["end"] == "exit"
+    assert result["trace"] == "2"
+    # The traced instructions with their source lines
+    assert reader.readline().decode().split() == ["202", "ADD", "V0,", "#02",
+                                                  ";", "line", "2"]
+    assert reader.readline().decode().split() == ["204", "EXIT", ";", "line",
+                                                  "3"]
+
+def test_errors_keep_the_connection(daemon):
+    client, reader = connect(daemon)
+    assert send(client, reader, "run rom=2 cycles=x", b"\x00\xfd")[:3] == \
+        ["error", "Bad", "number"]
+    assert send(client, reader, "fly rom=2", b"\x00\xfd") == \
+        ["error", "Unknown", "command", "fly"]
+    source = b"LD V0, missing\n"
+    assert send(client, reader, f"run asm={len(source)}", source)[0] == \
+        "error"
+    answer = send(client, reader, "run rom=2", b"\x00\xfd")
+    assert answer[0] == "ok" and fields(answer)["end"] == "exit"
+
+def test_times_out(daemon):
+    source = b"loop: JP loop\n"
+    client, reader = connect(daemon)
+    answer = send(client, reader,
+                  f"run asm={len(source)} cycles=1000000000000", source)
+    assert answer[:3] == ["error", "Timed", "out"]
+    # Shorter than the daemon allows
+    answer = send(client, reader, f"run asm={len(source)} frames=1000000 "
+                  "cycles=1000000000000 timeout=20", source)
+    assert answer[:5] == ["error", "Timed", "out", "after", "20"]
+
+def test_idle_connections_hold_no_machine(daemon):
+    # With one machine, a client that never sends a job doesn't block others
+    idle, _ = connect(daemon)
+    client, reader = connect(daemon)
+    assert send(client, reader, "run rom=2", b"\x00\xfd")[0] == "ok"
+    idle.close()
@@ -0,0 +1,54 @@
+#!/usr/bin/env python
+
+# Breakpoints, watchpoints and register watches of the debug interpreter
+
+from util import (Machine, assemble, FEATURE_DEBUG, FEATURE_ALL,
+                  STOP_NONE, STOP_BREAKPOINT, STOP_WATCHPOINT, STOP_REGISTER)
+
+PROGRAM = """
+        LD V0, #1
+        LD V1, #2
+        LD I, #300
+        LD [I], V1
+        LD V2, #3
+        EXIT
+"""
+
+def test_breakpoint_stops_before_instruction():
+    with Machine(assemble(PROGRAM)) as machine:
+        machine.set_breakpoint(0x204)
+        assert machine.run() == 2
+        assert machine.stopped() == (STOP_BREAKPOINT, 0x204)
+        assert machine.registers().PC == 0x204
+        assert machine.run() == 0
+
+        machine.resume()
+        machine.run()
+        assert machine.stopped() == (STOP_NONE, 0x204)
+        assert machine.debug()["V2"] == 3
+
+def test_watchpoint_stops_after_write():
+    with Machine(assemble(PROGRAM)) as machine:
+        machine.set_watchpoint(0x301)
+        machine.run()
+        assert machine.stopped() == (STOP_WATCHPOINT, 0x301)
+        assert machine.registers().PC == 0x208
+        assert machine.memory(0x300, 2) == b"\x01\x02"
+
+def test_register_watch():
+    with Machine(assemble(PROGRAM)) as machine:
+        machine.watch_registers(1 << 16)
+        machine.run()
+        assert machine.stopped() == (STOP_REGISTER, 16)
+        assert machine.registers().I == 0x300
+
+def test_switching_features_keeps_state():
+    with Machine(assemble(PROGRAM)) as machine:
+        machine.step(2)
+        machine.set_features(FEATURE_ALL)
+        machine.step(2)
+        machine.set_features(0)
+        machine.run()
+        debug = machine.debug()
+        assert (debug["V0"], debug["V1"], debug["V2"]) == (1, 2, 3)
+        assert machine.memory(0x300, 2) == b"\x01\x02"
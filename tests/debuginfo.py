@@ -0,0 +1,60 @@
+#!/usr/bin/env python
+
+# Debug info mapping addresses of assembled programs to their source
+
+from util import DebugInfo, assemble
+
+SOURCE = """; Counts to ten
+start:  LD V0, 5
+loop:   ADD V0, 1
+        SE V0, 10
+        JP loop
+        LD I, sprite
+        DRW V0, V1, 2
+        EXIT
+sprite: DB #f0, #90
+        DB #ff
+"""
+
+def test_lines_of_instructions(tmp_path):
+    filename = str(tmp_path / "count.ch8.dbg")
+    DebugInfo.write(SOURCE, filename, "count.asm")
+    with DebugInfo(filename) as info:
+        assert info.info
+        assert info.line(0x200) == (2, 9)
+        assert info.line(0x202) == (3, 9)
+        # Both bytes of an instruction belong to its line
+        assert info.line(0x203) == (3, 9)
+        assert info.line(0x20c) == (8, 9)
+        assert info.line(0x1fe) == (0, 0)
+        assert info.line(0x211) == (0, 0)
+        assert info.describe(0x206) == "count.asm:5:9 loop+4"
+        assert info.describe(0x200) == "count.asm:2:9 start"
+
+def test_data_ranges(tmp_path):
+    filename = str(tmp_path / "count.ch8.dbg")
+    DebugInfo.write(SOURCE, filename, "count.asm")
+    with DebugInfo(filename) as info:
+        assert not info.is_data(0x20c)
+        assert all(info.is_data(address) for address in range(0x20e, 0x211))
+        assert not info.is_data(0x211)
+        assert info.line(0x20f) == (9, 9)
+        assert info.line(0x210) == (10, 9)
+        assert info.describe(0x210) == "count.asm:10:9 sprite+2"
+
+def test_checked_against_rom(tmp_path):
+    filename = str(tmp_path / "count.ch8.dbg")
+    DebugInfo.write(SOURCE, filename, "count.asm")
+    rom = assemble(SOURCE)
+    with DebugInfo(filename, rom) as info:
+        assert info.info
+    with DebugInfo(filename, rom[:-1] + b"\x00") as info:
+        assert not info.info
+
+def test_damaged_file_is_rejected(tmp_path):
+    filename = tmp_path / "count.ch8.dbg"
+    DebugInfo.write(SOURCE, str(filename), "count.asm")
+    contents = filename.read_bytes()
+    filename.write_bytes(contents[:-3])
+    with DebugInfo(str(filename)) as info:
+        assert not info.info
@@ -0,0 +1,30 @@
+#!/usr/bin/env python
+
+# Recursive disassembly separates code from data and can be assembled again
+
+from util import assemble, disassemble
+
+def test_roms_reassemble():
+    for name in ["../roms/pong.ch8", "../roms/Fishie.ch8"]:
+        with open(name, "rb") as rom_file:
+            rom = rom_file.read()
+        assert assemble(disassemble(rom)) == rom
+
+def test_data_after_jump():
+    rom = assemble("""
+        LD I, sprite
+        JP end
+sprite: DB #f0, #90
+end:    EXIT
+    """)
+    source = disassemble(rom)
+    assert "DB #f0, #90" in source
+    assert "JP label_206" in source
+    assert assemble(source) == rom
+
+def test_load_into_instruction():
+    # LD I to the second byte of EXIT, which can't get a label
+    rom = bytes([0xa2, 0x03, 0x00, 0xfd])
+    source = disassemble(rom)
+    assert "LD I, #203" in source
+    assert assemble(source) == rom
@@ -0,0 +1,78 @@
+#!/usr/bin/env python
+
+# Machines stepped in lockstep with rewards and done flags, for training
+# agents
+
+from util import Env, assemble
+
+# Counts presses of key 5 in V2 and stores it at 0x302, exits at 3
+COUNTER = assemble("""
+        LD V1, #5
+        LD F, V0
+        DRW V0, V0, 5
+loop:   SKP V1
+        JP loop
+        ADD V2, #1
+        LD I, #300
+        LD [I], V2
+        SNE V2, #3
+        EXIT
+up:     SKNP V1
+        JP up
+        JP loop
+""")
+
+KEY_5 = 1 << 5
+
+def test_observations_are_the_screens():
+    with Env(COUNTER, 2) as env:
+        env.reset([1, 2])
+        assert env.observation(0)[0] == 0
+        env.step([0, 0])
+        assert env.observation(0)[0] == 0xF0
+        assert env.observation(1) == env.observation(0)
+
+def test_rewards_and_done():
+    with Env(COUNTER, 2) as env:
+        env.add_reward(0x302, 0.5)
+        env.reset([1, 1])
+        rewards, dones = env.step([KEY_5, 0])
+        assert rewards == [0.5, 0]
+        assert dones == [0, 0]
+
+        # Releasing and pressing the key again counts once more
+        env.step([0, 0])
+        rewards, _ = env.step([KEY_5, 0])
+        assert rewards == [0.5, 0]
+        env.step([0, 0])
+        _, dones = env.step([KEY_5, 0])
+        assert dones == [1, 0]
+
+        # Until it is reset, a finished machine stays put
+        assert env.step([KEY_5, KEY_5]) == ([0, 0.5], [1, 0])
+        env.reset([1, 1], mask=[1, 0])
+        assert env.dones[0] == 0
+        assert env.step([KEY_5, 0]) == ([0.5, 0], [0, 0])
+
+def test_done_address_and_frame_limit():
+    with Env(COUNTER, 1, frame_skip=4) as env:
+        env.set_done(0x302, 1)
+        env.reset([1])
+        assert env.step([KEY_5])[1] == [1]
+
+    with Env(COUNTER, 1, frame_skip=4) as env:
+        env.set_max_frames(8)
+        env.reset([1])
+        assert env.step([0])[1] == [0]
+        assert env.step([0])[1] == [1]
+
+def test_threads_step_the_same():
+    actions = [KEY_5 if i % 3 else 0 for i in range(17)]
+    results = []
+    for threads in [1, 4]:
+        with Env(COUNTER, 17, threads=threads) as env:
+            env.add_reward(0x302)
+            env.reset(range(17))
+            results.append([env.step(actions), env.step([0] * 17),
+                            env.step(actions)])
+    assert results[0] == results[1]
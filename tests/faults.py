@@ -0,0 +1,52 @@
+#!/usr/bin/env python
+
+# Faults and edge coverage recorded while a program runs
+
+from util import (Machine, assemble, FAULT_MEMORY, FAULT_STACK, FAULT_OPCODE)
+
+def run_faults(asm):
+    with Machine(assemble(asm)) as machine:
+        machine.run()
+        return machine.faults()
+
+def test_no_faults():
+    assert run_faults("""
+        LD I, #300
+        LD [I], V3
+        CALL sub
+        EXIT
+sub:    RET
+    """) == 0
+
+def test_store_past_end_of_memory():
+    assert run_faults("""
+        LD I, #FFE
+        LD [I], V3
+        EXIT
+    """) == FAULT_MEMORY
+
+def test_return_without_call():
+    assert run_faults("""
+        RET
+    """) & FAULT_STACK
+
+def test_unknown_opcode():
+    assert run_faults("""
+        DB #80, #0f
+        EXIT
+    """) == FAULT_OPCODE
+
+def test_coverage_counts_taken_branches():
+    rom = assemble("""
+        LD V0, #3
+loop:   ADD V0, #FF
+        SE V0, #0
+        JP loop
+        EXIT
+    """)
+    with Machine(rom) as machine:
+        coverage = machine.record_coverage()
+        machine.run()
+        counts = sorted(count for count in coverage.raw if count)
+    # SE not skipping twice and skipping once, JP taken twice
+    assert counts == [1, 2, 2]
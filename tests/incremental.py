@@ -0,0 +1,81 @@
+#!/usr/bin/env python
+
+# Assembling a program again as it is edited and patching it into a running
+# machine
+
+from util import IncrementalAssembler, Machine, assemble
+
+SOURCE = """
+start:  LD V0, 1
+loop:   ADD V1, 1
+        LD V2, 1
+        JP loop
+data:   DB #12, #34
+"""
+
+def test_same_binary_as_the_assembler():
+    with IncrementalAssembler() as assembler:
+        assert assembler.update(SOURCE)
+        assert assembler.binary() == assemble(SOURCE)
+        edited = SOURCE.replace("LD V2, 1", "LD V2, 2\n        CLS")
+        assert assembler.update(edited)
+        assert assembler.binary() == assemble(edited)
+
+def test_only_changed_lines_are_parsed():
+    with IncrementalAssembler() as assembler:
+        assembler.update(SOURCE)
+        assert assembler.counts() == (6, 5)
+
+        # Same size, no label moves
+        assembler.update(SOURCE.replace("LD V2, 1", "LD V2, 3"))
+        assert assembler.counts() == (1, 1)
+
+        # The inserted line moves loop and data, only JP loop uses them
+        assembler.update(SOURCE)
+        assembler.update(SOURCE.replace("start:  LD V0, 1",
+                                        "start:  LD V0, 1\n        CLS"))
+        assert assembler.counts() == (1, 2)
+
+        assembler.update(SOURCE.replace("JP loop", "JP nowhere"))
+        assert assembler.counts() == (1, 1)
+        assert not assembler.update(SOURCE.replace("JP loop", "JP nowhere"))
+
+def test_patched_machine_keeps_running():
+    with IncrementalAssembler() as assembler:
+        assembler.update(SOURCE)
+        rom = assembler.binary()
+        with Machine(rom) as machine:
+            machine.run(1001)
+            assert machine.registers().V[2] == 1
+            counter = machine.registers().V[1]
+
+            # LD V2, 1 is at 0x204
+            assembler.update(SOURCE.replace("LD V2, 1", "LD V2, 7"))
+            patched = assembler.binary()
+            assert [i for i in range(len(rom)) if rom[i] != patched[i]] == [5]
+            machine.patch(0x205, patched[5:6])
+
+            machine.run(300)
+            registers = machine.registers()
+            assert registers.V[2] == 7
+            assert registers.V[0] == 1
+            assert registers.V[1] == (counter + 100) % 256
+
+def test_shorter_program_clears_its_old_end():
+    with IncrementalAssembler() as assembler:
+        assembler.update(SOURCE)
+        rom = assembler.binary()
+        assert assembler.changes(rom) == []
+
+        # DB #12, #34 at 0x208 is gone
+        edited = SOURCE.replace("LD V2, 1", "LD V2, 7")
+        assembler.update(edited.replace("data:   DB #12, #34\n", ""))
+        assert assembler.changes(rom) == [(0x205, 0x206), (0x208, 0x20a)]
+
+        # Patched like the emulator does, with zeros past the end
+        with Machine(rom) as machine:
+            patched = assembler.binary().ljust(len(rom), b"\0")
+            for begin, end in assembler.changes(rom):
+                machine.patch(begin, patched[begin - 0x200:end - 0x200])
+            assert machine.memory(0x200, len(rom)) == patched
+            assert machine.memory(0x208, 2) == b"\0\0"
@@ -0,0 +1,85 @@
+#!/usr/bin/env python
+
+# chip8-test: running a manifest, skipping unchanged cases and reporting
+
+import json
+import subprocess
+import xml.etree.ElementTree as ElementTree
+
+from util import chip8_test
+
+PASSING = """
+        LD V0, 3
+        ADD V0, 4
+        EXIT
+"""
+
+FAILING = """
+        LD V0, 1
+        EXIT
+"""
+
+def write_manifest(tmp_path):
+    (tmp_path / "passing.asm").write_text(PASSING)
+    (tmp_path / "failing.asm").write_text(FAILING)
+    (tmp_path / "empty.ch8").write_bytes(b"")
+    (tmp_path / "bad.txt").write_text("seed 1\nzz\n")
+    manifest = tmp_path / "cases.txt"
+    manifest.write_text(
+        "passing  passing.asm  V0=7\n"
+        "failing  failing.asm  V0=2\n"
+        "empty    empty.ch8    V0=0\n"
+        "script   passing.asm  script=bad.txt\n")
+    return manifest
+
+def run(tmp_path, *args):
+    result = subprocess.run([chip8_test, "-j", "2", "-c",
+                             str(tmp_path / "cache"), *args,
+                             str(tmp_path / "cases.txt")],
+                            capture_output=True, text=True)
+    return result.returncode, result.stdout
+
+def test_failures_give_a_reason(tmp_path):
+    write_manifest(tmp_path)
+    status, output = run(tmp_path)
+    assert status == 1
+    assert "FAILED failing: V0 is 1, expected 2" in output
+    assert "FAILED empty: No program in" in output
+    assert "FAILED script: Couldn't parse script" in output
+    assert "1 passed, 3 failed, 0 unchanged" in output
+
+def test_unchanged_cases_are_skipped(tmp_path):
+    write_manifest(tmp_path)
+    run(tmp_path)
+    status, output = run(tmp_path)
+    assert "0 passed, 3 failed, 1 unchanged" in output
+
+    # Forced, or once the program changed, not just its source
+    status, output = run(tmp_path, "-f")
+    assert "1 passed, 3 failed, 0 unchanged" in output
+    (tmp_path / "passing.asm").write_text(PASSING + "\n")
+    status, output = run(tmp_path)
+    assert "0 passed, 3 failed, 1 unchanged" in output
+    (tmp_path / "passing.asm").write_text(PASSING.replace("3", "2")
+                                          .replace("4", "5"))
+    status, output = run(tmp_path)
+    assert "1 passed, 3 failed, 0 unchanged" in output
+
+def test_reports(tmp_path):
+    write_manifest(tmp_path)
+    run(tmp_path, "-o", str(tmp_path / "report.json"))
+    report = json.loads((tmp_path / "report.json").read_text())
+    assert report["failures"] == 3
+    cases = {case["name"]: case for case in report["cases"]}
+    assert cases["passing"]["status"] == "passed"
+    assert cases["passing"]["cycles"] == 3
+    assert cases["failing"]["message"] == "V0 is 1, expected 2"
+
+    run(tmp_path, "-o", str(tmp_path / "report.xml"))
+    suite = ElementTree.parse(tmp_path / "report.xml").getroot()
+    assert suite.get("tests") == "4" and suite.get("failures") == "3"
+    cases = {case.get("name"): case for case in suite}
+    assert cases["passing"].find("system-out").text == \
+        "Unchanged since it passed"
+    assert cases["failing"].find("failure").get("message") == \
+        "V0 is 1, expected 2"
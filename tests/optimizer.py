@@ -0,0 +1,114 @@
+#!/usr/bin/env python
+
+# Peephole optimizer of the assembler: programs get smaller and still end
+# the same way
+
+import pytest
+
+from util import Machine, assemble, assemble_optimized
+
+def run(rom):
+    """The registers and the screen. I is left out as the labels it is
+    loaded with move when instructions are removed.
+    """
+    with Machine(rom) as machine:
+        machine.run()
+        return list(machine.registers().V), machine.framebuffer()
+
+def check(asm, saved):
+    plain = assemble(asm)
+    optimized = assemble_optimized(asm)
+    assert len(plain) - len(optimized) == saved
+    assert run(plain) == run(optimized)
+
+def test_folds_add_into_load():
+    check("""
+        LD V0, 5
+        ADD V0, 3
+        ADD V0, #FE
+        EXIT
+    """, saved=4)
+
+def test_shortens_jump_chains():
+    asm = """
+        JP hop
+        EXIT
+hop:    JP done
+done:   LD V1, 1
+        EXIT
+    """
+    check(asm, saved=2)
+    # JP done, EXIT removed behind it, JP done, LD V1, 1
+    assert assemble_optimized(asm)[:2] == b"\x12\x04"
+
+def test_tail_call_becomes_jump():
+    check("""
+        CALL outer
+        LD V2, 2
+        EXIT
+outer:  LD V0, 1
+        CALL inner
+        RET
+inner:  LD V1, 1
+        RET
+    """, saved=2)
+
+def test_drops_redundant_load_of_i():
+    check("""
+        LD I, sprite
+        DRW V0, V1, 1
+        LD I, sprite
+        DRW V2, V1, 1
+        LD V3, V0
+        LD I, sprite
+        DRW V3, V3, 1
+        EXIT
+sprite: DB #80
+    """, saved=4)
+
+def test_keeps_load_of_i_after_it_changed():
+    check("""
+        LD I, sprite
+        DRW V0, V1, 1
+        LD F, V0
+        LD I, sprite
+        DRW V2, V1, 1
+        EXIT
+sprite: DB #80
+    """, saved=0)
+
+@pytest.mark.parametrize("asm", [
+    # What a skip skips stays where it is
+    """
+        LD V0, 1
+        SE V0, 1
+        LD V1, 2
+        ADD V1, 3
+        EXIT
+    """,
+    """
+        SE V0, 1
+        JP done
+        LD V1, 7
+done:   EXIT
+    """,
+    # Anything can jump to a label
+    """
+        LD V0, 1
+again:  ADD V0, 1
+        SE V0, 4
+        JP again
+        EXIT
+    """,
+])
+def test_keeps_skipped_and_labeled_instructions(asm):
+    check(asm, saved=0)
+
+def test_numeric_addresses_keep_size():
+    check("""
+        JP #204
+        LD V0, 1
+        LD V0, 2
+        ADD V0, 3
+        EXIT
+    """, saved=0)
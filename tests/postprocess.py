@@ -0,0 +1,91 @@
+#!/usr/bin/env python
+
+# Scale2x, Scale3x and phosphor fading, every instruction set against a
+# pixel by pixel reference
+
+import random
+
+import pytest
+
+from util import ISA_AVX2, ISA_SCALAR, ISA_SSE2, PostProcess
+
+def unpack(screen, width, height):
+    return [[screen[(y * width + x) // 8] >> (7 - x % 8) & 1
+             for x in range(width)] for y in range(height)]
+
+def scale(pixels, factor):
+    height, width = len(pixels), len(pixels[0])
+    def at(x, y):
+        return pixels[min(max(y, 0), height - 1)][min(max(x, 0), width - 1)]
+
+    out = [[0] * (width * factor) for _ in range(height * factor)]
+    for y in range(height):
+        for x in range(width):
+            A, B, C = at(x - 1, y - 1), at(x, y - 1), at(x + 1, y - 1)
+            D, E, F = at(x - 1, y), at(x, y), at(x + 1, y)
+            G, H, I = at(x - 1, y + 1), at(x, y + 1), at(x + 1, y + 1)
+            if factor == 1:
+                block = [E]
+            elif B == H or D == F:
+                block = [E] * factor * factor
+            elif factor == 2:
+                block = [D if D == B else E, F if B == F else E,
+                         D if D == H else E, F if H == F else E]
+            else:
+                block = [
+                    D if D == B else E,
+                    B if (D == B and E != C) or (B == F and E != A) else E,
+                    F if B == F else E,
+                    D if (D == B and E != G) or (D == H and E != A) else E,
+                    E,
+                    F if (B == F and E != I) or (H == F and E != C) else E,
+                    D if D == H else E,
+                    H if (D == H and E != I) or (H == F and E != G) else E,
+                    F if H == F else E]
+            for i, pixel in enumerate(block):
+                out[y * factor + i // factor][x * factor + i % factor] = pixel
+    return out
+
+def reference(frames, width, height, factor, persistence):
+    brightness = None
+    for screen in frames:
+        lit = [p for row in scale(unpack(screen, width, height), factor)
+               for p in row]
+        if brightness is None:
+            brightness = [0] * len(lit)
+        brightness = [255 if on else b * persistence >> 8
+                      for on, b in zip(lit, brightness)]
+    return [0xFF000000 | b * 0x010101 for b in brightness]
+
+@pytest.mark.parametrize("isa", [ISA_SCALAR, ISA_SSE2, ISA_AVX2])
+@pytest.mark.parametrize("factor", [1, 2, 3])
+@pytest.mark.parametrize("width,height", [(64, 32), (128, 64)])
+def test_matches_reference(isa, factor, width, height):
+    rng = random.Random(factor * 1000 + width)
+    frames = [bytes(rng.getrandbits(8) & rng.getrandbits(8)
+                    for _ in range(width * height // 8)) for _ in range(3)]
+    with PostProcess(width, height, factor, 200, isa) as post:
+        if not post.supported:
+            pytest.skip("CPU lacks the instruction set")
+        for screen in frames:
+            pixels = post.run(screen)
+    assert pixels == reference(frames, width, height, factor, 200)
+
+def test_diagonal_is_smoothed():
+    # A diagonal line from (0, 0) down to (7, 7)
+    screen = bytearray(256)
+    for i in range(8):
+        screen[i * 8] = 0x80 >> i
+    with PostProcess(64, 32, 2) as post:
+        pixels = post.run(bytes(screen))
+    lit = lambda x, y: pixels[y * 128 + x] == 0xFFFFFFFF
+    # Blocks of 2x2 would leave steps, the corners between them are filled
+    assert lit(2, 1) and lit(1, 2)
+    assert not lit(3, 0) and not lit(0, 3)
+
+def test_dark_pixels_fade():
+    lit = bytes([0x80]) + bytes(255)
+    dark = bytes(256)
+    with PostProcess(64, 32, 1, 128) as post:
+        values = [post.run(screen)[0] & 0xFF for screen in [lit, dark, dark]]
+    assert values == [255, 127, 63]
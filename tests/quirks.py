@@ -0,0 +1,86 @@
+#!/usr/bin/env python
+
+# Quirk profiles: the opcodes interpreted differently by interpreters of
+# different eras
+
+from util import (Machine, assemble, PROFILE_MODERN, PROFILE_COSMAC_VIP,
+                  PROFILE_CHIP48, PROFILE_SUPER_CHIP)
+
+def run_profile(asm, profile):
+    with Machine(assemble(asm)) as machine:
+        machine.set_quirk_profile(profile)
+        machine.run()
+        return machine.debug(), machine.framebuffer()
+
+def test_shift_vy():
+    asm = """
+        LD V1, #3
+        LD V2, #8
+        SHR V1, V2
+        LD V3, #81
+        LD V4, #40
+        SHL V3, V4
+        EXIT
+    """
+    modern, _ = run_profile(asm, PROFILE_MODERN)
+    assert (modern["V1"], modern["V3"]) == (1, 2)
+    vip, _ = run_profile(asm, PROFILE_COSMAC_VIP)
+    assert (vip["V1"], vip["V3"]) == (4, 0x80)
+
+def test_load_store_advances_i():
+    asm = """
+        LD I, #300
+        LD V2, #7
+        LD [I], V2
+        LD V2, [I]
+        EXIT
+    """
+    assert run_profile(asm, PROFILE_MODERN)[0]["I"] == 0x300
+    assert run_profile(asm, PROFILE_SUPER_CHIP)[0]["I"] == 0x300
+    assert run_profile(asm, PROFILE_COSMAC_VIP)[0]["I"] == 0x306
+    assert run_profile(asm, PROFILE_CHIP48)[0]["I"] == 0x304
+
+def test_jump_vx():
+    asm = """
+        LD V0, #2
+        LD V2, #4
+        JP V0, #206
+        LD V5, #1
+        LD V5, #2
+        EXIT
+    """
+    assert run_profile(asm, PROFILE_MODERN)[0]["V5"] == 2
+    assert run_profile(asm, PROFILE_COSMAC_VIP)[0]["V5"] == 2
+    assert run_profile(asm, PROFILE_SUPER_CHIP)[0]["V5"] == 0
+
+def test_clip_sprites():
+    asm = """
+        LD V0, #3e
+        LD V1, #1e
+        LD F, V2
+        DRW V0, V1, 5
+        EXIT
+    """
+    # The 0 of the font at (62, 30) wraps around to the left columns and
+    # the top rows
+    _, wrapped = run_profile(asm, PROFILE_MODERN)
+    assert (wrapped[30 * 8], wrapped[30 * 8 + 7]) == (0xC0, 0x03)
+    assert (wrapped[0], wrapped[7]) == (0x40, 0x02)
+    _, clipped = run_profile(asm, PROFILE_COSMAC_VIP)
+    assert (clipped[30 * 8], clipped[30 * 8 + 7]) == (0, 0x03)
+    assert (clipped[0], clipped[7]) == (0, 0)
+
+def test_profile_survives_feature_changes():
+    rom = assemble("""
+        LD V1, #3
+        LD V2, #8
+        SHR V1, V2
+        EXIT
+    """)
+    with Machine(rom) as machine:
+        machine.set_quirk_profile(PROFILE_COSMAC_VIP)
+        machine.set_breakpoint(0x204)
+        machine.run()
+        machine.resume()
+        machine.run()
+        assert machine.debug()["V1"] == 4
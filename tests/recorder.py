@@ -0,0 +1,94 @@
+#!/usr/bin/env python
+
+# Recordings of the screen: the run-length encoding of frames and the files
+# chip8-run writes
+
+import random
+import subprocess
+
+from util import chip8_run, decode_frame, encode_frame
+
+SCREEN_BYTES = 256
+BLANK = bytes(SCREEN_BYTES)
+ROM = "../roms/pong.ch8"
+
+def round_trip(screen, previous):
+    data = encode_frame(screen, previous)
+    assert decode_frame(data, previous) == (screen, len(data))
+    return data
+
+def test_unchanged_screen():
+    # Runs are at most 255 long, 256 equal bytes take two
+    assert round_trip(BLANK, BLANK) == bytes([255, 0, 1, 0])
+    full = bytes([0xff] * SCREEN_BYTES)
+    assert round_trip(full, BLANK) == bytes([255, 0xff, 1, 0xff])
+
+def test_random_screens():
+    generator = random.Random(8)
+    previous = BLANK
+    for _ in range(50):
+        screen = bytearray(previous)
+        for _ in range(generator.randrange(20)):
+            screen[generator.randrange(SCREEN_BYTES)] = generator.randrange(256)
+        screen = bytes(screen)
+        round_trip(screen, previous)
+        previous = screen
+
+def test_damaged_stream():
+    screen = bytes(range(SCREEN_BYTES))
+    data = encode_frame(screen, BLANK)
+    # Cut short, a run of 0 and a run past the end of the screen
+    assert decode_frame(data[:-2], BLANK)[1] == 0
+    assert decode_frame(bytes([0, 1]) + data, BLANK)[1] == 0
+    assert decode_frame(bytes([255, 0, 2, 0]), BLANK)[1] == 0
+    # Trailing bytes are left for the next frame
+    assert decode_frame(data + b"\x01", BLANK) == (screen, len(data))
+
+def record(tmp_path, name, frames):
+    filename = tmp_path / name
+    output = subprocess.run([chip8_run, "-n", str(frames), "-v", str(filename),
+                             ROM], capture_output=True, check=True).stdout
+    # The hash of the screen at the last frame
+    return filename.read_bytes(), output.split()[-1]
+
+def read_y4m(data):
+    header, _, data = data.partition(b"\n")
+    assert header.startswith(b"YUV4MPEG2 W64 H32 F60:1")
+    frames = []
+    luma, chroma = 64 * 32, 64 * 32 // 2
+    while data:
+        frame_header, _, data = data.partition(b"\n")
+        assert frame_header in (b"FRAME Xbeep=0", b"FRAME Xbeep=1")
+        pixels, data = data[:luma], data[luma + chroma:]
+        screen = bytearray(SCREEN_BYTES)
+        for i, pixel in enumerate(pixels):
+            if pixel == 235:
+                screen[i // 8] |= 0x80 >> (i % 8)
+        frames.append(bytes(screen))
+    return frames
+
+def read_rle(data):
+    assert data[:10] == b"CHIP8RLE" + bytes([64, 32])
+    data = data[10:]
+    frames = []
+    screen = BLANK
+    while data:
+        assert data[0] in (0, 1)
+        screen, used = decode_frame(data[1:], screen)
+        assert used > 0
+        data = data[1 + used:]
+        frames.append(screen)
+    return frames
+
+def test_recordings(tmp_path):
+    # More frames than the queue holds, chip8-run waits for the writer
+    frames = 600
+    y4m, y4m_hash = record(tmp_path, "run.y4m", frames)
+    rle, rle_hash = record(tmp_path, "run.rle", frames)
+    assert y4m_hash == rle_hash
+
+    video = read_y4m(y4m)
+    lossless = read_rle(rle)
+    assert len(video) == len(lossless) == frames
+    assert video == lossless
+    assert lossless[-1] != BLANK
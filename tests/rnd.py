@@ -7,7 +7,7 @@ import re
 import os
 import json
 
-from util import run_asm
+from util import Machine, assemble, run_asm
 
 def test_rnd():
     asm = """
@@ -26,3 +26,19 @@ def test_rnd_v0_is_zero():
     """
     emulator_debug = run_asm(asm)
     assert emulator_debug.get("V0") == 0
+
+def test_rnd_same_seed_same_numbers():
+    rom = assemble("""
+        RND V0, #ff
+        RND V1, #ff
+        RND V2, #ff
+        EXIT
+    """)
+    runs = []
+    for seed in [7, 7, 8]:
+        with Machine(rom) as machine:
+            machine.seed(seed)
+            machine.run()
+            runs.append(machine.debug())
+    assert runs[0] == runs[1]
+    assert runs[0] != runs[2]
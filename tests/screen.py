@@ -0,0 +1,32 @@
+#!/usr/bin/env python
+
+# Framebuffer hashes, as compared by chip8-run against golden files
+
+from util import Machine, assemble
+
+def screen_hash(asm):
+    with Machine(assemble(asm)) as machine:
+        machine.run()
+        return machine.framebuffer_hash()
+
+def test_blank_screen_hash_never_changes():
+    # Golden files store these hashes, a new value breaks all of them
+    assert screen_hash("EXIT") == 0x1865d10eec8688c8
+
+def test_same_screen_same_hash():
+    draw = """
+        LD V0, #5
+        LD F, V0
+        DRW V0, V0, 5
+        EXIT
+    """
+    assert screen_hash(draw) == screen_hash(draw)
+    assert screen_hash(draw) != screen_hash("EXIT")
+
+def test_drawing_twice_restores_hash():
+    assert screen_hash("""
+        LD F, V0
+        DRW V0, V0, 5
+        DRW V0, V0, 5
+        EXIT
+    """) == screen_hash("EXIT")
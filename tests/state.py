@@ -0,0 +1,99 @@
+#!/usr/bin/env python
+
+# Saving, forking and restoring machine states with shared memory pages
+
+from util import Machine, Pool, State, assemble
+
+PAGES = 18 # 4.5K of memory in 256 byte pages
+
+def play(machine, keys, frames):
+    for _ in range(frames):
+        machine.set_keys(keys, keys)
+        machine.step(8)
+
+def test_fork_shares_pages():
+    with open("../roms/pong.ch8", "rb") as rom, Pool() as pool:
+        with Machine(rom.read()) as machine:
+            play(machine, 0, 60)
+            root = State(pool)
+            machine.save(root)
+            assert pool.used() == PAGES
+
+            # Forks share every page, saving a branch only copies the
+            # pages written since
+            branch = root.fork()
+            assert pool.used() == PAGES
+            play(machine, 0x2, 30)
+            machine.save(branch)
+            assert PAGES < pool.used() < 2 * PAGES
+
+            branch.destroy()
+            root.destroy()
+
+def test_restore_replays_deterministically():
+    with open("../roms/pong.ch8", "rb") as rom, Pool() as pool:
+        with Machine(rom.read()) as machine:
+            play(machine, 0, 60)
+            root = State(pool)
+            machine.save(root)
+
+            hashes = []
+            for keys in [0x2, 0x10, 0x2]:
+                machine.restore(root)
+                play(machine, keys, 120)
+                hashes.append((machine.framebuffer_hash(), machine.debug()))
+            assert hashes[0] == hashes[2]
+            assert hashes[0] != hashes[1]
+            root.destroy()
+
+def test_restore_brings_back_overwritten_code():
+    # Counts V2 up to 16, then writes EXIT over its own loop
+    rom = assemble("""
+        LD V0, #00
+        LD V1, #FD
+        LD I, loop
+loop:   ADD V2, #1
+        SE V2, #10
+        JP loop
+        LD [I], V1
+        JP loop
+    """)
+    with Pool() as pool, Machine(rom) as machine:
+        machine.step(9)
+        saved = State(pool)
+        machine.save(saved)
+        counted = machine.debug()["V2"]
+
+        machine.run()
+        assert machine.memory(0x206, 2) == bytes([0x00, 0xFD])
+
+        machine.restore(saved)
+        assert machine.memory(0x206, 2) == bytes([0x72, 0x01])
+        machine.step(3)
+        assert machine.debug()["V2"] == counted + 1
+        saved.destroy()
+
+def test_hash_identifies_states():
+    # Comes back to the state it started from every 3 instructions
+    rom = assemble("""
+loop:   LD V0, #1
+        LD V0, #0
+        JP loop
+    """)
+    with Pool() as pool, Pool() as other, Machine(rom) as machine:
+        states = []
+        for steps in [0, 1, 2]:
+            machine.step(steps)
+            states.append(State(pool))
+            machine.save(states[-1])
+        start, middle, again = states
+        assert start.hash() == again.hash() != middle.hash()
+
+        # Only the contents count, not the pages they are in
+        fork = start.fork()
+        copy = State(other)
+        machine.save(copy)
+        assert fork.hash() == copy.hash() == start.hash()
+
+        for state in states + [fork, copy]:
+            state.destroy()
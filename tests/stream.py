@@ -0,0 +1,86 @@
+#!/usr/bin/env python
+
+# Streams of frames to viewers: late joiners, deltas and slow viewers
+
+import random
+import socket
+
+from util import FrameStreamer, FrameViewer, decode_frame, encode_frame
+
+BLANK = bytes(256)
+
+def screens(seed, count):
+    """Screens changing a few bytes at a time, like a running game"""
+    generator = random.Random(seed)
+    screen = bytearray(256)
+    for _ in range(count):
+        for _ in range(generator.randrange(1, 8)):
+            screen[generator.randrange(256)] = generator.randrange(256)
+        yield bytes(screen)
+
+def raw_viewer(path):
+    """A viewer reading the messages itself"""
+    viewer = socket.socket(socket.AF_UNIX, socket.SOCK_SEQPACKET)
+    viewer.connect(str(path))
+    return viewer
+
+def test_late_joiner_starts_from_blank(tmp_path):
+    path = tmp_path / "stream"
+    first, second, third = screens(1, 3)
+    with FrameStreamer(path) as streamer:
+        streamer.push(first)
+        viewer = raw_viewer(path)
+        # Accepted on the next frame, which it gets whole
+        streamer.push(second, beeping=True)
+        assert streamer.viewers() == 1
+        assert viewer.recv(1024) == b"\x01" + encode_frame(second, BLANK)
+        streamer.push(third)
+        assert viewer.recv(1024) == b"\x00" + encode_frame(third, second)
+        viewer.close()
+
+def test_deltas_reproduce_the_screen(tmp_path):
+    path = tmp_path / "stream"
+    frames = list(screens(2, 200))
+    with FrameStreamer(path) as streamer, FrameViewer(path) as viewer:
+        for i, screen in enumerate(frames):
+            if i == 50:
+                assert viewer.connect()
+            streamer.push(screen, beeping=i % 7 == 0)
+            if i < 50:
+                continue
+            # The first frame arrives with the push after connecting
+            viewer.poll()
+            if i > 50:
+                assert viewer.screen() == (screen, i % 7 == 0)
+        # Unchanged frames aren't sent
+        streamer.push(frames[-1], beeping=False)
+        assert not viewer.poll()
+        assert viewer.connected()
+
+def test_slow_viewer_is_disconnected(tmp_path):
+    path = tmp_path / "stream"
+    frames = list(screens(3, 100000))
+    with FrameStreamer(path) as streamer:
+        viewer = raw_viewer(path)
+        pushed = 0
+        for screen in frames:
+            streamer.push(screen)
+            pushed += 1
+            if pushed > 1 and streamer.viewers() == 0:
+                break
+        assert streamer.viewers() == 0
+
+        # What it got is a prefix of the frames, then the stream ends
+        received = []
+        screen = BLANK
+        while True:
+            message = viewer.recv(1024)
+            if not message:
+                break
+            screen, used = decode_frame(message[1:], screen)
+            assert used == len(message) - 1
+            received.append(screen)
+        viewer.close()
+        assert 0 < len(received) < pushed
+        # Connected before the first frame
+        assert received == frames[:len(received)]
@@ -0,0 +1,105 @@
+#!/usr/bin/env python
+
+# SUPER-CHIP instructions, which the assembler, the disassembler and the
+# emulator all take from the same instruction table
+
+from util import Machine, assemble, disassemble
+
+def run(asm):
+    with Machine(assemble(asm)) as machine:
+        machine.run()
+        return machine.debug(), machine.framebuffer(), machine.faults()
+
+def test_assemble_and_disassemble():
+    source = """
+        SCD #3
+        SCR
+        SCL
+        LOW
+        HIGH
+        LD HF, V2
+        LD R, V7
+        LD V7, R
+        EXIT
+    """
+    binary = assemble(source)
+    assert binary == bytes([0x00, 0xC3, 0x00, 0xFB, 0x00, 0xFC, 0x00, 0xFE,
+                            0x00, 0xFF, 0xF2, 0x30, 0xF7, 0x75, 0xF7, 0x85,
+                            0x00, 0xFD])
+    text = disassemble(binary)
+    for line in ["SCD #3", "SCR", "SCL", "LOW", "HIGH", "LD HF, V2",
+                 "LD R, V7", "LD V7, R"]:
+        assert line in text
+    assert assemble(text) == binary
+
+def test_scroll():
+    # A 1 pixel dot at (8, 0), scrolled down 2 rows, right and left twice
+    _, screen, _ = run("""
+        LD I, dot
+        LD V0, #8
+        LD V1, #0
+        DRW V0, V1, #1
+        SCD #2
+        SCR
+        EXIT
+dot:    DB #80
+    """)
+    assert screen[2 * 8 + 1] == 0x08
+    assert sum(screen) == 0x08
+
+    _, screen, _ = run("""
+        LD I, dot
+        LD V0, #8
+        LD V1, #0
+        DRW V0, V1, #1
+        SCL
+        SCL
+        SCL
+        EXIT
+dot:    DB #80
+    """)
+    assert screen == bytes(256)
+
+def test_flag_registers():
+    debug, _, _ = run("""
+        LD V0, #11
+        LD V1, #22
+        LD R, V1
+        LD V0, #0
+        LD V1, #0
+        LD V1, R
+        EXIT
+    """)
+    assert (debug["V0"], debug["V1"]) == (0x11, 0x22)
+
+def test_big_font():
+    with Machine(assemble("""
+        LD V0, #1
+        LD HF, V0
+        EXIT
+    """)) as machine:
+        machine.run()
+        address = machine.debug()["I"]
+        assert machine.memory(address, 10) == bytes(
+            [0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF])
+
+def test_opcodes_agree():
+    # 5xy1 isn't an instruction: not disassembled and not run as SE
+    rom = bytes([0x51, 0x21, 0x00, 0xFD])
+    assert "SE" not in disassemble(rom)
+    with Machine(rom) as machine:
+        machine.run()
+        assert machine.debug()["PC"] == 0x202
+        assert machine.faults() != 0
+
+    # The disassembler follows the core after opcodes it doesn't know: the
+    # core goes on to the next instruction, or waits in place in the E group
+    for opcode, continues in [(0x5121, True), (0x9121, True),
+                              (0x0123, True), (0xE000, False)]:
+        rom = opcode.to_bytes(2, "big") + bytes([0x00, 0xFD, 0x12, 0x34])
+        source = disassemble(rom)
+        assert ("EXIT" in source) == continues
+        assert "JP" not in source
+        with Machine(rom) as machine:
+            machine.step()
+            assert (machine.debug()["PC"] == 0x202) == continues
@@ -0,0 +1,47 @@
+#!/usr/bin/env python
+
+# Spans recorded into per-thread rings and written as Chrome trace events
+
+from util import Env, Machine, timeline_start, timeline_write
+
+def test_spans_of_loading_and_stepping(tmp_path):
+    timeline_start()
+    with open("../roms/pong.ch8", "rb") as rom_file:
+        rom = rom_file.read()
+    for _ in range(2):
+        with Machine(rom, str(tmp_path / "cache")) as machine:
+            machine.run(100)
+
+    with Env(rom, count=4, frame_skip=2, threads=2) as env:
+        env.reset(range(4))
+        env.step([0] * 4)
+
+    events = timeline_write(str(tmp_path / "timeline.json"))["traceEvents"]
+    names = {event["name"] for event in events}
+    assert {"load ROM", "translate", "write translation cache",
+            "read translation cache", "step machines"} <= names
+    assert all(event["ph"] == "X" and event["dur"] >= 0 for event in events)
+
+    # The worker steps its half of the machines on its own thread
+    threads = {event["tid"] for event in events
+               if event["name"] == "step machines"}
+    assert len(threads) == 2
+
+def test_threads_reuse_rings(tmp_path):
+    timeline_start(capacity=8)
+    with open("../roms/pong.ch8", "rb") as rom_file:
+        rom = rom_file.read()
+    # Every environment starts a worker thread of its own
+    for _ in range(20):
+        with Env(rom, count=2, threads=2) as env:
+            env.reset(range(2))
+            for _ in range(10):
+                env.step([0] * 2)
+
+    events = timeline_write(str(tmp_path / "timeline.json"))["traceEvents"]
+    threads = {event["tid"] for event in events
+               if event["name"] == "step machines"}
+    assert len(threads) == 2
+    # Rings from before keep only as many spans as the new capacity
+    for thread in {event["tid"] for event in events}:
+        assert sum(event["tid"] == thread for event in events) <= 8
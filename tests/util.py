@@ -3,11 +3,545 @@
 import re
 import os
 import json
-
-import pexpect
+import ctypes
 
 assembler = "../assembler/build/assembler"
 emulator = "../emulator/build/bin/emulator"
+library = "../libchip8/build/libchip8.so"
+chip8_run = "../tools/build/chip8-run"
+chip8_test = "../tools/build/chip8-test"
+chip8d = "../tools/build/chip8d"
+
+# Instructions executed before giving up on a program that never EXITs
+CYCLE_BUDGET = 100000
+
+FAULT_MEMORY = 1
+FAULT_STACK = 2
+FAULT_OPCODE = 4
+
+COVERAGE_SIZE = 65536
+
+FEATURE_DEBUG = 1
+FEATURE_TRACE = 2
+FEATURE_PROFILE = 4
+
+FEATURE_ALL = FEATURE_DEBUG | FEATURE_TRACE | FEATURE_PROFILE
+
+PROFILE_MODERN = 0
+PROFILE_COSMAC_VIP = 1
+PROFILE_CHIP48 = 2
+PROFILE_SUPER_CHIP = 3
+
+STOP_NONE = 0
+STOP_BREAKPOINT = 1
+STOP_WATCHPOINT = 2
+STOP_REGISTER = 3
+
+class Registers(ctypes.Structure):
+    _fields_ = [("V", ctypes.c_uint8 * 16),
+                ("I", ctypes.c_uint16),
+                ("SP", ctypes.c_uint16),
+                ("PC", ctypes.c_uint16),
+                ("delay", ctypes.c_uint8),
+                ("sound", ctypes.c_uint8)]
+
+def load_library(path=library):
+    lib = ctypes.CDLL(path)
+    lib.chip8_create.restype = ctypes.c_void_p
+    lib.chip8_destroy.argtypes = [ctypes.c_void_p]
+    lib.chip8_load.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t]
+    lib.chip8_load_cached.argtypes = [ctypes.c_void_p, ctypes.c_char_p,
+                                      ctypes.c_size_t, ctypes.c_char_p]
+    lib.chip8_step.argtypes = [ctypes.c_void_p, ctypes.c_int]
+    lib.chip8_quitting.argtypes = [ctypes.c_void_p]
+    lib.chip8_set_keys.argtypes = [ctypes.c_void_p, ctypes.c_uint16, ctypes.c_uint16]
+    lib.chip8_seed.argtypes = [ctypes.c_void_p, ctypes.c_uint64]
+    lib.chip8_faults.argtypes = [ctypes.c_void_p]
+    lib.chip8_set_coverage.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+    lib.chip8_set_features.argtypes = [ctypes.c_void_p, ctypes.c_uint]
+    lib.chip8_set_quirk_profile.argtypes = [ctypes.c_void_p, ctypes.c_int]
+    lib.chip8_set_breakpoint.argtypes = [ctypes.c_void_p, ctypes.c_uint16,
+                                         ctypes.c_int]
+    lib.chip8_set_watchpoint.argtypes = [ctypes.c_void_p, ctypes.c_uint16,
+                                         ctypes.c_int]
+    lib.chip8_watch_registers.argtypes = [ctypes.c_void_p, ctypes.c_uint32]
+    lib.chip8_stopped.argtypes = [ctypes.c_void_p,
+                                  ctypes.POINTER(ctypes.c_uint16)]
+    lib.chip8_resume.argtypes = [ctypes.c_void_p]
+    lib.chip8_get_registers.argtypes = [ctypes.c_void_p, ctypes.POINTER(Registers)]
+    lib.chip8_read_memory.restype = ctypes.c_size_t
+    lib.chip8_read_memory.argtypes = [ctypes.c_void_p, ctypes.c_uint16,
+                                      ctypes.c_char_p, ctypes.c_size_t]
+    lib.chip8_patch.argtypes = [ctypes.c_void_p, ctypes.c_uint16,
+                                ctypes.c_char_p, ctypes.c_size_t]
+    lib.chip8_read_framebuffer.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+    lib.chip8_framebuffer_hash.restype = ctypes.c_uint64
+    lib.chip8_framebuffer_hash.argtypes = [ctypes.c_void_p]
+    lib.chip8_pool_create.restype = ctypes.c_void_p
+    lib.chip8_pool_destroy.argtypes = [ctypes.c_void_p]
+    lib.chip8_pool_used.restype = ctypes.c_size_t
+    lib.chip8_pool_used.argtypes = [ctypes.c_void_p]
+    lib.chip8_state_create.restype = ctypes.c_void_p
+    lib.chip8_state_create.argtypes = [ctypes.c_void_p]
+    lib.chip8_state_fork.restype = ctypes.c_void_p
+    lib.chip8_state_fork.argtypes = [ctypes.c_void_p]
+    lib.chip8_state_destroy.argtypes = [ctypes.c_void_p]
+    lib.chip8_state_hash.restype = ctypes.c_uint64
+    lib.chip8_state_hash.argtypes = [ctypes.c_void_p]
+    lib.chip8_save.argtypes = [ctypes.c_void_p, ctypes.c_void_p]
+    lib.chip8_restore.argtypes = [ctypes.c_void_p, ctypes.c_void_p]
+    lib.chip8_timeline_start.argtypes = [ctypes.c_size_t]
+    lib.chip8_timeline_write.argtypes = [ctypes.c_char_p]
+    lib.chip8_postprocess_create.restype = ctypes.c_void_p
+    lib.chip8_postprocess_create.argtypes = [ctypes.c_int, ctypes.c_int,
+                                             ctypes.c_int, ctypes.c_int]
+    lib.chip8_postprocess_destroy.argtypes = [ctypes.c_void_p]
+    lib.chip8_postprocess_set_isa.argtypes = [ctypes.c_void_p, ctypes.c_int]
+    lib.chip8_postprocess_run.argtypes = [ctypes.c_void_p, ctypes.c_char_p,
+                                          ctypes.c_void_p]
+    lib.chip8_encode_frame.restype = ctypes.c_size_t
+    lib.chip8_encode_frame.argtypes = [ctypes.c_char_p, ctypes.c_char_p,
+                                       ctypes.c_char_p, ctypes.c_size_t]
+    lib.chip8_decode_frame.restype = ctypes.c_size_t
+    lib.chip8_decode_frame.argtypes = [ctypes.c_char_p, ctypes.c_size_t,
+                                       ctypes.c_char_p]
+    lib.chip8_streamer_create.restype = ctypes.c_void_p
+    lib.chip8_streamer_create.argtypes = [ctypes.c_char_p]
+    lib.chip8_streamer_destroy.argtypes = [ctypes.c_void_p]
+    lib.chip8_streamer_push.argtypes = [ctypes.c_void_p, ctypes.c_char_p,
+                                        ctypes.c_int]
+    lib.chip8_streamer_viewers.restype = ctypes.c_size_t
+    lib.chip8_streamer_viewers.argtypes = [ctypes.c_void_p]
+    lib.chip8_viewer_create.restype = ctypes.c_void_p
+    lib.chip8_viewer_create.argtypes = [ctypes.c_char_p]
+    lib.chip8_viewer_destroy.argtypes = [ctypes.c_void_p]
+    lib.chip8_viewer_connect.argtypes = [ctypes.c_void_p]
+    lib.chip8_viewer_connected.argtypes = [ctypes.c_void_p]
+    lib.chip8_viewer_poll.argtypes = [ctypes.c_void_p]
+    lib.chip8_viewer_screen.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+    lib.chip8_assemble_instruction.restype = ctypes.c_uint16
+    lib.chip8_assemble_instruction.argtypes = [ctypes.c_char_p]
+    lib.chip8_assemble.restype = ctypes.c_size_t
+    lib.chip8_assemble.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_size_t]
+    lib.chip8_incremental_create.restype = ctypes.c_void_p
+    lib.chip8_incremental_destroy.argtypes = [ctypes.c_void_p]
+    lib.chip8_incremental_update.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+    lib.chip8_incremental_binary.restype = ctypes.c_size_t
+    lib.chip8_incremental_binary.argtypes = [ctypes.c_void_p, ctypes.c_char_p,
+                                             ctypes.c_size_t]
+    lib.chip8_incremental_counts.argtypes = [ctypes.c_void_p,
+                                             ctypes.POINTER(ctypes.c_int),
+                                             ctypes.POINTER(ctypes.c_int)]
+    lib.chip8_incremental_changes.restype = ctypes.c_size_t
+    lib.chip8_incremental_changes.argtypes = [ctypes.c_void_p, ctypes.c_char_p,
+                                              ctypes.c_size_t, ctypes.c_void_p,
+                                              ctypes.c_size_t]
+    lib.chip8_assemble_optimized.restype = ctypes.c_size_t
+    lib.chip8_assemble_optimized.argtypes = [ctypes.c_char_p, ctypes.c_char_p,
+                                             ctypes.c_size_t]
+    lib.chip8_write_debug_info.argtypes = [ctypes.c_char_p, ctypes.c_char_p,
+                                           ctypes.c_char_p]
+    lib.chip8_debug_info_open.restype = ctypes.c_void_p
+    lib.chip8_debug_info_open.argtypes = [ctypes.c_char_p, ctypes.c_char_p,
+                                          ctypes.c_size_t]
+    lib.chip8_debug_info_close.argtypes = [ctypes.c_void_p]
+    lib.chip8_debug_info_line.restype = ctypes.c_uint32
+    lib.chip8_debug_info_line.argtypes = [ctypes.c_void_p, ctypes.c_uint16,
+                                          ctypes.POINTER(ctypes.c_uint32)]
+    lib.chip8_debug_info_is_data.argtypes = [ctypes.c_void_p, ctypes.c_uint16]
+    lib.chip8_debug_info_describe.restype = ctypes.c_size_t
+    lib.chip8_debug_info_describe.argtypes = [ctypes.c_void_p, ctypes.c_uint16,
+                                              ctypes.c_char_p, ctypes.c_size_t]
+    lib.chip8_disassemble.restype = ctypes.c_size_t
+    lib.chip8_disassemble.argtypes = [ctypes.c_char_p, ctypes.c_size_t,
+                                      ctypes.c_char_p, ctypes.c_size_t]
+    lib.chip8_env_create.restype = ctypes.c_void_p
+    lib.chip8_env_create.argtypes = [ctypes.c_char_p, ctypes.c_size_t,
+                                     ctypes.c_int]
+    lib.chip8_env_destroy.argtypes = [ctypes.c_void_p]
+    lib.chip8_env_set_frame_skip.argtypes = [ctypes.c_void_p, ctypes.c_int]
+    lib.chip8_env_set_max_frames.argtypes = [ctypes.c_void_p, ctypes.c_int]
+    lib.chip8_env_add_reward.argtypes = [ctypes.c_void_p, ctypes.c_uint16,
+                                         ctypes.c_float]
+    lib.chip8_env_set_done.argtypes = [ctypes.c_void_p, ctypes.c_uint16,
+                                       ctypes.c_uint8]
+    lib.chip8_env_set_quirk_profile.argtypes = [ctypes.c_void_p, ctypes.c_int]
+    lib.chip8_env_set_threads.argtypes = [ctypes.c_void_p, ctypes.c_int]
+    lib.chip8_env_set_buffers.argtypes = [ctypes.c_void_p, ctypes.c_void_p,
+                                          ctypes.c_void_p, ctypes.c_void_p]
+    lib.chip8_env_reset.argtypes = [ctypes.c_void_p, ctypes.c_void_p,
+                                    ctypes.c_void_p]
+    lib.chip8_env_step.argtypes = [ctypes.c_void_p, ctypes.c_void_p]
+    return lib
+
+lib = load_library()
+
+def assemble(asm):
+    source = asm.encode()
+    size = lib.chip8_assemble(source, None, 0)
+    binary = ctypes.create_string_buffer(size)
+    lib.chip8_assemble(source, binary, size)
+    return binary.raw
+
+def assemble_optimized(asm):
+    source = asm.encode()
+    size = lib.chip8_assemble_optimized(source, None, 0)
+    binary = ctypes.create_string_buffer(size)
+    lib.chip8_assemble_optimized(source, binary, size)
+    return binary.raw
+
+def timeline_start(capacity=65536):
+    lib.chip8_timeline_start(capacity)
+
+def timeline_write(filename):
+    """Writes the spans recorded so far and returns them as parsed JSON"""
+    assert lib.chip8_timeline_write(filename.encode()) == 0
+    with open(filename) as timeline:
+        return json.load(timeline)
+
+def disassemble(rom):
+    size = lib.chip8_disassemble(rom, len(rom), None, 0)
+    source = ctypes.create_string_buffer(size)
+    lib.chip8_disassemble(rom, len(rom), source, size)
+    return source.raw.decode()
+
+def encode_frame(screen, previous):
+    size = lib.chip8_encode_frame(screen, previous, None, 0)
+    data = ctypes.create_string_buffer(size)
+    lib.chip8_encode_frame(screen, previous, data, size)
+    return data.raw
+
+def decode_frame(data, previous):
+    """Applies data to previous. Returns the screen and the bytes of data
+    used, 0 if it is damaged.
+    """
+    screen = ctypes.create_string_buffer(bytes(previous), len(previous))
+    used = lib.chip8_decode_frame(data, len(data), screen)
+    return screen.raw, used
+
+class IncrementalAssembler:
+    """Assembles a program again as it is edited"""
+
+    def __init__(self):
+        self.assembler = lib.chip8_incremental_create()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        lib.chip8_incremental_destroy(self.assembler)
+
+    def update(self, asm):
+        """Returns False if labels were undefined"""
+        return lib.chip8_incremental_update(self.assembler, asm.encode()) == 0
+
+    def binary(self):
+        size = lib.chip8_incremental_binary(self.assembler, None, 0)
+        binary = ctypes.create_string_buffer(size)
+        lib.chip8_incremental_binary(self.assembler, binary, size)
+        return binary.raw
+
+    def counts(self):
+        """Lines parsed and instructions encoded by the last update"""
+        parsed = ctypes.c_int()
+        encoded = ctypes.c_int()
+        lib.chip8_incremental_counts(self.assembler, ctypes.byref(parsed),
+                                     ctypes.byref(encoded))
+        return parsed.value, encoded.value
+
+    def changes(self, previous):
+        """The (begin, end) address ranges differing from previous"""
+        count = lib.chip8_incremental_changes(self.assembler, previous,
+                                              len(previous), None, 0)
+        ranges = (ctypes.c_uint16 * (2 * count))()
+        lib.chip8_incremental_changes(self.assembler, previous, len(previous),
+                                      ranges, count)
+        return list(zip(ranges[0::2], ranges[1::2]))
+
+class DebugInfo:
+    """Source lines of an assembled program, from the file the assembler
+    writes with -g
+    """
+
+    def __init__(self, filename, rom=None):
+        size = len(rom) if rom is not None else 0
+        self.info = lib.chip8_debug_info_open(filename.encode(), rom, size)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        if self.info:
+            lib.chip8_debug_info_close(self.info)
+
+    @staticmethod
+    def write(asm, filename, source_name="test.asm"):
+        assert lib.chip8_write_debug_info(asm.encode(), source_name.encode(),
+                                          filename.encode()) == 0
+
+    def line(self, address):
+        """The line and column of address, (0, 0) if unknown"""
+        column = ctypes.c_uint32()
+        line = lib.chip8_debug_info_line(self.info, address,
+                                         ctypes.byref(column))
+        return line, column.value
+
+    def is_data(self, address):
+        return lib.chip8_debug_info_is_data(self.info, address) != 0
+
+    def describe(self, address):
+        size = lib.chip8_debug_info_describe(self.info, address, None, 0)
+        text = ctypes.create_string_buffer(size)
+        lib.chip8_debug_info_describe(self.info, address, text, size)
+        return text.raw.decode()
+
+class Machine:
+    """Chip-8 machine running in-process through libchip8"""
+
+    def __init__(self, rom=b"", cache=None):
+        self.vm = lib.chip8_create()
+        if cache:
+            lib.chip8_load_cached(self.vm, rom, len(rom), cache.encode())
+        else:
+            lib.chip8_load(self.vm, rom, len(rom))
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        lib.chip8_destroy(self.vm)
+
+    def step(self, cycles=1):
+        return lib.chip8_step(self.vm, cycles)
+
+    def run(self, budget=CYCLE_BUDGET):
+        return self.step(budget)
+
+    def set_keys(self, pressed, down=0):
+        lib.chip8_set_keys(self.vm, pressed, down)
+
+    def seed(self, seed):
+        lib.chip8_seed(self.vm, seed)
+
+    def faults(self):
+        return lib.chip8_faults(self.vm)
+
+    def record_coverage(self):
+        """Returns the bitmap the machine counts its control transfers in"""
+        self.coverage = ctypes.create_string_buffer(COVERAGE_SIZE)
+        lib.chip8_set_coverage(self.vm, self.coverage)
+        return self.coverage
+
+    def set_features(self, features):
+        lib.chip8_set_features(self.vm, features)
+
+    def set_quirk_profile(self, profile):
+        assert lib.chip8_set_quirk_profile(self.vm, profile) == 0
+
+    def set_breakpoint(self, address, enabled=True):
+        lib.chip8_set_breakpoint(self.vm, address, enabled)
+
+    def set_watchpoint(self, address, enabled=True):
+        lib.chip8_set_watchpoint(self.vm, address, enabled)
+
+    def watch_registers(self, mask):
+        lib.chip8_watch_registers(self.vm, mask)
+
+    def stopped(self):
+        """The stop reason and the breakpoint, address or register"""
+        address = ctypes.c_uint16()
+        reason = lib.chip8_stopped(self.vm, ctypes.byref(address))
+        return reason, address.value
+
+    def resume(self):
+        lib.chip8_resume(self.vm)
+
+    def registers(self):
+        registers = Registers()
+        lib.chip8_get_registers(self.vm, ctypes.byref(registers))
+        return registers
+
+    def memory(self, address, length):
+        out = ctypes.create_string_buffer(length)
+        copied = lib.chip8_read_memory(self.vm, address, out, length)
+        return out.raw[:copied]
+
+    def patch(self, address, data):
+        lib.chip8_patch(self.vm, address, data, len(data))
+
+    def framebuffer(self):
+        out = ctypes.create_string_buffer(256)
+        lib.chip8_read_framebuffer(self.vm, out)
+        return out.raw
+
+    def framebuffer_hash(self):
+        return lib.chip8_framebuffer_hash(self.vm)
+
+    def save(self, state):
+        lib.chip8_save(self.vm, state.state)
+
+    def restore(self, state):
+        assert lib.chip8_restore(self.vm, state.state) == 0
+
+    def debug(self):
+        """Same values as the emulator prints as JSON on exit"""
+        registers = self.registers()
+        debug = {"I": registers.I, "PC": registers.PC, "SP": registers.SP}
+        for i in range(16):
+            debug[f"V{i:X}"] = registers.V[i]
+        return debug
+
+class Pool:
+    """Memory pages shared by saved states"""
+
+    def __init__(self):
+        self.pool = lib.chip8_pool_create()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        lib.chip8_pool_destroy(self.pool)
+
+    def used(self):
+        return lib.chip8_pool_used(self.pool)
+
+class State:
+    """A saved machine state, forked in constant time"""
+
+    def __init__(self, pool=None, state=None):
+        self.state = state or lib.chip8_state_create(pool.pool)
+
+    def fork(self):
+        return State(state=lib.chip8_state_fork(self.state))
+
+    def hash(self):
+        return lib.chip8_state_hash(self.state)
+
+    def destroy(self):
+        lib.chip8_state_destroy(self.state)
+
+ISA_SCALAR = 0
+ISA_SSE2 = 1
+ISA_AVX2 = 2
+
+class PostProcess:
+    """Scales screens and fades them like phosphor, for display"""
+
+    def __init__(self, width, height, scale=1, persistence=0, isa=None):
+        self.size = width * scale * height * scale
+        self.post = lib.chip8_postprocess_create(width, height, scale,
+                                                 persistence)
+        self.supported = isa is None or \
+            lib.chip8_postprocess_set_isa(self.post, isa) == 0
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        lib.chip8_postprocess_destroy(self.post)
+
+    def run(self, screen):
+        """Returns the ARGB pixels as a list"""
+        pixels = (ctypes.c_uint32 * self.size)()
+        lib.chip8_postprocess_run(self.post, screen, pixels)
+        return list(pixels)
+
+class FrameStreamer:
+    """Sends the frames pushed to viewers connecting to path"""
+
+    def __init__(self, path):
+        self.streamer = lib.chip8_streamer_create(str(path).encode())
+        assert self.streamer
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        lib.chip8_streamer_destroy(self.streamer)
+
+    def push(self, screen, beeping=False):
+        lib.chip8_streamer_push(self.streamer, screen, beeping)
+
+    def viewers(self):
+        return lib.chip8_streamer_viewers(self.streamer)
+
+class FrameViewer:
+    """Keeps a copy of the screen a FrameStreamer sends"""
+
+    def __init__(self, path):
+        self.viewer = lib.chip8_viewer_create(str(path).encode())
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        lib.chip8_viewer_destroy(self.viewer)
+
+    def connect(self):
+        return lib.chip8_viewer_connect(self.viewer) == 0
+
+    def connected(self):
+        return lib.chip8_viewer_connected(self.viewer) != 0
+
+    def poll(self):
+        return lib.chip8_viewer_poll(self.viewer) != 0
+
+    def screen(self):
+        """The screen and whether the beeper sounds"""
+        screen = ctypes.create_string_buffer(256)
+        beeping = lib.chip8_viewer_screen(self.viewer, screen)
+        return screen.raw, beeping != 0
+
+class Env:
+    """Machines running a ROM in lockstep. observations, rewards and dones
+    are ctypes arrays the library writes into; numpy.frombuffer() maps them
+    without copying.
+    """
+
+    def __init__(self, rom, count, frame_skip=1, threads=1):
+        self.count = count
+        self.env = lib.chip8_env_create(rom, len(rom), count)
+        self.observations = (ctypes.c_uint8 * (count * 256))()
+        self.rewards = (ctypes.c_float * count)()
+        self.dones = (ctypes.c_uint8 * count)()
+        lib.chip8_env_set_buffers(self.env, self.observations, self.rewards,
+                                  self.dones)
+        lib.chip8_env_set_frame_skip(self.env, frame_skip)
+        lib.chip8_env_set_threads(self.env, threads)
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        lib.chip8_env_destroy(self.env)
+
+    def add_reward(self, address, scale=1.0):
+        lib.chip8_env_add_reward(self.env, address, scale)
+
+    def set_done(self, address, value):
+        lib.chip8_env_set_done(self.env, address, value)
+
+    def set_max_frames(self, frames):
+        lib.chip8_env_set_max_frames(self.env, frames)
+
+    def reset(self, seeds, mask=None):
+        seeds = (ctypes.c_uint64 * self.count)(*seeds)
+        if mask is not None:
+            mask = (ctypes.c_uint8 * self.count)(*mask)
+        lib.chip8_env_reset(self.env, seeds, mask)
+
+    def step(self, actions):
+        lib.chip8_env_step(self.env, (ctypes.c_uint16 * self.count)(*actions))
+        return list(self.rewards), list(self.dones)
+
+    def observation(self, index):
+        return bytes(self.observations[index * 256:(index + 1) * 256])
+
+def run_asm(asm):
+    with Machine(assemble(asm)) as machine:
+        machine.run()
+        return machine.debug()
 
 def parse_debug(output):
     match = re.search(r"({[\w:,\"]+})", str(output))
@@ -15,7 +549,10 @@ def parse_debug(output):
 
     return json.loads(match.group(1))
 
-def run_asm(asm):
+def run_asm_process(asm):
+    """Runs the program through the assembler and SDL emulator binaries"""
+    import pexpect
+
     filename = "temp.asm"
     binary_name = "out.bin"
     try:
@@ -0,0 +1,538 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <poll.h>
+#include <set>
+#include <signal.h>
+#include <sstream>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "../assembler/assembler.h"
+#include "../disassembler/disassembler.h"
+#include "../libchip8/chip8.h"
+#include "../libchip8/debuginfo.h"
+#include "script.h"
+
+/* chip8d runs jobs for other programs without starting a process per job.
+ * It listens on a Unix domain socket and reads the jobs of every connection
+ * on a thread of its own. Each job runs on a machine taken from a fixed
+ * pool, allocated up front and reused from job to job, so idle connections
+ * hold no machine. A connection can send any number of jobs, one after the
+ * other.
+ *
+ * A job is a line of words, the first one "run", then key=value settings,
+ * followed by the bytes of the program and of the input script whose sizes
+ * the line gives:
+ *
+ *     run rom=246 script=32 cycles=100000 profile=vip trace=8\n<246 bytes><32 bytes>
+ *
+ * rom=n is a binary, asm=n assembly source. script=n is an input script
+ * like the ones of chip8-cover, frames=n runs n frames without input;
+ * otherwise the program runs until EXIT. cycles=n is the budget of
+ * instructions (a million by default), profile=name the quirk profile,
+ * trace=n asks for the last n instructions executed (up to 256) and
+ * timeout=ms shortens the time a job may take.
+ *
+ * The answer is a line of the results, the registers, the screen hash, the
+ * instructions executed, faults and why the run ended (exit, frames or
+ * budget), followed by trace=n lines of address and instruction, for
+ * assembly with the source line:
+ *
+ *     ok V0=01 ... VF=00 I=2a0 SP=070 PC=206 hash=... instructions=52
+ *     faults=0 end=exit trace=1
+ *     204 EXIT  ; line 7
+ *
+ * or "error" and a message, after which the connection stays usable.
+ */
+
+const long DEFAULT_CYCLES = 1000000;
+const size_t MAX_SOURCE = 1 << 20;  // Bytes of assembly source
+const size_t MAX_SCRIPT = 16 << 20; // Bytes of an input script
+const size_t MAX_LINE = 4096;
+
+struct Options {
+  std::string path;
+  int machines = std::max(1u, std::thread::hardware_concurrency());
+  int timeout_ms = 10000; // Longest a job may run
+  std::string translations; // Cache directory, from CHIP8_CACHE
+};
+
+struct Job {
+  std::vector<uint8_t> rom;
+  std::vector<uint8_t> debug_info; // Of assembly
+  std::string script;
+  bool has_script = false;
+  int frames = 0;
+  long cycles = DEFAULT_CYCLES;
+  Profile profile = Profile::Modern;
+  int trace = 0;
+  int timeout_ms = 0;
+};
+
+/* Buffered reads and whole writes on a connected socket */
+class Connection {
+public:
+  explicit Connection(int fd) : m_fd(fd) {}
+
+  /* Reads up to a newline, which isn't kept. False at the end or when the
+   * line is too long.
+   */
+  bool read_line(std::string &line) {
+    for (;;) {
+      size_t end = m_buffer.find('\n');
+      if (end != std::string::npos) {
+        line = m_buffer.substr(0, end);
+        m_buffer.erase(0, end + 1);
+        return true;
+      }
+      if (m_buffer.size() > MAX_LINE || !fill())
+        return false;
+    }
+  }
+
+  bool read_bytes(size_t count, std::string &bytes) {
+    while (m_buffer.size() < count) {
+      if (!fill())
+        return false;
+    }
+    bytes = m_buffer.substr(0, count);
+    m_buffer.erase(0, count);
+    return true;
+  }
+
+  bool write(const std::string &text) {
+    size_t sent = 0;
+    while (sent < text.size()) {
+      ssize_t n = send(m_fd, text.data() + sent, text.size() - sent,
+                       MSG_NOSIGNAL);
+      if (n <= 0)
+        return false;
+      sent += n;
+    }
+    return true;
+  }
+
+private:
+  bool fill() {
+    char chunk[64 * 1024];
+    ssize_t n = recv(m_fd, chunk, sizeof(chunk), 0);
+    if (n <= 0)
+      return false;
+    m_buffer.append(chunk, n);
+    return true;
+  }
+
+  int m_fd;
+  std::string m_buffer;
+};
+
+/* Reads the job announced by line from connection. Returns false with a
+ * message if it is malformed. broken is set when the rest of the job
+ * couldn't be read, which ends the connection.
+ */
+bool read_job(const std::string &line, Connection &connection, Job &job,
+              std::string &message, bool &broken) {
+  std::istringstream words(line);
+  std::string command;
+  words >> command;
+  std::map<std::string, std::string> settings;
+  std::string word;
+  while (words >> word) {
+    size_t equals = word.find('=');
+    if (equals == std::string::npos) {
+      message = "Expected key=value: " + word;
+      broken = true;
+      return false;
+    }
+    settings[word.substr(0, equals)] = word.substr(equals + 1);
+  }
+
+  // The sizes are needed to find the next job, whatever else is wrong
+  size_t sizes[3] = {};
+  const char *payloads[3] = {"rom", "asm", "script"};
+  try {
+    for (auto i = 0; i < 3; i++) {
+      if (settings.count(payloads[i]))
+        sizes[i] = std::stoul(settings[payloads[i]]);
+    }
+  } catch (const std::exception &) {
+    message = "Bad size in " + line;
+    broken = true;
+    return false;
+  }
+  size_t rom_size = sizes[0], asm_size = sizes[1], script_size = sizes[2];
+  if (rom_size > MEMORY_SIZE - PROGRAM_START || asm_size > MAX_SOURCE ||
+      script_size > MAX_SCRIPT) {
+    message = "Program or script too large";
+    broken = true;
+    return false;
+  }
+
+  std::string program;
+  if (!connection.read_bytes(rom_size + asm_size, program) ||
+      !connection.read_bytes(script_size, job.script)) {
+    broken = true;
+    return false;
+  }
+  job.has_script = settings.count("script") > 0;
+
+  if (command != "run") {
+    message = "Unknown command " + command;
+    return false;
+  }
+  if ((rom_size == 0) == (asm_size == 0)) {
+    message = "Expected either rom=n or asm=n";
+    return false;
+  }
+  try {
+    for (auto const &[key, value] : settings) {
+      if (key == "frames")
+        job.frames = std::max(0, std::stoi(value));
+      else if (key == "cycles")
+        job.cycles = std::stol(value);
+      else if (key == "trace")
+        job.trace = std::clamp(std::stoi(value), 0, TRACE_LENGTH);
+      else if (key == "timeout")
+        job.timeout_ms = std::stoi(value);
+      else if (key == "profile") {
+        if (!profile_from_name(value, job.profile)) {
+          message = "Unknown profile " + value;
+          return false;
+        }
+      } else if (key != "rom" && key != "asm" && key != "script") {
+        message = "Unknown setting " + key;
+        return false;
+      }
+    }
+  } catch (const std::exception &) {
+    message = "Bad number in " + line;
+    return false;
+  }
+
+  if (asm_size > 0) {
+    std::istringstream source(program);
+    std::ostringstream errors;
+    DebugInfoBuilder debug_info;
+    job.rom = assemble_program(source, nullptr, errors, &debug_info);
+    if (!errors.str().empty()) {
+      message = errors.str();
+      std::replace(message.begin(), message.end(), '\n', ' ');
+      return false;
+    }
+    if (job.trace > 0)
+      job.debug_info = debug_info.finish("job", job.rom.data(), job.rom.size());
+  } else {
+    job.rom.assign(program.begin(), program.end());
+  }
+  return true;
+}
+
+/* Runs job on vm, frame by frame like the emulator. Returns the answer. */
+std::string run_job(Chip8 &vm, TranslationCache *cache, const Job &job,
+                    int timeout_ms) {
+  Script script;
+  if (job.has_script) {
+    std::istringstream text(job.script);
+    try {
+      parse_script(text, script);
+    } catch (const std::exception &) {
+      return "error Bad input script\n";
+    }
+  }
+
+  vm.reset();
+  vm.set_quirk_profile(job.profile);
+  vm.set_features(job.trace > 0 ? FEATURE_TRACE : 0);
+  vm.load_rom(job.rom.data(), job.rom.size(), cache);
+  vm.seed(script.seed);
+
+  // The watchdog is checked every so many frames, often enough to stop
+  // within a few milliseconds of the deadline
+  const int WATCHDOG_FRAMES = 256;
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::milliseconds(timeout_ms);
+
+  int frames = job.has_script ? script.frames.size() : job.frames;
+  uint16_t held = 0;
+  int frame = 0;
+  for (; frames == 0 || frame < frames; frame++) {
+    long budget = std::min<long>(CYCLES_PER_FRAME, job.cycles - vm.instructions());
+    if (budget <= 0 || vm.quitting())
+      break;
+    uint16_t keys = job.has_script ? script.frames[frame] : 0;
+    vm.set_keys(keys, keys & ~held);
+    held = keys;
+    if (vm.run_cycles(budget) == 0)
+      break;
+
+    if (frame % WATCHDOG_FRAMES == WATCHDOG_FRAMES - 1 &&
+        std::chrono::steady_clock::now() > deadline) {
+      return "error Timed out after " + std::to_string(timeout_ms) +
+             " ms at frame " + std::to_string(frame + 1) + "\n";
+    }
+  }
+
+  const char *end = vm.quitting()                   ? "exit"
+                    : frames > 0 && frame >= frames ? "frames"
+                                                    : "budget";
+  std::string answer = "ok";
+  char field[64];
+  for (auto i = 0; i < 16; i++) {
+    snprintf(field, sizeof(field), " V%X=%02x", i, vm.V(i));
+    answer += field;
+  }
+  snprintf(field, sizeof(field), " I=%03x SP=%03x PC=%03x", vm.I(), vm.SP(),
+           vm.PC());
+  answer += field;
+  snprintf(field, sizeof(field), " hash=%016llx instructions=%llu",
+           static_cast<unsigned long long>(vm.screen_hash()),
+           static_cast<unsigned long long>(vm.instructions()));
+  answer += field;
+  snprintf(field, sizeof(field), " faults=%x end=%s", vm.faults(), end);
+  answer += field;
+
+  std::vector<TraceEntry> trace = vm.trace();
+  size_t first = trace.size() - std::min<size_t>(trace.size(), job.trace);
+  answer += " trace=" + std::to_string(trace.size() - first) + "\n";
+  DebugInfo debug_info;
+  if (!job.debug_info.empty())
+    debug_info.load(job.debug_info);
+  for (size_t i = first; i < trace.size(); i++) {
+    // As the instruction is in memory now
+    uint16_t PC = trace[i].PC;
+    snprintf(field, sizeof(field), "%03x ", PC);
+    answer += field;
+    answer += disassemble(vm.memory()[PC], vm.memory()[PC + 1]);
+    if (const DebugLine *line = debug_info.find_line(PC))
+      answer += "  ; line " + std::to_string(line->line);
+    answer += "\n";
+  }
+  return answer;
+}
+
+/* A machine of the pool, kept warm from one job to the next */
+struct Machine {
+  Chip8 vm;
+  std::unique_ptr<TranslationCache> cache;
+};
+
+/* The machines and the connections, each read by a thread of its own */
+class Server {
+public:
+  explicit Server(const Options &options) : m_options(options) {
+    for (auto i = 0; i < options.machines; i++) {
+      m_machines.push_back(std::make_unique<Machine>());
+      if (!options.translations.empty())
+        m_machines.back()->cache =
+            std::make_unique<TranslationCache>(options.translations);
+      m_free.push_back(m_machines.back().get());
+    }
+  }
+
+  void add(int fd) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_connections[fd] = std::thread(&Server::serve, this, fd);
+  }
+
+  /* Joins the threads of connections that ended */
+  void reap() {
+    std::vector<std::thread> ended;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      for (auto fd : m_ended) {
+        ended.push_back(std::move(m_connections[fd]));
+        m_connections.erase(fd);
+        close(fd);
+      }
+      m_ended.clear();
+    }
+    for (auto &thread : ended) {
+      if (thread.joinable())
+        thread.join();
+    }
+  }
+
+  /* Ends the connections, jobs running finish first */
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stopping = true;
+      for (auto const &connection : m_connections)
+        shutdown(connection.first, SHUT_RDWR);
+    }
+    m_machine_free.notify_all();
+    for (;;) {
+      std::thread thread;
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_connections.empty())
+          break;
+        thread = std::move(m_connections.begin()->second);
+      }
+      thread.join();
+      reap();
+    }
+  }
+
+  long jobs() const { return m_jobs; }
+
+private:
+  void serve(int fd) {
+    Connection connection(fd);
+    std::string line;
+    while (connection.read_line(line)) {
+      if (line.empty())
+        continue;
+      Job job;
+      std::string message;
+      bool broken = false;
+      std::string answer;
+      if (read_job(line, connection, job, message, broken)) {
+        answer = run(job);
+      } else if (!message.empty()) {
+        answer = "error " + message + "\n";
+      }
+      if (answer.empty() || !connection.write(answer) || broken)
+        break;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_ended.push_back(fd);
+  }
+
+  /* Runs job on a free machine, waiting for one */
+  std::string run(const Job &job) {
+    Machine *machine;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_machine_free.wait(lock,
+                          [this] { return m_stopping || !m_free.empty(); });
+      if (m_stopping)
+        return "";
+      machine = m_free.back();
+      m_free.pop_back();
+    }
+
+    int timeout = m_options.timeout_ms;
+    if (job.timeout_ms > 0)
+      timeout = std::min(timeout, job.timeout_ms);
+    std::string answer =
+        run_job(machine->vm, machine->cache.get(), job, timeout);
+    m_jobs++;
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_free.push_back(machine);
+    }
+    m_machine_free.notify_one();
+    return answer;
+  }
+
+  const Options &m_options;
+  std::vector<std::unique_ptr<Machine>> m_machines;
+  std::mutex m_mutex;
+  std::condition_variable m_machine_free;
+  std::vector<Machine *> m_free;
+  std::map<int, std::thread> m_connections;
+  std::vector<int> m_ended; // Connections whose thread is done
+  bool m_stopping = false;
+  std::atomic<long> m_jobs{0};
+};
+
+volatile sig_atomic_t stopping = 0;
+
+void stop(int) { stopping = 1; }
+
+int listen_on(const std::string &path) {
+  sockaddr_un address{};
+  if (path.size() >= sizeof(address.sun_path)) {
+    std::cout << "Socket path too long: " << path << std::endl;
+    return -1;
+  }
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  unlink(path.c_str());
+  if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+      listen(fd, 64) != 0) {
+    std::cout << "Couldn't listen on " << path << std::endl;
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+void usage() {
+  std::cout << "Usage: chip8d [-j machines] [-t timeout_ms] socket"
+            << std::endl;
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  if (const char *directory = getenv("CHIP8_CACHE"))
+    options.translations = directory;
+  for (auto i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg[0] != '-') {
+      options.path = arg;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      usage();
+      return 1;
+    }
+    if (arg == "-j")
+      options.machines = std::max(1, std::stoi(argv[++i]));
+    else if (arg == "-t")
+      options.timeout_ms = std::max(1, std::stoi(argv[++i]));
+    else {
+      usage();
+      return 1;
+    }
+  }
+  if (options.path.empty()) {
+    usage();
+    return 1;
+  }
+
+  int listener = listen_on(options.path);
+  if (listener < 0)
+    return 1;
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+
+  Server server(options);
+  std::cout << "Listening on " << options.path << " with " << options.machines
+            << " machines" << std::endl;
+
+  while (!stopping) {
+    server.reap();
+    pollfd pending{listener, POLLIN, 0};
+    if (poll(&pending, 1, 200) <= 0)
+      continue;
+    int fd = accept(listener, nullptr, nullptr);
+    if (fd >= 0)
+      server.add(fd);
+  }
+
+  close(listener);
+  unlink(options.path.c_str());
+  server.stop();
+  std::cout << server.jobs() << " jobs run" << std::endl;
+  return 0;
+}
@@ -0,0 +1,379 @@
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../libchip8/chip8.h"
+#include "script.h"
+
+/* chip8-cover looks for inputs reaching new code in a ROM. It plays input
+ * scripts on many machines at once, records the edges between instructions
+ * they take, and keeps the scripts taking new edges (or taking known ones a
+ * new number of times) in a corpus to mutate further. Scripts causing
+ * faults or getting the program stuck are saved separately.
+ */
+
+namespace fs = std::filesystem;
+
+struct Options {
+  int threads = std::max(1u, std::thread::hardware_concurrency());
+  long runs = 0; // 0 runs until the time is up
+  int seconds = 60;
+  int frames = 600;
+  uint64_t seed = 1;
+  std::string output = "cover";
+  std::string replay;
+  std::string rom;
+  std::string translations; // Cache directory, from CHIP8_CACHE
+};
+
+// Hit counts are compared in buckets, 1, 2, 3, 4-7, 8-15, 16-31, 32-127 and
+// 128-255 times, one bit each
+constexpr std::array<uint8_t, 256> make_buckets() {
+  std::array<uint8_t, 256> buckets{};
+  for (auto count = 1; count < 256; count++) {
+    if (count <= 3)
+      buckets[count] = 1 << (count - 1);
+    else if (count <= 7)
+      buckets[count] = 8;
+    else if (count <= 15)
+      buckets[count] = 16;
+    else if (count <= 31)
+      buckets[count] = 32;
+    else if (count <= 127)
+      buckets[count] = 64;
+    else
+      buckets[count] = 128;
+  }
+  return buckets;
+}
+
+constexpr std::array<uint8_t, 256> buckets = make_buckets();
+
+/* Adds the buckets hit in trace to seen, returns true if any was new */
+bool merge(const uint8_t *trace, uint8_t *seen) {
+  bool found = false;
+  for (auto i = 0; i < COVERAGE_SIZE; i += 8) {
+    uint64_t word;
+    memcpy(&word, trace + i, sizeof(word));
+    if (word == 0)
+      continue;
+
+    for (auto j = i; j < i + 8; j++) {
+      uint8_t bucket = buckets[trace[j]];
+      if (bucket & ~seen[j]) {
+        seen[j] |= bucket;
+        found = true;
+      }
+    }
+  }
+  return found;
+}
+
+/* The scripts found so far and the coverage they reach, shared by all the
+ * workers
+ */
+class Corpus {
+public:
+  Corpus(const std::string &directory, int frames) : m_directory(directory) {
+    m_seen.resize(COVERAGE_SIZE);
+    for (auto sub : {"queue", "crashes", "hangs"})
+      fs::create_directories(fs::path(directory) / sub);
+
+    // Continue from an earlier session, which may have run longer scripts
+    for (auto const &entry : fs::directory_iterator(m_directory / "queue")) {
+      Script script;
+      if (read_script(entry.path(), script) && !script.frames.empty()) {
+        if ((int)script.frames.size() > frames)
+          script.frames.resize(frames);
+        m_queue.push_back(script);
+      }
+    }
+    m_saved = m_queue.size();
+
+    if (m_queue.empty()) {
+      Script idle;
+      idle.frames.resize(frames);
+      m_queue.push_back(idle);
+    }
+  }
+
+  Script pick(Random &random) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_queue[random.below(m_queue.size())];
+  }
+
+  /* Records the trace of script. Returns true if it reached new coverage,
+   * in which case the script joins the corpus. seen is updated to
+   * everything seen so far.
+   */
+  bool add(const Script &script, const uint8_t *trace, uint8_t *seen) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    bool found = merge(trace, m_seen.data());
+    if (found) {
+      m_queue.push_back(script);
+      char name[32];
+      snprintf(name, sizeof(name), "id_%06d", m_saved++);
+      save("queue", name, script);
+    }
+    memcpy(seen, m_seen.data(), COVERAGE_SIZE);
+    return found;
+  }
+
+  /* Saves scripts causing a new kind of fault or a new stuck state */
+  void report(const Script &script, const Outcome &outcome) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (outcome.faults != FAULT_NONE &&
+        m_crashes.insert(outcome.faults << 16 | outcome.fault_PC).second) {
+      char name[32];
+      snprintf(name, sizeof(name), "fault_%x_%03x", outcome.faults,
+               outcome.fault_PC);
+      save("crashes", name, script);
+    }
+    if (outcome.stuck && m_hangs.insert(outcome.stuck_PC).second) {
+      char name[32];
+      snprintf(name, sizeof(name), "stuck_%03x", outcome.stuck_PC);
+      save("hangs", name, script);
+    }
+  }
+
+  void status(std::ostream &out) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    int edges = 0;
+    for (auto bucket : m_seen)
+      edges += bucket != 0;
+    out << "corpus " << m_queue.size() << ", edges " << edges << ", crashes "
+        << m_crashes.size() << ", hangs " << m_hangs.size();
+  }
+
+private:
+  void save(const char *sub, const std::string &name, const Script &script) {
+    write_script(m_directory / sub / name, script);
+  }
+
+  std::mutex m_mutex;
+  fs::path m_directory;
+  std::vector<Script> m_queue;
+  std::vector<uint8_t> m_seen; // Buckets seen for every edge
+  std::set<uint32_t> m_crashes;
+  std::set<uint16_t> m_hangs;
+  int m_saved = 0;
+};
+
+const int MAX_CHANGE = 30; // Frames held, inserted or deleted at once
+
+void mutate(Script &script, Random &random, const Script &other,
+            int max_frames) {
+  std::vector<uint16_t> &frames = script.frames;
+  int changes = 1 << random.below(4);
+  for (auto n = 0; n < changes; n++) {
+    int i = random.below(frames.size());
+    int length = 1 + random.below(MAX_CHANGE);
+    switch (random.below(8)) {
+    case 0:
+      frames[i] ^= 1 << random.below(16);
+      break;
+    case 1:
+      frames[i] = 1 << random.below(16);
+      break;
+    case 2:
+      frames[i] = 0;
+      break;
+    case 3: // Hold the keys for a while
+      for (auto j = i + 1; j < i + length && j < (int)frames.size(); j++)
+        frames[j] = frames[i];
+      break;
+    case 4:
+      length = std::min<int>(length, max_frames - frames.size());
+      if (length > 0)
+        frames.insert(frames.begin() + i, length, frames[i]);
+      break;
+    case 5:
+      length = std::min<int>(length, frames.size() - i);
+      if ((int)frames.size() > length)
+        frames.erase(frames.begin() + i, frames.begin() + i + length);
+      break;
+    case 6:
+      script.seed = random.next();
+      break;
+    case 7: // Continue with the end of another script
+      if (other.frames.size() > 1) {
+        int j = random.below(other.frames.size());
+        frames.resize(i);
+        frames.insert(frames.end(), other.frames.begin() + j,
+                      other.frames.end());
+        if ((int)frames.size() > max_frames)
+          frames.resize(max_frames);
+        if (frames.empty())
+          frames.push_back(0);
+      }
+      break;
+    }
+  }
+}
+
+struct Shared {
+  const Options &options;
+  const std::vector<uint8_t> &rom;
+  Corpus &corpus;
+  std::atomic<long> runs{0};
+  std::atomic<bool> stop{false};
+};
+
+void work(Shared &shared, int index) {
+  Random random(shared.options.seed * 0x9E3779B97F4A7C15ULL + index);
+  std::vector<uint8_t> trace(COVERAGE_SIZE);
+  std::vector<uint8_t> seen(COVERAGE_SIZE);
+
+  Chip8 vm;
+  vm.set_coverage(trace.data());
+  std::unique_ptr<TranslationCache> cache;
+  if (!shared.options.translations.empty())
+    cache = std::make_unique<TranslationCache>(shared.options.translations);
+
+  while (!shared.stop) {
+    long run = shared.runs++;
+    if (shared.options.runs > 0 && run >= shared.options.runs)
+      break;
+
+    Script script = shared.corpus.pick(random);
+    mutate(script, random, shared.corpus.pick(random), shared.options.frames);
+
+    memset(trace.data(), 0, trace.size());
+    vm.reset();
+    vm.load_rom(shared.rom.data(), shared.rom.size(), cache.get());
+    Outcome outcome = play(vm, script);
+
+    // Most runs find nothing new, which is checked without the lock first
+    if (merge(trace.data(), seen.data()))
+      shared.corpus.add(script, trace.data(), seen.data());
+    if (outcome.faults != FAULT_NONE || outcome.stuck)
+      shared.corpus.report(script, outcome);
+  }
+}
+
+bool read_rom(const std::string &filename, std::vector<uint8_t> &rom) {
+  std::ifstream in(filename, std::ios::in | std::ios::binary);
+  if (!in.is_open()) {
+    std::cout << "Couldn't open ROM " << filename << std::endl;
+    return false;
+  }
+  rom.assign(std::istreambuf_iterator<char>(in),
+             std::istreambuf_iterator<char>());
+  return true;
+}
+
+int replay(const Options &options, const std::vector<uint8_t> &rom) {
+  Script script;
+  if (!read_script(options.replay, script))
+    return 1;
+
+  std::vector<uint8_t> trace(COVERAGE_SIZE);
+  Chip8 vm;
+  vm.set_coverage(trace.data());
+  vm.load_rom(rom.data(), rom.size());
+  Outcome outcome = play(vm, script);
+
+  int edges = 0;
+  for (auto count : trace)
+    edges += count != 0;
+
+  char line[128];
+  snprintf(line, sizeof(line),
+           "%d frames, %d edges, PC=%03x, faults=%x at %03x%s%s", outcome.frames,
+           edges, vm.PC(), outcome.faults, outcome.fault_PC,
+           outcome.exited ? ", exited" : "",
+           outcome.stuck ? ", stuck" : "");
+  std::cout << line << std::endl;
+  return 0;
+}
+
+void usage() {
+  std::cout << "Usage: chip8-cover [-j threads] [-n runs] [-t seconds] "
+               "[-f frames] [-s seed] [-o directory] rom\n"
+               "       chip8-cover -r script rom"
+            << std::endl;
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  if (const char *directory = getenv("CHIP8_CACHE"))
+    options.translations = directory;
+  for (auto i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg[0] != '-') {
+      options.rom = arg;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      usage();
+      return 1;
+    }
+    if (arg == "-j")
+      options.threads = std::max(1, std::stoi(argv[++i]));
+    else if (arg == "-n")
+      options.runs = std::stol(argv[++i]);
+    else if (arg == "-t")
+      options.seconds = std::stoi(argv[++i]);
+    else if (arg == "-f")
+      options.frames = std::max(1, std::stoi(argv[++i]));
+    else if (arg == "-s")
+      options.seed = std::stoull(argv[++i]);
+    else if (arg == "-o")
+      options.output = argv[++i];
+    else if (arg == "-r")
+      options.replay = argv[++i];
+    else {
+      usage();
+      return 1;
+    }
+  }
+
+  if (options.rom.empty()) {
+    usage();
+    return 1;
+  }
+
+  std::vector<uint8_t> rom;
+  if (!read_rom(options.rom, rom))
+    return 1;
+
+  if (!options.replay.empty())
+    return replay(options, rom);
+
+  Corpus corpus(options.output, options.frames);
+  Shared shared{options, rom, corpus};
+
+  std::vector<std::thread> workers;
+  for (auto i = 0; i < options.threads; i++)
+    workers.emplace_back(work, std::ref(shared), i);
+
+  auto start = std::chrono::steady_clock::now();
+  for (auto second = 1; !shared.stop; second++) {
+    std::this_thread::sleep_until(start + std::chrono::seconds(second));
+    long runs = std::min<long>(shared.runs, options.runs ? options.runs
+                                                         : shared.runs.load());
+    std::cout << second << " s: " << runs << " runs (" << runs / second
+              << "/s), ";
+    corpus.status(std::cout);
+    std::cout << std::endl;
+
+    if (second >= options.seconds ||
+        (options.runs > 0 && shared.runs >= options.runs))
+      shared.stop = true;
+  }
+
+  for (auto &worker : workers)
+    worker.join();
+
+  return 0;
+}
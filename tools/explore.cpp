@@ -0,0 +1,388 @@
+#include <algorithm>
+#include <chrono>
+#include <ctype.h>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "../libchip8/chip8.h"
+#include "../libchip8/state.h"
+#include "script.h"
+
+/* chip8-explore searches the states a ROM can reach by pressing keys,
+ * breadth first or taking the states with the highest value of a byte of
+ * memory first. Every input is tried from every new state, by restoring a
+ * saved state instead of replaying the inputs leading to it. States are
+ * told apart by their hash, so one reached again by another path isn't
+ * explored twice.
+ *
+ * It stops at a goal screen or memory value and writes the inputs reaching
+ * it as a script, and reports states no input gets out of, faults, and how
+ * many different screens were seen.
+ */
+
+namespace fs = std::filesystem;
+
+struct Options {
+  std::string rom;
+  std::string profile;
+  int frames = 4; // Per input, at least 2: the keys are let go in the last
+  std::vector<uint16_t> inputs;
+  long states = 1000000; // Distinct states to visit at most
+  int depth = 0;         // Inputs in a row at most, 0 for no limit
+  int best = -1;         // Address of the byte to maximize, -1 for BFS
+  uint64_t seed = 1;
+  bool screen_goal = false;
+  uint64_t goal_screen = 0;
+  int goal_address = -1;
+  uint8_t goal_value = 0;
+  std::string output = "explore";
+};
+
+/* VisitedSet keeps 64-bit hashes in an open addressing table with linear
+ * probing, 8 bytes a slot at a load of at most a half. 0 marks an empty
+ * slot, so a hash of 0 is stored as 1.
+ */
+class VisitedSet {
+public:
+  VisitedSet() : m_slots(1 << 16) {}
+
+  /* Returns false if hash was already in the set */
+  bool insert(uint64_t hash) {
+    if (hash == 0)
+      hash = 1;
+    if (2 * (m_size + 1) > m_slots.size())
+      grow();
+
+    size_t mask = m_slots.size() - 1;
+    for (size_t i = spread(hash) & mask;; i = (i + 1) & mask) {
+      if (m_slots[i] == hash)
+        return false;
+      if (m_slots[i] == 0) {
+        m_slots[i] = hash;
+        m_size++;
+        return true;
+      }
+    }
+  }
+
+  size_t size() const { return m_size; }
+
+private:
+  // The low bits of state hashes are good, but screen hashes end in a
+  // multiply
+  static size_t spread(uint64_t hash) { return hash ^ (hash >> 32); }
+
+  void grow() {
+    std::vector<uint64_t> slots(m_slots.size() * 2);
+    size_t mask = slots.size() - 1;
+    for (auto hash : m_slots) {
+      if (hash == 0)
+        continue;
+      size_t i = spread(hash) & mask;
+      while (slots[i] != 0)
+        i = (i + 1) & mask;
+      slots[i] = hash;
+    }
+    m_slots.swap(slots);
+  }
+
+  std::vector<uint64_t> m_slots;
+  size_t m_size = 0;
+};
+
+/* How a state was first reached: the state before it and the keys held */
+struct Step {
+  uint32_t parent;
+  uint16_t keys;
+};
+
+const uint32_t NO_PARENT = ~0u;
+
+/* A state waiting to be explored */
+struct Node {
+  MachineState state;
+  uint32_t step;
+  int depth;
+  int score;
+};
+
+/* The open nodes, in the order they are explored */
+class Frontier {
+public:
+  explicit Frontier(bool best) : m_best(best) {}
+
+  bool empty() const { return m_queue.empty() && m_heap.empty(); }
+  size_t size() const { return m_queue.size() + m_heap.size(); }
+
+  void push(Node &&node) {
+    if (m_best) {
+      m_heap.push_back(std::move(node));
+      std::push_heap(m_heap.begin(), m_heap.end(), Worse());
+    } else {
+      m_queue.push_back(std::move(node));
+    }
+  }
+
+  Node pop() {
+    if (m_best) {
+      std::pop_heap(m_heap.begin(), m_heap.end(), Worse());
+      Node node = std::move(m_heap.back());
+      m_heap.pop_back();
+      return node;
+    }
+    Node node = std::move(m_queue.front());
+    m_queue.pop_front();
+    return node;
+  }
+
+private:
+  // Highest score first, then the shallowest
+  struct Worse {
+    bool operator()(const Node &a, const Node &b) const {
+      return a.score != b.score ? a.score < b.score : a.depth > b.depth;
+    }
+  };
+
+  bool m_best;
+  std::deque<Node> m_queue;
+  std::vector<Node> m_heap;
+};
+
+/* Plays one input on vm: the keys are held down for all frames but the
+ * last, which lets go of them, so every input starts with no keys held.
+ */
+void play_input(Chip8 &vm, uint16_t keys, int frames) {
+  for (auto frame = 0; frame < frames && !vm.quitting(); frame++) {
+    bool last = frame == frames - 1;
+    vm.set_keys(last ? 0 : keys, frame == 0 ? keys : 0);
+    vm.run_cycles(CYCLES_PER_FRAME);
+  }
+}
+
+Script script_to(const std::vector<Step> &steps, uint32_t step,
+                 const Options &options) {
+  std::vector<uint16_t> inputs;
+  for (; steps[step].parent != NO_PARENT; step = steps[step].parent)
+    inputs.push_back(steps[step].keys);
+
+  Script script;
+  script.seed = options.seed;
+  for (auto keys = inputs.rbegin(); keys != inputs.rend(); keys++) {
+    script.frames.insert(script.frames.end(), options.frames - 1, *keys);
+    script.frames.push_back(0);
+  }
+  return script;
+}
+
+bool read_rom(const std::string &filename, std::vector<uint8_t> &rom) {
+  std::ifstream in(filename, std::ios::in | std::ios::binary);
+  if (!in.is_open()) {
+    std::cout << "Couldn't open ROM " << filename << std::endl;
+    return false;
+  }
+  rom.assign(std::istreambuf_iterator<char>(in),
+             std::istreambuf_iterator<char>());
+  return true;
+}
+
+int explore(const Options &options, const std::vector<uint8_t> &rom,
+            Profile profile) {
+  fs::create_directories(options.output);
+  auto save = [&](const std::string &name, const Script &script) {
+    write_script((fs::path(options.output) / name).string(), script);
+  };
+
+  // The pool has to outlive the machine, which keeps a state from it
+  PagePool pool;
+  Chip8 vm;
+  vm.set_quirk_profile(profile);
+  vm.load_rom(rom.data(), rom.size());
+  vm.seed(options.seed);
+
+  VisitedSet visited;
+  VisitedSet screens;
+  std::vector<Step> steps;
+  std::set<uint32_t> faults; // Kind and address of the faults seen
+  std::set<uint16_t> stuck;  // PCs of the states no input leaves
+  int deepest = 0;
+
+  Frontier frontier(options.best >= 0);
+  Node root{MachineState(pool), 0, 0, 0};
+  vm.save(root.state);
+  visited.insert(root.state.hash());
+  screens.insert(vm.screen_hash());
+  steps.push_back({NO_PARENT, 0});
+  frontier.push(std::move(root));
+
+  auto start = std::chrono::steady_clock::now();
+  auto report = start;
+  bool found = false;
+  while (!frontier.empty() && !found && (long)steps.size() < options.states) {
+    Node node = frontier.pop();
+    uint64_t hash = node.state.hash();
+    bool leaves = false;
+
+    for (auto keys : options.inputs) {
+      vm.restore(node.state);
+      play_input(vm, keys, options.frames);
+
+      Node child{MachineState(pool), (uint32_t)steps.size(), node.depth + 1,
+                 0};
+      vm.save(child.state);
+      uint64_t child_hash = child.state.hash();
+      leaves = leaves || child_hash != hash;
+      if (!visited.insert(child_hash))
+        continue;
+
+      steps.push_back({node.step, keys});
+      deepest = std::max(deepest, child.depth);
+      screens.insert(vm.screen_hash());
+
+      if (vm.faults() != FAULT_NONE &&
+          faults.insert(vm.faults() << 16 | vm.fault_PC()).second) {
+        char name[32];
+        snprintf(name, sizeof(name), "fault_%x_%03x", vm.faults(),
+                 vm.fault_PC());
+        save(name, script_to(steps, child.step, options));
+      }
+
+      if ((options.screen_goal && vm.screen_hash() == options.goal_screen) ||
+          (options.goal_address >= 0 &&
+           vm.memory()[options.goal_address] == options.goal_value)) {
+        save("goal", script_to(steps, child.step, options));
+        std::cout << "Goal reached after " << child.depth << " inputs"
+                  << std::endl;
+        found = true;
+        break;
+      }
+
+      if (vm.quitting() || (options.depth > 0 && child.depth >= options.depth))
+        continue;
+      if (options.best >= 0)
+        child.score = vm.memory()[options.best];
+      frontier.push(std::move(child));
+    }
+
+    // A soft-lock: whatever is pressed, nothing changes
+    if (!leaves && stuck.insert(node.state.registers().PC).second) {
+      char name[32];
+      snprintf(name, sizeof(name), "stuck_%03x", node.state.registers().PC);
+      save(name, script_to(steps, node.step, options));
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - report >= std::chrono::seconds(1)) {
+      report = now;
+      std::cout << steps.size() << " states, " << frontier.size()
+                << " open, depth " << deepest << ", " << pool.used()
+                << " pages" << std::endl;
+    }
+  }
+
+  double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+  std::cout << steps.size() << " states ("
+            << (long)(steps.size() / std::max(seconds, 1e-3)) << "/s), "
+            << screens.size() << " screens, depth " << deepest << ", "
+            << stuck.size() << " stuck, " << faults.size() << " faults"
+            << (frontier.empty() ? ", exhausted" : "") << std::endl;
+
+  bool goal = options.screen_goal || options.goal_address >= 0;
+  return goal && !found ? 1 : 0;
+}
+
+void usage() {
+  std::cout << "Usage: chip8-explore [-f frames] [-k keys] [-n states] "
+               "[-d depth] [-b address] [-g screen | -m address=value] "
+               "[-s seed] [-p profile] [-o directory] rom"
+            << std::endl;
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  std::string keys = "0123456789abcdef";
+  for (auto i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg[0] != '-') {
+      options.rom = arg;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      usage();
+      return 1;
+    }
+    if (arg == "-f") {
+      options.frames = std::max(2, std::stoi(argv[++i]));
+    } else if (arg == "-k") {
+      keys = argv[++i];
+    } else if (arg == "-n") {
+      options.states = std::stol(argv[++i]);
+    } else if (arg == "-d") {
+      options.depth = std::stoi(argv[++i]);
+    } else if (arg == "-b") {
+      options.best = std::stoi(argv[++i], nullptr, 16) & 0xFFF;
+    } else if (arg == "-g") {
+      options.screen_goal = true;
+      options.goal_screen = std::stoull(argv[++i], nullptr, 16);
+    } else if (arg == "-m") {
+      std::string goal = argv[++i];
+      size_t equals = goal.find('=');
+      if (equals == std::string::npos) {
+        usage();
+        return 1;
+      }
+      options.goal_address = std::stoi(goal.substr(0, equals), nullptr, 16) &
+                             0xFFF;
+      options.goal_value = std::stoi(goal.substr(equals + 1), nullptr, 16);
+    } else if (arg == "-s") {
+      options.seed = std::stoull(argv[++i], nullptr, 16);
+    } else if (arg == "-p") {
+      options.profile = argv[++i];
+    } else if (arg == "-o") {
+      options.output = argv[++i];
+    } else {
+      usage();
+      return 1;
+    }
+  }
+
+  if (options.rom.empty()) {
+    usage();
+    return 1;
+  }
+
+  // Doing nothing is always an input, then every key on its own
+  options.inputs.push_back(0);
+  for (auto digit : keys) {
+    std::string key(1, digit);
+    if (!isxdigit(digit)) {
+      std::cout << "Not a key: " << key << std::endl;
+      return 1;
+    }
+    options.inputs.push_back(1 << std::stoi(key, nullptr, 16));
+  }
+
+  std::vector<uint8_t> rom;
+  if (!read_rom(options.rom, rom))
+    return 1;
+
+  Profile profile = Profile::Modern;
+  if (!options.profile.empty()) {
+    if (!profile_from_name(options.profile, profile)) {
+      std::cout << "Unknown profile " << options.profile << std::endl;
+      return 1;
+    }
+  } else {
+    find_profile(profile_database(options.rom), rom.data(), rom.size(),
+                 profile);
+  }
+
+  return explore(options, rom, profile);
+}
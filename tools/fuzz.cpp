@@ -0,0 +1,359 @@
+#include <chrono>
+#include <iostream>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "../disassembler/disassembler.h"
+#include "../libchip8/chip8.h"
+#include "../libchip8/state.h"
+#include "reference.h"
+
+/* chip8-fuzz runs random programs from random initial states through the
+ * reference model and through the execution engines of the core, with and
+ * without every optional feature, under a random quirk profile. It reports
+ * the first divergence in registers or memory together with the smallest
+ * program still showing it.
+ */
+
+// Bytes of random data placed after the program for I to point at
+const int DATA_SIZE = 64;
+
+struct Options {
+  long sequences = 1000000;
+  uint64_t seed = 1;
+  int length = 16;  // Instructions per program
+  int cycles = 64;  // Instructions executed per program
+};
+
+struct Case {
+  std::vector<uint8_t> rom; // Program followed by data
+  int length;               // Instructions in the program
+  Registers registers;
+  uint16_t keys;
+  uint16_t key_down;
+  unsigned seed; // For RND
+  Profile profile;
+};
+
+/* Opcode templates: the fixed bits and the mask of the random ones */
+struct Template {
+  uint16_t bits;
+  uint16_t mask;
+};
+
+const Template templates[] = {
+    {0x00E0, 0x0000}, {0x00EE, 0x0000}, {0x1000, 0x0FFF}, {0x2000, 0x0FFF},
+    {0x3000, 0x0FFF}, {0x4000, 0x0FFF}, {0x5000, 0x0FF0}, {0x6000, 0x0FFF},
+    {0x7000, 0x0FFF}, {0x8000, 0x0FF0}, {0x8001, 0x0FF0}, {0x8002, 0x0FF0},
+    {0x8003, 0x0FF0}, {0x8004, 0x0FF0}, {0x8005, 0x0FF0}, {0x8006, 0x0FF0},
+    {0x8007, 0x0FF0}, {0x800E, 0x0FF0}, {0x9000, 0x0FF0}, {0xA000, 0x0FFF},
+    {0xB000, 0x0FFF}, {0xC000, 0x0FFF}, {0xD000, 0x0FFF}, {0xE09E, 0x0F00},
+    {0xE0A1, 0x0F00}, {0xF007, 0x0F00}, {0xF00A, 0x0F00}, {0xF015, 0x0F00},
+    {0xF018, 0x0F00}, {0xF01E, 0x0F00}, {0xF029, 0x0F00}, {0xF033, 0x0F00},
+    {0xF055, 0x0F00}, {0xF065, 0x0F00}, {0x00FD, 0x0000}, {0x0000, 0xFFFF},
+    {0x00C0, 0x000F}, {0x00FB, 0x0000}, {0x00FC, 0x0000}, {0x00FE, 0x0000},
+    {0x00FF, 0x0000}, {0xF030, 0x0F00}, {0xF075, 0x0F00}, {0xF085, 0x0F00}};
+
+const int template_count = sizeof(templates) / sizeof(templates[0]);
+
+uint16_t random_address(Random &random, int length) {
+  // Mostly into the program or its data, sometimes anywhere
+  if (random.below(8) == 0)
+    return random.below(0x1000);
+  return PROGRAM_START + random.below(length * 2 + DATA_SIZE);
+}
+
+uint16_t random_opcode(Random &random, int length) {
+  const Template &t = templates[random.below(template_count)];
+  uint16_t opcode = t.bits | (random.next() & t.mask);
+
+  switch (opcode & 0xF000) {
+  case 0x1000:
+  case 0x2000:
+  case 0xB000:
+    // Keep jumps inside the program, on instruction boundaries most of the
+    // time so that they exercise the translated blocks
+    if (random.below(8) != 0)
+      opcode = (opcode & 0xF000) | (PROGRAM_START + random.below(length) * 2);
+    break;
+  case 0xA000:
+    opcode = 0xA000 | random_address(random, length);
+    break;
+  }
+
+  return opcode;
+}
+
+void generate(Random &random, const Options &options, Case &c) {
+  c.length = options.length;
+  c.rom.resize(c.length * 2 + DATA_SIZE);
+  for (auto i = 0; i < c.length; i++) {
+    uint16_t opcode = random_opcode(random, c.length);
+    c.rom[i * 2] = opcode >> 8;
+    c.rom[i * 2 + 1] = opcode & 0xFF;
+  }
+  for (size_t i = c.length * 2; i < c.rom.size(); i++)
+    c.rom[i] = random.next();
+
+  for (auto i = 0; i < 16; i++)
+    c.registers.V[i] = random.next();
+  c.registers.I = random_address(random, c.length);
+  c.registers.SP = random.below(4) == 0 ? random.below(0x1000) : 0x70;
+  c.registers.PC = PROGRAM_START;
+  c.registers.delay = random.below(2) ? random.next() : 0;
+  c.registers.sound = random.below(2) ? random.next() : 0;
+  c.keys = random.next();
+  c.key_down = random.below(2) ? random.next() : 0;
+  c.seed = random.next();
+  c.profile = static_cast<Profile>(random.below(PROFILE_COUNT));
+}
+
+struct State {
+  Registers registers;
+  bool quitting;
+  const uint8_t *memory;
+};
+
+/* The machines are reused for every case. A case is loaded once into a
+ * start state, and every engine restores it, which only copies the pages
+ * the program or the last run changed and drops the code translated on
+ * them. reset() and load_rom() would clear and retranslate all of memory
+ * for every engine.
+ */
+class Harness {
+public:
+  enum Engine {
+    Interpreter,
+    Blocks,
+    InstrumentedInterpreter,
+    InstrumentedBlocks,
+    EngineCount
+  };
+
+  Harness() { m_instrumented.set_features(FEATURE_ALL); }
+
+  /* Makes c the case run_engine() starts from */
+  void load(const Case &c) {
+    m_loader.patch(PROGRAM_START, c.rom.data(), c.rom.size());
+    m_loader.set_registers(c.registers);
+    m_loader.set_keys(c.keys, c.key_down);
+    m_loader.seed(c.seed);
+    m_loader.save(m_start);
+  }
+
+  /* Runs the case on the reference and the engine, returns true if they
+   * end up in the same state.
+   */
+  bool agree(const Case &c, int cycles, Engine engine) {
+    load(c);
+    State expected = run_reference(c, cycles);
+    State actual = run_engine(c, cycles, engine);
+    return same(expected, actual);
+  }
+
+  State run_reference(const Case &c, int cycles) {
+    Reference &r = m_reference;
+    memcpy(r.memory, m_blank.memory(), MEMORY_SIZE);
+    memcpy(r.memory + PROGRAM_START, c.rom.data(), c.rom.size());
+    memcpy(r.V, c.registers.V, 16);
+    r.I = c.registers.I;
+    r.SP = c.registers.SP;
+    r.PC = c.registers.PC;
+    r.delay = c.registers.delay;
+    r.sound = c.registers.sound;
+    r.keys = c.keys;
+    r.key_down = c.key_down;
+    r.quitting = false;
+    r.quirks = quirks(c.profile);
+    memset(r.flags, 0, sizeof(r.flags));
+
+    r.random.seed(c.seed);
+    for (auto i = 0; i < cycles && !r.quitting; i++)
+      r.step();
+
+    State state;
+    memcpy(state.registers.V, r.V, 16);
+    state.registers.I = r.I;
+    state.registers.SP = r.SP;
+    state.registers.PC = r.PC;
+    state.registers.delay = r.delay;
+    state.registers.sound = r.sound;
+    state.quitting = r.quitting;
+    state.memory = r.memory;
+    return state;
+  }
+
+  /* Runs the case last loaded, c only gives its quirk profile */
+  State run_engine(const Case &c, int cycles, Engine engine) {
+    Chip8 &vm = engine == Interpreter ? m_interpreter
+                : engine == Blocks    ? m_blocks
+                                      : m_instrumented;
+    vm.restore(m_start);
+    vm.set_quirk_profile(c.profile);
+    if (engine == Interpreter || engine == InstrumentedInterpreter) {
+      for (auto i = 0; i < cycles && !vm.quitting(); i++)
+        vm.emulate();
+    } else {
+      vm.run_cycles(cycles);
+    }
+
+    return {vm.registers(), vm.quitting(), vm.memory()};
+  }
+
+  static bool same(const State &a, const State &b) {
+    return memcmp(&a.registers.V, &b.registers.V, 16) == 0 &&
+           a.registers.I == b.registers.I && a.registers.SP == b.registers.SP &&
+           a.registers.PC == b.registers.PC &&
+           a.registers.delay == b.registers.delay &&
+           a.registers.sound == b.registers.sound &&
+           a.quitting == b.quitting &&
+           memcmp(a.memory, b.memory, MEMORY_SIZE) == 0;
+  }
+
+private:
+  PagePool m_pool; // Outlives the machines and states using it
+  MachineState m_start{m_pool};
+  Chip8 m_blank;  // Memory after reset, with the font
+  Chip8 m_loader; // Never runs, only holds the loaded case
+  Reference m_reference;
+  Chip8 m_interpreter;
+  Chip8 m_blocks;
+  Chip8 m_instrumented; // Every feature on, but nothing to stop at
+};
+
+const char *engine_names[] = {"emulate", "run_cycles",
+                              "emulate with FEATURE_ALL",
+                              "run_cycles with FEATURE_ALL"};
+
+/* Shrinks a diverging case: first the number of cycles, then the program by
+ * turning instructions into 0000, which only advances PC. Returns the
+ * smallest number of cycles showing the divergence.
+ */
+int minimize(Harness &harness, Case &c, int cycles, Harness::Engine engine) {
+  // Divergences may heal again, so look for the first one from the start
+  for (auto first = 1; first < cycles; first++) {
+    if (!harness.agree(c, first, engine)) {
+      cycles = first;
+      break;
+    }
+  }
+
+  for (auto i = 0; i < c.length; i++) {
+    uint8_t first = c.rom[i * 2];
+    uint8_t last = c.rom[i * 2 + 1];
+    if (first == 0 && last == 0)
+      continue;
+
+    c.rom[i * 2] = 0;
+    c.rom[i * 2 + 1] = 0;
+    if (harness.agree(c, cycles, engine)) {
+      c.rom[i * 2] = first;
+      c.rom[i * 2 + 1] = last;
+    }
+  }
+
+  return cycles;
+}
+
+void print_registers(const char *name, const Registers &r, bool quitting) {
+  char line[128];
+  int length = snprintf(line, sizeof(line), "%-10s PC=%03x I=%03x SP=%03x "
+                        "DT=%02x ST=%02x V=", name, r.PC, r.I, r.SP, r.delay,
+                        r.sound);
+  for (auto i = 0; i < 16; i++)
+    length += snprintf(line + length, sizeof(line) - length, "%02x", r.V[i]);
+  std::cout << line << (quitting ? " exited" : "") << std::endl;
+}
+
+void report(Harness &harness, Case &c, int cycles, Harness::Engine engine) {
+  cycles = minimize(harness, c, cycles, engine);
+
+  std::cout << "Divergence in " << engine_names[engine] << " after " << cycles
+            << " instructions" << std::endl;
+
+  print_registers("initial", c.registers, false);
+  char keys[80];
+  snprintf(keys, sizeof(keys), "keys=%04x down=%04x seed=%u profile=%s",
+           c.keys, c.key_down, c.seed, profile_name(c.profile));
+  std::cout << keys << std::endl;
+
+  std::string listing;
+  disassemble_range(c.rom.data() - PROGRAM_START, PROGRAM_START,
+                    PROGRAM_START + c.length * 2, listing);
+  std::cout << listing;
+
+  State expected = harness.run_reference(c, cycles);
+  print_registers("reference", expected.registers, expected.quitting);
+  harness.load(c);
+  State actual = harness.run_engine(c, cycles, engine);
+  print_registers(engine_names[engine], actual.registers, actual.quitting);
+
+  for (auto i = 0; i < MEMORY_SIZE; i++) {
+    if (expected.memory[i] != actual.memory[i]) {
+      char line[64];
+      snprintf(line, sizeof(line), "memory[%03x] %02x != %02x", i,
+               expected.memory[i], actual.memory[i]);
+      std::cout << line << std::endl;
+    }
+  }
+}
+
+void usage() {
+  std::cout << "Usage: chip8-fuzz [-n sequences] [-s seed] [-l length] "
+               "[-c cycles]"
+            << std::endl;
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  for (auto i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      usage();
+      return 1;
+    }
+    if (arg == "-n")
+      options.sequences = std::stol(argv[++i]);
+    else if (arg == "-s")
+      options.seed = std::stoull(argv[++i]);
+    else if (arg == "-l")
+      options.length = std::max(1, std::stoi(argv[++i]));
+    else if (arg == "-c")
+      options.cycles = std::max(1, std::stoi(argv[++i]));
+    else {
+      usage();
+      return 1;
+    }
+  }
+
+  Random random(options.seed);
+  Harness harness;
+  Case c;
+
+  auto start = std::chrono::steady_clock::now();
+  for (long n = 0; n < options.sequences; n++) {
+    generate(random, options, c);
+    State expected = harness.run_reference(c, options.cycles);
+    harness.load(c);
+
+    for (auto engine = 0; engine < Harness::EngineCount; engine++) {
+      auto e = static_cast<Harness::Engine>(engine);
+      State actual = harness.run_engine(c, options.cycles, e);
+      if (!Harness::same(expected, actual)) {
+        std::cout << "Sequence " << n << " of seed " << options.seed << ": ";
+        report(harness, c, options.cycles, e);
+        return 1;
+      }
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  double seconds = std::chrono::duration<double>(end - start).count();
+  std::cout << options.sequences << " sequences, no divergence: " << seconds
+            << " s, " << options.sequences / seconds * 60 / 1e6
+            << " M sequences/min" << std::endl;
+
+  return 0;
+}
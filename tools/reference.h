@@ -0,0 +1,281 @@
+#ifndef REFERENCE_H
+#define REFERENCE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "../libchip8/chip8.h"
+
+/* Reference is a deliberately simple model of the Chip-8 CPU, written
+ * straight from the instruction descriptions without sharing any code with
+ * the core. The fuzzer checks the execution engines of the core against it.
+ *
+ * It follows the conventions of the core: the stack grows down in memory
+ * from SP, addresses wrap around at 4K, sprites wrap around the screen and
+ * the timers tick once per instruction. RND draws from the same generator
+ * as the core so that seeded runs can be compared. The quirks of a profile
+ * are plain flags here.
+ */
+struct Reference {
+  uint8_t V[16];
+  uint16_t I;
+  uint16_t SP;
+  uint16_t PC;
+  uint8_t delay;
+  uint8_t sound;
+  uint16_t keys;
+  uint16_t key_down;
+  bool quitting;
+  Random random;
+  Quirks quirks;
+  uint8_t flags[FLAG_REGISTERS];
+  uint8_t memory[MEMORY_SIZE];
+
+  uint8_t &mem(int address) { return memory[address & 0xFFF]; }
+
+  void step() {
+    PC &= 0xFFF;
+    uint16_t opcode = memory[PC] << 8 | memory[PC + 1];
+    uint8_t x = (opcode >> 8) & 0xF;
+    uint8_t y = (opcode >> 4) & 0xF;
+    uint8_t kk = opcode & 0xFF;
+    uint16_t nnn = opcode & 0xFFF;
+    uint16_t next = PC + 2;
+
+    switch (opcode & 0xF000) {
+    case 0x0000:
+      if (opcode == 0x00E0) {
+        memset(&memory[SCREEN_START], 0, SCREEN_WIDTH * SCREEN_HEIGHT / 8);
+      } else if (opcode == 0x00EE) {
+        next = (mem(SP) << 8 | mem(SP + 1)) & 0xFFF;
+        SP += 2;
+      } else if (opcode == 0x00FD) {
+        quitting = true;
+        next = PC;
+      } else if ((opcode & 0xFFF0) == 0x00C0) {
+        scroll(0, opcode & 0xF);
+      } else if (opcode == 0x00FB) {
+        scroll(4, 0);
+      } else if (opcode == 0x00FC) {
+        scroll(-4, 0);
+      }
+      break;
+    case 0x1000:
+      next = nnn;
+      break;
+    case 0x2000:
+      SP -= 2;
+      mem(SP) = next >> 8;
+      mem(SP + 1) = next & 0xFF;
+      next = nnn;
+      break;
+    case 0x3000:
+      if (V[x] == kk)
+        next += 2;
+      break;
+    case 0x4000:
+      if (V[x] != kk)
+        next += 2;
+      break;
+    case 0x5000:
+      if ((opcode & 0xF) == 0 && V[x] == V[y])
+        next += 2;
+      break;
+    case 0x6000:
+      V[x] = kk;
+      break;
+    case 0x7000:
+      V[x] += kk;
+      break;
+    case 0x8000:
+      alu(opcode & 0xF, x, y);
+      break;
+    case 0x9000:
+      if ((opcode & 0xF) == 0 && V[x] != V[y])
+        next += 2;
+      break;
+    case 0xA000:
+      I = nnn;
+      break;
+    case 0xB000:
+      next = ((quirks.jump_vx ? V[x] : V[0]) + nnn) & 0xFFF;
+      break;
+    case 0xC000:
+      V[x] = random.next() & kk;
+      break;
+    case 0xD000:
+      draw(V[x], V[y], opcode & 0xF);
+      break;
+    case 0xE000:
+      if (kk == 0x9E) {
+        if (pressed(V[x]))
+          next += 2;
+      } else if (kk == 0xA1) {
+        if (!pressed(V[x]))
+          next += 2;
+      } else {
+        next = PC;
+      }
+      break;
+    case 0xF000:
+      misc(kk, x, next);
+      break;
+    }
+
+    PC = next;
+    if (delay > 0)
+      delay--;
+    if (sound > 0)
+      sound--;
+  }
+
+  void alu(int operation, uint8_t x, uint8_t y) {
+    int vx = V[x];
+    int vy = V[y];
+    switch (operation) {
+    case 0x0:
+      V[x] = vy;
+      break;
+    case 0x1:
+      V[x] = vx | vy;
+      break;
+    case 0x2:
+      V[x] = vx & vy;
+      break;
+    case 0x3:
+      V[x] = vx ^ vy;
+      break;
+    case 0x4:
+      V[x] = vx + vy;
+      V[0xF] = vx + vy > 255;
+      break;
+    case 0x5:
+      V[x] = vx - vy;
+      V[0xF] = vx > vy;
+      break;
+    case 0x6:
+      if (quirks.shift_vy)
+        vx = vy;
+      V[x] = vx / 2;
+      V[0xF] = vx % 2;
+      break;
+    case 0x7:
+      V[x] = vy - vx;
+      V[0xF] = vy > vx;
+      break;
+    case 0xE:
+      if (quirks.shift_vy)
+        vx = vy;
+      V[x] = vx * 2;
+      V[0xF] = vx >= 128;
+      break;
+    }
+  }
+
+  void draw(int x, int y, int n) {
+    bool erased = false;
+    for (auto row = 0; row < n; row++) {
+      uint8_t sprite = mem(I + row);
+      for (auto bit = 0; bit < 8; bit++) {
+        if (!(sprite & (0x80 >> bit)))
+          continue;
+        int px = x % SCREEN_WIDTH + bit;
+        int py = y % SCREEN_HEIGHT + row;
+        if (quirks.clip && (px >= SCREEN_WIDTH || py >= SCREEN_HEIGHT))
+          continue;
+        px %= SCREEN_WIDTH;
+        py %= SCREEN_HEIGHT;
+        uint8_t &pixels = memory[SCREEN_START + py * SCREEN_WIDTH / 8 + px / 8];
+        uint8_t mask = 0x80 >> (px % 8);
+        if (pixels & mask)
+          erased = true;
+        pixels ^= mask;
+      }
+    }
+    V[0xF] = erased;
+  }
+
+  /* Moves every pixel by dx and dy, pixels moved in are off */
+  void scroll(int dx, int dy) {
+    uint8_t screen[SCREEN_BYTES] = {};
+    for (auto y = 0; y < SCREEN_HEIGHT; y++) {
+      for (auto x = 0; x < SCREEN_WIDTH; x++) {
+        int from_x = x - dx;
+        int from_y = y - dy;
+        if (from_x < 0 || from_x >= SCREEN_WIDTH || from_y < 0)
+          continue;
+        int from = from_y * SCREEN_WIDTH + from_x;
+        if (memory[SCREEN_START + from / 8] & (0x80 >> (from % 8)))
+          screen[(y * SCREEN_WIDTH + x) / 8] |= 0x80 >> (x % 8);
+      }
+    }
+    memcpy(&memory[SCREEN_START], screen, SCREEN_BYTES);
+  }
+
+  void misc(uint8_t kk, uint8_t x, uint16_t &next) {
+    switch (kk) {
+    case 0x07:
+      V[x] = delay;
+      break;
+    case 0x0A:
+      if (key_down == 0) {
+        next = PC;
+      } else {
+        for (auto key = 15; key >= 0; key--) {
+          if (key_down & (1 << key)) {
+            V[x] = key;
+            break;
+          }
+        }
+      }
+      break;
+    case 0x15:
+      delay = V[x];
+      break;
+    case 0x18:
+      sound = V[x];
+      break;
+    case 0x1E:
+      I += V[x];
+      break;
+    case 0x29:
+      I = V[x] * 5;
+      break;
+    case 0x30:
+      I = BIG_FONT_START + V[x] * 10;
+      break;
+    case 0x33:
+      mem(I) = V[x] / 100;
+      mem(I + 1) = V[x] / 10 % 10;
+      mem(I + 2) = V[x] % 10;
+      break;
+    case 0x55:
+      for (auto i = 0; i <= x; i++)
+        mem(I + i) = V[i];
+      advance_I(x);
+      break;
+    case 0x65:
+      for (auto i = 0; i <= x; i++)
+        V[i] = mem(I + i);
+      advance_I(x);
+      break;
+    case 0x75:
+      for (auto i = 0; i <= x && i < FLAG_REGISTERS; i++)
+        flags[i] = V[i];
+      break;
+    case 0x85:
+      for (auto i = 0; i <= x && i < FLAG_REGISTERS; i++)
+        V[i] = flags[i];
+      break;
+    }
+  }
+
+  void advance_I(uint8_t x) {
+    if (quirks.load_store_i)
+      I += quirks.load_store_x ? x : x + 1;
+  }
+
+  bool pressed(uint8_t key) const { return key < 16 && (keys >> key) & 1; }
+};
+
+#endif
@@ -0,0 +1,300 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../libchip8/chip8.h"
+#include "../libchip8/recorder.h"
+#include "../libchip8/stream.h"
+#include "script.h"
+
+/* chip8-run runs a ROM without a window and hashes the screen at chosen
+ * frames or whenever it changes. The hashes are printed, written to a
+ * golden file, or compared with one, stopping at the first mismatch and
+ * dumping that frame as a PBM image. Every frame can also be recorded, or
+ * streamed to viewers.
+ */
+
+struct Options {
+  std::string rom;
+  std::string script;
+  int frames = 600;
+  std::set<int> hash_frames; // Frames to hash at
+  bool changes = false;      // Hash whenever the screen changes
+  std::string golden;
+  bool write = false; // Write the golden file instead of checking it
+  std::string dump_directory = ".";
+  std::string recording; // File to record the frames to
+  std::string stream;    // Socket to stream the frames on
+  bool real_time = false; // Run at 60 frames per second instead of flat out
+  std::string profile;   // Taken from the profile database when empty
+  bool identify = false; // Only print the hash and the profile of the ROM
+};
+
+using Hashes = std::map<int, uint64_t>; // Hash of the screen per frame
+
+bool read_golden(const std::string &filename, Hashes &hashes) {
+  std::ifstream in(filename);
+  if (!in.is_open()) {
+    std::cout << "Couldn't open golden file " << filename << std::endl;
+    return false;
+  }
+
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    std::istringstream fields(line);
+    int frame;
+    uint64_t hash;
+    if (fields >> frame >> std::hex >> hash)
+      hashes[frame] = hash;
+  }
+  return true;
+}
+
+std::string format_hash(uint64_t hash) {
+  char text[17];
+  snprintf(text, sizeof(text), "%016llx",
+           static_cast<unsigned long long>(hash));
+  return text;
+}
+
+std::string format_hashes(const Hashes &hashes) {
+  std::string text;
+  for (auto const &[frame, hash] : hashes)
+    text += std::to_string(frame) + " " + format_hash(hash) + "\n";
+  return text;
+}
+
+/* Writes the screen as a binary PBM, lit pixels white */
+bool dump_frame(const std::string &filename, const uint8_t *screen) {
+  std::ofstream out(filename, std::ios::out | std::ios::binary);
+  if (!out.is_open()) {
+    std::cout << "Couldn't open " << filename << std::endl;
+    return false;
+  }
+
+  std::string image = "P4\n" + std::to_string(SCREEN_WIDTH) + " " +
+                      std::to_string(SCREEN_HEIGHT) + "\n";
+  for (auto i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT / 8; i++)
+    image += static_cast<char>(~screen[i]);
+  out << image;
+  return true;
+}
+
+bool read_rom(const std::string &filename, std::vector<uint8_t> &rom) {
+  std::ifstream in(filename, std::ios::in | std::ios::binary);
+  if (!in.is_open()) {
+    std::cout << "Couldn't open ROM " << filename << std::endl;
+    return false;
+  }
+  rom.assign(std::istreambuf_iterator<char>(in),
+             std::istreambuf_iterator<char>());
+  return true;
+}
+
+void usage() {
+  std::cout << "Usage: chip8-run [-n frames] [-s script] [-f frame,...] [-c] "
+               "[-g golden [-w]] [-d directory] [-v recording] [-S socket [-R]] [-p profile] rom\n"
+               "       chip8-run -i rom"
+            << std::endl;
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  for (auto i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg[0] != '-') {
+      options.rom = arg;
+    } else if (arg == "-c") {
+      options.changes = true;
+    } else if (arg == "-w") {
+      options.write = true;
+    } else if (arg == "-R") {
+      options.real_time = true;
+    } else if (arg == "-i") {
+      options.identify = true;
+    } else if (i + 1 >= argc) {
+      usage();
+      return 1;
+    } else if (arg == "-n") {
+      options.frames = std::stoi(argv[++i]);
+    } else if (arg == "-s") {
+      options.script = argv[++i];
+    } else if (arg == "-f") {
+      std::istringstream frames(argv[++i]);
+      std::string frame;
+      while (std::getline(frames, frame, ','))
+        options.hash_frames.insert(std::stoi(frame));
+    } else if (arg == "-g") {
+      options.golden = argv[++i];
+    } else if (arg == "-d") {
+      options.dump_directory = argv[++i];
+    } else if (arg == "-v") {
+      options.recording = argv[++i];
+    } else if (arg == "-S") {
+      options.stream = argv[++i];
+    } else if (arg == "-p") {
+      options.profile = argv[++i];
+    } else {
+      usage();
+      return 1;
+    }
+  }
+
+  if (options.rom.empty() || (options.write && options.golden.empty())) {
+    usage();
+    return 1;
+  }
+
+  std::vector<uint8_t> rom;
+  if (!read_rom(options.rom, rom))
+    return 1;
+
+  Profile profile = Profile::Modern;
+  if (!options.profile.empty()) {
+    if (!profile_from_name(options.profile, profile)) {
+      std::cout << "Unknown profile " << options.profile << std::endl;
+      return 1;
+    }
+  } else {
+    find_profile(profile_database(options.rom), rom.data(), rom.size(),
+                 profile);
+  }
+
+  // In the format of the profile database
+  if (options.identify) {
+    std::cout << format_hash(rom_hash(rom.data(), rom.size())) << " "
+              << profile_name(profile) << std::endl;
+    return 0;
+  }
+
+  Script script;
+  if (!options.script.empty()) {
+    if (!read_script(options.script, script))
+      return 1;
+  } else {
+    script.frames.resize(options.frames);
+  }
+
+  // Checking hashes at the frames in the golden file, and at changes if
+  // asked to. The set of frames hashed has to match exactly.
+  Hashes golden;
+  bool check = !options.golden.empty() && !options.write;
+  if (check) {
+    if (!read_golden(options.golden, golden))
+      return 1;
+    for (auto const &entry : golden)
+      options.hash_frames.insert(entry.first);
+  }
+  if (options.hash_frames.empty() && !options.changes)
+    options.hash_frames.insert(script.frames.size());
+
+  // Translations are kept across runs when CHIP8_CACHE names a directory
+  std::unique_ptr<TranslationCache> cache;
+  if (const char *directory = getenv("CHIP8_CACHE"))
+    cache = std::make_unique<TranslationCache>(directory);
+
+  Chip8 vm;
+  vm.set_quirk_profile(profile);
+  vm.load_rom(rom.data(), rom.size(), cache.get());
+
+  // There is no frame rate to keep up with, so wait for the writer rather
+  // than drop frames
+  std::unique_ptr<Recorder> recorder;
+  if (!options.recording.empty()) {
+    recorder = std::make_unique<Recorder>(options.recording,
+                                          Recorder::Overflow::Wait);
+    if (!recorder->is_open()) {
+      std::cout << "Couldn't open " << options.recording << std::endl;
+      return 1;
+    }
+  }
+
+  std::unique_ptr<FrameStreamer> streamer;
+  if (!options.stream.empty()) {
+    streamer = std::make_unique<FrameStreamer>(options.stream);
+    if (!streamer->is_open()) {
+      std::cout << "Couldn't listen on " << options.stream << std::endl;
+      return 1;
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  auto frame_duration = std::chrono::microseconds(1000000 / FRAME_RATE);
+
+  Hashes hashes;
+  uint64_t last_hash = vm.screen_hash();
+  bool mismatch = false;
+  Outcome outcome = play(vm, script, [&](int frame) {
+    if (recorder)
+      recorder->push(vm.screen(), vm.sound() > 0);
+    if (streamer)
+      streamer->push(vm.screen(), vm.sound() > 0);
+    if (options.real_time)
+      std::this_thread::sleep_until(start + frame * frame_duration);
+
+    uint64_t hash = vm.screen_hash();
+    bool changed = hash != last_hash;
+    last_hash = hash;
+    bool hashed =
+        options.hash_frames.count(frame) || (options.changes && changed);
+    if (hashed)
+      hashes[frame] = hash;
+
+    if (!check)
+      return true;
+
+    auto expected = golden.find(frame);
+    if (hashed == (expected != golden.end()) &&
+        (!hashed || expected->second == hash))
+      return true;
+
+    std::string dump = options.dump_directory + "/frame_" +
+                       std::to_string(frame) + ".pbm";
+    std::cout << "Frame " << frame << ": expected "
+              << (expected != golden.end() ? format_hash(expected->second)
+                                           : "no change")
+              << ", got " << (hashed ? format_hash(hash) : "no change")
+              << ", written to " << dump << std::endl;
+    dump_frame(dump, vm.screen());
+    mismatch = true;
+    return false;
+  });
+
+  if (mismatch)
+    return 1;
+
+  if (check) {
+    // The program may exit before the last golden frame
+    auto missing = golden.upper_bound(outcome.frames);
+    if (missing != golden.end()) {
+      std::cout << "Frame " << missing->first << " was never reached"
+                << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+
+  std::string text = format_hashes(hashes);
+  if (!options.write) {
+    std::cout << text;
+    return 0;
+  }
+
+  std::ofstream out(options.golden);
+  if (!out.is_open()) {
+    std::cout << "Couldn't open golden file " << options.golden << std::endl;
+    return 1;
+  }
+  out << "# " << options.rom << "\n" << text;
+  return 0;
+}
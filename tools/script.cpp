@@ -0,0 +1,91 @@
+#include <fstream>
+#include <iostream>
+#include <string.h>
+
+#include "script.h"
+
+bool read_script(const std::string &filename, Script &script) {
+  std::ifstream in(filename);
+  if (!in.is_open()) {
+    std::cout << "Couldn't open script " << filename << std::endl;
+    return false;
+  }
+
+  parse_script(in, script);
+  return true;
+}
+
+void parse_script(std::istream &in, Script &script) {
+  script = Script();
+  std::string word;
+  while (in >> word) {
+    if (word == "seed") {
+      in >> std::hex >> script.seed >> std::dec;
+      continue;
+    }
+    script.frames.push_back(std::stoul(word, nullptr, 16));
+  }
+}
+
+bool write_script(const std::string &filename, const Script &script) {
+  std::ofstream out(filename);
+  if (!out.is_open()) {
+    std::cout << "Couldn't open script " << filename << std::endl;
+    return false;
+  }
+
+  char line[32];
+  snprintf(line, sizeof(line), "seed %llx\n",
+           static_cast<unsigned long long>(script.seed));
+  std::string text = line;
+  for (auto keys : script.frames) {
+    snprintf(line, sizeof(line), "%04x\n", keys);
+    text += line;
+  }
+  out << text;
+  return true;
+}
+
+Outcome play(Chip8 &vm, const Script &script,
+             const FrameCallback &frame_done) {
+  Outcome outcome;
+  vm.seed(script.seed);
+
+  uint16_t held = 0;
+  Registers last = vm.registers();
+  int unchanged = 0;
+  bool keys_hit = false;
+
+  for (auto keys : script.frames) {
+    uint16_t down = keys & ~held;
+    held = keys;
+    keys_hit = keys_hit || down != 0;
+
+    vm.set_keys(keys, down);
+    vm.run_cycles(CYCLES_PER_FRAME);
+    outcome.frames++;
+
+    if (frame_done && !frame_done(outcome.frames))
+      break;
+
+    if (vm.quitting()) {
+      outcome.exited = true;
+      break;
+    }
+
+    Registers registers = vm.registers();
+    if (memcmp(&registers, &last, sizeof(registers)) != 0) {
+      last = registers;
+      unchanged = 0;
+      keys_hit = false;
+    } else if (++unchanged >= STUCK_FRAMES && keys_hit) {
+      outcome.stuck = true;
+      outcome.stuck_PC = registers.PC;
+      break;
+    }
+  }
+
+  outcome.faults = vm.faults();
+  outcome.fault_PC = vm.fault_PC();
+  return outcome;
+}
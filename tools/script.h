@@ -0,0 +1,55 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <functional>
+#include <istream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "../libchip8/chip8.h"
+
+/* An input script: the seed for RND and the keys held down in every frame.
+ * As text it is a "seed" line followed by one hexadecimal key mask per
+ * frame:
+ *
+ *     seed 2a
+ *     0000
+ *     0010
+ */
+struct Script {
+  uint64_t seed = 1;
+  std::vector<uint16_t> frames;
+};
+
+bool read_script(const std::string &filename, Script &script);
+void parse_script(std::istream &in, Script &script);
+bool write_script(const std::string &filename, const Script &script);
+
+/* What happened while a script was played */
+struct Outcome {
+  int frames = 0; // Frames played before the program exited
+  bool exited = false;
+  uint8_t faults = FAULT_NONE;
+  uint16_t fault_PC = 0;
+  bool stuck = false; // The state stopped changing although keys were hit
+  uint16_t stuck_PC = 0;
+};
+
+/* Frames without any change in the machine state, despite keys going down,
+ * after which a program counts as stuck
+ */
+const int STUCK_FRAMES = 60;
+
+/* Called after every frame with its number, starting from 1. Returning
+ * false stops playing.
+ */
+using FrameCallback = std::function<bool(int frame)>;
+
+/* Plays the script on vm, which must have the ROM loaded. A key counts as
+ * pressed down in a frame when it wasn't held in the previous one.
+ */
+Outcome play(Chip8 &vm, const Script &script,
+             const FrameCallback &frame_done = nullptr);
+
+#endif
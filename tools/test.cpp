@@ -0,0 +1,508 @@
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../assembler/assembler.h"
+#include "../libchip8/chip8.h"
+#include "script.h"
+
+/* chip8-test runs the cases of a manifest on all cores. Every case runs a
+ * ROM or an assembly source, optionally playing an input script, within a
+ * budget of instructions and then checks registers and the screen hash.
+ * Passing cases are remembered by a hash of everything they depend on, so
+ * unchanged cases are skipped on the next run.
+ *
+ * A manifest line is a name, a file and key=value settings, paths being
+ * relative to the manifest:
+ *
+ *     call       call.asm          SP=6e
+ *     pong-idle  ../roms/pong.ch8  frames=600 hash=8560914d8000f207
+ *
+ * script=file plays an input script, frames=n runs n frames without input;
+ * otherwise the case must EXIT. cycles=n is the instruction budget,
+ * profile=name the quirk profile. V0-VF, I, SP, PC and hash are expected
+ * values in hexadecimal.
+ */
+
+const long DEFAULT_CYCLES = 1000000;
+
+struct Case {
+  std::string name;
+  std::string line; // As written in the manifest
+  std::string file;
+  std::string script;
+  int frames = 0;
+  long cycles = DEFAULT_CYCLES;
+  Profile profile = Profile::Modern;
+  std::map<std::string, uint64_t> expected; // Register or "hash"
+};
+
+enum class Status { Passed, Failed, Cached };
+
+struct Result {
+  Status status = Status::Failed;
+  std::string message;
+  uint64_t key = 0; // Of the result cache
+  uint64_t cycles = 0;
+  double seconds = 0;
+};
+
+struct Options {
+  std::string manifest;
+  int threads = std::max(1u, std::thread::hardware_concurrency());
+  std::string cache = ".chip8-test-cache";
+  bool force = false; // Run cases even when they passed before
+  std::string report; // JUnit XML, or JSON when it ends in .json
+  std::string translations; // Cache directory, from CHIP8_CACHE
+};
+
+bool read_file(const std::string &filename, std::string &contents) {
+  std::ifstream in(filename, std::ios::in | std::ios::binary);
+  if (!in.is_open())
+    return false;
+  contents.assign(std::istreambuf_iterator<char>(in),
+                  std::istreambuf_iterator<char>());
+  return true;
+}
+
+bool ends_with(const std::string &text, const std::string &suffix) {
+  return text.size() >= suffix.size() &&
+         text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+const std::set<std::string> registers = {
+    "V0", "V1", "V2", "V3", "V4", "V5", "V6", "V7", "V8", "V9",
+    "VA", "VB", "VC", "VD", "VE", "VF", "I",  "SP", "PC"};
+
+bool read_manifest(const std::string &filename, std::vector<Case> &cases) {
+  std::ifstream in(filename);
+  if (!in.is_open()) {
+    std::cout << "Couldn't open manifest " << filename << std::endl;
+    return false;
+  }
+
+  size_t slash = filename.rfind('/');
+  std::string directory =
+      slash == std::string::npos ? "" : filename.substr(0, slash + 1);
+
+  std::string line;
+  for (auto number = 1; std::getline(in, line); number++) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream fields(line);
+    Case c;
+    if (!(fields >> c.name))
+      continue;
+    c.line = line;
+    if (!(fields >> c.file)) {
+      std::cout << filename << ":" << number << ": no file" << std::endl;
+      return false;
+    }
+    c.file = directory + c.file;
+
+    std::string setting;
+    while (fields >> setting) {
+      size_t equals = setting.find('=');
+      std::string key = setting.substr(0, equals);
+      std::string value =
+          equals == std::string::npos ? "" : setting.substr(equals + 1);
+      try {
+        if (key == "script")
+          c.script = directory + value;
+        else if (key == "frames")
+          c.frames = std::stoi(value);
+        else if (key == "cycles")
+          c.cycles = std::stol(value);
+        else if (key == "profile" && profile_from_name(value, c.profile))
+          ;
+        else if (key == "hash" || registers.count(key))
+          c.expected[key] = std::stoull(value, nullptr, 16);
+        else
+          throw std::invalid_argument(key);
+      } catch (const std::exception &) {
+        std::cout << filename << ":" << number << ": bad setting " << setting
+                  << std::endl;
+        return false;
+      }
+    }
+    cases.push_back(c);
+  }
+  return true;
+}
+
+/* Loads the ROM and the script of a case. Returns false with the reason in
+ * message if they can't be read.
+ */
+bool load(const Case &c, std::vector<uint8_t> &rom, std::string &script,
+          std::string &message) {
+  std::string source;
+  if (!read_file(c.file, source)) {
+    message = "Couldn't open " + c.file;
+    return false;
+  }
+  if (ends_with(c.file, ".asm")) {
+    std::istringstream program(source);
+    std::ostringstream errors;
+    rom = assemble_program(program, nullptr, errors);
+    if (!errors.str().empty()) {
+      message = errors.str();
+      return false;
+    }
+  } else {
+    rom.assign(source.begin(), source.end());
+  }
+  if (rom.empty()) {
+    message = "No program in " + c.file;
+    return false;
+  }
+
+  if (!c.script.empty() && !read_file(c.script, script)) {
+    message = "Couldn't open " + c.script;
+    return false;
+  }
+  return true;
+}
+
+uint64_t register_value(const Chip8 &vm, const std::string &name) {
+  if (name == "I")
+    return vm.I();
+  if (name == "SP")
+    return vm.SP();
+  if (name == "PC")
+    return vm.PC();
+  return vm.V(std::stoi(name.substr(1), nullptr, 16));
+}
+
+void run_case(const Case &c, const std::vector<uint8_t> &rom,
+              const Script *script, TranslationCache *cache, Result &result) {
+  Chip8 vm;
+  vm.set_quirk_profile(c.profile);
+  vm.load_rom(rom.data(), rom.size(), cache);
+  if (!vm.ready()) {
+    result.message = "Couldn't load " + c.file;
+    return;
+  }
+  if (script)
+    vm.seed(script->seed);
+
+  // Runs frame by frame like the emulator, until EXIT when there are no
+  // frames to run
+  int frames = script ? script->frames.size() : c.frames;
+  uint16_t held = 0;
+  int frame = 0;
+  for (; frames == 0 || frame < frames; frame++) {
+    long budget = std::min<long>(CYCLES_PER_FRAME, c.cycles - vm.instructions());
+    if (budget <= 0 || vm.quitting())
+      break;
+    uint16_t keys = script ? script->frames[frame] : 0;
+    vm.set_keys(keys, keys & ~held);
+    held = keys;
+    if (vm.run_cycles(budget) == 0)
+      break;
+  }
+  result.cycles = vm.instructions();
+
+  if (!vm.quitting() && (frames == 0 || frame < frames)) {
+    result.message = "Budget of " + std::to_string(c.cycles) +
+                     " instructions used up" +
+                     (frames ? " at frame " + std::to_string(frame) : "");
+    return;
+  }
+
+  for (auto const &[name, expected] : c.expected) {
+    uint64_t actual =
+        name == "hash" ? vm.screen_hash() : register_value(vm, name);
+    if (actual != expected) {
+      std::ostringstream message;
+      message << name << " is " << std::hex << actual << ", expected "
+              << expected;
+      result.message = message.str();
+      return;
+    }
+  }
+  result.status = Status::Passed;
+}
+
+/* Identifies this build of the runner and the core linked into it */
+uint64_t build_id() {
+  std::string executable;
+  read_file("/proc/self/exe", executable);
+  return rom_hash(reinterpret_cast<const uint8_t *>(executable.data()),
+                  executable.size());
+}
+
+/* Cases waiting to run, a queue per thread. A thread takes cases from the
+ * front of its own queue and, once that is empty, steals from the back of
+ * the others.
+ */
+class WorkQueues {
+public:
+  WorkQueues(int threads) : m_queues(threads) {}
+
+  void add(int thread, int index) { m_queues[thread].cases.push_back(index); }
+
+  bool take(int thread, int &index) {
+    for (size_t i = 0; i < m_queues.size(); i++) {
+      Queue &queue = m_queues[(thread + i) % m_queues.size()];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.cases.empty())
+        continue;
+      if (i == 0) {
+        index = queue.cases.front();
+        queue.cases.pop_front();
+      } else {
+        index = queue.cases.back();
+        queue.cases.pop_back();
+      }
+      return true;
+    }
+    return false;
+  }
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<int> cases;
+  };
+
+  std::vector<Queue> m_queues;
+};
+
+std::set<uint64_t> read_cache(const std::string &filename) {
+  std::set<uint64_t> keys;
+  std::ifstream in(filename);
+  uint64_t key;
+  while (in >> std::hex >> key)
+    keys.insert(key);
+  return keys;
+}
+
+void write_cache(const std::string &filename,
+                 const std::vector<Result> &results) {
+  std::ofstream out(filename);
+  if (!out.is_open()) {
+    std::cout << "Couldn't open " << filename << std::endl;
+    return;
+  }
+  for (auto const &result : results) {
+    if (result.status != Status::Failed)
+      out << std::hex << result.key << "\n";
+  }
+}
+
+std::string escape_xml(const std::string &text) {
+  std::string escaped;
+  for (auto c : text) {
+    switch (c) {
+    case '<':
+      escaped += "&lt;";
+      break;
+    case '>':
+      escaped += "&gt;";
+      break;
+    case '&':
+      escaped += "&amp;";
+      break;
+    case '"':
+      escaped += "&quot;";
+      break;
+    default:
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+std::string escape_json(const std::string &text) {
+  std::string escaped;
+  for (auto c : text) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (c == '\n') {
+      escaped += "\\n";
+    } else if (static_cast<unsigned char>(c) >= 0x20) {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+const char *status_names[] = {"passed", "failed", "cached"};
+
+bool write_report(const std::string &filename, const std::vector<Case> &cases,
+                  const std::vector<Result> &results, double seconds) {
+  std::ofstream out(filename);
+  if (!out.is_open()) {
+    std::cout << "Couldn't open " << filename << std::endl;
+    return false;
+  }
+
+  int failures = 0;
+  for (auto const &result : results)
+    failures += result.status == Status::Failed;
+
+  if (ends_with(filename, ".json")) {
+    out << "{\"seconds\": " << seconds << ", \"failures\": " << failures
+        << ", \"cases\": [";
+    for (size_t i = 0; i < cases.size(); i++) {
+      const Result &result = results[i];
+      out << (i ? ",\n  " : "\n  ") << "{\"name\": \""
+          << escape_json(cases[i].name) << "\", \"status\": \""
+          << status_names[static_cast<int>(result.status)]
+          << "\", \"cycles\": " << result.cycles
+          << ", \"seconds\": " << result.seconds << ", \"message\": \""
+          << escape_json(result.message) << "\"}";
+    }
+    out << "\n]}\n";
+    return true;
+  }
+
+  out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+      << "<testsuite name=\"chip8-test\" tests=\"" << cases.size()
+      << "\" failures=\"" << failures << "\" time=\"" << seconds << "\">\n";
+  for (size_t i = 0; i < cases.size(); i++) {
+    const Result &result = results[i];
+    out << "  <testcase name=\"" << escape_xml(cases[i].name)
+        << "\" classname=\"chip8\" time=\"" << result.seconds << "\"";
+    if (result.status == Status::Failed)
+      out << ">\n    <failure message=\"" << escape_xml(result.message)
+          << "\"/>\n  </testcase>\n";
+    else if (result.status == Status::Cached)
+      out << ">\n    <system-out>Unchanged since it passed</system-out>\n"
+          << "  </testcase>\n";
+    else
+      out << "/>\n";
+  }
+  out << "</testsuite>\n";
+  return true;
+}
+
+void usage() {
+  std::cout << "Usage: chip8-test [-j threads] [-c cache] [-f] [-o report] "
+               "manifest"
+            << std::endl;
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  if (const char *directory = getenv("CHIP8_CACHE"))
+    options.translations = directory;
+  for (auto i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg[0] != '-') {
+      options.manifest = arg;
+    } else if (arg == "-f") {
+      options.force = true;
+    } else if (i + 1 >= argc) {
+      usage();
+      return 1;
+    } else if (arg == "-j") {
+      options.threads = std::max(1, std::stoi(argv[++i]));
+    } else if (arg == "-c") {
+      options.cache = argv[++i];
+    } else if (arg == "-o") {
+      options.report = argv[++i];
+    } else {
+      usage();
+      return 1;
+    }
+  }
+
+  if (options.manifest.empty()) {
+    usage();
+    return 1;
+  }
+
+  std::vector<Case> cases;
+  if (!read_manifest(options.manifest, cases))
+    return 1;
+
+  auto start = std::chrono::steady_clock::now();
+
+  // Load everything and work out which cases changed. The key covers the
+  // build, the case as written and the contents of its files.
+  std::set<uint64_t> passed = read_cache(options.cache);
+  uint64_t build = build_id();
+  std::vector<Result> results(cases.size());
+  std::vector<std::vector<uint8_t>> roms(cases.size());
+  std::vector<Script> scripts(cases.size());
+  WorkQueues queues(options.threads);
+  int queued = 0;
+  for (size_t i = 0; i < cases.size(); i++) {
+    std::string script;
+    if (!load(cases[i], roms[i], script, results[i].message))
+      continue;
+    if (!cases[i].script.empty()) {
+      std::istringstream text(script);
+      try {
+        parse_script(text, scripts[i]);
+      } catch (const std::exception &) {
+        results[i].message = "Couldn't parse script " + cases[i].script;
+        continue;
+      }
+    }
+
+    std::string key = std::to_string(build) + "\n" + cases[i].line + "\n" +
+                      script + "\n";
+    key.append(roms[i].begin(), roms[i].end());
+    results[i].key = rom_hash(reinterpret_cast<const uint8_t *>(key.data()),
+                              key.size());
+    if (!options.force && passed.count(results[i].key)) {
+      results[i].status = Status::Cached;
+      continue;
+    }
+    queues.add(queued++ % options.threads, i);
+  }
+
+  std::vector<std::thread> workers;
+  for (auto thread = 0; thread < options.threads; thread++) {
+    workers.emplace_back([&, thread] {
+      std::unique_ptr<TranslationCache> cache;
+      if (!options.translations.empty())
+        cache = std::make_unique<TranslationCache>(options.translations);
+      int index;
+      while (queues.take(thread, index)) {
+        auto case_start = std::chrono::steady_clock::now();
+        const Case &c = cases[index];
+        run_case(c, roms[index], c.script.empty() ? nullptr : &scripts[index],
+                 cache.get(), results[index]);
+        results[index].seconds = std::chrono::duration<double>(
+                                     std::chrono::steady_clock::now() -
+                                     case_start)
+                                     .count();
+      }
+    });
+  }
+  for (auto &worker : workers)
+    worker.join();
+
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  int counts[3] = {};
+  for (size_t i = 0; i < cases.size(); i++) {
+    counts[static_cast<int>(results[i].status)]++;
+    if (results[i].status == Status::Failed)
+      std::cout << "FAILED " << cases[i].name << ": " << results[i].message
+                << std::endl;
+  }
+  std::cout << counts[0] << " passed, " << counts[1] << " failed, "
+            << counts[2] << " unchanged in " << seconds << " s" << std::endl;
+
+  write_cache(options.cache, results);
+  if (!options.report.empty() &&
+      !write_report(options.report, cases, results, seconds))
+    return 1;
+  return counts[static_cast<int>(Status::Failed)] ? 1 : 0;
+}
@@ -0,0 +1,113 @@
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../libchip8/stats.h"
+
+/* chip8-top shows the counters running emulators publish in shared memory.
+ * It only ever reads them, so it doesn't slow the emulators down.
+ */
+
+/* Names of the segments of running emulators */
+std::vector<std::string> find_segments() {
+  std::vector<std::string> names;
+  std::error_code error;
+  for (auto const &entry :
+       std::filesystem::directory_iterator("/dev/shm", error)) {
+    std::string name = entry.path().filename();
+    if (name.rfind("chip8.", 0) == 0)
+      names.push_back("/" + name);
+  }
+  return names;
+}
+
+void print(const StatsReader &reader, const Stats &stats) {
+  char line[256];
+  snprintf(line, sizeof(line),
+           "pid %u  PC %03x\n"
+           "instructions %llu  ips %u\n"
+           "frames %llu  late %llu  dropped %llu\n"
+           "frame %u us  present %u us  input latency %u us  "
+           "timer drift %lld us\n",
+           reader.pid(), stats.PC,
+           static_cast<unsigned long long>(stats.instructions), stats.ips,
+           static_cast<unsigned long long>(stats.frames),
+           static_cast<unsigned long long>(stats.late_frames),
+           static_cast<unsigned long long>(stats.dropped_frames),
+           stats.frame_time_us, stats.present_time_us, stats.input_latency_us,
+           static_cast<long long>(stats.timer_drift_us));
+  std::string text = line;
+
+  text += "frame times:";
+  for (auto i = 0; i < FRAME_TIME_BUCKETS; i++) {
+    if (i < FRAME_TIME_BUCKETS - 1)
+      snprintf(line, sizeof(line), " <%gms %llu", (1 << (i + 9)) / 1000.0,
+               static_cast<unsigned long long>(stats.frame_times[i]));
+    else
+      snprintf(line, sizeof(line), " more %llu",
+               static_cast<unsigned long long>(stats.frame_times[i]));
+    text += line;
+  }
+  std::cout << text << "\n" << std::endl;
+}
+
+void usage() {
+  std::cout << "Usage: chip8-top [-1] [-i milliseconds] [pid]" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  bool once = false;
+  int interval = 1000;
+  std::vector<std::string> names;
+  for (auto i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-1") {
+      once = true;
+    } else if (arg == "-i" && i + 1 < argc) {
+      interval = std::stoi(argv[++i]);
+    } else if (arg[0] != '-') {
+      names.push_back(stats_name(std::stoi(arg)));
+    } else {
+      usage();
+      return 1;
+    }
+  }
+
+  if (names.empty())
+    names = find_segments();
+  if (names.empty()) {
+    std::cout << "No running emulators" << std::endl;
+    return 1;
+  }
+
+  std::vector<std::unique_ptr<StatsReader>> readers;
+  for (auto const &name : names) {
+    readers.push_back(std::make_unique<StatsReader>(name));
+    if (!readers.back()->is_open()) {
+      std::cout << "Couldn't open " << name << std::endl;
+      return 1;
+    }
+  }
+
+  while (true) {
+    if (!once)
+      std::cout << "\033[H\033[2J";
+    for (auto const &reader : readers) {
+      Stats stats;
+      if (reader->read(stats))
+        print(*reader, stats);
+      else
+        std::cout << "pid " << reader->pid() << " stopped updating\n";
+    }
+    if (once)
+      break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+  }
+
+  return 0;
+}